@@ -0,0 +1,428 @@
+#include <sys/resource.h>
+#include <time.h>
+
+#include "user_interface.h"
+#include "metrics.h"
+
+#define BENCH_PREFIX "bench "
+#define BENCH_MAX_RECEPTIONS (16 * 1024 * 1024)
+#define BENCH_TIMEOUT_MS 10000
+
+typedef struct
+{
+    int matrix_size;
+    int num_workers;
+    int messages;
+    int broadcast_percent;
+    double rate;
+    unsigned seed;
+    int settle_ms;
+    const char *compression;
+    const char *logging;
+    const char *broadcast;
+} bench_options_t;
+
+typedef struct
+{
+    int messages;
+    uint64_t *sent_at;
+    bool *broadcast;
+    _Atomic uint64_t *unicast_latency;
+    atomic_int unicast_delivered;
+    uint64_t *reception_latency;
+    int reception_capacity;
+    atomic_int receptions;
+    _Atomic uint64_t last_event;
+} bench_state_t;
+
+/**
+ * @brief Records that a benchmark message reached a node.
+ *
+ * Runs on the simulation workers. The sequence number of the message is
+ * read back from its text.
+ *
+ * @param node The node the message reached.
+ * @param packet The packet.
+ * @param context The benchmark state.
+ */
+static void bench_on_delivery(node_t *node, const packet_t *packet, void *context)
+{
+    bench_state_t *state = (bench_state_t *)context;
+    const char *message = packet->mac_packet.app_packet.message;
+    uint64_t now = metrics_clock();
+
+    if (strncmp(message, BENCH_PREFIX, strlen(BENCH_PREFIX)) != 0)
+    {
+        return;
+    }
+
+    long sequence = strtol(message + strlen(BENCH_PREFIX), NULL, 10);
+    if (sequence < 0 || sequence >= state->messages)
+    {
+        return;
+    }
+
+    uint64_t latency = now - state->sent_at[sequence];
+
+    if (state->broadcast[sequence])
+    {
+        int index = atomic_fetch_add(&state->receptions, 1);
+        if (index < state->reception_capacity)
+        {
+            state->reception_latency[index] = latency;
+        }
+    }
+    else
+    {
+        uint64_t expected = 0;
+        if (atomic_compare_exchange_strong(&state->unicast_latency[sequence], &expected, latency))
+        {
+            atomic_fetch_add(&state->unicast_delivered, 1);
+        }
+    }
+
+    uint64_t last = atomic_load(&state->last_event);
+    while (last < now && !atomic_compare_exchange_weak(&state->last_event, &last, now))
+    {
+    }
+}
+
+/**
+ * @brief Orders latencies for qsort().
+ */
+static int compare_latency(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * @brief Returns a latency percentile of sorted samples by nearest rank.
+ *
+ * @param samples The sorted samples.
+ * @param count Number of samples.
+ * @param percentile The percentile, between 0 and 100.
+ * @return The percentile, or 0 without samples.
+ */
+static uint64_t percentile(const uint64_t *samples, int count, double percentile)
+{
+    if (count == 0)
+    {
+        return 0;
+    }
+
+    int rank = (int)(percentile / 100.0 * count + 0.999999) - 1;
+    if (rank < 0)
+    {
+        rank = 0;
+    }
+    if (rank >= count)
+    {
+        rank = count - 1;
+    }
+    return samples[rank];
+}
+
+/**
+ * @brief Prints latency statistics of a set of samples as a JSON object.
+ *
+ * @param output The stream to print to.
+ * @param samples The samples, sorted in place.
+ * @param count Number of samples.
+ */
+static void print_latency(FILE *output, uint64_t *samples, int count)
+{
+    qsort(samples, count, sizeof(uint64_t), compare_latency);
+
+    fprintf(output, "{\"p50\": %llu, \"p99\": %llu, \"p999\": %llu, \"max\": %llu}",
+            (unsigned long long)percentile(samples, count, 50), (unsigned long long)percentile(samples, count, 99),
+            (unsigned long long)percentile(samples, count, 99.9), (unsigned long long)(count ? samples[count - 1] : 0));
+}
+
+/**
+ * @brief Returns the CPU time used by the process so far.
+ *
+ * @return User and system time in nanoseconds.
+ */
+static uint64_t cpu_time(void)
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return (uint64_t)(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000000 +
+           (uint64_t)(usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) * 1000;
+}
+
+/**
+ * @brief Prints how to run the benchmark.
+ *
+ * @param program The name of the executable.
+ */
+static void print_usage(const char *program)
+{
+    fprintf(stderr, "Usage: %s [-n matrix_size] [-t threads] [-m messages] [-b percent] [-r rate]\n", program);
+    fprintf(stderr, "          [-S seed] [-w settle_ms] [-z level[:dict]] [-l logging] [-B mode[:radius]]\n");
+    fprintf(stderr, "  -n matrix_size  Side of the simulated grid (default: %d)\n", DEFAULT_MATRIX_SIZE);
+    fprintf(stderr, "  -t threads      Simulation worker threads (default: one per CPU)\n");
+    fprintf(stderr, "  -m messages     Messages to inject (default: 10000)\n");
+    fprintf(stderr, "  -b percent      Share of broadcasts among the messages (default: 10)\n");
+    fprintf(stderr, "  -r rate         Messages per second, 0 for as fast as possible (default: 0)\n");
+    fprintf(stderr, "  -S seed         Seed of the random source and destination nodes (default: 1)\n");
+    fprintf(stderr, "  -w settle_ms    Quiet time after which the mesh is considered drained (default: 200)\n");
+    fprintf(stderr, "  -z level        Packet compression, as for app-server (default: fast)\n");
+    fprintf(stderr, "  -l logging      Logging, as for app-server (default: drop,level=error)\n");
+    fprintf(stderr, "  -B mode         Broadcast flooding, as for app-server (default: mpr)\n");
+    fprintf(stderr, "Results are printed to stdout as one JSON object.\n");
+}
+
+/**
+ * @brief Parses the command line of the benchmark.
+ *
+ * @param argc Number of arguments.
+ * @param argv The arguments.
+ * @param options Receives the options.
+ * @return 0 on success, -1 if the command line is invalid.
+ */
+static int parse_options(int argc, char *argv[], bench_options_t *options)
+{
+    *options = (bench_options_t){
+        .matrix_size = DEFAULT_MATRIX_SIZE,
+        .num_workers = sysconf(_SC_NPROCESSORS_ONLN),
+        .messages = 10000,
+        .broadcast_percent = 10,
+        .rate = 0,
+        .seed = 1,
+        .settle_ms = 200,
+        .compression = "fast",
+        .logging = "drop,level=error",
+        .broadcast = "mpr",
+    };
+
+    int option;
+    while ((option = getopt(argc, argv, "n:t:m:b:r:S:w:z:l:B:")) != -1)
+    {
+        switch (option)
+        {
+        case 'n':
+            options->matrix_size = atoi(optarg);
+            break;
+        case 't':
+            options->num_workers = atoi(optarg);
+            break;
+        case 'm':
+            options->messages = atoi(optarg);
+            break;
+        case 'b':
+            options->broadcast_percent = atoi(optarg);
+            break;
+        case 'r':
+            options->rate = atof(optarg);
+            break;
+        case 'S':
+            options->seed = strtoul(optarg, NULL, 10);
+            break;
+        case 'w':
+            options->settle_ms = atoi(optarg);
+            break;
+        case 'z':
+            options->compression = optarg;
+            break;
+        case 'l':
+            options->logging = optarg;
+            break;
+        case 'B':
+            options->broadcast = optarg;
+            break;
+        default:
+            return -1;
+        }
+    }
+
+    int num_nodes = options->matrix_size * options->matrix_size;
+
+    if (options->matrix_size <= 0 || num_nodes < 2 || num_nodes > MAX_NODE_COUNT || options->num_workers <= 0 ||
+        options->messages <= 0 || options->broadcast_percent < 0 || options->broadcast_percent > 100 ||
+        options->rate < 0 || options->settle_ms <= 0)
+    {
+        return -1;
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    bench_options_t options;
+    compression_level level;
+    bool dictionary;
+    log_config_t log_config;
+    broadcast_config_t broadcast_config;
+
+    if (parse_options(argc, argv, &options) == -1 ||
+        compression_parse(options.compression, &level, &dictionary) == -1 ||
+        logger_parse(options.logging, &log_config) == -1 || broadcast_parse(options.broadcast, &broadcast_config) == -1)
+    {
+        print_usage(argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    compression_configure(level, dictionary);
+    logger_start(&log_config);
+
+    int num_nodes = options.matrix_size * options.matrix_size;
+
+    graph_t graph;
+    if (initialize_graph(&graph, num_nodes) == -1)
+    {
+        fprintf(stderr, "Graph allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    add_edges(options.matrix_size, &graph);
+
+    topology_shared_t *topology = topology_create(&graph);
+    metrics_shared_t *metrics = metrics_create(num_nodes);
+    if (!topology || !metrics)
+    {
+        fprintf(stderr, "Shared memory segment creation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    topology_publish(topology, &graph);
+
+    bench_state_t state = {.messages = options.messages};
+    unsigned seed = options.seed;
+    int broadcasts = 0;
+
+    state.sent_at = calloc(options.messages, sizeof(uint64_t));
+    state.broadcast = calloc(options.messages, sizeof(bool));
+    state.unicast_latency = calloc(options.messages, sizeof(uint64_t));
+    uint64_t *unicast_samples = malloc(options.messages * sizeof(uint64_t));
+
+    if (!state.sent_at || !state.broadcast || !state.unicast_latency || !unicast_samples)
+    {
+        fprintf(stderr, "Benchmark allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+
+    for (int i = 0; i < options.messages; i++)
+    {
+        state.broadcast[i] = (int)(rand_r(&seed) % 100) < options.broadcast_percent;
+        broadcasts += state.broadcast[i];
+    }
+
+    long reception_capacity = (long)broadcasts * num_nodes;
+    state.reception_capacity = reception_capacity < BENCH_MAX_RECEPTIONS ? reception_capacity : BENCH_MAX_RECEPTIONS;
+    state.reception_latency = malloc((state.reception_capacity + 1) * sizeof(uint64_t));
+
+    if (!state.reception_latency)
+    {
+        fprintf(stderr, "Benchmark allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+
+    simulation_t *simulation = simulation_create(topology, metrics, options.num_workers);
+    if (!simulation)
+    {
+        fprintf(stderr, "Simulation startup failed\n");
+        exit(EXIT_FAILURE);
+    }
+    simulation_set_delivery_handler(simulation, bench_on_delivery, &state);
+
+    uint32_t epoch = topology_current_epoch(topology);
+
+    uint64_t cpu_start = cpu_time();
+    uint64_t start = metrics_clock();
+
+    for (int i = 0; i < options.messages; i++)
+    {
+        if (options.rate > 0)
+        {
+            metrics_sleep_until(start + (uint64_t)(i * 1e9 / options.rate));
+        }
+
+        char message[MAX_MESSAGE_LENGTH];
+        snprintf(message, sizeof(message), BENCH_PREFIX "%d", i);
+
+        int source = rand_r(&seed) % num_nodes;
+        int destination = (source + 1 + rand_r(&seed) % (num_nodes - 1)) % num_nodes;
+
+        state.sent_at[i] = metrics_clock();
+        if (state.broadcast[i])
+        {
+            create_and_send_broadcast(source, epoch, &broadcast_config, message, &simulation->transport);
+        }
+        else
+        {
+            create_and_send_message(source, destination, epoch, false, message, &simulation->transport);
+        }
+    }
+
+    uint64_t injected = metrics_clock();
+    int events = -1;
+    uint64_t quiet_since = injected;
+
+    while (metrics_clock() - injected < (uint64_t)BENCH_TIMEOUT_MS * 1000000)
+    {
+        metrics_sleep_until(metrics_clock() + 10000000);
+
+        int now_events = atomic_load(&state.unicast_delivered) + atomic_load(&state.receptions);
+        if (now_events != events)
+        {
+            events = now_events;
+            quiet_since = metrics_clock();
+        }
+        else if (metrics_clock() - quiet_since >= (uint64_t)options.settle_ms * 1000000)
+        {
+            break;
+        }
+    }
+
+    uint64_t cpu_used = cpu_time() - cpu_start;
+    uint64_t last_event = atomic_load(&state.last_event);
+    double duration = (double)((last_event > injected ? last_event : injected) - start) / 1e9;
+
+    simulation_destroy(simulation);
+
+    unsigned long transmissions = 0;
+    for (int i = 0; i < num_nodes; i++)
+    {
+        transmissions += atomic_load(&metrics_node(metrics, i)->counters[METRIC_FORWARDED]);
+    }
+
+    int unicasts = options.messages - broadcasts;
+    int delivered = 0;
+
+    for (int i = 0; i < options.messages; i++)
+    {
+        uint64_t latency = atomic_load(&state.unicast_latency[i]);
+        if (!state.broadcast[i] && latency)
+        {
+            unicast_samples[delivered++] = latency;
+        }
+    }
+
+    int receptions = atomic_load(&state.receptions);
+    int recorded = receptions < state.reception_capacity ? receptions : state.reception_capacity;
+
+    printf("{\"benchmark\": \"mesh\", \"nodes\": %d, \"workers\": %d, \"compression\": \"%s\", "
+           "\"broadcast_mode\": \"%s\", \"rate\": %.0f, \"seed\": %u, \"messages\": %d, \"duration_s\": %.6f, "
+           "\"throughput_msgs_per_s\": %.1f, \"cpu_ns_per_message\": %.0f, \"transmissions\": %lu,\n",
+           num_nodes, options.num_workers, options.compression, options.broadcast, options.rate, options.seed,
+           options.messages, duration, (delivered + broadcasts) / duration, (double)cpu_used / options.messages,
+           transmissions);
+    printf(" \"unicast\": {\"sent\": %d, \"delivered\": %d, \"loss_rate\": %.6f, \"latency_ns\": ",
+           unicasts, delivered, unicasts ? 1.0 - (double)delivered / unicasts : 0.0);
+    print_latency(stdout, unicast_samples, delivered);
+    printf("},\n \"broadcast\": {\"sent\": %d, \"receptions\": %d, \"mean_reach\": %.2f, \"latency_ns\": ",
+           broadcasts, receptions, broadcasts ? (double)receptions / broadcasts : 0.0);
+    print_latency(stdout, state.reception_latency, recorded);
+    printf("}}\n");
+
+    free(unicast_samples);
+    free(state.sent_at);
+    free(state.broadcast);
+    free(state.unicast_latency);
+    free(state.reception_latency);
+    metrics_destroy(metrics);
+    topology_destroy(topology);
+    free_graph(&graph);
+    return EXIT_SUCCESS;
+}
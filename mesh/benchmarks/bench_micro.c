@@ -0,0 +1,429 @@
+#include <math.h>
+#include <time.h>
+
+#include "packet.h"
+#include "graph.h"
+#include "routing.h"
+#include "forwarding.h"
+#include "metrics.h"
+#include "logger.h"
+
+#define BENCH_MAX_REPETITIONS 101
+#define BENCH_BATCH_NS 2000000
+#define BENCH_WARMUP_NS 50000000
+
+typedef void (*bench_body)(void *context, long iterations);
+
+typedef struct
+{
+    packet_t packet;
+    packet_wire_t wire;
+    char datagram[PACKET_DATAGRAM_SIZE];
+    char compressed[PACKET_DATAGRAM_SIZE];
+    size_t compressed_size;
+    char message[MAX_MESSAGE_LENGTH];
+    size_t length;
+} payload_context_t;
+
+typedef struct
+{
+    csr_graph_t graph;
+    int *distances;
+    int *predecessors;
+    route_table_t routes;
+    topology_view_t view;
+    node_t node;
+    node_metrics_t metrics;
+    unsigned seed;
+} graph_context_t;
+
+static int repetitions = 21;
+static const char *filter = NULL;
+static volatile uint64_t sink;
+
+/**
+ * @brief Returns a monotonic timestamp in nanoseconds.
+ */
+static uint64_t now_ns(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+/**
+ * @brief Orders samples for qsort().
+ */
+static int compare_double(const void *a, const void *b)
+{
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * @brief Times a function and prints its statistics as one JSON line.
+ *
+ * The number of iterations per batch is doubled until a batch takes at
+ * least BENCH_BATCH_NS. Batches then run for BENCH_WARMUP_NS to warm up
+ * caches and branch predictors, after which every repetition times one batch.
+ *
+ * @param function The name of the timed function.
+ * @param parameters The parameters of the case, as JSON members.
+ * @param body Runs the function the given number of times.
+ * @param context Passed to the body.
+ */
+static void bench_run(const char *function, const char *parameters, bench_body body, void *context)
+{
+    if (filter && !strstr(function, filter))
+    {
+        return;
+    }
+
+    long iterations = 1;
+    while (1)
+    {
+        uint64_t start = now_ns();
+        body(context, iterations);
+        if (now_ns() - start >= BENCH_BATCH_NS || iterations >= (1L << 30))
+        {
+            break;
+        }
+        iterations *= 2;
+    }
+
+    uint64_t warmup_start = now_ns();
+    while (now_ns() - warmup_start < BENCH_WARMUP_NS)
+    {
+        body(context, iterations);
+    }
+
+    double samples[BENCH_MAX_REPETITIONS];
+    double sum = 0;
+
+    for (int i = 0; i < repetitions; i++)
+    {
+        uint64_t start = now_ns();
+        body(context, iterations);
+        samples[i] = (double)(now_ns() - start) / iterations;
+        sum += samples[i];
+    }
+
+    double mean = sum / repetitions;
+    double variance = 0;
+    for (int i = 0; i < repetitions; i++)
+    {
+        variance += (samples[i] - mean) * (samples[i] - mean);
+    }
+    double stddev = repetitions > 1 ? sqrt(variance / (repetitions - 1)) : 0;
+
+    qsort(samples, repetitions, sizeof(double), compare_double);
+
+    printf("{\"function\": \"%s\", \"params\": {%s}, \"iterations\": %ld, \"repetitions\": %d, "
+           "\"ns_per_op\": {\"median\": %.2f, \"mean\": %.2f, \"stddev\": %.2f, \"min\": %.2f, \"max\": %.2f}}\n",
+           function, parameters, iterations, repetitions, samples[repetitions / 2], mean, stddev, samples[0],
+           samples[repetitions - 1]);
+    fflush(stdout);
+}
+
+static void body_create_packet(void *context, long iterations)
+{
+    payload_context_t *payload = (payload_context_t *)context;
+    for (long i = 0; i < iterations; i++)
+    {
+        packet_t packet = create_packet(1, 2, TTL_LIMIT, 1, 2, payload->message);
+        sink += packet.mac_packet.crc;
+    }
+}
+
+static void body_checksum_crc32c(void *context, long iterations)
+{
+    payload_context_t *payload = (payload_context_t *)context;
+    for (long i = 0; i < iterations; i++)
+    {
+        sink += checksum_crc32c(0, payload->message, payload->length);
+    }
+}
+
+static void body_compress_data(void *context, long iterations)
+{
+    payload_context_t *payload = (payload_context_t *)context;
+    for (long i = 0; i < iterations; i++)
+    {
+        char output[PACKET_DATAGRAM_SIZE];
+        size_t output_size = sizeof(output);
+        compress_data(payload->message, payload->length, output, &output_size);
+        sink += output_size;
+    }
+}
+
+static void body_decompress_data(void *context, long iterations)
+{
+    payload_context_t *payload = (payload_context_t *)context;
+    for (long i = 0; i < iterations; i++)
+    {
+        char output[MAX_MESSAGE_LENGTH];
+        size_t output_size = sizeof(output);
+        decompress_data(payload->compressed, payload->compressed_size, output, &output_size);
+        sink += output_size;
+    }
+}
+
+static void body_packet_serialize(void *context, long iterations)
+{
+    payload_context_t *payload = (payload_context_t *)context;
+    for (long i = 0; i < iterations; i++)
+    {
+        sink += packet_serialize(&payload->packet, &payload->wire);
+    }
+}
+
+static void body_packet_parse(void *context, long iterations)
+{
+    payload_context_t *payload = (payload_context_t *)context;
+    for (long i = 0; i < iterations; i++)
+    {
+        packet_t packet;
+        sink += packet_parse(payload->datagram, payload->wire.size, &packet);
+    }
+}
+
+static void body_dijkstra(void *context, long iterations)
+{
+    graph_context_t *graph = (graph_context_t *)context;
+    for (long i = 0; i < iterations; i++)
+    {
+        dijkstra(&graph->graph, rand_r(&graph->seed) % graph->graph.num_nodes, graph->distances, graph->predecessors, NULL);
+        sink += graph->distances[0];
+    }
+}
+
+static void body_route_table_build(void *context, long iterations)
+{
+    graph_context_t *graph = (graph_context_t *)context;
+    for (long i = 0; i < iterations; i++)
+    {
+        route_table_build(&graph->routes, &graph->graph, rand_r(&graph->seed) % graph->graph.num_nodes);
+        sink += graph->routes.next_hops[0];
+    }
+}
+
+static void body_find_next_hop(void *context, long iterations)
+{
+    graph_context_t *graph = (graph_context_t *)context;
+    for (long i = 0; i < iterations; i++)
+    {
+        sink += find_next_hop(&graph->node, rand_r(&graph->seed) % graph->graph.num_nodes, rand_r(&graph->seed));
+    }
+}
+
+/**
+ * @brief Benchmarks the packet functions for one payload size.
+ *
+ * @param length The length of the message in the packet.
+ */
+static void bench_payload(size_t length)
+{
+    static const char *levels[] = {"none", "fast", "best"};
+    payload_context_t payload;
+    char parameters[128];
+
+    memset(payload.message, 'a', length);
+    payload.message[length] = '\0';
+    payload.length = length;
+    payload.packet = create_packet(1, 2, TTL_LIMIT, 1, 2, payload.message);
+
+    snprintf(parameters, sizeof(parameters), "\"payload\": %zu", length);
+    bench_run("create_packet", parameters, body_create_packet, &payload);
+
+    snprintf(parameters, sizeof(parameters), "\"payload\": %zu, \"implementation\": \"%s\"",
+             length, checksum_implementation());
+    bench_run("checksum_crc32c", parameters, body_checksum_crc32c, &payload);
+
+    for (int level = COMPRESSION_NONE; level <= COMPRESSION_BEST; level++)
+    {
+        compression_configure(level, false);
+
+        payload.compressed_size = sizeof(payload.compressed);
+        compress_data(payload.message, length, payload.compressed, &payload.compressed_size);
+
+        snprintf(parameters, sizeof(parameters), "\"payload\": %zu, \"level\": \"%s\", \"compressed_size\": %zu",
+                 length, levels[level], payload.compressed_size);
+        bench_run("compress_data", parameters, body_compress_data, &payload);
+        bench_run("decompress_data", parameters, body_decompress_data, &payload);
+
+        packet_serialize(&payload.packet, &payload.wire);
+        transport_gather(payload.datagram, payload.wire.iov, payload.wire.count);
+
+        snprintf(parameters, sizeof(parameters), "\"payload\": %zu, \"level\": \"%s\", \"datagram_size\": %zu",
+                 length, levels[level], payload.wire.size);
+        bench_run("packet_serialize", parameters, body_packet_serialize, &payload);
+        bench_run("packet_parse", parameters, body_packet_parse, &payload);
+    }
+
+    compression_configure(COMPRESSION_FAST, false);
+}
+
+/**
+ * @brief Builds a connected random graph with the given average degree.
+ *
+ * A ring keeps the graph connected, and random edges with weights from 1
+ * to 10 are added on top of it until the average degree is reached.
+ *
+ * @param graph Receives the graph.
+ * @param num_nodes Number of nodes.
+ * @param degree Average number of neighbors per node.
+ * @param seed Seed of the random edges.
+ * @return 0 on success, -1 on allocation failure.
+ */
+static int build_random_graph(graph_t *graph, int num_nodes, int degree, unsigned seed)
+{
+    if (initialize_graph(graph, num_nodes) == -1)
+    {
+        return -1;
+    }
+
+    long edges = (long)num_nodes * degree / 2;
+    for (int i = 0; i < num_nodes; i++)
+    {
+        if (add_edge(i, (i + 1) % num_nodes, 1 + rand_r(&seed) % 10, graph) == -1)
+        {
+            return -1;
+        }
+    }
+
+    for (long i = num_nodes; i < edges; i++)
+    {
+        int u = rand_r(&seed) % num_nodes;
+        int v = rand_r(&seed) % num_nodes;
+        if (u != v && add_edge(u, v, 1 + rand_r(&seed) % 10, graph) == -1)
+        {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Benchmarks the routing functions on one random graph.
+ *
+ * find_next_hop runs on a node whose view is set up by hand from the graph,
+ * so the table is built once and the timed calls are steady-state lookups.
+ *
+ * @param num_nodes Number of nodes.
+ * @param degree Average number of neighbors per node.
+ */
+static void bench_graph(int num_nodes, int degree)
+{
+    graph_t graph;
+    graph_context_t context;
+    char parameters[128];
+
+    memset(&context, 0, sizeof(context));
+    context.seed = 1;
+
+    if (build_random_graph(&graph, num_nodes, degree, 1) == -1 || csr_build(&context.graph, &graph) == -1)
+    {
+        fprintf(stderr, "Graph allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+
+    context.distances = malloc(num_nodes * sizeof(int));
+    context.predecessors = malloc(num_nodes * sizeof(int));
+    if (!context.distances || !context.predecessors)
+    {
+        fprintf(stderr, "Graph allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+
+    context.view.graph = context.graph;
+    context.view.cache.epoch = 1;
+    context.view.change_count = -1;
+    context.node.id = 0;
+    context.node.view = &context.view;
+    context.node.metrics = &context.metrics;
+
+    snprintf(parameters, sizeof(parameters), "\"nodes\": %d, \"degree\": %d, \"edges\": %d",
+             num_nodes, degree, context.graph.num_edges);
+    bench_run("dijkstra", parameters, body_dijkstra, &context);
+    bench_run("route_table_build", parameters, body_route_table_build, &context);
+    bench_run("find_next_hop", parameters, body_find_next_hop, &context);
+
+    route_table_free(&context.routes);
+    route_table_free(&context.node.routes);
+    free(context.distances);
+    free(context.predecessors);
+    csr_free(&context.graph);
+    free_graph(&graph);
+}
+
+/**
+ * @brief Prints how to run the benchmark.
+ *
+ * @param program The name of the executable.
+ */
+static void print_usage(const char *program)
+{
+    fprintf(stderr, "Usage: %s [-r repetitions] [-f function] [-q]\n", program);
+    fprintf(stderr, "  -r repetitions  Timed batches per case, 1..%d (default: 21)\n", BENCH_MAX_REPETITIONS);
+    fprintf(stderr, "  -f function     Only run functions whose name contains this text\n");
+    fprintf(stderr, "  -q              Quick run with the smaller sizes only\n");
+    fprintf(stderr, "Every case is printed to stdout as one JSON line.\n");
+}
+
+int main(int argc, char *argv[])
+{
+    bool quick = false;
+    int option;
+
+    while ((option = getopt(argc, argv, "r:f:q")) != -1)
+    {
+        switch (option)
+        {
+        case 'r':
+            repetitions = atoi(optarg);
+            break;
+        case 'f':
+            filter = optarg;
+            break;
+        case 'q':
+            quick = true;
+            break;
+        default:
+            print_usage(argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if (repetitions < 1 || repetitions > BENCH_MAX_REPETITIONS)
+    {
+        print_usage(argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    log_config_t log_config;
+    logger_parse("level=error", &log_config);
+    logger_start(&log_config);
+
+    static const size_t payloads[] = {1, 16, 64, MAX_MESSAGE_LENGTH - 1};
+    static const int sizes[] = {100, 1000, 10000};
+    static const int degrees[] = {4, 16, 64};
+
+    for (size_t i = 0; i < sizeof(payloads) / sizeof(payloads[0]); i++)
+    {
+        bench_payload(payloads[i]);
+    }
+
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]) && !(quick && i > 0); i++)
+    {
+        for (size_t j = 0; j < sizeof(degrees) / sizeof(degrees[0]); j++)
+        {
+            if (degrees[j] < sizes[i])
+            {
+                bench_graph(sizes[i], degrees[j]);
+            }
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
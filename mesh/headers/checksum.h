@@ -0,0 +1,11 @@
+#ifndef CHECKSUM_H
+#define CHECKSUM_H
+
+#include <stdint.h>
+
+#include "stdafx.h"
+
+uint32_t checksum_crc32c(uint32_t crc, const void *data, size_t length);
+const char *checksum_implementation(void);
+
+#endif // CHECKSUM_H
@@ -12,8 +12,30 @@ typedef enum
 
 } message_type;
 
-uint16_t calculate_crc(const char *data, const size_t length);
+typedef enum
+{
+    LOG_LEVEL_INFO,
+    LOG_LEVEL_WARNING,
+    LOG_LEVEL_ERROR
+
+} log_level;
+
+#define MESSAGE_TYPE_LEVEL(type)                          \
+    ((type) == MSG_TYPE_ERROR            ? LOG_LEVEL_ERROR   \
+     : (type) == MSG_TYPE_NOT_VALID_DATA ? LOG_LEVEL_WARNING \
+                                         : LOG_LEVEL_INFO)
+
+typedef enum
+{
+    COMPRESSION_NONE,
+    COMPRESSION_FAST,
+    COMPRESSION_BEST
+
+} compression_level;
 
+int compression_parse(const char *spec, compression_level *level, bool *dictionary);
+void compression_configure(compression_level level, bool dictionary);
+bool compression_enabled(void);
 int compress_data(const char *input, size_t input_size, char *output, size_t *output_size);
 int decompress_data(const char *input, size_t input_size, char *output, size_t *output_size);
 
@@ -6,14 +6,86 @@
 #define CLIENT_BASE_PORT 1000
 #define SERVER_PORT 999
 
-#define MAX_NODES 100
+#define DEFAULT_MATRIX_SIZE 10
+#define MAX_NODE_COUNT (65535 - CLIENT_BASE_PORT)
 #define MAX_MESSAGE_LENGTH 150
 
+// Bytes of a transfer carried by each fragment, and the most fragments a transfer can have
+#define FRAGMENT_PAYLOAD_SIZE (MAX_MESSAGE_LENGTH - 1)
+#define FRAGMENT_MAX_COUNT 65535
+
+// Fragments a destination buffers ahead of the first missing one, transfers it reassembles
+// at once, and how long an idle transfer is kept
+#define REASSEMBLY_WINDOW 1024
+#define REASSEMBLY_TRANSFERS 8
+#define REASSEMBLY_TIMEOUT_MS 5000
+
+// How long the server waits for room in the inbox of a node before it drops a packet
+#define SERVER_SEND_TIMEOUT_MS 100
+
+// How long the server waits for the nodes it started to be ready before it runs any command
+#define NODE_READY_TIMEOUT_MS 5000
+
+// How long a node waits after its transport failed to receive, doubled for every consecutive
+// failure up to NODE_RECEIVE_BACKOFF_MAX_MS, and after how many consecutive failures it stops
+#define NODE_RECEIVE_BACKOFF_MS 10
+#define NODE_RECEIVE_BACKOFF_MAX_MS 1000
+#define NODE_RECEIVE_MAX_FAILURES 16
+
+// How often the sleep command checks whether the server was interrupted
+#define SERVER_SLEEP_SLICE_MS 10
+
+// Longest command line the server reads
+#define COMMAND_MAX_LENGTH 4096
+
+#define PACKET_VERSION 5
+
 #define BROADCAST_RADIUS 3
-#define BROADCAST_NODE 0xFF
+#define BROADCAST_MAX_WEIGHT 3
+#define BROADCAST_NODE 0xFFFF
 
 #define TTL_LIMIT 24
+// Hops recorded in the trace of a packet, enough for any packet that has not run out of TTL
+#define TRACE_MAX_HOPS (TTL_LIMIT + 1)
+
+// Message IDs remembered per broadcast origin, and how long an idle origin is remembered
+#define BROADCAST_WINDOW_SIZE 256
+#define BROADCAST_WINDOW_TIMEOUT_MS 5000
+
+// Packets a node keeps in flight per neighbor in reliable mode, and how many more wait behind them
+#define LINK_WINDOW_SIZE 64
+#define LINK_QUEUE_LIMIT 1024
+
+// Retransmission timeout before the first round trip is measured, and its bounds
+#define LINK_RTO_INITIAL_MS 1000
+#define LINK_RTO_MIN_MS 10
+#define LINK_RTO_MAX_MS 1000
+// Retransmissions of a packet before the link gives up on it, and the acknowledgements
+// reporting later packets that trigger a retransmission before the timeout
+#define LINK_MAX_RETRIES 8
+#define LINK_FAST_RETRANSMIT 3
+
+// Link costs are measured in hundredths of a hop. In adaptive mode every node reports the
+// smoothed cost of its links each LINK_REPORT_INTERVAL_MS; a link costs one more hop for every
+// LINK_COST_QUEUE packets waiting on it, every LINK_COST_LOSS_PERCENT percent of its packets
+// retransmitted and every LINK_COST_RTT_MS of smoothed round trip
+#define LINK_COST_HOP 100
+#define LINK_REPORT_INTERVAL_MS 500
+#define LINK_COST_QUEUE 32
+#define LINK_COST_LOSS_PERCENT 10
+#define LINK_COST_RTT_MS 20
+// The server changes the weight of an edge once its cost is WEIGHT_HYSTERESIS past the next whole
+// hop, at most every WEIGHT_HOLD_MS, and adds at most WEIGHT_MAX_PENALTY hops to its configured weight
+#define WEIGHT_HYSTERESIS 25
+#define WEIGHT_HOLD_MS 2000
+#define WEIGHT_MAX_PENALTY 4
+
+#define RECV_BATCH_SIZE 32
+#define SEND_BATCH_SIZE 32
 
 #define INF INT_MAX
 
+// Neighbors of a node that traffic can be spread over when several shortest paths lead to a destination
+#define ROUTE_MULTIPATH_NEIGHBORS 64
+
 #endif // CONSTANTS_H
\ No newline at end of file
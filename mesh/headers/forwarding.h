@@ -0,0 +1,86 @@
+#ifndef FORWARDING_H
+#define FORWARDING_H
+
+#include "stdafx.h"
+#include "constants.h"
+#include "packet.h"
+#include "topology.h"
+#include "routing.h"
+#include "transport.h"
+#include "metrics.h"
+#include "link.h"
+#include "reassembly.h"
+
+typedef struct
+{
+    const topology_shared_t *topology;
+    topology_cache_t cache;
+    csr_graph_t graph;
+    uint32_t previous_epoch;
+    int change_count;
+    topology_change_t last_change;
+    bool shared;
+    pthread_rwlock_t lock;
+} topology_view_t;
+
+typedef enum
+{
+    BROADCAST_FLOOD,
+    BROADCAST_MPR
+
+} broadcast_mode;
+
+typedef struct
+{
+    broadcast_mode mode;
+    int radius;
+} broadcast_config_t;
+
+typedef struct
+{
+    uint64_t last_seen;
+    uint16_t latest;
+    bool active;
+    uint64_t seen[BROADCAST_WINDOW_SIZE / 64];
+    uint64_t relayed[BROADCAST_WINDOW_SIZE / 64];
+} broadcast_window_t;
+
+typedef struct node node_t;
+
+typedef void (*node_delivery_handler)(node_t *node, const packet_t *packet, void *context);
+
+struct node
+{
+    int id;
+    topology_view_t *view;
+    route_table_t routes;
+    uint32_t routes_epoch;
+    broadcast_window_t *broadcast_windows;
+    bool **relays;
+    uint8_t **broadcast_trees;
+    int relays_count;
+    uint32_t relays_epoch;
+    transport_t *transport;
+    link_table_t links;
+    bool reliable;
+    reassembly_table_t reassembly;
+    node_metrics_t *metrics;
+    node_delivery_handler on_delivery;
+    void *delivery_context;
+};
+
+int topology_view_init(topology_view_t *view, const topology_shared_t *topology, bool shared);
+void topology_view_refresh(topology_view_t *view);
+void topology_view_free(topology_view_t *view);
+
+int broadcast_parse(const char *spec, broadcast_config_t *config);
+
+int node_init(node_t *node, int id, topology_view_t *view, transport_t *transport, node_metrics_t *metrics);
+void node_free(node_t *node);
+int find_next_hop(node_t *node, int destination_node, uint32_t flow);
+void broadcast_signal(node_t *node, packet_t *packet);
+void send_packet(node_t *node, packet_t *packet);
+void node_handle_packet(node_t *node, const char *data, size_t size);
+int node_poll(node_t *node, uint64_t now);
+
+#endif // FORWARDING_H
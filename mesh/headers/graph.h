@@ -4,12 +4,57 @@
 #include "stdafx.h"
 #include "constants.h"
 
-void initialize_graph(int size, int graph[MAX_NODES][MAX_NODES]);
-void add_edge(int u, int v, int weight, int graph[MAX_NODES][MAX_NODES]);
-void add_edges(int matrix_size, int graph[MAX_NODES][MAX_NODES]);
-void remove_node(int node_id, int graph[MAX_NODES][MAX_NODES]);
-void dijkstra(int graph[MAX_NODES][MAX_NODES], int start_node, int num_nodes, int distances[MAX_NODES], int predecessors[MAX_NODES]);
-void print_path(int node, int predecessors[MAX_NODES]);
-void print_paths(int start_node, int num_nodes, int predecessors[MAX_NODES]);
+typedef struct
+{
+    int target;
+    int weight;
+
+    // Part of the weight added while the link is congested
+    int penalty;
+} edge_t;
+
+typedef struct
+{
+    int num_nodes;
+    int *degrees;
+    int *capacities;
+    edge_t **adjacency;
+} graph_t;
+
+typedef struct
+{
+    int num_nodes;
+    int num_edges;
+    int *offsets;
+    int *targets;
+    int *weights;
+} csr_graph_t;
+
+typedef struct
+{
+    int *nodes;
+    int *positions;
+    int size;
+    const int *keys;
+} node_heap_t;
+
+int initialize_graph(graph_t *graph, int num_nodes);
+void free_graph(graph_t *graph);
+int add_edge(int u, int v, int weight, graph_t *graph);
+int add_penalized_edge(int u, int v, int weight, int penalty, graph_t *graph);
+void add_edges(int matrix_size, graph_t *graph);
+void remove_node(int node_id, graph_t *graph);
+int get_edge_weight(const graph_t *graph, int u, int v);
+int csr_build(csr_graph_t *csr, const graph_t *graph);
+void csr_free(csr_graph_t *csr);
+void csr_remove_node(csr_graph_t *csr, int node_id);
+int csr_set_weight(csr_graph_t *csr, int u, int v, int weight);
+int node_heap_init(node_heap_t *heap, int num_nodes);
+void node_heap_free(node_heap_t *heap);
+int dijkstra(const csr_graph_t *graph, int start_node, int *distances, int *predecessors, node_heap_t *heap);
+int dijkstra_resume(const csr_graph_t *graph, const int *frontier, int frontier_count, int *distances, int *predecessors,
+                    node_heap_t *heap);
+void print_path(int node, const int *predecessors);
+void print_paths(int start_node, int num_nodes, const int *predecessors);
 
 #endif // GRAPH_H
\ No newline at end of file
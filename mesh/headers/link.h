@@ -0,0 +1,108 @@
+#ifndef LINK_H
+#define LINK_H
+
+#include "stdafx.h"
+#include "constants.h"
+#include "packet.h"
+#include "transport.h"
+#include "metrics.h"
+
+// First byte of an acknowledgement datagram, which cannot be mistaken for a packet version
+#define LINK_ACK_TYPE 0xA1
+
+// Encoded acknowledgement: type, sender, session of the acknowledged link, next expected
+// sequence, the bitmap of the sequences from it on that were received, then the CRC32C of all that
+#define LINK_ACK_SIZE 21
+
+// First byte of a link cost report sent to the server
+#define LINK_REPORT_TYPE 0xC1
+
+// Encoded report: type, sender and number of links, then the neighbor and cost of each link
+#define LINK_REPORT_HEADER_SIZE 4
+#define LINK_REPORT_ENTRY_SIZE 4
+#define LINK_REPORT_MAX_LINKS 64
+
+typedef struct
+{
+    uint64_t sent_at;
+    uint64_t deadline;
+    uint8_t retries;
+    uint8_t duplicate_acks;
+    bool in_flight;
+    uint32_t size;
+    char data[PACKET_DATAGRAM_SIZE];
+} link_slot_t;
+
+typedef struct link_pending
+{
+    struct link_pending *next;
+    uint32_t size;
+    char data[];
+} link_pending_t;
+
+typedef struct
+{
+    int neighbor;
+
+    // Sending side: sequences base..next_sequence - 1 are in flight or queued
+    uint32_t next_sequence;
+    uint32_t base;
+    link_slot_t slots[LINK_WINDOW_SIZE];
+    link_pending_t *pending_head;
+    link_pending_t *pending_tail;
+    int pending_count;
+    uint64_t srtt;
+    uint64_t rttvar;
+    uint64_t rto;
+
+    // Receiving side: bit i of received is set if expected + i was received
+    bool synchronized;
+    uint16_t session;
+    uint32_t expected;
+    uint64_t received;
+    bool ack_pending;
+
+    // Cost: packets sent and retransmitted since the last report, and the smoothed cost in hundredths of a hop
+    uint32_t sent;
+    uint32_t retransmitted;
+    int cost;
+} link_t;
+
+typedef struct
+{
+    int neighbor;
+    int cost;
+} link_cost_t;
+
+typedef struct
+{
+    int node_id;
+    int count;
+    link_cost_t links[LINK_REPORT_MAX_LINKS];
+} link_report_t;
+
+typedef struct
+{
+    int node_id;
+    int num_nodes;
+    uint16_t session;
+    transport_t *transport;
+    node_metrics_t *metrics;
+    link_t **links;
+    int *active;
+    int active_count;
+    uint64_t deadline;
+    bool reports;
+    uint64_t report_at;
+} link_table_t;
+
+void link_table_init(link_table_t *table, int node_id, int num_nodes, transport_t *transport, node_metrics_t *metrics);
+void link_table_free(link_table_t *table);
+link_t *link_open(link_table_t *table, int neighbor);
+int link_send(link_table_t *table, link_t *link, const struct iovec *iov, int iov_count);
+bool link_accept(link_table_t *table, int neighbor, const packet_link_t *header);
+void link_handle_ack(link_table_t *table, const char *data, size_t size);
+int link_poll(link_table_t *table, uint64_t now);
+int link_report_decode(const char *data, size_t size, link_report_t *report);
+
+#endif // LINK_H
@@ -1,13 +1,88 @@
 #ifndef LOGGER_H
 #define LOGGER_H
 
+#include <stdatomic.h>
+
 #include "stdafx.h"
 #include "common.h"
 
 #define LOG_FILE "logs.log"
+#define LOG_BINARY_FILE "logs.bin"
+
+#define LOG_RECORD_SIZE 256
+#define LOG_DEFAULT_BUFFER_SIZE (256 * 1024)
+#define LOG_FLUSH_INTERVAL_MS 50
+#define LOG_WRITE_BATCH_SIZE (64 * 1024)
+#define LOG_MAX_FORMATS 256
+#define LOG_MAX_ARGUMENTS 16
+
+#ifndef LOG_MIN_LEVEL
+#define LOG_MIN_LEVEL LOG_LEVEL_INFO
+#endif
+
+#define log_message(creator, type, ...)                                                                \
+    do                                                                                                 \
+    {                                                                                                  \
+        if (MESSAGE_TYPE_LEVEL(type) >= LOG_MIN_LEVEL && MESSAGE_TYPE_LEVEL(type) >= log_threshold) \
+        {                                                                                              \
+            log_message_write(creator, type, __VA_ARGS__);                                             \
+        }                                                                                              \
+    } while (0)
+
+typedef enum
+{
+    LOG_POLICY_SYNC,
+    LOG_POLICY_BLOCK,
+    LOG_POLICY_DROP
+
+} log_policy;
+
+typedef enum
+{
+    LOG_RECORD_MESSAGE,
+    LOG_RECORD_FORMAT,
+    LOG_RECORD_TEXT
+
+} log_record_kind;
+
+typedef struct
+{
+    log_policy policy;
+    size_t buffer_size;
+    bool binary;
+    log_level threshold;
+} log_config_t;
+
+typedef struct
+{
+    uint64_t timestamp;
+    uint32_t pid;
+    int32_t node;
+    uint16_t size;
+    uint16_t format;
+    uint8_t kind;
+    uint8_t type;
+    uint16_t reserved;
+} log_record_header_t;
+
+typedef struct
+{
+    atomic_uint sequence;
+    uint32_t length;
+    char text[LOG_RECORD_SIZE];
+} log_slot_t;
 
 const char *get_message_type_string(const message_type type);
-void log_message(const char *creator, const message_type type,
-                 const char *message_format, ...);
+extern log_level log_threshold;
+
+void log_message_write(const char *creator, const message_type type,
+                       const char *message_format, ...);
+
+int log_format_signature(const char *format, char *signature);
+
+int logger_parse(const char *spec, log_config_t *config);
+int logger_start(const log_config_t *config);
+void logger_stop(void);
+void logger_set_node(int node_id);
 
-#endif // LOGGER_H
\ No newline at end of file
+#endif // LOGGER_H
@@ -0,0 +1,77 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdatomic.h>
+
+#include "stdafx.h"
+
+#define METRICS_SHM_NAME "/mesh-metrics"
+#define METRICS_HISTOGRAM_BUCKETS 40
+
+typedef enum
+{
+    METRIC_RECEIVED,
+    METRIC_DELIVERED,
+    METRIC_FORWARDED,
+    METRIC_TTL_DROPS,
+    METRIC_CRC_FAILURES,
+    METRIC_DECOMPRESSION_FAILURES,
+    METRIC_DUPLICATE_BROADCASTS,
+    METRIC_SEND_FAILURES,
+    METRIC_RETRANSMISSIONS,
+    METRIC_LINK_DUPLICATES,
+    METRIC_LINK_FAILURES,
+    METRIC_FRAGMENT_DROPS,
+    METRIC_REASSEMBLY_TIMEOUTS,
+    METRIC_COUNTER_COUNT
+
+} metrics_counter;
+
+typedef enum
+{
+    METRIC_COMPRESS_TIME,
+    METRIC_DECOMPRESS_TIME,
+    METRIC_ROUTE_TIME,
+    METRIC_LINK_RTT,
+    METRIC_HISTOGRAM_COUNT
+
+} metrics_histogram;
+
+typedef struct
+{
+    atomic_ulong count;
+    atomic_ulong total;
+    atomic_ulong buckets[METRICS_HISTOGRAM_BUCKETS];
+} metrics_histogram_t;
+
+typedef struct
+{
+    _Alignas(64) atomic_ulong counters[METRIC_COUNTER_COUNT];
+    metrics_histogram_t histograms[METRIC_HISTOGRAM_COUNT];
+} node_metrics_t;
+
+typedef struct
+{
+    size_t size;
+    int num_nodes;
+    atomic_int ready;
+    node_metrics_t nodes[];
+} metrics_shared_t;
+
+metrics_shared_t *metrics_create(int num_nodes);
+metrics_shared_t *metrics_attach(void);
+void metrics_destroy(metrics_shared_t *metrics);
+void metrics_detach(metrics_shared_t *metrics);
+node_metrics_t *metrics_node(metrics_shared_t *metrics, int node_id);
+void metrics_set_ready(metrics_shared_t *metrics);
+int metrics_wait_ready(metrics_shared_t *metrics, int count, int timeout_ms);
+
+void metrics_add(node_metrics_t *metrics, metrics_counter counter, unsigned long value);
+uint64_t metrics_clock(void);
+void metrics_sleep_until(uint64_t deadline);
+int metrics_bucket(uint64_t elapsed);
+void metrics_observe(node_metrics_t *metrics, metrics_histogram histogram, uint64_t start);
+uint64_t metrics_quantile(const unsigned long *buckets, unsigned long count, double quantile);
+void metrics_print(const metrics_shared_t *metrics, int node_id);
+
+#endif // METRICS_H
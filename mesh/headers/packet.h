@@ -1,39 +1,140 @@
 #ifndef PACKET_H
 #define PACKET_H
 
+#include <sys/uio.h>
+
 #include "constants.h"
 #include "common.h"
+#include "checksum.h"
+
+typedef uint16_t node_id_t;
 
 typedef struct
 {
-    uint8_t app_sender;
-    uint8_t app_receiver;
+    node_id_t app_sender;
+    node_id_t app_receiver;
     uint16_t message_id;
+    uint16_t transfer_id;
+    uint16_t fragment_index;
+    uint16_t fragment_count;
     uint8_t message_length;
     char message[MAX_MESSAGE_LENGTH];
-    uint16_t crc;
+    uint32_t crc;
 } app_packet_t;
 
 typedef struct
 {
-    uint8_t mac_sender;
-    uint8_t mac_receiver;
+    uint8_t version;
     uint8_t ttl;
+    uint8_t flags;
+    uint8_t hops;
+    uint8_t radius;
+    node_id_t mac_sender;
+    node_id_t mac_receiver;
+    node_id_t relay;
     uint8_t message_length;
     app_packet_t app_packet;
-    uint16_t crc;
+    uint32_t crc;
 } mac_packet_t;
 
 typedef struct
 {
-    int network_graph[MAX_NODES][MAX_NODES];
+    node_id_t node;
+    uint32_t elapsed;
+} trace_hop_t;
+
+typedef struct
+{
+    uint64_t sent_at;
+    uint8_t count;
+    trace_hop_t hops[TRACE_MAX_HOPS];
+} packet_trace_t;
+
+typedef struct
+{
+    uint16_t session;
+    uint32_t sequence;
+    uint32_t base;
+} packet_link_t;
+
+typedef struct
+{
+    uint32_t topology_epoch;
     union
     {
         mac_packet_t mac_packet;
         app_packet_t app_packet;
     };
+    packet_link_t link;
+    packet_trace_t trace;
 } packet_t;
 
-packet_t create_packet(uint8_t mac_sender, uint8_t mac_receiver, uint8_t ttl,
-                       uint8_t app_sender, uint8_t app_receiver, const char *message);
+// Encoded header: version, flags, TTL, hops, radius, MAC addresses, relay, topology epoch
+// and MAC CRC, then the application addresses, message ID, message length and application CRC
+#define PACKET_HEADER_SIZE 30
+#define PACKET_APP_HEADER_OFFSET 19
+
+// The payload is compressed with the configured codec. Only set on the wire.
+#define PACKET_FLAG_COMPRESSED 0x01
+// The broadcast is flooded through multipoint relays
+#define PACKET_FLAG_MPR 0x02
+// The receiver was selected as a multipoint relay by the node that sent this copy
+#define PACKET_FLAG_RELAY 0x04
+// The header is followed by the trace of the nodes the packet went through
+#define PACKET_FLAG_TRACE 0x08
+// The packet is retransmitted until the next hop acknowledges it. The header
+// is followed by the link session, the sequence of the packet on the link and
+// the oldest sequence the sender still waits for.
+#define PACKET_FLAG_RELIABLE 0x10
+
+// The message is one fragment of a larger transfer. The trace, if any, is followed
+// by the transfer ID, the index of the fragment and the number of fragments.
+#define PACKET_FLAG_FRAGMENT 0x20
+
+#define PACKET_LINK_SIZE 10
+#define PACKET_FRAGMENT_SIZE 6
+
+// Encoded trace: send time, hop count, then the node and the nanoseconds elapsed since the send of each hop
+#define PACKET_TRACE_SIZE(count) (9 + 6 * (count))
+#define PACKET_TRACE_MAX_SIZE PACKET_TRACE_SIZE(TRACE_MAX_HOPS)
+
+// Largest datagram a packet can take on the wire. A compressed payload is
+// only sent when it is smaller than the message itself.
+#define PACKET_DATAGRAM_SIZE (PACKET_HEADER_SIZE + PACKET_LINK_SIZE + PACKET_TRACE_MAX_SIZE + PACKET_FRAGMENT_SIZE + MAX_MESSAGE_LENGTH)
+
+typedef struct
+{
+    unsigned char header[PACKET_HEADER_SIZE + PACKET_LINK_SIZE + PACKET_TRACE_MAX_SIZE + PACKET_FRAGMENT_SIZE];
+    char payload[MAX_MESSAGE_LENGTH];
+    struct iovec iov[2];
+    int count;
+    size_t size;
+} packet_wire_t;
+
+typedef enum
+{
+    PACKET_PARSE_OK,
+    PACKET_PARSE_MALFORMED,
+    PACKET_PARSE_VERSION,
+    PACKET_PARSE_DECOMPRESSION
+
+} packet_parse_result;
+
+void packet_put_u16(unsigned char *output, uint16_t value);
+void packet_put_u32(unsigned char *output, uint32_t value);
+uint16_t packet_get_u16(const unsigned char *input);
+uint32_t packet_get_u32(const unsigned char *input);
+packet_t create_packet(node_id_t mac_sender, node_id_t mac_receiver, uint8_t ttl,
+                       node_id_t app_sender, node_id_t app_receiver, const char *message);
+packet_t create_fragment(node_id_t sender, node_id_t receiver, uint8_t ttl, uint16_t transfer_id,
+                         uint16_t fragment_index, uint16_t fragment_count, const char *data, size_t length);
+uint32_t packet_app_crc(const app_packet_t *app_packet);
+uint32_t packet_mac_crc(const packet_t *packet);
+void packet_stamp_link(char *datagram, const packet_link_t *link);
+size_t packet_serialize(const packet_t *packet, packet_wire_t *wire);
+void packet_serialize_header(const packet_t *packet, packet_wire_t *wire);
+packet_parse_result packet_parse(const char *data, size_t size, packet_t *packet);
+size_t packet_trace_encode(const packet_trace_t *trace, unsigned char *output);
+int packet_trace_decode(const unsigned char *input, size_t size, packet_trace_t *trace);
+void packet_trace_hop(packet_t *packet, node_id_t node, uint64_t now);
 #endif // PACKET_H
\ No newline at end of file
@@ -0,0 +1,46 @@
+#ifndef REASSEMBLY_H
+#define REASSEMBLY_H
+
+#include "stdafx.h"
+#include "constants.h"
+#include "packet.h"
+#include "checksum.h"
+
+typedef enum
+{
+    REASSEMBLY_PENDING,
+    REASSEMBLY_COMPLETE,
+    REASSEMBLY_DUPLICATE,
+    REASSEMBLY_DROPPED
+
+} reassembly_result;
+
+typedef struct
+{
+    bool active;
+    node_id_t origin;
+    uint16_t transfer_id;
+    uint16_t fragment_count;
+    uint16_t next;
+    uint64_t size;
+    uint32_t crc;
+    uint64_t started_at;
+    uint64_t last_seen;
+    bool present[REASSEMBLY_WINDOW];
+    uint8_t lengths[REASSEMBLY_WINDOW];
+    char (*fragments)[FRAGMENT_PAYLOAD_SIZE];
+    packet_t first;
+} reassembly_t;
+
+typedef struct
+{
+    reassembly_t *transfers;
+} reassembly_table_t;
+
+void reassembly_free(reassembly_table_t *table);
+int reassembly_expire(reassembly_table_t *table, uint64_t now);
+int reassembly_timeout(const reassembly_table_t *table, uint64_t now);
+reassembly_result reassembly_add(reassembly_table_t *table, const packet_t *packet, uint64_t now, reassembly_t **transfer);
+void reassembly_finish(reassembly_t *transfer);
+
+#endif // REASSEMBLY_H
@@ -0,0 +1,53 @@
+#ifndef RECEIPTS_H
+#define RECEIPTS_H
+
+#include "stdafx.h"
+#include "packet.h"
+#include "metrics.h"
+
+// First byte of a receipt datagram, which cannot be mistaken for a packet version
+#define RECEIPT_TYPE 0xD1
+
+// Encoded receipt: type, origin, destination and message ID, then the trace of the message
+#define RECEIPT_HEADER_SIZE 7
+#define RECEIPT_MAX_SIZE (RECEIPT_HEADER_SIZE + PACKET_TRACE_MAX_SIZE)
+
+typedef struct
+{
+    node_id_t origin;
+    node_id_t destination;
+    uint16_t message_id;
+    packet_trace_t trace;
+} receipt_t;
+
+typedef struct
+{
+    uint32_t key;
+    unsigned long sent;
+    unsigned long delivered;
+    unsigned long hops;
+    uint64_t latency_total;
+    uint64_t latency_max;
+    unsigned long buckets[METRICS_HISTOGRAM_BUCKETS];
+    receipt_t last;
+} receipt_pair_t;
+
+typedef struct
+{
+    pthread_mutex_t lock;
+    receipt_pair_t total;
+    receipt_pair_t *pairs;
+    size_t capacity;
+    size_t count;
+} receipts_t;
+
+bool receipt_from_packet(const packet_t *packet, receipt_t *receipt);
+size_t receipt_encode(const receipt_t *receipt, unsigned char *output);
+int receipt_decode(const char *data, size_t size, receipt_t *receipt);
+int receipts_init(receipts_t *receipts);
+void receipts_free(receipts_t *receipts);
+void receipts_sent(receipts_t *receipts, int origin, int destination);
+void receipts_record(receipts_t *receipts, const receipt_t *receipt);
+void receipts_print(receipts_t *receipts, int origin, int destination);
+
+#endif // RECEIPTS_H
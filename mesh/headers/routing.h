@@ -0,0 +1,33 @@
+#ifndef ROUTING_H
+#define ROUTING_H
+
+#include "stdafx.h"
+#include "constants.h"
+#include "graph.h"
+
+typedef struct
+{
+    int source;
+    int num_nodes;
+    int *distances;
+    int *predecessors;
+    int *next_hops;
+    node_heap_t heap;
+    const csr_graph_t *graph;
+
+    // Bit i of next_hop_sets[d] is set if neighbors[i] lies on a shortest path to d,
+    // once spread[d] says the set has been collected
+    uint64_t *next_hop_sets;
+    uint8_t *spread;
+    int neighbors[ROUTE_MULTIPATH_NEIGHBORS];
+    int neighbor_count;
+} route_table_t;
+
+int route_table_build(route_table_t *table, const csr_graph_t *graph, int source);
+int route_table_remove_node(route_table_t *table, const csr_graph_t *graph, int node_id);
+int route_table_next_hop(const route_table_t *table, int destination);
+uint64_t route_table_next_hop_set(route_table_t *table, int destination);
+int route_table_next_hop_flow(route_table_t *table, int destination, uint32_t flow);
+void route_table_free(route_table_t *table);
+
+#endif // ROUTING_H
@@ -0,0 +1,76 @@
+#ifndef SIMULATION_H
+#define SIMULATION_H
+
+#include <stdatomic.h>
+
+#include "stdafx.h"
+#include "constants.h"
+#include "forwarding.h"
+
+#define ACTOR_BATCH_SIZE 64
+
+typedef struct simulation simulation_t;
+
+typedef struct mailbox_message
+{
+    struct mailbox_message *_Atomic next;
+    size_t size;
+    char data[];
+} mailbox_message_t;
+
+typedef struct
+{
+    node_t node;
+    simulation_t *simulation;
+    mailbox_message_t *_Atomic head;
+    mailbox_message_t *tail;
+    mailbox_message_t stub;
+    atomic_bool scheduled;
+    atomic_bool stopped;
+} actor_t;
+
+typedef struct
+{
+    atomic_long top;
+    atomic_long bottom;
+    long mask;
+    actor_t *_Atomic *buffer;
+} work_deque_t;
+
+typedef struct
+{
+    simulation_t *simulation;
+    int index;
+    unsigned seed;
+    pthread_t thread;
+    work_deque_t deque;
+} worker_t;
+
+struct simulation
+{
+    transport_t transport;
+    topology_view_t view;
+    int num_nodes;
+    actor_t *actors;
+    int num_workers;
+    int num_threads;
+    worker_t *workers;
+
+    pthread_mutex_t inject_lock;
+    actor_t **inject_queue;
+    int inject_head;
+    int inject_count;
+
+    atomic_int pending;
+    atomic_int sleepers;
+    atomic_bool running;
+    pthread_mutex_t park_lock;
+    pthread_cond_t park_cond;
+};
+
+simulation_t *simulation_create(const topology_shared_t *topology, metrics_shared_t *metrics, int num_workers);
+void simulation_set_delivery_handler(simulation_t *simulation, node_delivery_handler handler, void *context);
+void simulation_stop_node(simulation_t *simulation, int node_id);
+void simulation_destroy(simulation_t *simulation);
+
+#endif // SIMULATION_H
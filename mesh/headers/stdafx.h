@@ -13,5 +13,7 @@
 #include <limits.h>
 #include <stdbool.h>
 #include <sys/file.h>
+#include <sys/mman.h>
+#include <fcntl.h>
 
 #endif // STDAFX_H
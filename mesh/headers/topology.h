@@ -0,0 +1,84 @@
+#ifndef TOPOLOGY_H
+#define TOPOLOGY_H
+
+#include <stdatomic.h>
+
+#include "stdafx.h"
+#include "constants.h"
+#include "graph.h"
+
+#define TOPOLOGY_SHM_NAME "/mesh-topology"
+#define TOPOLOGY_LOG_SIZE 256
+
+typedef enum
+{
+    TOPOLOGY_CHANGE_EDGE,
+    TOPOLOGY_CHANGE_NODE_REMOVED
+
+} topology_change_kind;
+
+typedef struct
+{
+    uint32_t epoch;
+    topology_change_kind kind;
+    int u;
+    int v;
+    int weight;
+    int penalty;
+} topology_change_t;
+
+typedef struct
+{
+    int u;
+    int v;
+    int weight;
+    int penalty;
+} topology_edge_t;
+
+typedef struct
+{
+    atomic_uint sequence;
+    uint32_t epoch;
+    uint32_t delta_floor;
+    uint32_t log_count;
+    size_t size;
+    int num_nodes;
+    int edge_capacity;
+    int edge_count;
+    topology_change_t log[TOPOLOGY_LOG_SIZE];
+    topology_edge_t edges[];
+} topology_shared_t;
+
+typedef struct
+{
+    uint32_t epoch;
+    graph_t graph;
+    topology_edge_t *edges;
+} topology_cache_t;
+
+typedef enum
+{
+    TOPOLOGY_SYNC_NONE,
+    TOPOLOGY_SYNC_DELTA,
+    TOPOLOGY_SYNC_FULL,
+    TOPOLOGY_SYNC_ERROR
+
+} topology_sync_result;
+
+typedef void (*topology_change_handler)(const topology_change_t *change, topology_cache_t *cache, void *context);
+
+topology_shared_t *topology_create(const graph_t *graph);
+topology_shared_t *topology_attach(void);
+void topology_destroy(topology_shared_t *topology);
+void topology_detach(topology_shared_t *topology);
+
+uint32_t topology_publish(topology_shared_t *topology, const graph_t *graph);
+uint32_t topology_remove_node(topology_shared_t *topology, int node_id);
+int topology_set_weights(topology_shared_t *topology, topology_edge_t *edges, int count);
+uint32_t topology_current_epoch(const topology_shared_t *topology);
+
+topology_sync_result topology_sync(const topology_shared_t *topology, topology_cache_t *cache,
+                                   topology_change_handler handler, void *context);
+void topology_cache_free(topology_cache_t *cache);
+
+#endif // TOPOLOGY_H
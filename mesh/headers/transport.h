@@ -0,0 +1,72 @@
+#ifndef TRANSPORT_H
+#define TRANSPORT_H
+
+#include <stdatomic.h>
+
+#include "stdafx.h"
+#include "constants.h"
+#include "packet.h"
+
+#define TRANSPORT_SHM_NAME "/mesh-transport"
+#define TRANSPORT_RING_SIZE 128
+
+// Destination that sends a datagram to the server instead of a node
+#define TRANSPORT_SERVER -1
+
+typedef enum
+{
+    TRANSPORT_UDP,
+    TRANSPORT_SHM
+
+} transport_kind;
+
+typedef struct
+{
+    char data[RECV_BATCH_SIZE][PACKET_DATAGRAM_SIZE];
+    size_t sizes[RECV_BATCH_SIZE];
+} transport_batch_t;
+
+typedef struct transport transport_t;
+
+struct transport
+{
+    int (*send)(transport_t *transport, int destination, const struct iovec *iov, int iov_count);
+    int (*send_many)(transport_t *transport, const int *destinations, int count, const struct iovec *iov, int iov_count);
+    int (*receive)(transport_t *transport, transport_batch_t *batch, int timeout);
+    void (*close)(transport_t *transport);
+};
+
+typedef struct
+{
+    atomic_uint sequence;
+    uint32_t size;
+    char data[PACKET_DATAGRAM_SIZE];
+} transport_slot_t;
+
+typedef struct
+{
+    _Alignas(64) atomic_uint tail;
+    _Alignas(64) uint32_t head;
+    atomic_uint signal;
+    atomic_uint waiting;
+    _Alignas(64) transport_slot_t slots[TRANSPORT_RING_SIZE];
+} transport_ring_t;
+
+// Holds one inbox per node, followed by the inbox of the server
+typedef struct
+{
+    size_t size;
+    int num_nodes;
+    transport_ring_t rings[];
+} transport_shared_t;
+
+transport_t *transport_udp_open(int node_id);
+transport_t *transport_shm_create(int num_nodes);
+transport_t *transport_shm_attach(int node_id);
+int transport_send_each(transport_t *transport, const int *destinations, int count, const struct iovec *iov, int iov_count);
+size_t transport_iov_size(const struct iovec *iov, int iov_count);
+void transport_gather(char *output, const struct iovec *iov, int iov_count);
+const char *transport_name(transport_kind kind);
+int transport_parse(const char *name, transport_kind *kind);
+
+#endif // TRANSPORT_H
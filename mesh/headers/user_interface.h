@@ -5,10 +5,20 @@
 #include "constants.h"
 #include "logger.h"
 #include "packet.h"
+#include "topology.h"
+#include "forwarding.h"
+#include "transport.h"
+#include "simulation.h"
+#include "receipts.h"
+#include "weights.h"
 
-void send_command_to_node(packet_t *packet, int client_socket);
-void create_and_send_message(const int src, const int dest, int graph[MAX_NODES][MAX_NODES], const int size_graph, const char *message, int client_socket);
-void create_and_send_broadcast(const int src, int graph[MAX_NODES][MAX_NODES], const int size_graph, const char *message, int client_socket);
+void send_command_to_node(packet_t *packet, transport_t *transport);
+void create_and_send_message(const int src, const int dest, const uint32_t topology_epoch, const bool trace,
+                             const char *message, transport_t *transport);
+int create_and_send_transfer(const int src, const int dest, const uint32_t topology_epoch, const uint16_t transfer_id,
+                             const char *data, const size_t size, const double rate, transport_t *transport);
+void create_and_send_broadcast(const int src, const uint32_t topology_epoch, const broadcast_config_t *config,
+                               const char *message, transport_t *transport);
 void print_help();
 
 #endif // USER_INTERFACE_H
\ No newline at end of file
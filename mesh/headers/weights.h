@@ -0,0 +1,38 @@
+#ifndef WEIGHTS_H
+#define WEIGHTS_H
+
+#include "stdafx.h"
+#include "constants.h"
+#include "graph.h"
+#include "topology.h"
+#include "link.h"
+
+typedef struct
+{
+    int u;
+    int v;
+    int base;
+    int penalty;
+    uint64_t changed_at;
+
+    // Last cost reported by u for its link to v, and by v for its link to u
+    int costs[2];
+} weights_edge_t;
+
+typedef struct
+{
+    int num_nodes;
+    int edge_count;
+    weights_edge_t *edges;
+
+    // The edges of node u are edges[indices[offsets[u] .. offsets[u + 1])]
+    int *offsets;
+    int *indices;
+} weights_t;
+
+int weights_init(weights_t *weights, const graph_t *graph);
+void weights_free(weights_t *weights);
+int weights_update(weights_t *weights, const link_report_t *report, uint64_t now, topology_edge_t *changes);
+void weights_print(const weights_t *weights);
+
+#endif // WEIGHTS_H
@@ -0,0 +1,167 @@
+#if defined(__x86_64__) || defined(__i386__)
+#include <nmmintrin.h>
+#define CHECKSUM_X86
+#endif
+
+#include "checksum.h"
+
+// Reflected Castagnoli polynomial, as used by iSCSI, ext4 and the SSE4.2 crc32 instruction
+#define CRC32C_POLYNOMIAL 0x82F63B78u
+
+typedef uint32_t (*checksum_function)(uint32_t crc, const unsigned char *data, size_t length);
+
+static uint32_t crc32c_table[8][256];
+static checksum_function crc32c_function;
+static const char *crc32c_name;
+static pthread_once_t crc32c_once = PTHREAD_ONCE_INIT;
+
+/**
+ * @brief Computes CRC32C eight bytes at a time with lookup tables.
+ *
+ * This is the portable fallback for CPUs without a CRC instruction.
+ *
+ * @param crc The inverted running CRC.
+ * @param data The data.
+ * @param length The length of the data in bytes.
+ * @return The inverted running CRC after the data.
+ */
+static uint32_t crc32c_software(uint32_t crc, const unsigned char *data, size_t length)
+{
+    while (length >= 8)
+    {
+        uint32_t low;
+        uint32_t high;
+        memcpy(&low, data, sizeof(low));
+        memcpy(&high, data + 4, sizeof(high));
+        low ^= crc;
+
+        crc = crc32c_table[7][low & 0xff] ^ crc32c_table[6][(low >> 8) & 0xff] ^
+              crc32c_table[5][(low >> 16) & 0xff] ^ crc32c_table[4][low >> 24] ^
+              crc32c_table[3][high & 0xff] ^ crc32c_table[2][(high >> 8) & 0xff] ^
+              crc32c_table[1][(high >> 16) & 0xff] ^ crc32c_table[0][high >> 24];
+
+        data += 8;
+        length -= 8;
+    }
+
+    while (length--)
+    {
+        crc = crc32c_table[0][(crc ^ *data++) & 0xff] ^ (crc >> 8);
+    }
+
+    return crc;
+}
+
+#ifdef CHECKSUM_X86
+/**
+ * @brief Computes CRC32C with the SSE4.2 crc32 instruction.
+ *
+ * @param crc The inverted running CRC.
+ * @param data The data.
+ * @param length The length of the data in bytes.
+ * @return The inverted running CRC after the data.
+ */
+__attribute__((target("sse4.2"))) static uint32_t crc32c_sse42(uint32_t crc, const unsigned char *data, size_t length)
+{
+#ifdef __x86_64__
+    uint64_t wide = crc;
+
+    while (length >= 8)
+    {
+        uint64_t word;
+        memcpy(&word, data, sizeof(word));
+        wide = _mm_crc32_u64(wide, word);
+        data += 8;
+        length -= 8;
+    }
+
+    crc = (uint32_t)wide;
+#endif
+
+    while (length >= 4)
+    {
+        uint32_t word;
+        memcpy(&word, data, sizeof(word));
+        crc = _mm_crc32_u32(crc, word);
+        data += 4;
+        length -= 4;
+    }
+
+    while (length--)
+    {
+        crc = _mm_crc32_u8(crc, *data++);
+    }
+
+    return crc;
+}
+#endif
+
+/**
+ * @brief Selects the fastest CRC32C implementation the CPU supports.
+ *
+ * The lookup tables are always built, so the fallback is ready even
+ * when the hardware implementation is chosen.
+ */
+static void crc32c_init(void)
+{
+    for (uint32_t i = 0; i < 256; i++)
+    {
+        uint32_t crc = i;
+        for (int bit = 0; bit < 8; bit++)
+        {
+            crc = (crc >> 1) ^ (CRC32C_POLYNOMIAL & -(crc & 1));
+        }
+        crc32c_table[0][i] = crc;
+    }
+
+    for (uint32_t i = 0; i < 256; i++)
+    {
+        for (int slice = 1; slice < 8; slice++)
+        {
+            uint32_t previous = crc32c_table[slice - 1][i];
+            crc32c_table[slice][i] = crc32c_table[0][previous & 0xff] ^ (previous >> 8);
+        }
+    }
+
+    crc32c_function = crc32c_software;
+    crc32c_name = "software";
+
+#ifdef CHECKSUM_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse4.2"))
+    {
+        crc32c_function = crc32c_sse42;
+        crc32c_name = "sse4.2";
+    }
+#endif
+}
+
+/**
+ * @brief Calculates the CRC32C (Castagnoli) checksum of the data.
+ *
+ * The implementation is chosen at the first call: the SSE4.2 crc32
+ * instruction where the CPU has it, and lookup tables otherwise.
+ * Checksums can be chained over several ranges by passing the result
+ * for the previous range, starting from 0.
+ *
+ * @param crc The checksum of the preceding data, or 0.
+ * @param data Pointer to the data.
+ * @param length The length of the data in bytes.
+ * @return The checksum of the preceding data followed by this data.
+ */
+uint32_t checksum_crc32c(uint32_t crc, const void *data, size_t length)
+{
+    pthread_once(&crc32c_once, crc32c_init);
+    return ~crc32c_function(~crc, (const unsigned char *)data, length);
+}
+
+/**
+ * @brief Returns the name of the CRC32C implementation in use.
+ *
+ * @return "sse4.2" or "software".
+ */
+const char *checksum_implementation(void)
+{
+    pthread_once(&crc32c_once, crc32c_init);
+    return crc32c_name;
+}
@@ -1,26 +1,158 @@
 #include "common.h"
+#include "packet.h"
+
+#define CODEC_WINDOW_BITS 9
+#define CODEC_MEM_LEVEL 1
+
+typedef struct
+{
+    z_stream deflate_stream;
+    z_stream inflate_stream;
+    bool deflate_ready;
+    bool inflate_ready;
+    int level;
+} codec_context_t;
+
+static compression_level codec_level = COMPRESSION_FAST;
+static bool codec_use_dictionary = false;
+static pthread_key_t codec_key;
+static pthread_once_t codec_once = PTHREAD_ONCE_INIT;
+static unsigned char codec_dictionary[sizeof(packet_t)];
+
+/**
+ * @brief Releases the codec context of a thread when the thread exits.
+ *
+ * @param context The codec context of the thread.
+ */
+static void codec_release(void *context)
+{
+    codec_context_t *codec = (codec_context_t *)context;
+
+    if (codec->deflate_ready)
+    {
+        deflateEnd(&codec->deflate_stream);
+    }
+    if (codec->inflate_ready)
+    {
+        inflateEnd(&codec->inflate_stream);
+    }
+    free(codec);
+}
 
 /**
- * @brief Calculates the CRC (Cyclic Redundancy Check) for the data.
+ * @brief Creates the thread-local storage key and the preset dictionary.
  *
- * The function uses the zlib library to calculate CRC32.
- * CRC is used to check the integrity of the data.
+ * The dictionary is the layout of an empty packet: a valid version, the
+ * initial TTL and zeroed fields. Only message payloads are compressed, so it
+ * mainly lets runs of zero bytes be matched from the very first byte.
+ */
+static void codec_init_once(void)
+{
+    pthread_key_create(&codec_key, codec_release);
+
+    packet_t template;
+    memset(&template, 0, sizeof(template));
+    template.mac_packet.version = PACKET_VERSION;
+    template.mac_packet.ttl = TTL_LIMIT;
+    memcpy(codec_dictionary, &template, sizeof(template));
+}
+
+/**
+ * @brief Returns the codec context of the calling thread, creating it on first use.
  *
- * @param data Pointer to the data for which to calculate the CRC.
- * @param length The length of the data.
- * @return 16-bit CRC value.
+ * @return The codec context, or NULL if memory allocation failed.
  */
-uint16_t calculate_crc(const char *data, size_t length)
+static codec_context_t *codec_get(void)
 {
-    uLong crc = crc32(0L, Z_NULL, 0);
-    crc = crc32(crc, (const Bytef *)data, length);
-    return (uint16_t)crc;
+    pthread_once(&codec_once, codec_init_once);
+
+    codec_context_t *codec = pthread_getspecific(codec_key);
+    if (!codec)
+    {
+        codec = calloc(1, sizeof(codec_context_t));
+        if (!codec || pthread_setspecific(codec_key, codec) != 0)
+        {
+            free(codec);
+            return NULL;
+        }
+    }
+    return codec;
+}
+
+/**
+ * @brief Parses a compression setting from the command line.
+ *
+ * The setting is a level (none, fast or best), optionally followed by
+ * ":dict" to enable the preset dictionary, for example "fast:dict".
+ *
+ * @param spec The setting to parse.
+ * @param level Receives the compression level.
+ * @param dictionary Receives whether the dictionary is used.
+ * @return 0 on success, -1 if the setting is invalid.
+ */
+int compression_parse(const char *spec, compression_level *level, bool *dictionary)
+{
+    const char *separator = strchr(spec, ':');
+    size_t length = separator ? (size_t)(separator - spec) : strlen(spec);
+
+    if (separator && strcmp(separator, ":dict") != 0)
+    {
+        return -1;
+    }
+
+    if (length == 4 && strncmp(spec, "none", length) == 0)
+    {
+        *level = COMPRESSION_NONE;
+    }
+    else if (length == 4 && strncmp(spec, "fast", length) == 0)
+    {
+        *level = COMPRESSION_FAST;
+    }
+    else if (length == 4 && strncmp(spec, "best", length) == 0)
+    {
+        *level = COMPRESSION_BEST;
+    }
+    else
+    {
+        return -1;
+    }
+
+    *dictionary = separator != NULL;
+    return 0;
+}
+
+/**
+ * @brief Selects how outgoing packets are compressed by this process.
+ *
+ * Must be called before any packet is compressed. Decompression does not
+ * depend on the setting: any level, with or without the dictionary, is accepted.
+ *
+ * @param level The compression level.
+ * @param dictionary Whether to compress against the preset dictionary.
+ */
+void compression_configure(compression_level level, bool dictionary)
+{
+    codec_level = level;
+    codec_use_dictionary = dictionary;
+}
+
+/**
+ * @brief Tells whether outgoing payloads are compressed at all.
+ *
+ * @return false if the configured level is none.
+ */
+bool compression_enabled(void)
+{
+    return codec_level != COMPRESSION_NONE;
 }
 
 /**
  * @brief Compresses input data using zlib.
  *
- * The function uses the deflate algorithm to compress data with the best compression.
+ * The function uses the deflate algorithm at the configured level. Each thread
+ * keeps its deflate state and only resets it between packets. The state is
+ * sized for packets: a small window and hash table keep the reset cheap.
+ * With level none, the data is stored in a zlib stream without compression.
  * The compressed data is written to the output buffer.
  *
  * @param input Pointer to the input data to be compressed.
@@ -31,35 +163,63 @@ uint16_t calculate_crc(const char *data, size_t length)
  */
 int compress_data(const char *input, size_t input_size, char *output, size_t *output_size)
 {
-    z_stream stream;
-    memset(&stream, 0, sizeof(stream));
+    static const int zlib_levels[] = {Z_NO_COMPRESSION, Z_BEST_SPEED, Z_BEST_COMPRESSION};
 
-    if (deflateInit(&stream, Z_BEST_COMPRESSION) != Z_OK)
+    codec_context_t *codec = codec_get();
+    if (!codec)
     {
         return Z_ERRNO;
     }
 
-    stream.next_in = (Bytef *)input;
-    stream.avail_in = input_size;
-    stream.next_out = (Bytef *)output;
-    stream.avail_out = *output_size;
+    z_stream *stream = &codec->deflate_stream;
+    int level = zlib_levels[codec_level];
 
-    int ret = deflate(&stream, Z_FINISH);
-    if (ret != Z_STREAM_END)
+    if (codec->deflate_ready && codec->level == level)
+    {
+        deflateReset(stream);
+    }
+    else
+    {
+        if (codec->deflate_ready)
+        {
+            deflateEnd(stream);
+            codec->deflate_ready = false;
+        }
+
+        memset(stream, 0, sizeof(z_stream));
+        if (deflateInit2(stream, level, Z_DEFLATED, CODEC_WINDOW_BITS, CODEC_MEM_LEVEL, Z_DEFAULT_STRATEGY) != Z_OK)
+        {
+            return Z_ERRNO;
+        }
+        codec->deflate_ready = true;
+        codec->level = level;
+    }
+
+    if (codec_use_dictionary && deflateSetDictionary(stream, codec_dictionary, sizeof(codec_dictionary)) != Z_OK)
+    {
+        return Z_ERRNO;
+    }
+
+    stream->next_in = (Bytef *)input;
+    stream->avail_in = input_size;
+    stream->next_out = (Bytef *)output;
+    stream->avail_out = *output_size;
+
+    if (deflate(stream, Z_FINISH) != Z_STREAM_END)
     {
-        deflateEnd(&stream);
         return Z_ERRNO;
     }
 
-    *output_size = stream.total_out;
-    deflateEnd(&stream);
+    *output_size = stream->total_out;
     return Z_OK;
 }
 
 /**
  * @brief Decompresses input data using zlib.
  *
- * The function uses the inflate algorithm to decompress data.
+ * The function uses the inflate algorithm to decompress data, reusing the
+ * inflate state of the calling thread. Streams compressed against the preset
+ * dictionary are recognized and decompressed with it.
  * Decompressed data is written to the output buffer.
  *
  * @param input Pointer to the input data to decompress.
@@ -70,27 +230,48 @@ int compress_data(const char *input, size_t input_size, char *output, size_t *ou
  */
 int decompress_data(const char *input, size_t input_size, char *output, size_t *output_size)
 {
-    z_stream stream;
-    memset(&stream, 0, sizeof(stream));
-
-    if (inflateInit(&stream) != Z_OK)
+    codec_context_t *codec = codec_get();
+    if (!codec)
     {
         return Z_ERRNO;
     }
 
-    stream.next_in = (Bytef *)input;
-    stream.avail_in = input_size;
-    stream.next_out = (Bytef *)output;
-    stream.avail_out = *output_size;
+    z_stream *stream = &codec->inflate_stream;
+
+    if (codec->inflate_ready)
+    {
+        inflateReset(stream);
+    }
+    else
+    {
+        memset(stream, 0, sizeof(z_stream));
+        if (inflateInit(stream) != Z_OK)
+        {
+            return Z_ERRNO;
+        }
+        codec->inflate_ready = true;
+    }
+
+    stream->next_in = (Bytef *)input;
+    stream->avail_in = input_size;
+    stream->next_out = (Bytef *)output;
+    stream->avail_out = *output_size;
+
+    int ret = inflate(stream, Z_FINISH);
+    if (ret == Z_NEED_DICT)
+    {
+        if (inflateSetDictionary(stream, codec_dictionary, sizeof(codec_dictionary)) != Z_OK)
+        {
+            return Z_ERRNO;
+        }
+        ret = inflate(stream, Z_FINISH);
+    }
 
-    int ret = inflate(&stream, Z_FINISH);
     if (ret != Z_STREAM_END)
     {
-        inflateEnd(&stream);
         return Z_ERRNO;
     }
 
-    *output_size = stream.total_out;
-    inflateEnd(&stream);
+    *output_size = stream->total_out;
     return Z_OK;
 }
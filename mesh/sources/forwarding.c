@@ -0,0 +1,1243 @@
+#include "forwarding.h"
+#include "common.h"
+#include "logger.h"
+
+typedef enum
+{
+    BROADCAST_NEW,
+    BROADCAST_SEEN,
+    BROADCAST_RELAYED
+
+} broadcast_state;
+
+typedef enum
+{
+    BROADCAST_SKIP,
+    BROADCAST_COPY,
+    BROADCAST_RELAY_COPY
+
+} broadcast_child;
+
+typedef struct
+{
+    topology_view_t *view;
+    uint32_t previous_epoch;
+    int change_count;
+    topology_change_t last_change;
+    bool rebuild;
+} topology_view_update_t;
+
+/**
+ * @brief Takes the view for reading when it is shared between threads.
+ *
+ * @param view The topology view.
+ */
+static void topology_view_read_lock(topology_view_t *view)
+{
+    if (view->shared)
+    {
+        pthread_rwlock_rdlock(&view->lock);
+    }
+}
+
+/**
+ * @brief Releases the view after topology_view_read_lock().
+ *
+ * @param view The topology view.
+ */
+static void topology_view_unlock(topology_view_t *view)
+{
+    if (view->shared)
+    {
+        pthread_rwlock_unlock(&view->lock);
+    }
+}
+
+/**
+ * @brief Initializes a node's view of the published topology.
+ *
+ * A view holds the cached graph and its compact form. A node process owns
+ * its view, while the simulation shares one view between all of its nodes,
+ * in which case it is protected by a read-write lock.
+ *
+ * @param view The view to initialize.
+ * @param topology The shared topology segment.
+ * @param shared Whether the view is used by several threads.
+ * @return 0 on success, -1 on failure.
+ */
+int topology_view_init(topology_view_t *view, const topology_shared_t *topology, bool shared)
+{
+    memset(view, 0, sizeof(topology_view_t));
+    view->topology = topology;
+    view->shared = shared;
+
+    if (shared && pthread_rwlock_init(&view->lock, NULL) != 0)
+    {
+        return -1;
+    }
+
+    topology_view_refresh(view);
+    return view->cache.epoch ? 0 : -1;
+}
+
+/**
+ * @brief Applies a topology delta to the compact graph of the view.
+ *
+ * Node removals and weight changes of existing edges are applied in place.
+ * Any other change makes the compact graph be rebuilt once the whole delta
+ * has been applied.
+ *
+ * @param change The change that was applied to the cache.
+ * @param cache The topology cache, already updated.
+ * @param context The update being collected.
+ */
+static void topology_view_apply_change(const topology_change_t *change, topology_cache_t *cache, void *context)
+{
+    topology_view_update_t *update = (topology_view_update_t *)context;
+
+    if (change->kind == TOPOLOGY_CHANGE_NODE_REMOVED && !update->rebuild)
+    {
+        csr_remove_node(&update->view->graph, change->u);
+    }
+    else if (change->kind != TOPOLOGY_CHANGE_EDGE || update->rebuild ||
+             csr_set_weight(&update->view->graph, change->u, change->v, change->weight) == -1)
+    {
+        update->rebuild = true;
+    }
+
+    update->change_count++;
+    update->last_change = *change;
+}
+
+/**
+ * @brief Brings the view up to the published epoch.
+ *
+ * The view remembers the epoch it was at before the update and the last
+ * applied change, so that routing tables one epoch behind can be repaired
+ * incrementally instead of being rebuilt.
+ *
+ * @param view The topology view.
+ */
+void topology_view_refresh(topology_view_t *view)
+{
+    if (view->shared)
+    {
+        pthread_rwlock_wrlock(&view->lock);
+    }
+
+    topology_view_update_t update = {.view = view, .previous_epoch = view->cache.epoch};
+    topology_sync_result result = topology_sync(view->topology, &view->cache, topology_view_apply_change, &update);
+
+    if (result == TOPOLOGY_SYNC_FULL || (result == TOPOLOGY_SYNC_DELTA && update.rebuild))
+    {
+        csr_free(&view->graph);
+        if (csr_build(&view->graph, &view->cache.graph) == -1)
+        {
+            log_message("CLIENT", MSG_TYPE_ERROR, "Failed to allocate the routing graph");
+            view->cache.epoch = 0;
+        }
+    }
+
+    if (result == TOPOLOGY_SYNC_FULL || result == TOPOLOGY_SYNC_DELTA)
+    {
+        view->previous_epoch = update.previous_epoch;
+        view->change_count = result == TOPOLOGY_SYNC_FULL ? -1 : update.change_count;
+        view->last_change = update.last_change;
+    }
+    else if (result == TOPOLOGY_SYNC_ERROR)
+    {
+        log_message("CLIENT", MSG_TYPE_ERROR, "Failed to synchronize the topology");
+    }
+
+    topology_view_unlock(view);
+}
+
+/**
+ * @brief Releases the memory owned by a topology view.
+ *
+ * @param view The view to release.
+ */
+void topology_view_free(topology_view_t *view)
+{
+    topology_cache_free(&view->cache);
+    csr_free(&view->graph);
+    if (view->shared)
+    {
+        pthread_rwlock_destroy(&view->lock);
+    }
+}
+
+/**
+ * @brief Frees the cached multipoint relays and broadcast trees of a node.
+ *
+ * @param node The node.
+ */
+static void node_release_relays(node_t *node)
+{
+    for (int k = 0; k < node->relays_count; k++)
+    {
+        free(node->relays[k]);
+        free(node->broadcast_trees[k]);
+    }
+    free(node->relays);
+    free(node->broadcast_trees);
+    node->relays = NULL;
+    node->broadcast_trees = NULL;
+    node->relays_count = 0;
+}
+
+/**
+ * @brief Initializes the forwarding state of a node.
+ *
+ * The routing table is built lazily, the first time the node forwards a
+ * unicast packet, so nodes that only deliver or flood never pay for it.
+ *
+ * @param node The node to initialize.
+ * @param id The identifier of the node.
+ * @param view The topology view the node routes on.
+ * @param transport The transport used to reach other nodes.
+ * @param metrics Where the node counts packets and times its work.
+ * @return 0 on success, -1 if memory allocation failed.
+ */
+int node_init(node_t *node, int id, topology_view_t *view, transport_t *transport, node_metrics_t *metrics)
+{
+    memset(node, 0, sizeof(node_t));
+    node->id = id;
+    node->view = view;
+    node->transport = transport;
+    node->metrics = metrics;
+    link_table_init(&node->links, id, view->topology->num_nodes, transport, metrics);
+
+    node->broadcast_windows = calloc(view->topology->num_nodes, sizeof(broadcast_window_t));
+    return node->broadcast_windows ? 0 : -1;
+}
+
+/**
+ * @brief Releases the memory owned by a node.
+ *
+ * @param node The node to release.
+ */
+void node_free(node_t *node)
+{
+    route_table_free(&node->routes);
+    free(node->broadcast_windows);
+    node->broadcast_windows = NULL;
+    node_release_relays(node);
+    link_table_free(&node->links);
+    reassembly_free(&node->reassembly);
+}
+
+/**
+ * @brief Brings the node's routing table up to the epoch of its view.
+ *
+ * A table that is exactly one node removal behind is repaired incrementally.
+ * Any other difference rebuilds the table from scratch.
+ * Must be called with the view locked for reading.
+ *
+ * @param node The node whose table is refreshed.
+ */
+static void node_refresh_routes(node_t *node)
+{
+    topology_view_t *view = node->view;
+
+    if (node->routes.distances && node->routes_epoch == view->cache.epoch)
+    {
+        return;
+    }
+
+    uint64_t start = metrics_clock();
+
+    bool repair = node->routes.distances && view->change_count == 1 && node->routes_epoch == view->previous_epoch &&
+                  view->last_change.kind == TOPOLOGY_CHANGE_NODE_REMOVED;
+
+    if ((repair ? route_table_remove_node(&node->routes, &view->graph, view->last_change.u)
+                : route_table_build(&node->routes, &view->graph, node->id)) == -1)
+    {
+        log_message("CLIENT", MSG_TYPE_ERROR, "Failed to allocate the routing table");
+        return;
+    }
+
+    node->routes_epoch = view->cache.epoch;
+    metrics_observe(node->metrics, METRIC_ROUTE_TIME, start);
+}
+
+/**
+ * @brief Finds the next node to forward the packet through the graph.
+ *
+ * The shortest paths are precomputed into the node's routing table whenever
+ * the topology changes, so forwarding is a single table lookup. When several
+ * shortest paths lead to the destination, the flow picks one of them.
+ * Must be called with the view locked for reading.
+ *
+ * @param node The current node.
+ * @param destination_node The destination node to which the packet should be sent.
+ * @param flow The flow key of the packet.
+ * @return The index of the next node to forward the packet to, or -1 if no path is found.
+ */
+int find_next_hop(node_t *node, int destination_node, uint32_t flow)
+{
+    node_refresh_routes(node);
+    return route_table_next_hop_flow(&node->routes, destination_node, flow);
+}
+
+/**
+ * @brief Parses a broadcast setting from the command line.
+ *
+ * The setting is a mode, flood or mpr, optionally followed by the hop
+ * radius, for example "mpr:5". The radius defaults to BROADCAST_RADIUS,
+ * and 0 floods the whole network.
+ *
+ * @param spec The setting to parse.
+ * @param config Receives the broadcast mode and radius.
+ * @return 0 on success, -1 if the setting is invalid.
+ */
+int broadcast_parse(const char *spec, broadcast_config_t *config)
+{
+    const char *separator = strchr(spec, ':');
+    size_t length = separator ? (size_t)(separator - spec) : strlen(spec);
+
+    if (length == 5 && strncmp(spec, "flood", length) == 0)
+    {
+        config->mode = BROADCAST_FLOOD;
+    }
+    else if (length == 3 && strncmp(spec, "mpr", length) == 0)
+    {
+        config->mode = BROADCAST_MPR;
+    }
+    else
+    {
+        return -1;
+    }
+
+    config->radius = BROADCAST_RADIUS;
+
+    if (separator)
+    {
+        char *end;
+        long radius = strtol(separator + 1, &end, 10);
+        if (separator[1] == '\0' || *end != '\0' || radius < 0 || radius > UINT8_MAX)
+        {
+            return -1;
+        }
+        config->radius = radius;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Records a broadcast in the window of its origin.
+ *
+ * The window remembers the latest message ID seen from the origin and, for
+ * the BROADCAST_WINDOW_SIZE IDs before it, which ones were seen and which
+ * ones this node has already relayed. Each origin numbers its broadcasts
+ * with its own sequence, so the window spans that many of its broadcasts.
+ * A newer ID slides the window forward, clearing at most one window of
+ * bits. IDs that fell behind the window are treated as relayed. An origin
+ * that has been idle for BROADCAST_WINDOW_TIMEOUT_MS starts over, so a
+ * restarted sender whose IDs begin again from zero is not mistaken for a
+ * stale one.
+ *
+ * @param window The window of the origin.
+ * @param id The message ID of the broadcast.
+ * @param now The current time in nanoseconds.
+ * @return Whether the broadcast is new, was seen, or was already relayed.
+ */
+static broadcast_state broadcast_window_check(broadcast_window_t *window, uint16_t id, uint64_t now)
+{
+    if (!window->active || now - window->last_seen > (uint64_t)BROADCAST_WINDOW_TIMEOUT_MS * 1000000)
+    {
+        memset(window->seen, 0, sizeof(window->seen));
+        memset(window->relayed, 0, sizeof(window->relayed));
+        window->active = true;
+        window->latest = id;
+    }
+
+    int16_t distance = (int16_t)(id - window->latest);
+    unsigned bit = id % BROADCAST_WINDOW_SIZE;
+    uint64_t mask = 1ULL << (bit % 64);
+
+    if (distance > 0)
+    {
+        if (distance >= BROADCAST_WINDOW_SIZE)
+        {
+            memset(window->seen, 0, sizeof(window->seen));
+            memset(window->relayed, 0, sizeof(window->relayed));
+        }
+        else
+        {
+            for (uint16_t skipped = window->latest + 1; skipped != id; skipped++)
+            {
+                unsigned skipped_bit = skipped % BROADCAST_WINDOW_SIZE;
+                window->seen[skipped_bit / 64] &= ~(1ULL << (skipped_bit % 64));
+                window->relayed[skipped_bit / 64] &= ~(1ULL << (skipped_bit % 64));
+            }
+            window->seen[bit / 64] &= ~mask;
+            window->relayed[bit / 64] &= ~mask;
+        }
+        window->latest = id;
+    }
+    else if (-distance >= BROADCAST_WINDOW_SIZE || (window->relayed[bit / 64] & mask))
+    {
+        return BROADCAST_RELAYED;
+    }
+
+    window->last_seen = now;
+
+    if (window->seen[bit / 64] & mask)
+    {
+        return BROADCAST_SEEN;
+    }
+
+    window->seen[bit / 64] |= mask;
+    return BROADCAST_NEW;
+}
+
+/**
+ * @brief Marks a broadcast as relayed by this node.
+ *
+ * @param window The window of the origin, after broadcast_window_check().
+ * @param id The message ID of the broadcast.
+ */
+static void broadcast_window_relayed(broadcast_window_t *window, uint16_t id)
+{
+    unsigned bit = id % BROADCAST_WINDOW_SIZE;
+    window->relayed[bit / 64] |= 1ULL << (bit % 64);
+}
+
+/**
+ * @brief Tells whether an edge is short enough to pass broadcasts.
+ *
+ * Only the configured weight counts. A congestion penalty moves unicast
+ * routes off the link but does not cut its nodes off from broadcasts.
+ *
+ * @param edge The edge.
+ * @return true if the edge is a broadcast link.
+ */
+static bool broadcast_edge(const edge_t *edge)
+{
+    return edge->weight - edge->penalty <= BROADCAST_MAX_WEIGHT;
+}
+
+/**
+ * @brief Tells whether two nodes are linked closely enough to pass broadcasts.
+ *
+ * @param graph The topology.
+ * @param u One node.
+ * @param v The other node.
+ * @return true if u and v are distinct neighbors over a broadcast link.
+ */
+static bool broadcast_link(const graph_t *graph, int u, int v)
+{
+    for (int k = 0; u != v && k < graph->degrees[u]; k++)
+    {
+        if (graph->adjacency[u][k].target == v)
+        {
+            return broadcast_edge(&graph->adjacency[u][k]);
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Orders node identifiers for qsort().
+ */
+static int compare_nodes(const void *a, const void *b)
+{
+    return *(const int *)a - *(const int *)b;
+}
+
+/**
+ * @brief Selects the multipoint relays of a node.
+ *
+ * The relays are a small set of neighbors that together reach every
+ * two-hop neighbor, chosen with the greedy heuristic of OLSR (RFC 3626,
+ * section 8.3.1): first the neighbors that are the only way to some two-hop
+ * neighbor, then repeatedly the neighbor that reaches the most two-hop
+ * neighbors not reached yet. The selection only depends on the topology,
+ * so every node computes the same relays for a given node.
+ *
+ * @param graph The topology.
+ * @param u The node whose relays are selected.
+ * @return For each neighbor of u, in adjacency order, whether it is a relay,
+ *         or NULL if memory allocation failed.
+ */
+static bool *select_relays(const graph_t *graph, int u)
+{
+    int degree = graph->degrees[u];
+    const edge_t *links = graph->adjacency[u];
+    int candidates = 0;
+
+    for (int k = 0; k < degree; k++)
+    {
+        candidates += graph->degrees[links[k].target];
+    }
+
+    bool *relays = calloc(degree > 0 ? degree : 1, sizeof(bool));
+    int *two_hop = malloc((candidates > 0 ? candidates : 1) * sizeof(int));
+    bool *covered = calloc(candidates > 0 ? candidates : 1, sizeof(bool));
+
+    if (!relays || !two_hop || !covered)
+    {
+        free(relays);
+        free(two_hop);
+        free(covered);
+        return NULL;
+    }
+
+    int num_two_hop = 0;
+
+    for (int k = 0; k < degree; k++)
+    {
+        int neighbor = links[k].target;
+        if (!broadcast_edge(&links[k]))
+        {
+            continue;
+        }
+
+        for (int j = 0; j < graph->degrees[neighbor]; j++)
+        {
+            int target = graph->adjacency[neighbor][j].target;
+            if (broadcast_edge(&graph->adjacency[neighbor][j]) && target != u &&
+                !broadcast_link(graph, u, target))
+            {
+                two_hop[num_two_hop++] = target;
+            }
+        }
+    }
+
+    qsort(two_hop, num_two_hop, sizeof(int), compare_nodes);
+
+    int unique = 0;
+    for (int i = 0; i < num_two_hop; i++)
+    {
+        if (unique == 0 || two_hop[unique - 1] != two_hop[i])
+        {
+            two_hop[unique++] = two_hop[i];
+        }
+    }
+    num_two_hop = unique;
+
+    for (int i = 0; i < num_two_hop; i++)
+    {
+        int only = -1;
+        int reaching = 0;
+
+        for (int k = 0; k < degree && reaching < 2; k++)
+        {
+            if (broadcast_edge(&links[k]) && broadcast_link(graph, links[k].target, two_hop[i]))
+            {
+                only = k;
+                reaching++;
+            }
+        }
+
+        if (reaching == 1)
+        {
+            relays[only] = true;
+        }
+    }
+
+    int uncovered = num_two_hop;
+
+    while (1)
+    {
+        for (int i = 0; i < num_two_hop; i++)
+        {
+            for (int k = 0; k < degree && !covered[i]; k++)
+            {
+                if (relays[k] && broadcast_link(graph, links[k].target, two_hop[i]))
+                {
+                    covered[i] = true;
+                    uncovered--;
+                }
+            }
+        }
+
+        if (uncovered == 0)
+        {
+            break;
+        }
+
+        int best = -1;
+        int best_count = 0;
+
+        for (int k = 0; k < degree; k++)
+        {
+            if (relays[k] || !broadcast_edge(&links[k]))
+            {
+                continue;
+            }
+
+            int count = 0;
+            for (int i = 0; i < num_two_hop; i++)
+            {
+                if (!covered[i] && broadcast_link(graph, links[k].target, two_hop[i]))
+                {
+                    count++;
+                }
+            }
+
+            if (count > best_count)
+            {
+                best = k;
+                best_count = count;
+            }
+        }
+
+        if (best == -1)
+        {
+            break;
+        }
+        relays[best] = true;
+    }
+
+    free(two_hop);
+    free(covered);
+    return relays;
+}
+
+/**
+ * @brief Drops the cached relays and trees if the topology changed.
+ *
+ * Must be called with the view locked for reading.
+ *
+ * @param node The current node.
+ * @return 0 on success, -1 if memory allocation failed.
+ */
+static int node_check_relays(node_t *node)
+{
+    int num_nodes = node->view->cache.graph.num_nodes;
+
+    if (node->relays && node->relays_epoch == node->view->cache.epoch)
+    {
+        return 0;
+    }
+
+    node_release_relays(node);
+    node->relays = calloc(num_nodes, sizeof(bool *));
+    node->broadcast_trees = calloc(num_nodes, sizeof(uint8_t *));
+    if (!node->relays || !node->broadcast_trees)
+    {
+        free(node->relays);
+        free(node->broadcast_trees);
+        node->relays = NULL;
+        node->broadcast_trees = NULL;
+        return -1;
+    }
+    node->relays_count = num_nodes;
+    node->relays_epoch = node->view->cache.epoch;
+    return 0;
+}
+
+/**
+ * @brief Returns the multipoint relays of a node.
+ *
+ * Each set is selected the first time it is needed and kept until the
+ * topology changes.
+ * Must be called with the view locked for reading.
+ *
+ * @param node The current node.
+ * @param u The node whose relays are needed.
+ * @return The relays, as returned by select_relays(), or NULL if memory
+ *         allocation failed.
+ */
+static const bool *node_relays(node_t *node, int u)
+{
+    if (node_check_relays(node) == -1)
+    {
+        return NULL;
+    }
+
+    if (!node->relays[u])
+    {
+        node->relays[u] = select_relays(&node->view->cache.graph, u);
+    }
+    return node->relays[u];
+}
+
+/**
+ * @brief Builds the part of a broadcast tree that hangs from the node.
+ *
+ * The tree replays MPR flooding from the origin one hop at a time: the
+ * relays at one hop reach every node they link to that is not reached yet,
+ * and a node reached at the next hop becomes a relay if any relay at this
+ * hop selected it. The multipoint relays cover every two-hop neighbor, so
+ * the tree reaches every node at its distance from the origin, and since
+ * every node builds the same tree, each node is sent exactly one copy.
+ * Must be called with the view locked for reading.
+ *
+ * @param node The current node.
+ * @param origin The node the broadcasts start from.
+ * @return For each neighbor of the node, in adjacency order, a
+ *         broadcast_child, or NULL if memory allocation failed.
+ */
+static uint8_t *broadcast_tree_build(node_t *node, int origin)
+{
+    const graph_t *graph = &node->view->cache.graph;
+    int num_nodes = graph->num_nodes;
+    int degree = graph->degrees[node->id];
+
+    int *hops = malloc(num_nodes * sizeof(int));
+    int *parents = malloc(num_nodes * sizeof(int));
+    int *queue = malloc(num_nodes * sizeof(int));
+    bool *relaying = calloc(num_nodes, sizeof(bool));
+    uint8_t *children = calloc(degree > 0 ? degree : 1, sizeof(uint8_t));
+
+    if (!hops || !parents || !queue || !relaying || !children)
+    {
+        free(hops);
+        free(parents);
+        free(queue);
+        free(relaying);
+        free(children);
+        return NULL;
+    }
+
+    for (int i = 0; i < num_nodes; i++)
+    {
+        hops[i] = -1;
+        parents[i] = -1;
+    }
+
+    int head = 0;
+    int tail = 0;
+
+    hops[origin] = 0;
+    relaying[origin] = true;
+    queue[tail++] = origin;
+
+    while (head < tail && children)
+    {
+        int relay = queue[head++];
+        const bool *relays = node_relays(node, relay);
+        if (!relays)
+        {
+            free(children);
+            children = NULL;
+            break;
+        }
+
+        for (int k = 0; k < graph->degrees[relay]; k++)
+        {
+            int target = graph->adjacency[relay][k].target;
+            if (target == relay || !broadcast_edge(&graph->adjacency[relay][k]))
+            {
+                continue;
+            }
+
+            if (hops[target] == -1)
+            {
+                hops[target] = hops[relay] + 1;
+                parents[target] = relay;
+            }
+            if (relays[k] && !relaying[target] && hops[target] == hops[relay] + 1)
+            {
+                relaying[target] = true;
+                parents[target] = relay;
+                queue[tail++] = target;
+            }
+        }
+    }
+
+    for (int k = 0; children && k < degree; k++)
+    {
+        int target = graph->adjacency[node->id][k].target;
+        if (parents[target] == node->id && broadcast_edge(&graph->adjacency[node->id][k]))
+        {
+            children[k] = relaying[target] ? BROADCAST_RELAY_COPY : BROADCAST_COPY;
+        }
+    }
+
+    free(hops);
+    free(parents);
+    free(queue);
+    free(relaying);
+    return children;
+}
+
+/**
+ * @brief Returns the neighbors the node passes the broadcasts of an origin to.
+ *
+ * The tree of each origin is built the first time the node relays one of
+ * its broadcasts and kept until the topology changes.
+ * Must be called with the view locked for reading.
+ *
+ * @param node The current node.
+ * @param origin The node the broadcasts start from.
+ * @return The children, as returned by broadcast_tree_build(), or NULL if
+ *         memory allocation failed.
+ */
+static const uint8_t *node_broadcast_tree(node_t *node, int origin)
+{
+    if (node_check_relays(node) == -1)
+    {
+        return NULL;
+    }
+
+    if (!node->broadcast_trees[origin])
+    {
+        node->broadcast_trees[origin] = broadcast_tree_build(node, origin);
+        if (!node->broadcast_trees[origin])
+        {
+            log_message("CLIENT", MSG_TYPE_ERROR, "Failed to allocate the broadcast tree");
+        }
+    }
+    return node->broadcast_trees[origin];
+}
+
+/**
+ * @brief Sends one encoded broadcast to a batch of neighbors.
+ *
+ * @param node The current node.
+ * @param neighbors The neighbors to send to.
+ * @param count Number of neighbors.
+ * @param wire The encoded packet.
+ */
+static void broadcast_flush(node_t *node, const int *neighbors, int count, const packet_wire_t *wire)
+{
+    int sent = node->transport->send_many(node->transport, neighbors, count, wire->iov, wire->count);
+
+    metrics_add(node->metrics, METRIC_FORWARDED, sent);
+    metrics_add(node->metrics, METRIC_SEND_FAILURES, count - sent);
+
+    if (sent < count)
+    {
+        log_message("CLIENT", MSG_TYPE_ERROR, "Broadcast sendmmsg() failed to %d of %d nodes", count - sent, count);
+    }
+    log_message("CLIENT", MSG_TYPE_INFO, "Broadcast packet sent to %d nodes", sent);
+}
+
+/**
+ * @brief Broadcast packet sending.
+ *
+ * The function processes broadcast packets by checking for duplicates by
+ * origin and message ID, and retransmits each broadcast at most once to the
+ * neighbors within BROADCAST_RADIUS hops of the origin.
+ * The first copy of a broadcast is reported to the node's delivery handler.
+ *
+ * A flooded packet is sent to every neighbor except those the node it came
+ * from already reached. Packets flagged with PACKET_FLAG_MPR follow the
+ * broadcast tree of their origin instead: the node only sends to its
+ * children, the copies sent to relays carry PACKET_FLAG_RELAY, and only a
+ * node that receives such a copy retransmits. If the tree cannot be built,
+ * the node floods the packet with every copy flagged as relay.
+ *
+ * Each copy is encoded once and handed to the transport in batches of
+ * neighbors, which UDP sends with a single system call per batch.
+ * Must be called with the view locked for reading.
+ *
+ * @param node The current node.
+ * @param packet Pointer to the packet to be sent.
+ */
+void broadcast_signal(node_t *node, packet_t *packet)
+{
+    const graph_t *graph = &node->view->cache.graph;
+    mac_packet_t *mac_packet = &packet->mac_packet;
+    const app_packet_t *app_packet = &mac_packet->app_packet;
+
+    if (app_packet->app_sender >= node->view->topology->num_nodes)
+    {
+        log_message("CLIENT", MSG_TYPE_NOT_VALID_DATA, "Broadcast from unknown node %d, packet dropped", app_packet->app_sender);
+        return;
+    }
+
+    broadcast_window_t *window = &node->broadcast_windows[app_packet->app_sender];
+    broadcast_state state = broadcast_window_check(window, app_packet->message_id, metrics_clock());
+
+    if (state == BROADCAST_NEW)
+    {
+        if (node->on_delivery)
+        {
+            node->on_delivery(node, packet, node->delivery_context);
+        }
+    }
+    else
+    {
+        metrics_add(node->metrics, METRIC_DUPLICATE_BROADCASTS, 1);
+    }
+
+    bool origin = mac_packet->hops == 0;
+    bool mpr = (mac_packet->flags & PACKET_FLAG_MPR) != 0;
+    bool selected = origin || !mpr || (mac_packet->flags & PACKET_FLAG_RELAY);
+    bool in_radius = mac_packet->radius == 0 || mac_packet->hops < mac_packet->radius;
+
+    if (state == BROADCAST_RELAYED || !selected || !in_radius)
+    {
+        if (state != BROADCAST_NEW)
+        {
+            log_message("CLIENT", MSG_TYPE_NOT_VALID_DATA, "Duplicate broadcast packet received, packet dropped");
+        }
+        return;
+    }
+
+    broadcast_window_relayed(window, app_packet->message_id);
+
+    const uint8_t *children = NULL;
+    int degree = graph->degrees[node->id];
+    int previous = -1;
+
+    for (int k = 0; !origin && k < degree; k++)
+    {
+        if (graph->adjacency[node->id][k].target == mac_packet->relay)
+        {
+            previous = k;
+            break;
+        }
+    }
+
+    if (mpr)
+    {
+        children = node_broadcast_tree(node, app_packet->app_sender);
+    }
+
+    mac_packet->hops++;
+    mac_packet->relay = node->id;
+    mac_packet->flags &= ~PACKET_FLAG_RELAY;
+    mac_packet->crc = packet_mac_crc(packet);
+
+    packet_wire_t wire;
+    packet_wire_t relay_wire;
+
+    uint64_t start = metrics_clock();
+    packet_serialize(packet, &wire);
+    metrics_observe(node->metrics, METRIC_COMPRESS_TIME, start);
+
+    if (mpr)
+    {
+        relay_wire = wire;
+        mac_packet->flags |= PACKET_FLAG_RELAY;
+        mac_packet->crc = packet_mac_crc(packet);
+        packet_serialize_header(packet, &relay_wire);
+    }
+
+    int neighbors[SEND_BATCH_SIZE];
+    int relay_targets[SEND_BATCH_SIZE];
+    int count = 0;
+    int relay_count = 0;
+
+    for (int k = 0; k < degree; k++)
+    {
+        int target = graph->adjacency[node->id][k].target;
+
+        if (!broadcast_edge(&graph->adjacency[node->id][k]) || k == previous)
+        {
+            continue;
+        }
+
+        if (children ? children[k] == BROADCAST_SKIP
+                     : previous != -1 && broadcast_link(graph, graph->adjacency[node->id][previous].target, target))
+        {
+            continue;
+        }
+
+        bool relay = mpr && (!children || children[k] == BROADCAST_RELAY_COPY);
+
+        if (relay)
+        {
+            relay_targets[relay_count++] = target;
+            if (relay_count == SEND_BATCH_SIZE)
+            {
+                broadcast_flush(node, relay_targets, relay_count, &relay_wire);
+                relay_count = 0;
+            }
+        }
+        else
+        {
+            neighbors[count++] = target;
+            if (count == SEND_BATCH_SIZE)
+            {
+                broadcast_flush(node, neighbors, count, &wire);
+                count = 0;
+            }
+        }
+    }
+
+    if (relay_count > 0)
+    {
+        broadcast_flush(node, relay_targets, relay_count, &relay_wire);
+    }
+    if (count > 0)
+    {
+        broadcast_flush(node, neighbors, count, &wire);
+    }
+}
+
+/**
+ * @brief Sending a packet to the next node.
+ *
+ * The function handles the sending of the packet. If the TTL of the packet has expired, it is discarded.
+ * Otherwise, the next node to route the packet is determined. Packets from the
+ * same sender to the same receiver form a flow, which keeps to one of the
+ * shortest paths, while different flows are spread over all of them.
+ * A node in reliable mode sends the packet over its link to the next node,
+ * which retransmits it until it is acknowledged.
+ * Must be called with the view locked for reading.
+ *
+ * @param node The current node.
+ * @param packet Pointer to the packet to be sent.
+ */
+void send_packet(node_t *node, packet_t *packet)
+{
+    if (packet->mac_packet.ttl == 0)
+    {
+        metrics_add(node->metrics, METRIC_TTL_DROPS, 1);
+        log_message("CLIENT", MSG_TYPE_NOT_VALID_DATA, "TTL expired, packet dropped");
+        return;
+    }
+
+    packet->mac_packet.ttl--;
+
+    if (packet->mac_packet.mac_receiver == BROADCAST_NODE)
+    {
+        broadcast_signal(node, packet);
+        return;
+    }
+
+    const app_packet_t *app_packet = &packet->mac_packet.app_packet;
+    uint32_t flow = (uint32_t)app_packet->app_sender << 16 | app_packet->app_receiver;
+    int next_node = find_next_hop(node, packet->mac_packet.mac_receiver, flow);
+
+    if (next_node == -1)
+    {
+        log_message("CLIENT", MSG_TYPE_ERROR, "Next hop not found, packet dropped");
+        return;
+    }
+
+    link_t *link = node->reliable ? link_open(&node->links, next_node) : NULL;
+
+    packet->mac_packet.relay = node->id;
+    if (link)
+    {
+        packet->mac_packet.flags |= PACKET_FLAG_RELIABLE;
+        packet->link.session = node->links.session;
+        packet->link.sequence = link->next_sequence;
+        packet->link.base = link->base;
+    }
+    packet->mac_packet.crc = packet_mac_crc(packet);
+
+    packet_wire_t wire;
+
+    uint64_t start = metrics_clock();
+    packet_serialize(packet, &wire);
+    metrics_observe(node->metrics, METRIC_COMPRESS_TIME, start);
+
+    if (link)
+    {
+        if (link_send(&node->links, link, wire.iov, wire.count) == -1)
+        {
+            metrics_add(node->metrics, METRIC_SEND_FAILURES, 1);
+            log_message("CLIENT", MSG_TYPE_ERROR, "Link to node %d is full, packet dropped", next_node);
+        }
+        else
+        {
+            log_message("CLIENT", MSG_TYPE_INFO, "Sent MAC packet from %d to node %d, ttl %d, link packet %u",
+                        node->id, next_node, packet->mac_packet.ttl, packet->link.sequence);
+        }
+    }
+    else if (node->transport->send(node->transport, next_node, wire.iov, wire.count) == -1)
+    {
+        metrics_add(node->metrics, METRIC_SEND_FAILURES, 1);
+        log_message("CLIENT", MSG_TYPE_ERROR, "sendto() failed");
+    }
+    else
+    {
+        metrics_add(node->metrics, METRIC_FORWARDED, 1);
+        log_message("CLIENT", MSG_TYPE_INFO, "Sent MAC packet from %d to node %d, ttl %d", node->id, next_node, packet->mac_packet.ttl);
+    }
+}
+
+/**
+ * @brief Reassembles a fragment delivered to the node.
+ *
+ * A transfer counts as one delivery when its last missing fragment arrives.
+ * The delivery handler then gets the first fragment, whose trace, if any,
+ * is completed with the time the whole transfer took. Transfers that stopped
+ * receiving fragments are given up first, to free their slots, as node_poll()
+ * also does while no fragment arrives.
+ *
+ * @param node The destination node.
+ * @param packet The fragment.
+ */
+static void node_reassemble(node_t *node, const packet_t *packet)
+{
+    const app_packet_t *app_packet = &packet->mac_packet.app_packet;
+    uint64_t now = metrics_clock();
+    reassembly_t *transfer;
+
+    metrics_add(node->metrics, METRIC_REASSEMBLY_TIMEOUTS, reassembly_expire(&node->reassembly, now));
+
+    switch (reassembly_add(&node->reassembly, packet, now, &transfer))
+    {
+    case REASSEMBLY_COMPLETE:
+    {
+        packet_trace_t *trace = &transfer->first.trace;
+        if (trace->count > 0)
+        {
+            uint64_t elapsed = now > trace->sent_at ? now - trace->sent_at : 0;
+            trace->hops[trace->count - 1].elapsed = elapsed < UINT32_MAX ? elapsed : UINT32_MAX;
+        }
+
+        metrics_add(node->metrics, METRIC_DELIVERED, 1);
+        if (node->on_delivery)
+        {
+            node->on_delivery(node, &transfer->first, node->delivery_context);
+        }
+        log_message("CLIENT", MSG_TYPE_INFO, "Transfer %d from node %d complete: %llu bytes in %d fragments, CRC32C %08x",
+                    transfer->transfer_id, transfer->origin, (unsigned long long)transfer->size, transfer->fragment_count, transfer->crc);
+        reassembly_finish(transfer);
+        break;
+    }
+    case REASSEMBLY_DUPLICATE:
+        log_message("CLIENT", MSG_TYPE_NOT_VALID_DATA, "Duplicate fragment %d of transfer %d from node %d, fragment dropped",
+                    app_packet->fragment_index, app_packet->transfer_id, app_packet->app_sender);
+        break;
+    case REASSEMBLY_DROPPED:
+        metrics_add(node->metrics, METRIC_FRAGMENT_DROPS, 1);
+        log_message("CLIENT", MSG_TYPE_ERROR, "Fragment %d of %d of transfer %d from node %d cannot be reassembled, fragment dropped",
+                    app_packet->fragment_index, app_packet->fragment_count, app_packet->transfer_id, app_packet->app_sender);
+        break;
+    default:
+        break;
+    }
+}
+
+/**
+ * @brief Processes a single datagram received by the node.
+ *
+ * The function decodes the packet and checks its version and CRCs before
+ * trusting any other field. It then refreshes the topology view if the
+ * packet was stamped with a newer epoch, and either consumes the packet or
+ * forwards it. A packet received over a reliable link is dropped if it is
+ * a retransmission the node already has. Acknowledgements of the node's own
+ * reliable links are handed to them.
+ *
+ * @param node The receiving node.
+ * @param data The received datagram.
+ * @param size The size of the datagram in bytes.
+ */
+void node_handle_packet(node_t *node, const char *data, size_t size)
+{
+    packet_t parsed;
+    packet_t *packet = &parsed;
+
+    if (size > 0 && (unsigned char)data[0] == LINK_ACK_TYPE)
+    {
+        link_handle_ack(&node->links, data, size);
+        return;
+    }
+
+    metrics_add(node->metrics, METRIC_RECEIVED, 1);
+
+    uint64_t start = metrics_clock();
+    packet_parse_result parse_result = packet_parse(data, size, packet);
+    metrics_observe(node->metrics, METRIC_DECOMPRESS_TIME, start);
+
+    if (parse_result == PACKET_PARSE_DECOMPRESSION)
+    {
+        metrics_add(node->metrics, METRIC_DECOMPRESSION_FAILURES, 1);
+        log_message("CLIENT", MSG_TYPE_ERROR, "Decompression failed");
+        return;
+    }
+    else if (parse_result == PACKET_PARSE_VERSION)
+    {
+        log_message("CLIENT", MSG_TYPE_NOT_VALID_DATA, "Unsupported packet version %d, packet dropped", (unsigned char)data[0]);
+        return;
+    }
+    else if (parse_result != PACKET_PARSE_OK)
+    {
+        log_message("CLIENT", MSG_TYPE_NOT_VALID_DATA, "Malformed packet of %zu bytes, packet dropped", size);
+        return;
+    }
+
+    uint32_t mac_crc = packet_mac_crc(packet);
+
+    uint32_t app_crc = packet_app_crc(&packet->mac_packet.app_packet);
+
+    if (packet->mac_packet.crc != mac_crc || packet->mac_packet.app_packet.crc != app_crc)
+    {
+        metrics_add(node->metrics, METRIC_CRC_FAILURES, 1);
+        log_message("CLIENT", MSG_TYPE_ERROR, "Received packet with invalid CRC. Calculated MAC CRC: %u. Calculated APP CRC: %u", mac_crc, app_crc);
+        return;
+    }
+
+    topology_view_read_lock(node->view);
+
+    if (packet->topology_epoch > node->view->cache.epoch)
+    {
+        topology_view_unlock(node->view);
+        topology_view_refresh(node->view);
+        topology_view_read_lock(node->view);
+    }
+
+    if (packet->mac_packet.flags & PACKET_FLAG_RELIABLE)
+    {
+        packet->mac_packet.flags &= ~PACKET_FLAG_RELIABLE;
+
+        if (!link_accept(&node->links, packet->mac_packet.relay, &packet->link))
+        {
+            metrics_add(node->metrics, METRIC_LINK_DUPLICATES, 1);
+            log_message("CLIENT", MSG_TYPE_NOT_VALID_DATA, "Duplicate link packet %u from node %d, packet dropped",
+                        packet->link.sequence, packet->mac_packet.relay);
+            topology_view_unlock(node->view);
+            return;
+        }
+    }
+
+    if (packet->mac_packet.flags & PACKET_FLAG_TRACE)
+    {
+        packet_trace_hop(packet, node->id, metrics_clock());
+    }
+
+    if (packet->mac_packet.mac_receiver == node->id && (packet->mac_packet.flags & PACKET_FLAG_FRAGMENT))
+    {
+        node_reassemble(node, packet);
+    }
+    else if (packet->mac_packet.mac_receiver == node->id)
+    {
+        metrics_add(node->metrics, METRIC_DELIVERED, 1);
+        if (node->on_delivery)
+        {
+            node->on_delivery(node, packet, node->delivery_context);
+        }
+        log_message("CLIENT", MSG_TYPE_INFO, "Message for this node: %s", packet->mac_packet.app_packet.message);
+    }
+    else if (packet->mac_packet.ttl > 0)
+    {
+        send_packet(node, packet);
+    }
+    else
+    {
+        metrics_add(node->metrics, METRIC_TTL_DROPS, 1);
+        log_message("CLIENT", MSG_TYPE_NOT_VALID_DATA, "TTL expired, packet dropped");
+    }
+
+    topology_view_unlock(node->view);
+}
+
+/**
+ * @brief Runs the timers of a node.
+ *
+ * The links send their pending acknowledgements and retransmit expired
+ * packets, and transfers that stopped receiving fragments are given up, so
+ * an abandoned transfer does not keep its slot and buffer on an idle node.
+ *
+ * @param node The node.
+ * @param now The current time in nanoseconds.
+ * @return How long to wait for datagrams before the next call, in milliseconds,
+ *         or -1 if no timer is armed.
+ */
+int node_poll(node_t *node, uint64_t now)
+{
+    int timeout = link_poll(&node->links, now);
+
+    metrics_add(node->metrics, METRIC_REASSEMBLY_TIMEOUTS, reassembly_expire(&node->reassembly, now));
+
+    int expiry = reassembly_timeout(&node->reassembly, now);
+    if (expiry != -1 && (timeout == -1 || expiry < timeout))
+    {
+        timeout = expiry;
+    }
+
+    return timeout;
+}
@@ -4,16 +4,16 @@
 #include "graph.h"
 
 /**
- * @brief Adds edges to the graph as an adjacency matrix.
+ * @brief Adds the edges of a square grid to the graph.
  *
- * The function adds edges between nodes in a matrix representing the graph.
+ * The function lays the nodes out as a matrix_size x matrix_size grid.
  * It creates edges between the current node and its right, bottom, and
  * diagonal neighbors (bottom right and bottom left).
  *
  * @param matrix_size Matrix size (number of nodes in row and column).
- * @param graph The adjacency matrix representing the graph.
+ * @param graph The graph to add the edges to.
  */
-void add_edges(int matrix_size, int graph[MAX_NODES][MAX_NODES])
+void add_edges(int matrix_size, graph_t *graph)
 {
     for (int row = 0; row < matrix_size; row++)
     {
@@ -53,24 +53,97 @@ void add_edges(int matrix_size, int graph[MAX_NODES][MAX_NODES])
 }
 
 /**
- * @brief Initializes the graph by filling it with INF values.
+ * @brief Initializes an empty graph with the given number of nodes.
  *
- * Function sets the weights of edges between nodes. For nodes that reference themselves,
- * is set to weight 0, for all others - INF (infinity).
+ * Every node starts without edges. The adjacency lists grow on demand as
+ * edges are added, so memory is proportional to the number of edges rather
+ * than to the square of the number of nodes.
  *
- * @param size Size of the graph.
- * @param graph The adjacency matrix for initialization.
+ * @param graph The graph to initialize. Must be released with free_graph().
+ * @param num_nodes Number of nodes in the graph.
+ * @return 0 on success, -1 if memory allocation failed.
  */
-void initialize_graph(int size, int graph[MAX_NODES][MAX_NODES])
+int initialize_graph(graph_t *graph, int num_nodes)
 {
-    for (int i = 0; i < size; i++)
+    graph->num_nodes = num_nodes;
+    graph->degrees = calloc(num_nodes, sizeof(int));
+    graph->capacities = calloc(num_nodes, sizeof(int));
+    graph->adjacency = calloc(num_nodes, sizeof(edge_t *));
+
+    if (!graph->degrees || !graph->capacities || !graph->adjacency)
+    {
+        free_graph(graph);
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Releases the memory owned by a graph.
+ *
+ * @param graph The graph to release.
+ */
+void free_graph(graph_t *graph)
+{
+    if (graph->adjacency)
     {
-        for (int j = 0; j < size; j++)
+        for (int i = 0; i < graph->num_nodes; i++)
         {
-            if (i == j)
-                graph[i][j] = 0;
-            else
-                graph[i][j] = INF;
+            free(graph->adjacency[i]);
+        }
+    }
+
+    free(graph->degrees);
+    free(graph->capacities);
+    free(graph->adjacency);
+    memset(graph, 0, sizeof(graph_t));
+}
+
+/**
+ * @brief Sets the weight of the directed edge u -> v, appending it if missing.
+ *
+ * @return 0 on success, -1 if memory allocation failed.
+ */
+static int set_directed_edge(int u, int v, int weight, int penalty, graph_t *graph)
+{
+    for (int i = 0; i < graph->degrees[u]; i++)
+    {
+        if (graph->adjacency[u][i].target == v)
+        {
+            graph->adjacency[u][i].weight = weight;
+            graph->adjacency[u][i].penalty = penalty;
+            return 0;
+        }
+    }
+
+    if (graph->degrees[u] == graph->capacities[u])
+    {
+        int capacity = graph->capacities[u] ? graph->capacities[u] * 2 : 8;
+        edge_t *edges = realloc(graph->adjacency[u], capacity * sizeof(edge_t));
+        if (!edges)
+        {
+            return -1;
+        }
+        graph->adjacency[u] = edges;
+        graph->capacities[u] = capacity;
+    }
+
+    graph->adjacency[u][graph->degrees[u]++] = (edge_t){.target = v, .weight = weight, .penalty = penalty};
+    return 0;
+}
+
+/**
+ * @brief Removes the directed edge u -> v if it exists.
+ */
+static void remove_directed_edge(int u, int v, graph_t *graph)
+{
+    for (int i = 0; i < graph->degrees[u]; i++)
+    {
+        if (graph->adjacency[u][i].target == v)
+        {
+            graph->adjacency[u][i] = graph->adjacency[u][--graph->degrees[u]];
+            return;
         }
     }
 }
@@ -78,95 +151,430 @@ void initialize_graph(int size, int graph[MAX_NODES][MAX_NODES])
 /**
  * @brief Adds an edge between two nodes in a graph.
  *
- * The function sets the weight of edges between nodes u and v in the adjacency matrix.
+ * The function sets the weight of edges between nodes u and v, adding them if they do not exist.
  * The edges are added in both directions so that the graph is undirected.
+ * A weight of INF removes the edge.
  *
  * @param u First node.
  * @param v Second node.
  * @param weight Weight of the edges.
- * @param graph The adjacency matrix representing the graph.
+ * @param graph The graph to modify.
+ * @return 0 on success, -1 if memory allocation failed.
+ */
+int add_edge(int u, int v, int weight, graph_t *graph)
+{
+    return add_penalized_edge(u, v, weight, 0, graph);
+}
+
+/**
+ * @brief Adds an edge whose weight includes a congestion penalty.
+ *
+ * Shortest paths follow the whole weight, while broadcasts only look at the
+ * configured part, so a congested link still carries them.
+ *
+ * @param u First node.
+ * @param v Second node.
+ * @param weight Weight of the edges, penalty included. INF removes the edge.
+ * @param penalty Part of the weight added because the link is congested.
+ * @param graph The graph to modify.
+ * @return 0 on success, -1 if memory allocation failed.
  */
-void add_edge(int u, int v, int weight, int graph[MAX_NODES][MAX_NODES])
+int add_penalized_edge(int u, int v, int weight, int penalty, graph_t *graph)
 {
-    graph[u][v] = weight;
-    graph[v][u] = weight;
+    if (weight == INF)
+    {
+        remove_directed_edge(u, v, graph);
+        remove_directed_edge(v, u, graph);
+        return 0;
+    }
+
+    if (set_directed_edge(u, v, weight, penalty, graph) == -1 || set_directed_edge(v, u, weight, penalty, graph) == -1)
+    {
+        return -1;
+    }
+    return 0;
 }
 
 /**
  * @brief Removes a node from the graph.
  *
- * The function sets the weight of edges coming from the node being removed to INF,
+ * The function deletes every edge coming from or to the node being removed,
  * thereby excluding it from the graph.
  *
  * @param node_id The node to be deleted.
- * @param graph The adjacency matrix representing the graph.
+ * @param graph The graph to modify.
  */
-void remove_node(int node_id, int graph[MAX_NODES][MAX_NODES])
+void remove_node(int node_id, graph_t *graph)
 {
-    for (int i = 0; i < MAX_NODES; i++)
+    for (int i = 0; i < graph->degrees[node_id]; i++)
     {
-        graph[node_id][i] = INF;
-        graph[i][node_id] = INF;
+        remove_directed_edge(graph->adjacency[node_id][i].target, node_id, graph);
     }
+    graph->degrees[node_id] = 0;
 }
 
 /**
- * @brief Implements Dijkstra's algorithm for finding shortest paths.
+ * @brief Returns the weight of the edge between two nodes.
  *
- * The function calculates the shortest distances from the initial node to all other nodes of the graph.
- * nodes of the graph using Dijkstra's algorithm. The predecessors of the nodes are also stored.
+ * @param graph The graph.
+ * @param u First node.
+ * @param v Second node.
+ * @return The weight of the edge, 0 if u == v, or INF if there is no edge.
+ */
+int get_edge_weight(const graph_t *graph, int u, int v)
+{
+    if (u == v)
+    {
+        return 0;
+    }
+
+    for (int i = 0; i < graph->degrees[u]; i++)
+    {
+        if (graph->adjacency[u][i].target == v)
+        {
+            return graph->adjacency[u][i].weight;
+        }
+    }
+    return INF;
+}
+
+/**
+ * @brief Builds a compressed sparse row (CSR) view of the graph.
  *
- * @param graph The adjacency matrix representing the graph.
- * @param start_node The starting node for computing shortest paths.
- * @param num_nodes Total number of nodes in the graph.
- * @param distances Array to store the shortest distances from the start node.
- * @param predecessors An array to store the predecessors of nodes.
+ * The neighbors of node u are stored contiguously in targets[offsets[u] .. offsets[u + 1]),
+ * with the matching edge weights in weights. Keeping the whole graph in three flat arrays
+ * makes the shortest path search walk memory sequentially.
+ *
+ * @param csr The CSR graph to fill. Must be released with csr_free().
+ * @param graph The graph to convert.
+ * @return 0 on success, -1 if memory allocation failed.
  */
-void dijkstra(int graph[MAX_NODES][MAX_NODES], int start_node, int num_nodes, int distances[MAX_NODES], int predecessors[MAX_NODES])
+int csr_build(csr_graph_t *csr, const graph_t *graph)
 {
-    bool visited[MAX_NODES];
+    int num_nodes = graph->num_nodes;
+    int num_edges = 0;
+    for (int u = 0; u < num_nodes; u++)
+    {
+        num_edges += graph->degrees[u];
+    }
 
-    for (int i = 0; i < num_nodes; i++)
+    csr->num_nodes = num_nodes;
+    csr->num_edges = num_edges;
+    csr->offsets = malloc((num_nodes + 1) * sizeof(int));
+    csr->targets = malloc((num_edges ? num_edges : 1) * sizeof(int));
+    csr->weights = malloc((num_edges ? num_edges : 1) * sizeof(int));
+
+    if (!csr->offsets || !csr->targets || !csr->weights)
     {
-        distances[i] = INF;
-        visited[i] = false;
-        predecessors[i] = -1;
+        csr_free(csr);
+        return -1;
     }
 
-    distances[start_node] = 0;
+    int edge = 0;
+    for (int u = 0; u < num_nodes; u++)
+    {
+        csr->offsets[u] = edge;
+        for (int i = 0; i < graph->degrees[u]; i++)
+        {
+            csr->targets[edge] = graph->adjacency[u][i].target;
+            csr->weights[edge] = graph->adjacency[u][i].weight;
+            edge++;
+        }
+    }
+    csr->offsets[num_nodes] = edge;
 
-    for (int i = 0; i < num_nodes; i++)
+    return 0;
+}
+
+/**
+ * @brief Releases the memory owned by a CSR graph.
+ *
+ * @param csr The CSR graph to release.
+ */
+void csr_free(csr_graph_t *csr)
+{
+    free(csr->offsets);
+    free(csr->targets);
+    free(csr->weights);
+    memset(csr, 0, sizeof(csr_graph_t));
+}
+
+/**
+ * @brief Removes a node from a CSR graph in place.
+ *
+ * The edges from and to the node keep their slots but get the weight INF,
+ * which the shortest path search skips.
+ *
+ * @param csr The CSR graph.
+ * @param node_id The node to be deleted.
+ */
+void csr_remove_node(csr_graph_t *csr, int node_id)
+{
+    for (int e = csr->offsets[node_id]; e < csr->offsets[node_id + 1]; e++)
     {
-        int min_distance = INF;
-        int u = -1;
+        int v = csr->targets[e];
+        csr->weights[e] = INF;
 
-        for (int j = 0; j < num_nodes; j++)
+        for (int back = csr->offsets[v]; back < csr->offsets[v + 1]; back++)
         {
-            if (!visited[j] && distances[j] < min_distance)
-            {
-                min_distance = distances[j];
-                u = j;
-            }
+            if (csr->targets[back] == node_id)
+                csr->weights[back] = INF;
         }
+    }
+}
+
+/**
+ * @brief Changes the weight of an existing edge of a CSR graph in place.
+ *
+ * Both directions of the edge are changed. Removed edges keep the weight INF.
+ *
+ * @param csr The CSR graph.
+ * @param u First node.
+ * @param v Second node.
+ * @param weight The new weight.
+ * @return 0 on success, -1 if the graph has no such edge.
+ */
+int csr_set_weight(csr_graph_t *csr, int u, int v, int weight)
+{
+    int forward = -1;
+    int backward = -1;
+
+    for (int e = csr->offsets[u]; e < csr->offsets[u + 1]; e++)
+    {
+        if (csr->targets[e] == v)
+            forward = e;
+    }
+    for (int e = csr->offsets[v]; e < csr->offsets[v + 1]; e++)
+    {
+        if (csr->targets[e] == u)
+            backward = e;
+    }
+
+    if (forward == -1 || backward == -1 || csr->weights[forward] == INF)
+    {
+        return -1;
+    }
 
-        if (u == -1)
+    csr->weights[forward] = weight;
+    csr->weights[backward] = weight;
+    return 0;
+}
+
+/**
+ * @brief Allocates a heap that can hold every node of a graph.
+ *
+ * @param heap The heap to initialize.
+ * @param num_nodes Number of nodes in the graph.
+ * @return 0 on success, -1 if memory allocation failed.
+ */
+int node_heap_init(node_heap_t *heap, int num_nodes)
+{
+    heap->nodes = malloc(num_nodes * sizeof(int));
+    heap->positions = malloc(num_nodes * sizeof(int));
+    heap->size = 0;
+    heap->keys = NULL;
+
+    if (!heap->nodes || !heap->positions)
+    {
+        node_heap_free(heap);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Releases the memory owned by a heap.
+ *
+ * @param heap The heap to release.
+ */
+void node_heap_free(node_heap_t *heap)
+{
+    free(heap->nodes);
+    free(heap->positions);
+    heap->nodes = NULL;
+    heap->positions = NULL;
+}
+
+/**
+ * @brief Swaps two heap entries and keeps the position index in sync.
+ */
+static void heap_swap(node_heap_t *heap, int i, int j)
+{
+    int a = heap->nodes[i];
+    int b = heap->nodes[j];
+    heap->nodes[i] = b;
+    heap->nodes[j] = a;
+    heap->positions[b] = i;
+    heap->positions[a] = j;
+}
+
+/**
+ * @brief Moves an entry towards the root until the heap order holds.
+ */
+static void heap_sift_up(node_heap_t *heap, int i)
+{
+    while (i > 0)
+    {
+        int parent = (i - 1) / 2;
+        if (heap->keys[heap->nodes[parent]] <= heap->keys[heap->nodes[i]])
+            break;
+        heap_swap(heap, i, parent);
+        i = parent;
+    }
+}
+
+/**
+ * @brief Moves an entry towards the leaves until the heap order holds.
+ */
+static void heap_sift_down(node_heap_t *heap, int i)
+{
+    while (1)
+    {
+        int smallest = i;
+        int left = 2 * i + 1;
+        int right = left + 1;
+
+        if (left < heap->size && heap->keys[heap->nodes[left]] < heap->keys[heap->nodes[smallest]])
+            smallest = left;
+        if (right < heap->size && heap->keys[heap->nodes[right]] < heap->keys[heap->nodes[smallest]])
+            smallest = right;
+        if (smallest == i)
             break;
 
-        visited[u] = true;
+        heap_swap(heap, i, smallest);
+        i = smallest;
+    }
+}
 
-        for (int v = 0; v < num_nodes; v++)
+/**
+ * @brief Inserts a node into the heap, or lowers its key if it is already there.
+ */
+static void heap_push_or_decrease(node_heap_t *heap, int node)
+{
+    if (heap->positions[node] == -1)
+    {
+        heap->nodes[heap->size] = node;
+        heap->positions[node] = heap->size;
+        heap->size++;
+    }
+    heap_sift_up(heap, heap->positions[node]);
+}
+
+/**
+ * @brief Removes and returns the node with the smallest key.
+ */
+static int heap_pop(node_heap_t *heap)
+{
+    int top = heap->nodes[0];
+    heap->size--;
+    if (heap->size > 0)
+    {
+        heap_swap(heap, 0, heap->size);
+        heap_sift_down(heap, 0);
+    }
+    heap->positions[top] = -2;
+    return top;
+}
+
+/**
+ * @brief Continues Dijkstra's algorithm from a set of already labelled nodes.
+ *
+ * The nodes in the frontier must have their tentative distances set. Every other
+ * node keeps its current distance unless a shorter path through the frontier is found.
+ * This allows the same engine to compute shortest paths from scratch and to repair
+ * them after part of the graph has changed. A caller that runs many searches can
+ * pass a heap sized with node_heap_init(); otherwise one is allocated for the search.
+ *
+ * @param graph The CSR graph.
+ * @param frontier Nodes to start the search from.
+ * @param frontier_count Number of nodes in the frontier.
+ * @param distances Array of current distances, updated in place.
+ * @param predecessors Array of current predecessors, updated in place.
+ * @param heap A heap for every node of the graph, or NULL.
+ * @return 0 on success, -1 if memory allocation failed.
+ */
+int dijkstra_resume(const csr_graph_t *graph, const int *frontier, int frontier_count, int *distances, int *predecessors,
+                    node_heap_t *heap)
+{
+    int num_nodes = graph->num_nodes;
+    node_heap_t local;
+
+    if (!heap)
+    {
+        if (node_heap_init(&local, num_nodes) == -1)
+        {
+            return -1;
+        }
+        heap = &local;
+    }
+
+    heap->size = 0;
+    heap->keys = distances;
+
+    for (int i = 0; i < num_nodes; i++)
+    {
+        heap->positions[i] = -1;
+    }
+
+    for (int i = 0; i < frontier_count; i++)
+    {
+        if (distances[frontier[i]] != INF)
+            heap_push_or_decrease(heap, frontier[i]);
+    }
+
+    while (heap->size > 0)
+    {
+        int u = heap_pop(heap);
+
+        for (int e = graph->offsets[u]; e < graph->offsets[u + 1]; e++)
         {
-            if (graph[u][v] != INF && !visited[v])
+            int v = graph->targets[e];
+            int weight = graph->weights[e];
+
+            if (weight == INF || heap->positions[v] == -2)
+                continue;
+
+            int alt = distances[u] + weight;
+            if (alt < distances[v])
             {
-                int alt = distances[u] + graph[u][v];
-                if (alt < distances[v])
-                {
-                    distances[v] = alt;
-                    predecessors[v] = u;
-                }
+                distances[v] = alt;
+                predecessors[v] = u;
+                heap_push_or_decrease(heap, v);
             }
         }
     }
+
+    if (heap == &local)
+    {
+        node_heap_free(&local);
+    }
+    return 0;
+}
+
+/**
+ * @brief Implements Dijkstra's algorithm for finding shortest paths.
+ *
+ * The function calculates the shortest distances from the initial node to all other
+ * nodes of the graph using a binary heap over the CSR adjacency, in O((V + E) log V).
+ * The predecessors of the nodes are also stored.
+ *
+ * @param graph The CSR graph.
+ * @param start_node The starting node for computing shortest paths.
+ * @param distances Array to store the shortest distances from the start node.
+ * @param predecessors An array to store the predecessors of nodes.
+ * @param heap A heap for every node of the graph, or NULL to allocate one.
+ * @return 0 on success, -1 if memory allocation failed.
+ */
+int dijkstra(const csr_graph_t *graph, int start_node, int *distances, int *predecessors, node_heap_t *heap)
+{
+    for (int i = 0; i < graph->num_nodes; i++)
+    {
+        distances[i] = INF;
+        predecessors[i] = -1;
+    }
+
+    distances[start_node] = 0;
+    return dijkstra_resume(graph, &start_node, 1, distances, predecessors, heap);
 }
 
 /**
@@ -180,7 +588,7 @@ void dijkstra(int graph[MAX_NODES][MAX_NODES], int start_node, int num_nodes, in
  * @param node The node for which you want to output the path.
  * @param predecessors An array of predecessors containing the path information.
  */
-void print_path(int node, int predecessors[MAX_NODES])
+void print_path(int node, const int *predecessors)
 {
     if (predecessors[node] == -1)
     {
@@ -201,7 +609,7 @@ void print_path(int node, int predecessors[MAX_NODES])
  * @param num_nodes The total number of nodes in the graph.
  * @param predecessors Array of node predecessors.
  */
-void print_paths(int start_node, int num_nodes, int predecessors[MAX_NODES])
+void print_paths(int start_node, int num_nodes, const int *predecessors)
 {
     for (int i = 0; i < num_nodes; i++)
     {
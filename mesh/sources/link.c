@@ -0,0 +1,759 @@
+#include "link.h"
+#include "logger.h"
+
+#define LINK_MS 1000000ull
+
+_Static_assert(LINK_WINDOW_SIZE <= 64, "the receive bitmap holds at most 64 sequences");
+
+/**
+ * @brief Initializes the reliable links of a node.
+ *
+ * The links themselves are allocated the first time the node sends to or
+ * receives from a neighbor in reliable mode, so nodes that never use it only
+ * pay for the table. The session tells the neighbors apart the links of
+ * successive runs of the node, whose sequences start over.
+ *
+ * @param table The links to initialize.
+ * @param node_id The node that owns the links.
+ * @param num_nodes Number of nodes in the network.
+ * @param transport The transport used to reach the neighbors.
+ * @param metrics Where the links count retransmissions and time round trips.
+ */
+void link_table_init(link_table_t *table, int node_id, int num_nodes, transport_t *transport, node_metrics_t *metrics)
+{
+    memset(table, 0, sizeof(link_table_t));
+    table->node_id = node_id;
+    table->num_nodes = num_nodes;
+    table->session = (uint16_t)(metrics_clock() ^ getpid());
+    table->transport = transport;
+    table->metrics = metrics;
+    table->deadline = UINT64_MAX;
+}
+
+/**
+ * @brief Drops the packets waiting for room in the window of a link.
+ *
+ * @param link The link.
+ * @return The number of packets dropped.
+ */
+static int link_drop_pending(link_t *link)
+{
+    int count = link->pending_count;
+
+    while (link->pending_head)
+    {
+        link_pending_t *pending = link->pending_head;
+        link->pending_head = pending->next;
+        free(pending);
+    }
+    link->pending_tail = NULL;
+    link->pending_count = 0;
+
+    return count;
+}
+
+/**
+ * @brief Releases the links of a node, with the packets still in flight.
+ *
+ * @param table The links to release.
+ */
+void link_table_free(link_table_t *table)
+{
+    for (int i = 0; i < table->active_count; i++)
+    {
+        link_t *link = table->links[table->active[i]];
+        link_drop_pending(link);
+        free(link);
+    }
+
+    free(table->links);
+    free(table->active);
+    table->links = NULL;
+    table->active = NULL;
+    table->active_count = 0;
+}
+
+/**
+ * @brief Finds the link to a neighbor, creating it if needed.
+ *
+ * @param table The links of the node.
+ * @param neighbor The neighbor.
+ * @return The link, or NULL if the neighbor is unknown or memory allocation failed.
+ */
+link_t *link_open(link_table_t *table, int neighbor)
+{
+    if (neighbor < 0 || neighbor >= table->num_nodes)
+    {
+        return NULL;
+    }
+
+    if (!table->links)
+    {
+        table->links = calloc(table->num_nodes, sizeof(link_t *));
+        table->active = calloc(table->num_nodes, sizeof(int));
+        if (!table->links || !table->active)
+        {
+            free(table->links);
+            free(table->active);
+            table->links = NULL;
+            table->active = NULL;
+            return NULL;
+        }
+    }
+
+    if (!table->links[neighbor])
+    {
+        link_t *link = calloc(1, sizeof(link_t));
+        if (!link)
+        {
+            return NULL;
+        }
+
+        link->neighbor = neighbor;
+        link->rto = LINK_RTO_INITIAL_MS * LINK_MS;
+        table->links[neighbor] = link;
+        table->active[table->active_count++] = neighbor;
+    }
+
+    return table->links[neighbor];
+}
+
+/**
+ * @brief Returns the first sequence of a link that was not transmitted yet.
+ *
+ * Sequences from the base up to it are in the window, and the packets
+ * after it wait in the queue.
+ *
+ * @param link The link.
+ * @return The sequence.
+ */
+static uint32_t link_unsent(const link_t *link)
+{
+    return link->next_sequence - link->pending_count;
+}
+
+/**
+ * @brief Transmits the packet held in a slot of the window and arms its timer.
+ *
+ * Every transmission carries the current start of the window, with the MAC
+ * checksum recomputed over it. The timeout doubles with every
+ * retransmission of the packet, up to LINK_RTO_MAX_MS. A transmission that
+ * fails is retried when it expires, like a packet lost on the way.
+ *
+ * @param table The links of the node.
+ * @param link The link.
+ * @param sequence The sequence of the packet.
+ * @param now The current time in nanoseconds.
+ */
+static void link_transmit(link_table_t *table, link_t *link, uint32_t sequence, uint64_t now)
+{
+    link_slot_t *slot = &link->slots[sequence % LINK_WINDOW_SIZE];
+    packet_link_t fields = {.session = table->session, .sequence = sequence, .base = link->base};
+    struct iovec iov = {.iov_base = slot->data, .iov_len = slot->size};
+
+    packet_stamp_link(slot->data, &fields);
+
+    if (table->transport->send(table->transport, link->neighbor, &iov, 1) == -1)
+    {
+        metrics_add(table->metrics, METRIC_SEND_FAILURES, 1);
+        log_message("CLIENT", MSG_TYPE_ERROR, "sendto() failed to node %d, the packet will be retransmitted", link->neighbor);
+    }
+    else
+    {
+        metrics_add(table->metrics, slot->retries == 0 ? METRIC_FORWARDED : METRIC_RETRANSMISSIONS, 1);
+    }
+
+    if (slot->retries == 0)
+    {
+        link->sent++;
+    }
+    else
+    {
+        link->retransmitted++;
+    }
+
+    uint64_t timeout = link->rto << slot->retries;
+    if (timeout > LINK_RTO_MAX_MS * LINK_MS)
+    {
+        timeout = LINK_RTO_MAX_MS * LINK_MS;
+    }
+
+    slot->deadline = now + timeout;
+    if (slot->deadline < table->deadline)
+    {
+        table->deadline = slot->deadline;
+    }
+}
+
+/**
+ * @brief Moves a datagram into its slot of the window and transmits it.
+ *
+ * @param table The links of the node.
+ * @param link The link.
+ * @param sequence The sequence of the datagram.
+ * @param data The datagram, or NULL to gather it from iov.
+ * @param iov The parts of the datagram when data is NULL.
+ * @param iov_count Number of parts.
+ * @param size The size of the datagram in bytes.
+ * @param now The current time in nanoseconds.
+ */
+static void link_start(link_table_t *table, link_t *link, uint32_t sequence, const char *data,
+                       const struct iovec *iov, int iov_count, size_t size, uint64_t now)
+{
+    link_slot_t *slot = &link->slots[sequence % LINK_WINDOW_SIZE];
+
+    if (data)
+    {
+        memcpy(slot->data, data, size);
+    }
+    else
+    {
+        transport_gather(slot->data, iov, iov_count);
+    }
+
+    slot->size = size;
+    slot->sent_at = now;
+    slot->retries = 0;
+    slot->duplicate_acks = 0;
+    slot->in_flight = true;
+
+    link_transmit(table, link, sequence, now);
+}
+
+/**
+ * @brief Sends a packet to a neighbor over its reliable link.
+ *
+ * The packet must carry PACKET_FLAG_RELIABLE, the session of the table, and
+ * link->next_sequence and link->base as its link fields. It is transmitted at
+ * once if the window has room, and otherwise waits in the queue of the link
+ * until acknowledgements open the window.
+ *
+ * @param table The links of the node.
+ * @param link The link to the next hop.
+ * @param iov The parts of the datagram.
+ * @param iov_count Number of parts.
+ * @return 0 if the packet was sent or queued, -1 if the queue is full.
+ */
+int link_send(link_table_t *table, link_t *link, const struct iovec *iov, int iov_count)
+{
+    size_t size = transport_iov_size(iov, iov_count);
+
+    if (size > PACKET_DATAGRAM_SIZE)
+    {
+        return -1;
+    }
+
+    if (link->pending_count == 0 && link->next_sequence - link->base < LINK_WINDOW_SIZE)
+    {
+        link_start(table, link, link->next_sequence, NULL, iov, iov_count, size, metrics_clock());
+        link->next_sequence++;
+        return 0;
+    }
+
+    if (link->pending_count >= LINK_QUEUE_LIMIT)
+    {
+        return -1;
+    }
+
+    link_pending_t *pending = malloc(sizeof(link_pending_t) + size);
+    if (!pending)
+    {
+        return -1;
+    }
+
+    pending->next = NULL;
+    pending->size = size;
+    transport_gather(pending->data, iov, iov_count);
+
+    if (link->pending_tail)
+    {
+        link->pending_tail->next = pending;
+    }
+    else
+    {
+        link->pending_head = pending;
+    }
+    link->pending_tail = pending;
+    link->pending_count++;
+    link->next_sequence++;
+    return 0;
+}
+
+/**
+ * @brief Slides the window of a link past the packets that left it.
+ *
+ * Queued packets then take the freed slots and are transmitted.
+ *
+ * @param table The links of the node.
+ * @param link The link.
+ * @param now The current time in nanoseconds.
+ */
+static void link_advance(link_table_t *table, link_t *link, uint64_t now)
+{
+    while (link->base != link_unsent(link) && !link->slots[link->base % LINK_WINDOW_SIZE].in_flight)
+    {
+        link->base++;
+    }
+
+    while (link->pending_head && link_unsent(link) - link->base < LINK_WINDOW_SIZE)
+    {
+        link_pending_t *pending = link->pending_head;
+        link->pending_head = pending->next;
+        if (!link->pending_head)
+        {
+            link->pending_tail = NULL;
+        }
+
+        uint32_t sequence = link_unsent(link);
+        link->pending_count--;
+        link_start(table, link, sequence, pending->data, NULL, 0, pending->size, now);
+        free(pending);
+    }
+}
+
+/**
+ * @brief Updates the retransmission timeout of a link with a measured round trip.
+ *
+ * The smoothed round trip and its variation are estimated as in RFC 6298,
+ * and the timeout is kept within LINK_RTO_MIN_MS and LINK_RTO_MAX_MS.
+ *
+ * @param link The link.
+ * @param rtt The round trip in nanoseconds.
+ */
+static void link_measure(link_t *link, uint64_t rtt)
+{
+    if (link->srtt == 0)
+    {
+        link->srtt = rtt ? rtt : 1;
+        link->rttvar = rtt / 2;
+    }
+    else
+    {
+        uint64_t delta = link->srtt > rtt ? link->srtt - rtt : rtt - link->srtt;
+        link->rttvar = (3 * link->rttvar + delta) / 4;
+        link->srtt = (7 * link->srtt + rtt) / 8;
+    }
+
+    link->rto = link->srtt + 4 * link->rttvar;
+    if (link->rto < LINK_RTO_MIN_MS * LINK_MS)
+    {
+        link->rto = LINK_RTO_MIN_MS * LINK_MS;
+    }
+    else if (link->rto > LINK_RTO_MAX_MS * LINK_MS)
+    {
+        link->rto = LINK_RTO_MAX_MS * LINK_MS;
+    }
+}
+
+/**
+ * @brief Releases the slot of an acknowledged packet.
+ *
+ * Only packets acknowledged after their first transmission give a round
+ * trip sample, since an acknowledgement of a retransmitted packet may
+ * answer any of its copies.
+ *
+ * @param table The links of the node.
+ * @param link The link.
+ * @param sequence The acknowledged sequence, within the window.
+ * @param now The current time in nanoseconds.
+ */
+static void link_acknowledged(link_table_t *table, link_t *link, uint32_t sequence, uint64_t now)
+{
+    link_slot_t *slot = &link->slots[sequence % LINK_WINDOW_SIZE];
+
+    if (!slot->in_flight)
+    {
+        return;
+    }
+
+    if (slot->retries == 0)
+    {
+        link_measure(link, now - slot->sent_at);
+        metrics_observe(table->metrics, METRIC_LINK_RTT, slot->sent_at);
+    }
+    slot->in_flight = false;
+}
+
+/**
+ * @brief Processes an acknowledgement received from a neighbor.
+ *
+ * Acknowledgements that are truncated or fail their checksum are ignored.
+ * Every packet before the next expected sequence is acknowledged, and so
+ * is every later packet flagged in the bitmap. When the bitmap shows that
+ * packets after the first missing one arrived LINK_FAST_RETRANSMIT times,
+ * the missing packet is retransmitted without waiting for its timeout.
+ * Acknowledgements of an earlier session of the node are ignored.
+ *
+ * @param table The links of the node.
+ * @param data The datagram.
+ * @param size The size of the datagram in bytes.
+ */
+void link_handle_ack(link_table_t *table, const char *data, size_t size)
+{
+    const unsigned char *input = (const unsigned char *)data;
+
+    if (size != LINK_ACK_SIZE || input[0] != LINK_ACK_TYPE ||
+        checksum_crc32c(0, input, LINK_ACK_SIZE - 4) != packet_get_u32(input + LINK_ACK_SIZE - 4))
+    {
+        return;
+    }
+
+    int neighbor = packet_get_u16(input + 1);
+    uint16_t session = packet_get_u16(input + 3);
+    uint32_t expected = packet_get_u32(input + 5);
+    uint64_t received = (uint64_t)packet_get_u32(input + 9) << 32 | packet_get_u32(input + 13);
+
+    if (session != table->session || neighbor >= table->num_nodes || !table->links || !table->links[neighbor])
+    {
+        return;
+    }
+
+    link_t *link = table->links[neighbor];
+    uint32_t unsent = link_unsent(link);
+    uint32_t in_window = unsent - link->base;
+    uint64_t now = metrics_clock();
+
+    for (uint32_t sequence = link->base; sequence != unsent && (int32_t)(expected - sequence) > 0; sequence++)
+    {
+        link_acknowledged(table, link, sequence, now);
+    }
+
+    for (int i = 1; i < 64; i++)
+    {
+        if ((received >> i & 1) && expected + i - link->base < in_window)
+        {
+            link_acknowledged(table, link, expected + i, now);
+        }
+    }
+
+    if (received != 0 && expected - link->base < in_window)
+    {
+        link_slot_t *slot = &link->slots[expected % LINK_WINDOW_SIZE];
+        if (slot->in_flight && ++slot->duplicate_acks == LINK_FAST_RETRANSMIT)
+        {
+            slot->retries++;
+            link_transmit(table, link, expected, now);
+            log_message("CLIENT", MSG_TYPE_INFO, "Fast retransmission of link packet %u to node %d", expected, neighbor);
+        }
+    }
+
+    link_advance(table, link, now);
+}
+
+/**
+ * @brief Moves the receive window of a link forward.
+ *
+ * Sequences before the new start are considered received, and the window
+ * then skips every sequence that was already received.
+ *
+ * @param link The link.
+ * @param expected The new start of the window.
+ */
+static void link_slide(link_t *link, uint32_t expected)
+{
+    uint32_t shift = expected - link->expected;
+
+    link->received = shift >= 64 ? 0 : link->received >> shift;
+    link->expected = expected;
+
+    while (link->received & 1)
+    {
+        link->received >>= 1;
+        link->expected++;
+    }
+}
+
+/**
+ * @brief Checks a packet received over the reliable link from a neighbor.
+ *
+ * The packet is acknowledged with the next poll whether it is new or not,
+ * since a duplicate means that an acknowledgement was lost. The first
+ * packet of a session starts the window at the oldest sequence the sender
+ * waits for, and the window later follows that sequence, so packets the
+ * sender gave up on do not hold it back.
+ *
+ * @param table The links of the node.
+ * @param neighbor The neighbor that sent the packet.
+ * @param header The link fields of the packet.
+ * @return true if the packet is new, false if it was already received.
+ */
+bool link_accept(link_table_t *table, int neighbor, const packet_link_t *header)
+{
+    link_t *link = link_open(table, neighbor);
+    if (!link)
+    {
+        return true;
+    }
+
+    if (!link->synchronized || link->session != header->session)
+    {
+        link->synchronized = true;
+        link->session = header->session;
+        link->expected = header->base;
+        link->received = 0;
+    }
+
+    link->ack_pending = true;
+
+    if ((int32_t)(header->base - link->expected) > 0)
+    {
+        link_slide(link, header->base);
+    }
+
+    uint32_t offset = header->sequence - link->expected;
+    if ((int32_t)offset < 0)
+    {
+        return false;
+    }
+
+    if (offset >= 64)
+    {
+        link_slide(link, header->sequence - 63);
+        offset = header->sequence - link->expected;
+    }
+
+    if (link->received >> offset & 1)
+    {
+        return false;
+    }
+
+    link->received |= 1ull << offset;
+    link_slide(link, link->expected);
+    return true;
+}
+
+/**
+ * @brief Sends the acknowledgement of the packets received on a link.
+ *
+ * @param table The links of the node.
+ * @param link The link.
+ */
+static void link_send_ack(link_table_t *table, link_t *link)
+{
+    unsigned char data[LINK_ACK_SIZE];
+
+    data[0] = LINK_ACK_TYPE;
+    packet_put_u16(data + 1, table->node_id);
+    packet_put_u16(data + 3, link->session);
+    packet_put_u32(data + 5, link->expected);
+    packet_put_u32(data + 9, link->received >> 32);
+    packet_put_u32(data + 13, link->received);
+    packet_put_u32(data + 17, checksum_crc32c(0, data, LINK_ACK_SIZE - 4));
+
+    struct iovec iov = {.iov_base = data, .iov_len = sizeof(data)};
+    if (table->transport->send(table->transport, link->neighbor, &iov, 1) == -1)
+    {
+        log_message("CLIENT", MSG_TYPE_ERROR, "Failed to acknowledge packets to node %d", link->neighbor);
+    }
+    link->ack_pending = false;
+}
+
+/**
+ * @brief Retransmits the packets whose timeout expired.
+ *
+ * A packet still unacknowledged after LINK_MAX_RETRIES retransmissions is
+ * given up, together with the queue of its link, since the neighbor is
+ * most likely gone. The queued packets never went on the wire, so their
+ * sequences are handed out again to the next packets.
+ *
+ * @param table The links of the node.
+ * @param now The current time in nanoseconds.
+ */
+static void link_expire(link_table_t *table, uint64_t now)
+{
+    table->deadline = UINT64_MAX;
+
+    for (int i = 0; i < table->active_count; i++)
+    {
+        link_t *link = table->links[table->active[i]];
+        uint32_t unsent = link_unsent(link);
+
+        for (uint32_t sequence = link->base; sequence != unsent; sequence++)
+        {
+            link_slot_t *slot = &link->slots[sequence % LINK_WINDOW_SIZE];
+
+            if (!slot->in_flight)
+            {
+                continue;
+            }
+
+            if (slot->deadline > now)
+            {
+                if (slot->deadline < table->deadline)
+                {
+                    table->deadline = slot->deadline;
+                }
+                continue;
+            }
+
+            if (slot->retries >= LINK_MAX_RETRIES)
+            {
+                slot->in_flight = false;
+                int dropped = link_drop_pending(link);
+                link->next_sequence -= dropped;
+                metrics_add(table->metrics, METRIC_LINK_FAILURES, 1 + dropped);
+                log_message("CLIENT", MSG_TYPE_ERROR, "Node %d did not acknowledge link packet %u, %d packets dropped",
+                            link->neighbor, sequence, 1 + dropped);
+                continue;
+            }
+
+            slot->retries++;
+            link_transmit(table, link, sequence, now);
+            log_message("CLIENT", MSG_TYPE_INFO, "Retransmission %d of link packet %u to node %d", slot->retries, sequence, link->neighbor);
+        }
+
+        link_advance(table, link, now);
+    }
+}
+
+/**
+ * @brief Updates the smoothed cost of a link with the last report interval.
+ *
+ * The sample adds the packets waiting on the link, the share of packets that
+ * had to be retransmitted and the smoothed round trip, each scaled to hops.
+ * The round trip only counts when packets were sent, since it is not measured
+ * on an idle link. Samples are smoothed with a weight of 1/4.
+ *
+ * @param link The link.
+ * @return The smoothed cost in hundredths of a hop.
+ */
+static int link_update_cost(link_t *link)
+{
+    uint64_t sample = (uint64_t)(link->next_sequence - link->base) * LINK_COST_HOP / LINK_COST_QUEUE;
+
+    if (link->sent > 0)
+    {
+        sample += (uint64_t)link->retransmitted * 100 * LINK_COST_HOP / ((uint64_t)link->sent * LINK_COST_LOSS_PERCENT);
+        sample += link->srtt * LINK_COST_HOP / (LINK_COST_RTT_MS * LINK_MS);
+    }
+
+    if (sample > INT_MAX / 4)
+    {
+        sample = INT_MAX / 4;
+    }
+
+    link->cost = (3 * link->cost + (int)sample) / 4;
+    link->sent = 0;
+    link->retransmitted = 0;
+    return link->cost;
+}
+
+/**
+ * @brief Reports the cost of every link of the node to the server.
+ *
+ * The report is sent even if the costs did not change, so a lost report
+ * is made up for by the next one.
+ *
+ * @param table The links of the node.
+ */
+static void link_send_report(link_table_t *table)
+{
+    unsigned char data[LINK_REPORT_HEADER_SIZE + LINK_REPORT_MAX_LINKS * LINK_REPORT_ENTRY_SIZE];
+    int count = table->active_count < LINK_REPORT_MAX_LINKS ? table->active_count : LINK_REPORT_MAX_LINKS;
+
+    if (count == 0)
+    {
+        return;
+    }
+
+    data[0] = LINK_REPORT_TYPE;
+    packet_put_u16(data + 1, table->node_id);
+    data[3] = count;
+
+    for (int i = 0; i < count; i++)
+    {
+        link_t *link = table->links[table->active[i]];
+        int cost = link_update_cost(link);
+        unsigned char *entry = data + LINK_REPORT_HEADER_SIZE + i * LINK_REPORT_ENTRY_SIZE;
+
+        cost = cost > UINT16_MAX ? UINT16_MAX : cost;
+        packet_put_u16(entry, link->neighbor);
+        packet_put_u16(entry + 2, cost);
+    }
+
+    struct iovec iov = {.iov_base = data, .iov_len = LINK_REPORT_HEADER_SIZE + count * LINK_REPORT_ENTRY_SIZE};
+    if (table->transport->send(table->transport, TRANSPORT_SERVER, &iov, 1) == -1)
+    {
+        log_message("CLIENT", MSG_TYPE_ERROR, "Failed to report the cost of the links to the server");
+    }
+}
+
+/**
+ * @brief Decodes a link cost report received by the server.
+ *
+ * @param data The datagram.
+ * @param size The size of the datagram in bytes.
+ * @param report Receives the report.
+ * @return 0 on success, -1 if the datagram is not a valid report.
+ */
+int link_report_decode(const char *data, size_t size, link_report_t *report)
+{
+    const unsigned char *input = (const unsigned char *)data;
+
+    if (size < LINK_REPORT_HEADER_SIZE || input[0] != LINK_REPORT_TYPE || input[3] > LINK_REPORT_MAX_LINKS ||
+        size != LINK_REPORT_HEADER_SIZE + (size_t)input[3] * LINK_REPORT_ENTRY_SIZE)
+    {
+        return -1;
+    }
+
+    report->node_id = packet_get_u16(input + 1);
+    report->count = input[3];
+
+    for (int i = 0; i < report->count; i++)
+    {
+        const unsigned char *entry = input + LINK_REPORT_HEADER_SIZE + i * LINK_REPORT_ENTRY_SIZE;
+        report->links[i].neighbor = packet_get_u16(entry);
+        report->links[i].cost = packet_get_u16(entry + 2);
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Sends the pending acknowledgements and retransmits expired packets.
+ *
+ * Called after every batch of received datagrams, so one acknowledgement
+ * covers all the packets a neighbor sent in the batch, and whenever the
+ * wait for datagrams times out. When the table reports link costs, the
+ * report is sent here as well once its interval has elapsed.
+ *
+ * @param table The links of the node.
+ * @param now The current time in nanoseconds.
+ * @return How long to wait for datagrams before the next call, in milliseconds,
+ *         or -1 if no packet is waiting for an acknowledgement and no report is due.
+ */
+int link_poll(link_table_t *table, uint64_t now)
+{
+    for (int i = 0; i < table->active_count; i++)
+    {
+        link_t *link = table->links[table->active[i]];
+        if (link->ack_pending)
+        {
+            link_send_ack(table, link);
+        }
+    }
+
+    if (now >= table->deadline)
+    {
+        link_expire(table, now);
+    }
+
+    uint64_t deadline = table->deadline;
+
+    if (table->reports)
+    {
+        if (now >= table->report_at)
+        {
+            link_send_report(table);
+            table->report_at = now + LINK_REPORT_INTERVAL_MS * LINK_MS;
+        }
+        deadline = table->report_at < deadline ? table->report_at : deadline;
+    }
+
+    if (deadline == UINT64_MAX)
+    {
+        return -1;
+    }
+
+    return deadline <= now ? 0 : (int)((deadline - now + LINK_MS - 1) / LINK_MS);
+}
@@ -0,0 +1,456 @@
+#define _GNU_SOURCE
+
+#include <ctype.h>
+#include <stdint.h>
+#include <strings.h>
+#include <time.h>
+
+#include "logger.h"
+
+typedef struct
+{
+    char creator[LOG_RECORD_SIZE];
+    char format[LOG_RECORD_SIZE];
+    char signature[LOG_MAX_ARGUMENTS + 1];
+    bool defined;
+} log_definition_t;
+
+typedef struct
+{
+    uint32_t pid;
+    log_definition_t formats[LOG_MAX_FORMATS];
+} log_process_t;
+
+typedef struct
+{
+    int node;
+    bool any_node;
+    unsigned types;
+    uint64_t since;
+    uint64_t until;
+} log_filter_t;
+
+static log_process_t *processes;
+static int num_processes;
+
+/**
+ * @brief Returns the format table of the process that wrote a record.
+ *
+ * @param pid The process identifier.
+ * @return The format table, or NULL if it cannot be allocated.
+ */
+static log_process_t *find_process(uint32_t pid)
+{
+    static int last = -1;
+
+    if (last != -1 && processes[last].pid == pid)
+    {
+        return &processes[last];
+    }
+
+    for (int i = 0; i < num_processes; i++)
+    {
+        if (processes[i].pid == pid)
+        {
+            last = i;
+            return &processes[i];
+        }
+    }
+
+    log_process_t *grown = realloc(processes, (num_processes + 1) * sizeof(log_process_t));
+    if (!grown)
+    {
+        return NULL;
+    }
+
+    processes = grown;
+    memset(&processes[num_processes], 0, sizeof(log_process_t));
+    processes[num_processes].pid = pid;
+    last = num_processes++;
+    return &processes[last];
+}
+
+/**
+ * @brief Reads a string with a 16-bit length prefix from a record.
+ *
+ * @param record The record.
+ * @param offset The offset of the string, advanced past it.
+ * @param size The size of the record.
+ * @param string Receives the string, LOG_RECORD_SIZE bytes.
+ * @return 0 on success, -1 if the record is truncated.
+ */
+static int get_string(const char *record, size_t *offset, size_t size, char *string)
+{
+    uint16_t length;
+
+    if (*offset + sizeof(length) > size)
+    {
+        return -1;
+    }
+    memcpy(&length, record + *offset, sizeof(length));
+    *offset += sizeof(length);
+
+    if (*offset + length > size || length >= LOG_RECORD_SIZE)
+    {
+        return -1;
+    }
+    memcpy(string, record + *offset, length);
+    string[length] = '\0';
+    *offset += length;
+    return 0;
+}
+
+/**
+ * @brief Renders a binary message record with its format string.
+ *
+ * Each conversion of the format is printed on its own with the argument
+ * taken from the record. Integer conversions are widened to long long,
+ * which is how 8-byte arguments are stored.
+ *
+ * @param definition The format of the record.
+ * @param record The record.
+ * @param size The size of the record.
+ * @param output Receives the message.
+ * @param output_size The size of the output buffer.
+ */
+static void render_message(const log_definition_t *definition, const char *record, size_t size,
+                           char *output, size_t output_size)
+{
+    size_t offset = sizeof(log_record_header_t);
+    size_t length = 0;
+    const char *kind = definition->signature;
+
+    for (const char *c = definition->format; *c && length < output_size - 1;)
+    {
+        if (*c != '%' || c[1] == '%')
+        {
+            output[length++] = *c;
+            c += *c == '%' ? 2 : 1;
+            continue;
+        }
+
+        char spec[32];
+        size_t spec_length = 0;
+
+        spec[spec_length++] = *c++;
+        while (*c && strchr("-+ #0123456789.", *c) && spec_length < sizeof(spec) - 4)
+        {
+            spec[spec_length++] = *c++;
+        }
+        while (*c && strchr("hlzjt", *c))
+        {
+            c++;
+        }
+
+        char conversion = *c ? *c++ : 's';
+        char argument[LOG_RECORD_SIZE];
+        char text[LOG_RECORD_SIZE];
+        int32_t narrow = 0;
+        int64_t wide = 0;
+        double real = 0;
+
+        if (*kind == 's')
+        {
+            if (get_string(record, &offset, size, argument) == -1)
+            {
+                strcpy(argument, "?");
+            }
+        }
+        else if (*kind == 'i' && offset + sizeof(narrow) <= size)
+        {
+            memcpy(&narrow, record + offset, sizeof(narrow));
+            offset += sizeof(narrow);
+        }
+        else if (*kind == 'f' && offset + sizeof(real) <= size)
+        {
+            memcpy(&real, record + offset, sizeof(real));
+            offset += sizeof(real);
+        }
+        else if (*kind && offset + sizeof(wide) <= size)
+        {
+            memcpy(&wide, record + offset, sizeof(wide));
+            offset += sizeof(wide);
+        }
+
+        if (*kind && *kind != 's' && *kind != 'i' && *kind != 'f' && *kind != 'p')
+        {
+            spec[spec_length++] = 'l';
+            spec[spec_length++] = 'l';
+        }
+        spec[spec_length++] = conversion;
+        spec[spec_length] = '\0';
+
+        switch (*kind)
+        {
+        case 's':
+            snprintf(text, sizeof(text), spec, argument);
+            break;
+        case 'i':
+            snprintf(text, sizeof(text), spec, narrow);
+            break;
+        case 'f':
+            snprintf(text, sizeof(text), spec, real);
+            break;
+        case 'p':
+            snprintf(text, sizeof(text), spec, (void *)(intptr_t)wide);
+            break;
+        case '\0':
+            strcpy(text, "?");
+            break;
+        default:
+            snprintf(text, sizeof(text), spec, (long long)wide);
+            break;
+        }
+
+        if (*kind)
+        {
+            kind++;
+        }
+
+        for (const char *t = text; *t && length < output_size - 1; t++)
+        {
+            output[length++] = *t;
+        }
+    }
+
+    output[length] = '\0';
+}
+
+/**
+ * @brief Checks whether a record passes the filter.
+ *
+ * @param header The header of the record.
+ * @param filter The filter.
+ * @return true if the record is printed.
+ */
+static bool filter_matches(const log_record_header_t *header, const log_filter_t *filter)
+{
+    return (filter->any_node || header->node == filter->node) &&
+           (filter->types & (1u << header->type)) &&
+           header->timestamp >= filter->since && header->timestamp <= filter->until;
+}
+
+/**
+ * @brief Decodes a binary log and prints it in the text log format.
+ *
+ * @param input The binary log.
+ * @param filter Which records to print.
+ * @return 0 on success, -1 if the log is corrupted.
+ */
+static int decode_log(FILE *input, const log_filter_t *filter)
+{
+    char record[LOG_RECORD_SIZE];
+    log_record_header_t header;
+
+    while (fread(&header, sizeof(header), 1, input) == 1)
+    {
+        if (header.size < sizeof(header) || header.size > LOG_RECORD_SIZE)
+        {
+            fprintf(stderr, "Corrupted record at offset %ld\n", ftell(input) - (long)sizeof(header));
+            return -1;
+        }
+
+        memcpy(record, &header, sizeof(header));
+        if (fread(record + sizeof(header), header.size - sizeof(header), 1, input) != 1 && header.size > sizeof(header))
+        {
+            fprintf(stderr, "Truncated record at the end of the log\n");
+            return -1;
+        }
+
+        log_process_t *process = find_process(header.pid);
+        if (!process)
+        {
+            return -1;
+        }
+
+        size_t offset = sizeof(header);
+        char creator[LOG_RECORD_SIZE];
+        char message[LOG_RECORD_SIZE * 2];
+
+        if (header.kind == LOG_RECORD_FORMAT)
+        {
+            log_definition_t *definition = &process->formats[header.format % LOG_MAX_FORMATS];
+            if (get_string(record, &offset, header.size, definition->creator) == 0 &&
+                get_string(record, &offset, header.size, definition->format) == 0)
+            {
+                definition->defined = log_format_signature(definition->format, definition->signature) != -1;
+            }
+            continue;
+        }
+
+        if (!filter_matches(&header, filter))
+        {
+            continue;
+        }
+
+        if (header.kind == LOG_RECORD_TEXT)
+        {
+            if (get_string(record, &offset, header.size, creator) == -1 ||
+                get_string(record, &offset, header.size, message) == -1)
+            {
+                continue;
+            }
+        }
+        else
+        {
+            const log_definition_t *definition = &process->formats[header.format % LOG_MAX_FORMATS];
+            if (!definition->defined)
+            {
+                fprintf(stderr, "Record of process %u uses undefined format %u\n", header.pid, header.format);
+                continue;
+            }
+            strcpy(creator, definition->creator);
+            render_message(definition, record, header.size, message, sizeof(message));
+        }
+
+        time_t seconds = header.timestamp / 1000000000;
+        struct tm t;
+        char time_str[20];
+        localtime_r(&seconds, &t);
+        strftime(time_str, sizeof(time_str), "%Y-%m-%d %H:%M:%S", &t);
+
+        printf("[%s] [%s] [%s] %s\n", creator, get_message_type_string(header.type), time_str, message);
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Parses a point in time given on the command line.
+ *
+ * @param text Local time as "YYYY-MM-DD HH:MM:SS", or seconds since the epoch.
+ * @param timestamp Receives the time in nanoseconds since the epoch.
+ * @return 0 on success, -1 if the time is invalid.
+ */
+static int parse_time(const char *text, uint64_t *timestamp)
+{
+    struct tm t = {0};
+    char *end = strptime(text, "%Y-%m-%d %H:%M:%S", &t);
+    time_t seconds;
+
+    if (end && *end == '\0')
+    {
+        t.tm_isdst = -1;
+        seconds = mktime(&t);
+    }
+    else
+    {
+        seconds = strtoll(text, &end, 10);
+        if (*text == '\0' || *end != '\0')
+        {
+            return -1;
+        }
+    }
+
+    *timestamp = (uint64_t)seconds * 1000000000;
+    return 0;
+}
+
+/**
+ * @brief Parses a message type given on the command line.
+ *
+ * The name is compared with the type as written in the text log, ignoring
+ * case, with '-' or '_' standing for spaces, for example "not-valid-data".
+ *
+ * @param text The name of the type.
+ * @return The message type, or -1 if the name is unknown.
+ */
+static int parse_type(const char *text)
+{
+    for (int type = MSG_TYPE_INFO; type <= MSG_TYPE_NOT_VALID_DATA; type++)
+    {
+        const char *name = get_message_type_string(type);
+        size_t i = 0;
+
+        while (name[i] && text[i] &&
+               (tolower((unsigned char)name[i]) == tolower((unsigned char)text[i]) ||
+                (name[i] == ' ' && (text[i] == '-' || text[i] == '_'))))
+        {
+            i++;
+        }
+        if (name[i] == '\0' && text[i] == '\0')
+        {
+            return type;
+        }
+    }
+
+    return strcasecmp(text, "info") == 0 ? MSG_TYPE_INFO : -1;
+}
+
+/**
+ * @brief Prints how to run the decoder.
+ *
+ * @param program The name of the executable.
+ */
+static void print_usage(const char *program)
+{
+    fprintf(stderr, "Usage: %s [-n node] [-t type] [-s since] [-u until] [file]\n", program);
+    fprintf(stderr, "  -n node   Only records of this node (-1 for the server)\n");
+    fprintf(stderr, "  -t type   Only records of this type: info, command, error or not-valid-data;\n");
+    fprintf(stderr, "            may be repeated\n");
+    fprintf(stderr, "  -s since  Only records from this time on, as \"YYYY-MM-DD HH:MM:SS\" or epoch seconds\n");
+    fprintf(stderr, "  -u until  Only records up to this time\n");
+    fprintf(stderr, "The log is read from %s by default and printed in the text log format.\n", LOG_BINARY_FILE);
+}
+
+int main(int argc, char *argv[])
+{
+    log_filter_t filter = {.any_node = true, .types = 0, .since = 0, .until = UINT64_MAX};
+    int option;
+
+    while ((option = getopt(argc, argv, "n:t:s:u:")) != -1)
+    {
+        int type;
+
+        switch (option)
+        {
+        case 'n':
+            filter.node = atoi(optarg);
+            filter.any_node = false;
+            break;
+        case 't':
+            type = parse_type(optarg);
+            if (type == -1)
+            {
+                print_usage(argv[0]);
+                exit(EXIT_FAILURE);
+            }
+            filter.types |= 1u << type;
+            break;
+        case 's':
+        case 'u':
+            if (parse_time(optarg, option == 's' ? &filter.since : &filter.until) == -1)
+            {
+                print_usage(argv[0]);
+                exit(EXIT_FAILURE);
+            }
+            if (option == 'u')
+            {
+                filter.until += 999999999;
+            }
+            break;
+        default:
+            print_usage(argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if (filter.types == 0)
+    {
+        filter.types = ~0u;
+    }
+
+    const char *path = optind < argc ? argv[optind] : LOG_BINARY_FILE;
+    FILE *input = fopen(path, "rb");
+    if (!input)
+    {
+        perror("Failed to open the binary log");
+        exit(EXIT_FAILURE);
+    }
+
+    int result = decode_log(input, &filter);
+
+    fclose(input);
+    free(processes);
+    return result == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
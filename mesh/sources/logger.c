@@ -1,5 +1,45 @@
+#include <errno.h>
+#include <linux/futex.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/syscall.h>
+
 #include "logger.h"
 
+static struct
+{
+    log_slot_t *slots;
+    unsigned capacity;
+    log_policy policy;
+    int fd;
+    pthread_t thread;
+    atomic_bool running;
+    atomic_uint writers;
+    atomic_ulong dropped;
+    _Alignas(64) atomic_uint tail;
+    _Alignas(64) atomic_uint head;
+    atomic_uint signal;
+    atomic_uint waiting;
+} logger;
+
+typedef struct
+{
+    _Atomic(const char *) format;
+    const char *creator;
+    char signature[LOG_MAX_ARGUMENTS + 1];
+    bool supported;
+} log_format_entry_t;
+
+log_level log_threshold = LOG_LEVEL_INFO;
+
+static bool log_binary = false;
+static log_format_entry_t log_formats[LOG_MAX_FORMATS];
+static pthread_mutex_t log_formats_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static _Thread_local time_t cached_second = -1;
+static _Thread_local char cached_time[20];
+static _Thread_local int log_node = -1;
+
 /**
  * @brief Converts the message type to a string for output.
  *
@@ -27,49 +67,940 @@ const char *get_message_type_string(const message_type type)
 }
 
 /**
- * @brief Writes the message to a log file.
+ * @brief Returns the current time formatted for a log record.
  *
- * The function opens a log file, locks it, writes a message into it with the creator, message type and timestamp, and then closes the file.
- * specifying the creator, message type and timestamp, and then closes the file.
- * Error handling is performed for file opening and locking.
+ * The string is cached per thread and only rebuilt when the second changes.
  *
+ * @return The current local time as "YYYY-MM-DD HH:MM:SS".
+ */
+static const char *log_time_string(void)
+{
+    time_t now = time(NULL);
+
+    if (now != cached_second)
+    {
+        struct tm t;
+        localtime_r(&now, &t);
+        strftime(cached_time, sizeof(cached_time), "%Y-%m-%d %H:%M:%S", &t);
+        cached_second = now;
+    }
+    return cached_time;
+}
+
+/**
+ * @brief Formats a log record, truncating it to the buffer if needed.
+ *
+ * @param buffer Receives the record, always terminated by a newline.
+ * @param size The size of the buffer.
  * @param creator The name or identifier of the message creator.
- * @param type The type of message (message_type) to be logged.
- * @param message_format A message format that supports a variable number of arguments (printf-style).
- * @param ... Variable number of arguments to format the message.
+ * @param type The type of message.
+ * @param message_format A printf-style message format.
+ * @param args Arguments for the message format.
+ * @return The length of the record in bytes.
  */
-void log_message(const char *creator, const message_type type, const char *message_format, ...)
+static size_t log_format(char *buffer, size_t size, const char *creator, message_type type,
+                         const char *message_format, va_list args)
 {
-    FILE *logfile = fopen(LOG_FILE, "a");
-    if (!logfile)
+    int length = snprintf(buffer, size, "[%s] [%s] [%s] ", creator, get_message_type_string(type), log_time_string());
+
+    if (length >= 0 && (size_t)length < size)
     {
-        perror("Failed to open log file.");
-        return;
+        int message_length = vsnprintf(buffer + length, size - length, message_format, args);
+        if (message_length > 0)
+        {
+            length += message_length;
+        }
+    }
+
+    if (length < 0)
+    {
+        length = 0;
+    }
+    if ((size_t)length > size - 1)
+    {
+        length = size - 1;
+    }
+
+    buffer[length] = '\n';
+    return length + 1;
+}
+
+/**
+ * @brief Describes the arguments a printf-style format expects.
+ *
+ * Every conversion is reduced to one character: 'i' for int, 'l' for long,
+ * 'q' for long long, 'z' for size_t, 'j' for intmax_t, 't' for ptrdiff_t,
+ * 'f' for double, 'p' for pointers and 's' for strings.
+ *
+ * @param format The format string.
+ * @param signature Receives the signature, at least LOG_MAX_ARGUMENTS + 1 bytes.
+ * @return The number of arguments, or -1 if the format cannot be recorded in binary.
+ */
+int log_format_signature(const char *format, char *signature)
+{
+    int count = 0;
+
+    for (const char *c = format; *c; c++)
+    {
+        if (*c != '%')
+        {
+            continue;
+        }
+        c++;
+        if (*c == '%')
+        {
+            continue;
+        }
+
+        while (*c && strchr("-+ #0123456789.", *c))
+        {
+            c++;
+        }
+
+        char length = 0;
+        if (c[0] == 'h')
+        {
+            c += c[1] == 'h' ? 2 : 1;
+        }
+        else if (c[0] == 'l' && c[1] == 'l')
+        {
+            length = 'q';
+            c += 2;
+        }
+        else if (*c == 'l' || *c == 'z' || *c == 'j' || *c == 't')
+        {
+            length = *c++;
+        }
+
+        char kind;
+        if (*c && strchr("diuoxXc", *c))
+        {
+            kind = length ? length : 'i';
+        }
+        else if (*c && strchr("fFeEgGaA", *c) && !length)
+        {
+            kind = 'f';
+        }
+        else if ((*c == 's' || *c == 'p') && !length)
+        {
+            kind = *c;
+        }
+        else
+        {
+            return -1;
+        }
+
+        if (count == LOG_MAX_ARGUMENTS)
+        {
+            return -1;
+        }
+        signature[count++] = kind;
+    }
+
+    signature[count] = '\0';
+    return count;
+}
+
+/**
+ * @brief Fills in the header of a binary log record.
+ *
+ * @param buffer The record.
+ * @param kind The kind of record.
+ * @param format The format identifier.
+ * @param type The type of message.
+ * @param size The size of the record in bytes, header included.
+ * @return The size of the record.
+ */
+static size_t log_record_header(char *buffer, log_record_kind kind, int format, message_type type, size_t size)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+
+    log_record_header_t header = {
+        .timestamp = (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec,
+        .pid = getpid(),
+        .node = log_node,
+        .size = size,
+        .format = format,
+        .kind = kind,
+        .type = type,
+    };
+    memcpy(buffer, &header, sizeof(header));
+    return size;
+}
+
+/**
+ * @brief Appends a string with a 16-bit length prefix, truncated to the space left.
+ *
+ * @param buffer The record.
+ * @param offset Where the string goes.
+ * @param size The size of the record buffer.
+ * @param string The string, or NULL.
+ * @return The offset after the string.
+ */
+static size_t log_put_string(char *buffer, size_t offset, size_t size, const char *string)
+{
+    if (!string)
+    {
+        string = "(null)";
+    }
+
+    size_t length = strlen(string);
+    if (offset + sizeof(uint16_t) > size)
+    {
+        return offset;
+    }
+    if (length > size - offset - sizeof(uint16_t))
+    {
+        length = size - offset - sizeof(uint16_t);
+    }
+
+    uint16_t prefix = length;
+    memcpy(buffer + offset, &prefix, sizeof(prefix));
+    memcpy(buffer + offset + sizeof(prefix), string, length);
+    return offset + sizeof(prefix) + length;
+}
+
+/**
+ * @brief Encodes a message as a binary record with its raw arguments.
+ *
+ * Integers are stored as 4 or 8 bytes, doubles as 8 bytes and strings with
+ * a length prefix. The text is only produced later by app-logdecode.
+ *
+ * @param buffer Receives the record.
+ * @param size The size of the buffer.
+ * @param format The identifier of the format in the format table.
+ * @param type The type of message.
+ * @param args Arguments for the message format.
+ * @return The size of the record in bytes.
+ */
+static size_t log_encode_message(char *buffer, size_t size, int format, message_type type, va_list args)
+{
+    size_t offset = sizeof(log_record_header_t);
+
+    for (const char *kind = log_formats[format].signature; *kind; kind++)
+    {
+        if (*kind == 's')
+        {
+            offset = log_put_string(buffer, offset, size, va_arg(args, const char *));
+            continue;
+        }
+
+        int32_t narrow;
+        int64_t wide;
+        double real;
+        const void *value = &wide;
+        size_t length = sizeof(wide);
+
+        switch (*kind)
+        {
+        case 'i':
+            narrow = va_arg(args, int);
+            value = &narrow;
+            length = sizeof(narrow);
+            break;
+        case 'l':
+            wide = va_arg(args, long);
+            break;
+        case 'q':
+            wide = va_arg(args, long long);
+            break;
+        case 'z':
+            wide = va_arg(args, size_t);
+            break;
+        case 'j':
+            wide = va_arg(args, intmax_t);
+            break;
+        case 't':
+            wide = va_arg(args, ptrdiff_t);
+            break;
+        case 'p':
+            wide = (intptr_t)va_arg(args, void *);
+            break;
+        default:
+            real = va_arg(args, double);
+            value = &real;
+            break;
+        }
+
+        if (offset + length > size)
+        {
+            break;
+        }
+        memcpy(buffer + offset, value, length);
+        offset += length;
+    }
+
+    return log_record_header(buffer, LOG_RECORD_MESSAGE, format, type, offset);
+}
+
+/**
+ * @brief Encodes an already formatted message as a binary record.
+ *
+ * Used for formats that do not fit the format table or the argument encoding.
+ *
+ * @param buffer Receives the record.
+ * @param size The size of the buffer.
+ * @param creator The name or identifier of the message creator.
+ * @param type The type of message.
+ * @param message_format A printf-style message format.
+ * @param args Arguments for the message format.
+ * @return The size of the record in bytes.
+ */
+static size_t log_encode_text(char *buffer, size_t size, const char *creator, message_type type,
+                              const char *message_format, va_list args)
+{
+    char text[LOG_RECORD_SIZE];
+    vsnprintf(text, sizeof(text), message_format, args);
+
+    size_t offset = log_put_string(buffer, sizeof(log_record_header_t), size, creator);
+    offset = log_put_string(buffer, offset, size, text);
+    return log_record_header(buffer, LOG_RECORD_TEXT, 0, type, offset);
+}
+
+/**
+ * @brief Encodes a message in the format the logger was started with.
+ *
+ * @param buffer Receives the record.
+ * @param size The size of the buffer.
+ * @param format The identifier of the format in the format table, or -1.
+ * @param creator The name or identifier of the message creator.
+ * @param type The type of message.
+ * @param message_format A printf-style message format.
+ * @param args Arguments for the message format.
+ * @return The size of the record in bytes.
+ */
+static size_t log_encode(char *buffer, size_t size, int format, const char *creator, message_type type,
+                         const char *message_format, va_list args)
+{
+    if (!log_binary)
+    {
+        return log_format(buffer, size, creator, type, message_format, args);
+    }
+    if (format >= 0)
+    {
+        return log_encode_message(buffer, size, format, type, args);
     }
+    return log_encode_text(buffer, size, creator, type, message_format, args);
+}
 
-    int fd = fileno(logfile);
+/**
+ * @brief Appends data to the log file under an exclusive lock.
+ *
+ * The lock keeps records of different processes from interleaving.
+ *
+ * @param fd The log file, opened for appending.
+ * @param data The records to write.
+ * @param size The size of the records in bytes.
+ */
+static void log_write(int fd, const char *data, size_t size)
+{
     if (flock(fd, LOCK_EX) == -1)
     {
         perror("Failed to lock log file.");
-        fclose(logfile);
         return;
     }
 
-    time_t now = time(NULL);
-    struct tm *t = localtime(&now);
-    char time_str[20];
-    strftime(time_str, sizeof(time_str), "%Y-%m-%d %H:%M:%S", t);
+    while (size > 0)
+    {
+        ssize_t written = write(fd, data, size);
+        if (written == -1)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            perror("Failed to write log file.");
+            break;
+        }
+        data += written;
+        size -= written;
+    }
+
+    flock(fd, LOCK_UN);
+}
 
-    fprintf(logfile, "[%s] [%s] [%s] ", creator, get_message_type_string(type), time_str);
+/**
+ * @brief Blocks while a word still holds the given value, at most for a timeout.
+ *
+ * @param address The word to wait on.
+ * @param value The value the word is expected to hold.
+ * @param timeout_ms The longest time to wait, in milliseconds.
+ */
+static void futex_wait(atomic_uint *address, unsigned value, long timeout_ms)
+{
+    struct timespec timeout = {.tv_sec = timeout_ms / 1000, .tv_nsec = (timeout_ms % 1000) * 1000000};
+    syscall(SYS_futex, address, FUTEX_WAIT_PRIVATE, value, &timeout, NULL, 0);
+}
+
+/**
+ * @brief Wakes up the flusher thread if it is waiting.
+ */
+static void logger_wake(void)
+{
+    atomic_fetch_add_explicit(&logger.signal, 1, memory_order_relaxed);
+    if (atomic_load_explicit(&logger.waiting, memory_order_relaxed))
+    {
+        syscall(SYS_futex, &logger.signal, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+    }
+}
 
+/**
+ * @brief Encodes a message given as variable arguments.
+ *
+ * @param buffer Receives the record.
+ * @param size The size of the buffer.
+ * @param creator The name or identifier of the message creator.
+ * @param type The type of message.
+ * @param message_format A printf-style message format.
+ * @param ... Arguments for the message format.
+ * @return The size of the record in bytes.
+ */
+static size_t log_render(char *buffer, size_t size, const char *creator, message_type type, const char *message_format, ...)
+{
     va_list args;
     va_start(args, message_format);
-    vfprintf(logfile, message_format, args);
+    size_t length = log_encode(buffer, size, -1, creator, type, message_format, args);
     va_end(args);
+    return length;
+}
 
-    fprintf(logfile, "\n");
+/**
+ * @brief Writes all published records from the ring to the log file.
+ *
+ * Records are copied into a local batch, which frees their slots at once,
+ * and the batch is written with one system call.
+ *
+ * @return The number of records written.
+ */
+static int logger_drain(void)
+{
+    static char batch[LOG_WRITE_BATCH_SIZE];
+    unsigned head = atomic_load_explicit(&logger.head, memory_order_relaxed);
+    size_t size = 0;
+    int count = 0;
 
-    fflush(logfile);
-    flock(fd, LOCK_UN);
-    fclose(logfile);
-}
\ No newline at end of file
+    unsigned long dropped = atomic_exchange_explicit(&logger.dropped, 0, memory_order_relaxed);
+    if (dropped > 0)
+    {
+        size += log_render(batch, LOG_RECORD_SIZE, "LOGGER", MSG_TYPE_ERROR, "%lu log records dropped", dropped);
+    }
+
+    while (1)
+    {
+        log_slot_t *slot = &logger.slots[head & (logger.capacity - 1)];
+        if (atomic_load_explicit(&slot->sequence, memory_order_acquire) != head + 1)
+        {
+            break;
+        }
+
+        if (size + slot->length > sizeof(batch))
+        {
+            log_write(logger.fd, batch, size);
+            size = 0;
+        }
+
+        memcpy(batch + size, slot->text, slot->length);
+        size += slot->length;
+        count++;
+
+        atomic_store_explicit(&slot->sequence, head + logger.capacity, memory_order_release);
+        head++;
+        atomic_store_explicit(&logger.head, head, memory_order_release);
+    }
+
+    if (size > 0)
+    {
+        log_write(logger.fd, batch, size);
+    }
+    return count;
+}
+
+/**
+ * @brief Flusher thread body.
+ *
+ * The thread writes the ring out every LOG_FLUSH_INTERVAL_MS, or sooner when
+ * producers find the ring half full. The ring is drained once more on stop.
+ *
+ * @param argument Unused.
+ * @return Always NULL.
+ */
+static void *logger_run(void *argument)
+{
+    while (atomic_load_explicit(&logger.running, memory_order_acquire))
+    {
+        logger_drain();
+
+        unsigned signal = atomic_load_explicit(&logger.signal, memory_order_relaxed);
+        atomic_store_explicit(&logger.waiting, 1, memory_order_relaxed);
+        atomic_thread_fence(memory_order_seq_cst);
+
+        unsigned used = atomic_load_explicit(&logger.tail, memory_order_relaxed) -
+                        atomic_load_explicit(&logger.head, memory_order_relaxed);
+        if (used < logger.capacity / 2 && atomic_load_explicit(&logger.running, memory_order_relaxed))
+        {
+            futex_wait(&logger.signal, signal, LOG_FLUSH_INTERVAL_MS);
+        }
+
+        atomic_store_explicit(&logger.waiting, 0, memory_order_relaxed);
+    }
+
+    logger_drain();
+    return NULL;
+}
+
+/**
+ * @brief Appends a record to the log file synchronously.
+ *
+ * Used when the background logger is not running. The file is opened,
+ * locked, written and closed for every record.
+ *
+ * @param data The record.
+ * @param size The size of the record in bytes.
+ */
+static void log_append(const char *data, size_t size)
+{
+    int fd = open(log_binary ? LOG_BINARY_FILE : LOG_FILE, O_WRONLY | O_APPEND | O_CREAT, 0644);
+    if (fd == -1)
+    {
+        perror("Failed to open log file.");
+        return;
+    }
+
+    log_write(fd, data, size);
+    close(fd);
+}
+
+/**
+ * @brief Claims the next slot of the ring.
+ *
+ * If the ring is full, the record is dropped or the caller waits for space,
+ * depending on the policy. A waiting caller gives up once the logger is
+ * stopped, since the flusher no longer frees slots.
+ *
+ * @param may_drop Whether the record may be dropped.
+ * @param position Receives the position of the slot.
+ * @return The slot, or NULL if the record was dropped or the logger stopped.
+ */
+static log_slot_t *logger_claim(bool may_drop, unsigned *position)
+{
+    unsigned tail = atomic_load_explicit(&logger.tail, memory_order_relaxed);
+
+    while (1)
+    {
+        log_slot_t *slot = &logger.slots[tail & (logger.capacity - 1)];
+        unsigned sequence = atomic_load_explicit(&slot->sequence, memory_order_acquire);
+        int difference = (int)(sequence - tail);
+
+        if (difference == 0)
+        {
+            if (atomic_compare_exchange_weak_explicit(&logger.tail, &tail, tail + 1, memory_order_relaxed, memory_order_relaxed))
+            {
+                *position = tail;
+                return slot;
+            }
+        }
+        else if (difference < 0)
+        {
+            if (!atomic_load_explicit(&logger.running, memory_order_acquire))
+            {
+                return NULL;
+            }
+            if (may_drop && logger.policy == LOG_POLICY_DROP)
+            {
+                atomic_fetch_add_explicit(&logger.dropped, 1, memory_order_relaxed);
+                return NULL;
+            }
+            logger_wake();
+            sched_yield();
+            tail = atomic_load_explicit(&logger.tail, memory_order_relaxed);
+        }
+        else
+        {
+            tail = atomic_load_explicit(&logger.tail, memory_order_relaxed);
+        }
+    }
+}
+
+/**
+ * @brief Hands a filled slot to the flusher thread.
+ *
+ * The flusher is woken up early once the ring is half full.
+ *
+ * @param slot The slot.
+ * @param position The position of the slot.
+ */
+static void logger_publish(log_slot_t *slot, unsigned position)
+{
+    atomic_store_explicit(&slot->sequence, position + 1, memory_order_release);
+
+    if (position + 1 - atomic_load_explicit(&logger.head, memory_order_relaxed) >= logger.capacity / 2)
+    {
+        atomic_thread_fence(memory_order_seq_cst);
+        logger_wake();
+    }
+}
+
+/**
+ * @brief Looks up a format in the format table.
+ *
+ * @param creator The name or identifier of the message creator.
+ * @param message_format The format string.
+ * @param known Receives whether the format is already in the table.
+ * @return The entry of the format if it is known, otherwise the first free
+ *         entry for it, or -1 if the table is full.
+ */
+static int log_format_probe(const char *creator, const char *message_format, bool *known)
+{
+    unsigned hash = ((uintptr_t)message_format ^ ((uintptr_t)creator >> 4)) * 2654435761u;
+
+    for (unsigned i = 0; i < LOG_MAX_FORMATS; i++)
+    {
+        int index = (hash + i) % LOG_MAX_FORMATS;
+        const char *format = atomic_load_explicit(&log_formats[index].format, memory_order_acquire);
+
+        if (format == NULL || (format == message_format && log_formats[index].creator == creator))
+        {
+            *known = format != NULL;
+            return index;
+        }
+    }
+
+    *known = false;
+    return -1;
+}
+
+/**
+ * @brief Adds a format to the format table and writes its definition record.
+ *
+ * The definition is written before the entry becomes visible to other threads,
+ * so every record that uses the format comes after it in the log.
+ * Must be called with the table locked.
+ *
+ * @param index The free entry to use.
+ * @param creator The name or identifier of the message creator.
+ * @param message_format The format string.
+ */
+static void log_format_define(int index, const char *creator, const char *message_format)
+{
+    log_format_entry_t *entry = &log_formats[index];
+
+    entry->creator = creator;
+    entry->supported = log_format_signature(message_format, entry->signature) != -1;
+
+    if (entry->supported)
+    {
+        char record[LOG_RECORD_SIZE];
+        size_t size = log_put_string(record, sizeof(log_record_header_t), sizeof(record), creator);
+        size = log_put_string(record, size, sizeof(record), message_format);
+        log_record_header(record, LOG_RECORD_FORMAT, index, MSG_TYPE_INFO, size);
+
+        unsigned position;
+        log_slot_t *slot;
+
+        if (atomic_load_explicit(&logger.running, memory_order_acquire) && (slot = logger_claim(false, &position)))
+        {
+            memcpy(slot->text, record, size);
+            slot->length = size;
+            logger_publish(slot, position);
+        }
+        else
+        {
+            log_append(record, size);
+        }
+    }
+
+    atomic_store_explicit(&entry->format, message_format, memory_order_release);
+}
+
+/**
+ * @brief Finds the identifier of a format in the binary log, defining it if needed.
+ *
+ * Formats are identified by the address of the creator and format strings,
+ * so a lookup of a known format only compares pointers without locking.
+ *
+ * @param creator The name or identifier of the message creator.
+ * @param message_format The format string.
+ * @return The format identifier, or -1 if the message has to be recorded as text.
+ */
+static int log_format_lookup(const char *creator, const char *message_format)
+{
+    bool known;
+    int index = log_format_probe(creator, message_format, &known);
+
+    if (!known)
+    {
+        pthread_mutex_lock(&log_formats_lock);
+        index = log_format_probe(creator, message_format, &known);
+        if (index != -1 && !known)
+        {
+            log_format_define(index, creator, message_format);
+        }
+        pthread_mutex_unlock(&log_formats_lock);
+    }
+
+    return index != -1 && log_formats[index].supported ? index : -1;
+}
+
+/**
+ * @brief Writes the message to a log file.
+ *
+ * Called through the log_message macro, which skips messages below the
+ * compile-time LOG_MIN_LEVEL or the runtime threshold without evaluating
+ * their arguments.
+ *
+ * When the background logger is running, the record is encoded straight
+ * into a slot of a lock-free ring and written out later by the flusher thread.
+ * Otherwise, the record is written synchronously. In binary mode, the record
+ * holds the format identifier and the raw arguments instead of text.
+ * The caller counts as a writer until it is done with the ring, so that
+ * logger_stop() does not free the slots under it.
+ *
+ * @param creator The name or identifier of the message creator.
+ * @param type The type of message (message_type) to be logged.
+ * @param message_format A message format that supports a variable number of arguments (printf-style).
+ * @param ... Variable number of arguments to format the message.
+ */
+void log_message_write(const char *creator, const message_type type, const char *message_format, ...)
+{
+    va_list args;
+    va_start(args, message_format);
+
+    atomic_fetch_add_explicit(&logger.writers, 1, memory_order_seq_cst);
+    int format = log_binary ? log_format_lookup(creator, message_format) : -1;
+
+    bool running = atomic_load_explicit(&logger.running, memory_order_seq_cst);
+    unsigned position;
+    log_slot_t *slot = running ? logger_claim(true, &position) : NULL;
+
+    if (slot)
+    {
+        slot->length = log_encode(slot->text, sizeof(slot->text), format, creator, type, message_format, args);
+        logger_publish(slot, position);
+    }
+    atomic_fetch_sub_explicit(&logger.writers, 1, memory_order_release);
+
+    // Records that found the logger stopped are written directly, unless the drop policy discarded them
+    if (!slot && (!running || logger.policy != LOG_POLICY_DROP))
+    {
+        char record[LOG_RECORD_SIZE];
+        size_t size = log_encode(record, sizeof(record), format, creator, type, message_format, args);
+        log_append(record, size);
+    }
+    va_end(args);
+}
+
+/**
+ * @brief Parses a logging setting from the command line.
+ *
+ * The setting is a comma-separated list of a policy and a buffer size:
+ * "sync" writes every record directly, "block" (the default) waits for space
+ * when the buffer is full and "drop" discards the record instead. The size
+ * is given in bytes with an optional k or m suffix, for example "drop,64k".
+ * "binary" writes compact records to LOG_BINARY_FILE instead of text, and
+ * "level=info|warning|error" sets the lowest level that is logged.
+ *
+ * @param spec The setting to parse.
+ * @param config Receives the logger settings.
+ * @return 0 on success, -1 if the setting is invalid.
+ */
+int logger_parse(const char *spec, log_config_t *config)
+{
+    config->policy = LOG_POLICY_BLOCK;
+    config->buffer_size = LOG_DEFAULT_BUFFER_SIZE;
+    config->binary = false;
+    config->threshold = LOG_LEVEL_INFO;
+
+    while (*spec)
+    {
+        const char *separator = strchr(spec, ',');
+        size_t length = separator ? (size_t)(separator - spec) : strlen(spec);
+
+        if (length == 4 && strncmp(spec, "sync", length) == 0)
+        {
+            config->policy = LOG_POLICY_SYNC;
+        }
+        else if (length == 5 && strncmp(spec, "block", length) == 0)
+        {
+            config->policy = LOG_POLICY_BLOCK;
+        }
+        else if (length == 4 && strncmp(spec, "drop", length) == 0)
+        {
+            config->policy = LOG_POLICY_DROP;
+        }
+        else if (length == 6 && strncmp(spec, "binary", length) == 0)
+        {
+            config->binary = true;
+        }
+        else if (length == 10 && strncmp(spec, "level=info", length) == 0)
+        {
+            config->threshold = LOG_LEVEL_INFO;
+        }
+        else if (length == 13 && strncmp(spec, "level=warning", length) == 0)
+        {
+            config->threshold = LOG_LEVEL_WARNING;
+        }
+        else if (length == 11 && strncmp(spec, "level=error", length) == 0)
+        {
+            config->threshold = LOG_LEVEL_ERROR;
+        }
+        else
+        {
+            char *end;
+            unsigned long size = strtoul(spec, &end, 10);
+
+            if (end < spec + length && (*end == 'k' || *end == 'K'))
+            {
+                size *= 1024;
+                end++;
+            }
+            else if (end < spec + length && (*end == 'm' || *end == 'M'))
+            {
+                size *= 1024 * 1024;
+                end++;
+            }
+
+            if (end != spec + length || size < 2 * sizeof(log_slot_t))
+            {
+                return -1;
+            }
+            config->buffer_size = size;
+        }
+
+        spec += length;
+        if (*spec == ',')
+        {
+            spec++;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Returns the logger of a forked child to synchronous writes.
+ *
+ * The flusher thread does not exist in the child. The child also starts with
+ * an empty format table, since app-logdecode keeps the formats per process
+ * and would not know the ones the parent defined under its own pid.
+ */
+static void logger_after_fork(void)
+{
+    atomic_store_explicit(&logger.running, false, memory_order_relaxed);
+    atomic_store_explicit(&logger.writers, 0, memory_order_relaxed);
+    logger.slots = NULL;
+    memset(log_formats, 0, sizeof(log_formats));
+    pthread_mutex_init(&log_formats_lock, NULL);
+}
+
+/**
+ * @brief Starts the background logger of this process.
+ *
+ * The ring gets as many slots as fit in the buffer size, rounded down to a
+ * power of two. The log file stays open until the logger is stopped, which
+ * also happens when the process exits.
+ *
+ * @param config The logger settings.
+ * @return 0 on success, -1 on failure, in which case logging stays synchronous.
+ */
+int logger_start(const log_config_t *config)
+{
+    log_binary = config->binary;
+    log_threshold = config->threshold;
+
+    if (config->policy == LOG_POLICY_SYNC || atomic_load_explicit(&logger.running, memory_order_relaxed))
+    {
+        return 0;
+    }
+
+    unsigned capacity = 2;
+    while ((size_t)capacity * 2 * sizeof(log_slot_t) <= config->buffer_size)
+    {
+        capacity *= 2;
+    }
+
+    logger.slots = malloc(capacity * sizeof(log_slot_t));
+    if (!logger.slots)
+    {
+        return -1;
+    }
+
+    logger.fd = open(log_binary ? LOG_BINARY_FILE : LOG_FILE, O_WRONLY | O_APPEND | O_CREAT, 0644);
+    if (logger.fd == -1)
+    {
+        free(logger.slots);
+        logger.slots = NULL;
+        return -1;
+    }
+
+    for (unsigned i = 0; i < capacity; i++)
+    {
+        atomic_init(&logger.slots[i].sequence, i);
+    }
+    logger.capacity = capacity;
+    logger.policy = config->policy;
+    atomic_init(&logger.tail, 0);
+    atomic_init(&logger.head, 0);
+    atomic_init(&logger.dropped, 0);
+    atomic_init(&logger.signal, 0);
+    atomic_init(&logger.waiting, 0);
+    atomic_store_explicit(&logger.running, true, memory_order_release);
+
+    if (pthread_create(&logger.thread, NULL, logger_run, NULL) != 0)
+    {
+        atomic_store_explicit(&logger.running, false, memory_order_relaxed);
+        close(logger.fd);
+        free(logger.slots);
+        logger.slots = NULL;
+        return -1;
+    }
+
+    static bool registered = false;
+    if (!registered)
+    {
+        pthread_atfork(NULL, NULL, logger_after_fork);
+        atexit(logger_stop);
+        registered = true;
+    }
+    return 0;
+}
+
+/**
+ * @brief Stops the background logger and writes out the remaining records.
+ *
+ * Logging falls back to synchronous writes afterwards. Writers that saw the
+ * logger running are waited for before the ring is drained and freed.
+ */
+void logger_stop(void)
+{
+    if (!logger.slots)
+    {
+        return;
+    }
+
+    atomic_store_explicit(&logger.running, false, memory_order_seq_cst);
+    logger_wake();
+    while (atomic_load_explicit(&logger.writers, memory_order_seq_cst) != 0)
+    {
+        sched_yield();
+    }
+    pthread_join(logger.thread, NULL);
+
+    logger_drain();
+    close(logger.fd);
+    free(logger.slots);
+    logger.slots = NULL;
+}
+
+/**
+ * @brief Sets the node that the calling thread logs for.
+ *
+ * The node identifier is stored in binary records, so that app-logdecode
+ * can filter by node.
+ *
+ * @param node_id The node, or -1 for the server.
+ */
+void logger_set_node(int node_id)
+{
+    log_node = node_id;
+}
@@ -0,0 +1,337 @@
+#include <errno.h>
+#include <time.h>
+
+#include "metrics.h"
+
+static const char *counter_names[METRIC_COUNTER_COUNT] = {
+    "received",
+    "delivered",
+    "forwarded",
+    "ttl drops",
+    "crc failures",
+    "decompression failures",
+    "duplicate broadcasts",
+    "send failures",
+    "retransmissions",
+    "link duplicates",
+    "link failures",
+    "fragment drops",
+    "reassembly timeouts",
+};
+
+static const char *histogram_names[METRIC_HISTOGRAM_COUNT] = {
+    "compress",
+    "decompress",
+    "route computation",
+    "link round trip",
+};
+
+/**
+ * @brief Maps the shared segment that holds the metrics of every node.
+ *
+ * @param flags Flags passed to shm_open().
+ * @param size Size of the segment. When creating, the segment is resized to it.
+ *             When attaching with 0, the size is read from the segment header.
+ * @return Pointer to the mapped segment, or NULL on failure.
+ */
+static metrics_shared_t *metrics_map(int flags, size_t size)
+{
+    int fd = shm_open(METRICS_SHM_NAME, flags, 0600);
+    if (fd == -1)
+    {
+        return NULL;
+    }
+
+    if ((flags & O_CREAT) && ftruncate(fd, size) == -1)
+    {
+        close(fd);
+        return NULL;
+    }
+
+    if (size == 0)
+    {
+        metrics_shared_t header;
+        if (pread(fd, &header, sizeof(header), 0) != sizeof(header))
+        {
+            close(fd);
+            return NULL;
+        }
+        size = header.size;
+    }
+
+    void *memory = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+
+    return memory == MAP_FAILED ? NULL : (metrics_shared_t *)memory;
+}
+
+/**
+ * @brief Creates the metrics segment on the server side.
+ *
+ * The segment starts zeroed, so all counters and histograms start empty.
+ *
+ * @param num_nodes Number of nodes in the network.
+ * @return The metrics segment, or NULL on failure.
+ */
+metrics_shared_t *metrics_create(int num_nodes)
+{
+    size_t size = sizeof(metrics_shared_t) + num_nodes * sizeof(node_metrics_t);
+
+    shm_unlink(METRICS_SHM_NAME);
+    metrics_shared_t *metrics = metrics_map(O_CREAT | O_RDWR, size);
+    if (!metrics)
+    {
+        return NULL;
+    }
+
+    metrics->size = size;
+    metrics->num_nodes = num_nodes;
+    return metrics;
+}
+
+/**
+ * @brief Attaches a node to the metrics segment created by the server.
+ *
+ * @return The metrics segment, or NULL on failure.
+ */
+metrics_shared_t *metrics_attach(void)
+{
+    return metrics_map(O_RDWR, 0);
+}
+
+/**
+ * @brief Unmaps and removes the metrics segment.
+ *
+ * @param metrics The metrics segment.
+ */
+void metrics_destroy(metrics_shared_t *metrics)
+{
+    metrics_detach(metrics);
+    shm_unlink(METRICS_SHM_NAME);
+}
+
+/**
+ * @brief Unmaps the metrics segment.
+ *
+ * @param metrics The metrics segment.
+ */
+void metrics_detach(metrics_shared_t *metrics)
+{
+    if (metrics)
+    {
+        munmap(metrics, metrics->size);
+    }
+}
+
+/**
+ * @brief Counts a node as ready to receive packets.
+ *
+ * @param metrics The metrics segment.
+ */
+void metrics_set_ready(metrics_shared_t *metrics)
+{
+    atomic_fetch_add(&metrics->ready, 1);
+}
+
+/**
+ * @brief Waits until the given number of nodes are ready.
+ *
+ * @param metrics The metrics segment.
+ * @param count The number of nodes to wait for.
+ * @param timeout_ms How long to wait at most, in milliseconds.
+ * @return The number of nodes that are ready.
+ */
+int metrics_wait_ready(metrics_shared_t *metrics, int count, int timeout_ms)
+{
+    uint64_t deadline = metrics_clock() + timeout_ms * 1000000ull;
+    int ready;
+
+    while ((ready = atomic_load(&metrics->ready)) < count && metrics_clock() < deadline)
+    {
+        metrics_sleep_until(metrics_clock() + 1000000);
+    }
+    return ready;
+}
+
+/**
+ * @brief Returns the metrics of one node.
+ *
+ * @param metrics The metrics segment.
+ * @param node_id The node.
+ * @return The metrics of the node, or NULL if the node is not in the segment.
+ */
+node_metrics_t *metrics_node(metrics_shared_t *metrics, int node_id)
+{
+    if (!metrics || node_id < 0 || node_id >= metrics->num_nodes)
+    {
+        return NULL;
+    }
+    return &metrics->nodes[node_id];
+}
+
+/**
+ * @brief Adds a value to a counter of a node.
+ *
+ * Only the node itself updates its metrics, so a relaxed load and store is
+ * enough and no atomic read-modify-write is needed. The server only reads.
+ *
+ * @param metrics The metrics of the node.
+ * @param counter The counter.
+ * @param value The value to add.
+ */
+void metrics_add(node_metrics_t *metrics, metrics_counter counter, unsigned long value)
+{
+    atomic_ulong *slot = &metrics->counters[counter];
+    atomic_store_explicit(slot, atomic_load_explicit(slot, memory_order_relaxed) + value, memory_order_relaxed);
+}
+
+/**
+ * @brief Returns a monotonic timestamp to measure durations with.
+ *
+ * @return The time in nanoseconds.
+ */
+uint64_t metrics_clock(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+/**
+ * @brief Waits until the given monotonic time.
+ *
+ * @param deadline The time in nanoseconds, as returned by metrics_clock().
+ */
+void metrics_sleep_until(uint64_t deadline)
+{
+    struct timespec until = {.tv_sec = deadline / 1000000000, .tv_nsec = deadline % 1000000000};
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &until, NULL) == EINTR)
+    {
+    }
+}
+
+/**
+ * @brief Returns the histogram bucket of a duration.
+ *
+ * Bucket i counts durations in [2^i, 2^(i+1)) nanoseconds; the last bucket
+ * also counts everything longer.
+ *
+ * @param elapsed The duration in nanoseconds.
+ * @return The bucket.
+ */
+int metrics_bucket(uint64_t elapsed)
+{
+    int bucket = 63 - __builtin_clzll(elapsed | 1);
+    return bucket < METRICS_HISTOGRAM_BUCKETS ? bucket : METRICS_HISTOGRAM_BUCKETS - 1;
+}
+
+/**
+ * @brief Records the time elapsed since a timestamp in a histogram of a node.
+ *
+ * Bucket i counts durations in [2^i, 2^(i+1)) nanoseconds.
+ *
+ * @param metrics The metrics of the node.
+ * @param histogram The histogram.
+ * @param start The timestamp returned by metrics_clock() when the operation started.
+ */
+void metrics_observe(node_metrics_t *metrics, metrics_histogram histogram, uint64_t start)
+{
+    uint64_t elapsed = metrics_clock() - start;
+    int bucket = metrics_bucket(elapsed);
+
+    metrics_histogram_t *target = &metrics->histograms[histogram];
+    atomic_store_explicit(&target->count, atomic_load_explicit(&target->count, memory_order_relaxed) + 1, memory_order_relaxed);
+    atomic_store_explicit(&target->total, atomic_load_explicit(&target->total, memory_order_relaxed) + elapsed, memory_order_relaxed);
+    atomic_store_explicit(&target->buckets[bucket], atomic_load_explicit(&target->buckets[bucket], memory_order_relaxed) + 1, memory_order_relaxed);
+}
+
+/**
+ * @brief Returns the upper bound of the bucket that holds a quantile.
+ *
+ * @param buckets The merged histogram buckets.
+ * @param count The number of samples in the histogram.
+ * @param quantile The quantile, between 0 and 1.
+ * @return The upper bound of the bucket in nanoseconds.
+ */
+uint64_t metrics_quantile(const unsigned long *buckets, unsigned long count, double quantile)
+{
+    unsigned long rank = (unsigned long)(quantile * count);
+    unsigned long seen = 0;
+
+    for (int i = 0; i < METRICS_HISTOGRAM_BUCKETS; i++)
+    {
+        seen += buckets[i];
+        if (seen > rank)
+        {
+            return 2ull << i;
+        }
+    }
+    return 2ull << (METRICS_HISTOGRAM_BUCKETS - 1);
+}
+
+/**
+ * @brief Prints the metrics of one node or the sum over all nodes.
+ *
+ * The metrics are read while the nodes keep updating them, so the output
+ * is a live snapshot that never blocks the data path.
+ *
+ * @param metrics The metrics segment.
+ * @param node_id The node, or -1 to aggregate all nodes.
+ */
+void metrics_print(const metrics_shared_t *metrics, int node_id)
+{
+    unsigned long counters[METRIC_COUNTER_COUNT] = {0};
+    unsigned long buckets[METRIC_HISTOGRAM_COUNT][METRICS_HISTOGRAM_BUCKETS] = {{0}};
+    unsigned long counts[METRIC_HISTOGRAM_COUNT] = {0};
+    unsigned long totals[METRIC_HISTOGRAM_COUNT] = {0};
+
+    int first = node_id < 0 ? 0 : node_id;
+    int last = node_id < 0 ? metrics->num_nodes - 1 : node_id;
+
+    for (int node = first; node <= last; node++)
+    {
+        const node_metrics_t *source = &metrics->nodes[node];
+
+        for (int i = 0; i < METRIC_COUNTER_COUNT; i++)
+        {
+            counters[i] += atomic_load_explicit(&source->counters[i], memory_order_relaxed);
+        }
+
+        for (int h = 0; h < METRIC_HISTOGRAM_COUNT; h++)
+        {
+            counts[h] += atomic_load_explicit(&source->histograms[h].count, memory_order_relaxed);
+            totals[h] += atomic_load_explicit(&source->histograms[h].total, memory_order_relaxed);
+            for (int i = 0; i < METRICS_HISTOGRAM_BUCKETS; i++)
+            {
+                buckets[h][i] += atomic_load_explicit(&source->histograms[h].buckets[i], memory_order_relaxed);
+            }
+        }
+    }
+
+    if (node_id < 0)
+    {
+        printf("Metrics of all %d nodes:\n", metrics->num_nodes);
+    }
+    else
+    {
+        printf("Metrics of node %d:\n", node_id);
+    }
+
+    for (int i = 0; i < METRIC_COUNTER_COUNT; i++)
+    {
+        printf("  %-24s %lu\n", counter_names[i], counters[i]);
+    }
+
+    for (int h = 0; h < METRIC_HISTOGRAM_COUNT; h++)
+    {
+        if (counts[h] == 0)
+        {
+            printf("  %-24s no samples\n", histogram_names[h]);
+            continue;
+        }
+
+        printf("  %-24s %lu samples, mean %lu ns, p50 < %llu ns, p99 < %llu ns\n", histogram_names[h], counts[h],
+               totals[h] / counts[h], (unsigned long long)metrics_quantile(buckets[h], counts[h], 0.5),
+               (unsigned long long)metrics_quantile(buckets[h], counts[h], 0.99));
+    }
+}
@@ -1,308 +1,212 @@
-#include <errno.h>
-
 #include "constants.h"
 #include "logger.h"
 #include "packet.h"
+#include "forwarding.h"
+#include "transport.h"
+#include "receipts.h"
 
-int node_id;
-int client_socket;
+topology_shared_t *topology;
+metrics_shared_t *metrics;
+node_metrics_t local_metrics;
+topology_view_t view;
+node_t node;
+transport_t *transport;
 
 /**
- * @brief Finds the next node to forward the packet through the graph.
+ * @brief Releases the resources of the node and terminates the program.
  *
- * The function implements the shortest path search algorithm (Dijkstra)
- * to determine the next node through which to send a packet
- * from the current node to the target node.
+ * @param status The exit code.
+ */
+void stop_node(int status)
+{
+    transport->close(transport);
+    node_free(&node);
+    topology_view_free(&view);
+    topology_detach(topology);
+    metrics_detach(metrics);
+    exit(status);
+}
+
+/**
+ * @brief Processes the termination signal.
+ *
+ * The function is called when the signal is received.
+ * It closes the transport and terminates the program with a success code.
  *
- * @param current_node The current node from which the packet is being sent.
- * @param destination_node The destination node to which the packet should be sent.
- * @param graph The adjacency matrix representing the graph.
- * @param size The size of the graph (number of nodes).
- * @return The index of the next node to forward the packet to, or -1 if no path is found.
+ * @param sig The identifier of the signal that was received.
  */
-int find_next_hop(int current_node, int destination_node, int graph[MAX_NODES][MAX_NODES], int size)
+void handle_signal(int sig)
 {
-    int distances[MAX_NODES];
-    bool visited[MAX_NODES];
-    int predecessors[MAX_NODES];
+    stop_node(EXIT_SUCCESS);
+}
 
-    for (int i = 0; i < size; i++)
+/**
+ * @brief Waits before the node tries to receive again after its transport failed.
+ *
+ * The wait doubles with every consecutive failure, so a transport that keeps
+ * failing does not make the node spin. The node stops once the failures
+ * reach NODE_RECEIVE_MAX_FAILURES.
+ *
+ * @param failures The number of consecutive failures, this one included.
+ */
+void back_off_receive(int failures)
+{
+    if (failures >= NODE_RECEIVE_MAX_FAILURES)
     {
-        distances[i] = INF;
-        visited[i] = false;
-        predecessors[i] = -1;
+        log_message("CLIENT", MSG_TYPE_ERROR, "Stopping after %d consecutive receive failures", failures);
+        stop_node(EXIT_FAILURE);
     }
 
-    distances[current_node] = 0;
-
-    for (int i = 0; i < size; i++)
+    int backoff = NODE_RECEIVE_BACKOFF_MS;
+    for (int i = 1; i < failures && backoff < NODE_RECEIVE_BACKOFF_MAX_MS; i++)
     {
-        int min_distance = INF;
-        int u = -1;
-        for (int j = 0; j < size; j++)
-        {
-            if (!visited[j] && distances[j] < min_distance)
-            {
-                min_distance = distances[j];
-                u = j;
-            }
-        }
-
-        if (u == -1)
-            break;
-
-        visited[u] = true;
-
-        for (int v = 0; v < size; v++)
-        {
-            if (graph[u][v] != INF && !visited[v])
-            {
-                int alt = distances[u] + graph[u][v];
-                if (alt < distances[v])
-                {
-                    distances[v] = alt;
-                    predecessors[v] = u;
-                }
-            }
-        }
+        backoff *= 2;
     }
-
-    if (predecessors[destination_node] == -1)
-        return -1;
-
-    int next_hop = destination_node;
-    while (predecessors[next_hop] != current_node)
+    if (backoff > NODE_RECEIVE_BACKOFF_MAX_MS)
     {
-        next_hop = predecessors[next_hop];
+        backoff = NODE_RECEIVE_BACKOFF_MAX_MS;
     }
 
-    return next_hop;
+    log_message("CLIENT", MSG_TYPE_ERROR, "Receive failed, retrying in %d ms", backoff);
+    metrics_sleep_until(metrics_clock() + (uint64_t)backoff * 1000000);
 }
 
 /**
- * @brief Broadcast packet sending.
+ * @brief Sends the delivery receipt of a traced message to the server.
  *
- * The function processes broadcast packets by checking for duplicates
- * and sends the packet to all nodes within a radius of 3 from the current node.
+ * Called for every message delivered to the node. Broadcasts and untraced
+ * messages have no receipt.
  *
- * @param packet Pointer to the packet to be sent.
+ * @param node The node the message was delivered to.
+ * @param packet The delivered message.
+ * @param context The transport used to reach the server.
  */
-void broadcast_signal(packet_t *packet)
+void send_receipt(node_t *node, const packet_t *packet, void *context)
 {
-    static int processed_broadcasts[MAX_NODES] = {0};
+    transport_t *server = context;
+    receipt_t receipt;
+    unsigned char data[RECEIPT_MAX_SIZE];
 
-    if (processed_broadcasts[packet->mac_packet.mac_sender])
+    if (!receipt_from_packet(packet, &receipt))
     {
-        log_message("CLIENT", MSG_TYPE_NOT_VALID_DATA, "Duplicate broadcast packet received, packet dropped");
         return;
     }
 
-    processed_broadcasts[packet->mac_packet.mac_sender] = 1;
+    struct iovec iov = {.iov_base = data, .iov_len = receipt_encode(&receipt, data)};
 
-    for (int i = 0; i < MAX_NODES; i++)
+    if (server->send(server, TRANSPORT_SERVER, &iov, 1) == -1)
     {
-        if (i != node_id && packet->network_graph[node_id][i] != INF && packet->network_graph[node_id][i] <= 3)
-        {
-            struct sockaddr_in node_address;
-            node_address.sin_family = AF_INET;
-            node_address.sin_port = htons(CLIENT_BASE_PORT + i);
-            node_address.sin_addr.s_addr = INADDR_ANY;
-
-            char compressed_data[sizeof(packet_t)];
-            size_t compressed_size = sizeof(packet_t);
-
-            int compress_result = compress_data((char *)packet, sizeof(packet_t), compressed_data, &compressed_size);
-
-            if (compress_result)
-            {
-                log_message("CLIENT", MSG_TYPE_ERROR, "Compression failed");
-                continue;
-            }
-
-            int sent_bytes = sendto(client_socket, compressed_data, compressed_size, 0, (struct sockaddr *)&node_address, sizeof(node_address));
-
-            if (sent_bytes == -1)
-            {
-                log_message("CLIENT", MSG_TYPE_ERROR, "Broadcast sendto() failed to node %d", i);
-            }
-            else
-            {
-                log_message("CLIENT", MSG_TYPE_INFO, "Broadcast packet sent to node %d", i);
-            }
-        }
+        log_message("CLIENT", MSG_TYPE_ERROR, "Failed to send the delivery receipt of message %d to the server", receipt.message_id);
     }
 }
 
-/**
- * @brief Sending a packet to the next node.
- *
- * The function handles the sending of the packet. If the TTL of the packet has expired, it is discarded.
- * Otherwise, the next node to route the packet is determined.
- *
- * @param packet Pointer to the packet to be sent.
- */
-void send_packet(packet_t *packet)
+int main(int argc, char *argv[])
 {
-    if (packet->mac_packet.ttl == 0)
+    transport_kind kind = TRANSPORT_UDP;
+    compression_level level = COMPRESSION_FAST;
+    bool dictionary = false;
+    bool reliable = false;
+    bool adaptive = false;
+    log_config_t log_config;
+
+    logger_parse("", &log_config);
+
+    if (argc < 2 || (argc > 2 && transport_parse(argv[2], &kind) == -1) ||
+        (argc > 3 && compression_parse(argv[3], &level, &dictionary) == -1) ||
+        (argc > 4 && logger_parse(argv[4], &log_config) == -1) ||
+        (argc > 5 && strcmp(argv[5], "reliable") != 0 && strcmp(argv[5], "unreliable") != 0 && strcmp(argv[5], "adaptive") != 0))
     {
-        log_message("CLIENT", MSG_TYPE_NOT_VALID_DATA, "TTL expired, packet dropped");
-        return;
+        fprintf(stderr, "Usage: %s <node_id> [udp|shm] [none|fast|best[:dict]] [logging] [reliable|unreliable|adaptive]\n", argv[0]);
+        exit(EXIT_FAILURE);
     }
 
-    packet->mac_packet.ttl--;
-
-    if (packet->mac_packet.mac_receiver == BROADCAST_NODE)
-    {
-        broadcast_signal(packet);
-        return;
-    }
+    compression_configure(level, dictionary);
+    reliable = argc > 5 && strcmp(argv[5], "unreliable") != 0;
+    adaptive = argc > 5 && strcmp(argv[5], "adaptive") == 0;
 
-    int next_node = find_next_hop(node_id, packet->mac_packet.mac_receiver, packet->network_graph, MAX_NODES);
+    int node_id = atoi(argv[1]);
 
-    if (next_node == -1)
+    logger_set_node(node_id);
+    if (logger_start(&log_config) == -1)
     {
-        log_message("CLIENT", MSG_TYPE_ERROR, "Next hop not found, packet dropped");
-        return;
+        log_message("CLIENT", MSG_TYPE_ERROR, "Failed to start the background logger");
     }
 
-    struct sockaddr_in node_address;
-    node_address.sin_family = AF_INET;
-    node_address.sin_port = htons(CLIENT_BASE_PORT + next_node);
-    node_address.sin_addr.s_addr = INADDR_ANY;
-
-    char compressed_data[sizeof(packet_t)];
-    size_t compressed_size = sizeof(packet_t);
-
-    int compress_result = compress_data((char *)packet, sizeof(packet_t), compressed_data, &compressed_size);
+    signal(SIGTERM, handle_signal);
 
-    if (compress_result)
+    transport = kind == TRANSPORT_SHM ? transport_shm_attach(node_id) : transport_udp_open(node_id);
+    if (!transport)
     {
-        log_message("CLIENT", MSG_TYPE_ERROR, "Compression failed");
-        return;
+        log_message("CLIENT", MSG_TYPE_ERROR, "Failed to open the %s transport", transport_name(kind));
+        exit(EXIT_FAILURE);
     }
 
-    int sent_bytes = sendto(client_socket, compressed_data, compressed_size, 0, (struct sockaddr *)&node_address, sizeof(node_address));
-
-    if (sent_bytes == -1)
-    {
-        log_message("CLIENT", MSG_TYPE_ERROR, "sendto() failed");
-    }
-    else
+    topology = topology_attach();
+    if (!topology)
     {
-        log_message("CLIENT", MSG_TYPE_INFO, "Sent MAC packet from %d to node %d, ttl %d", node_id, next_node, packet->mac_packet.ttl);
+        log_message("CLIENT", MSG_TYPE_ERROR, "Failed to attach to the topology segment");
+        exit(EXIT_FAILURE);
     }
-}
 
-/**
- * @brief Processes the termination signal.
- *
- * The function is called when the signal is received.
- * It closes the client socket and terminates the program with a success code.
- *
- * @param sig The identifier of the signal that was received.
- */
-void handle_signal(int sig)
-{
-    close(client_socket);
-    exit(EXIT_SUCCESS);
-}
-
-int main(int argc, char *argv[])
-{
-    if (argc < 2)
+    if (topology_view_init(&view, topology, false) == -1)
     {
-        fprintf(stderr, "Usage: %s <node_id>\n", argv[0]);
+        log_message("CLIENT", MSG_TYPE_ERROR, "Failed to synchronize the topology");
         exit(EXIT_FAILURE);
     }
 
-    node_id = atoi(argv[1]);
-
-    signal(SIGTERM, handle_signal);
-
-    client_socket = socket(AF_INET, SOCK_DGRAM, 0);
-
-    if (client_socket == -1)
+    if (node_id < 0 || node_id >= view.cache.graph.num_nodes)
     {
-        log_message("CLIENT", MSG_TYPE_ERROR, "Error in calling socket()");
+        log_message("CLIENT", MSG_TYPE_ERROR, "Node %d is not part of the topology", node_id);
         exit(EXIT_FAILURE);
     }
 
-    struct sockaddr_in node_address;
-    node_address.sin_family = AF_INET;
-    node_address.sin_port = htons(CLIENT_BASE_PORT + node_id);
-    node_address.sin_addr.s_addr = INADDR_ANY;
+    metrics = metrics_attach();
+    node_metrics_t *node_metrics = metrics_node(metrics, node_id);
+    if (!node_metrics)
+    {
+        log_message("CLIENT", MSG_TYPE_ERROR, "Failed to attach to the metrics segment");
+        node_metrics = &local_metrics;
+    }
 
-    if (bind(client_socket, (struct sockaddr *)&node_address, sizeof(node_address)) == -1)
+    if (node_init(&node, node_id, &view, transport, node_metrics) == -1)
     {
-        log_message("CLIENT", MSG_TYPE_ERROR, "Error in calling bind()");
+        log_message("CLIENT", MSG_TYPE_ERROR, "Failed to allocate the broadcast table");
         exit(EXIT_FAILURE);
     }
 
-    int flags = fcntl(client_socket, F_GETFL, 0);
-    fcntl(client_socket, F_SETFL, flags | O_NONBLOCK);
+    node.on_delivery = send_receipt;
+    node.delivery_context = transport;
+    node.reliable = reliable;
+    node.links.reports = adaptive;
 
-    char buffer[sizeof(packet_t)];
-    char decompressed_data[sizeof(packet_t)];
-    size_t decompressed_size = sizeof(decompressed_data);
+    if (node_metrics != &local_metrics)
+    {
+        metrics_set_ready(metrics);
+    }
 
-    struct sockaddr_in sender_addr;
-    socklen_t addr_len = sizeof(sender_addr);
+    static transport_batch_t batch;
+    int timeout = -1;
+    int failures = 0;
 
     while (1)
     {
-        int recv_bytes = recvfrom(client_socket, buffer, sizeof(buffer), 0, (struct sockaddr *)&sender_addr, &addr_len);
+        int received = transport->receive(transport, &batch, timeout);
 
-        if (recv_bytes == -1)
+        if (received == -1)
         {
-            if (errno == EWOULDBLOCK || errno == EAGAIN)
-            {
-                usleep(100000);
-                continue;
-            }
-            else
-            {
-                log_message("CLIENT", MSG_TYPE_ERROR, "recvfrom failed");
-                continue;
-            }
+            back_off_receive(++failures);
         }
-
-        if (recv_bytes > 0)
+        else
         {
-            int decompress_result = decompress_data(buffer, sizeof(packet_t), decompressed_data, &decompressed_size);
-
-            if (decompress_result != Z_OK)
-            {
-                log_message("CLIENT", MSG_TYPE_ERROR, "Decompression failed");
-                continue;
-            }
-
-            packet_t *packet = (packet_t *)decompressed_data;
-
-            uint16_t app_crc = calculate_crc((const char *)&packet->mac_packet.app_packet.message, sizeof(packet->mac_packet.app_packet.message_length));
-
-            uint16_t mac_crc = calculate_crc((const char *)&packet->mac_packet.app_packet, sizeof(packet->mac_packet.app_packet));
-
-            if (packet->mac_packet.app_packet.crc == app_crc && packet->mac_packet.crc == mac_crc)
-            {
+            failures = 0;
+        }
 
-                if (packet->mac_packet.mac_receiver == node_id)
-                {
-                    log_message("CLIENT", MSG_TYPE_INFO, "Message for this node: %s", packet->mac_packet.app_packet.message);
-                }
-                else if (packet->mac_packet.ttl > 0)
-                {
-                    send_packet(packet);
-                }
-                else
-                {
-                    log_message("CLIENT", MSG_TYPE_NOT_VALID_DATA, "TTL expired, packet dropped");
-                }
-            }
-            else
-            {
-                log_message("CLIENT", MSG_TYPE_ERROR, "Received packet with invalid CRC. Calculated MAC CRC: %u. Calculated APP CRC: %u", mac_crc, app_crc);
-            }
+        for (int i = 0; i < received; i++)
+        {
+            node_handle_packet(&node, batch.data[i], batch.sizes[i]);
         }
+
+        timeout = node_poll(&node, metrics_clock());
     }
 
     return EXIT_SUCCESS;
@@ -5,8 +5,9 @@
  * @brief Creates a data packet to send over the network.
  *
  * The function initializes the packet structure, fills it with fields,
- * such as sender, receiver, time to live (TTL), message ID, and the message itself.
- * The checksums (CRC) for the packet and its application are then calculated.
+ * such as header version, sender, receiver, time to live (TTL), message ID, and the message itself.
+ * The checksums (CRC32C) for the packet and its application are then calculated.
+ * Messages longer than MAX_MESSAGE_LENGTH - 1 bytes are truncated.
  *
  * @param mac_sender The MAC address of the sending node.
  * @param mac_receiver The MAC address of the destination node.
@@ -16,12 +17,13 @@
  * @param message The message to be sent in the packet.
  * @return Returns the generated packet of type packet_t.
  */
-packet_t create_packet(uint8_t mac_sender, uint8_t mac_receiver, uint8_t ttl,
-                       uint8_t app_sender, uint8_t app_receiver, const char *message)
+packet_t create_packet(node_id_t mac_sender, node_id_t mac_receiver, uint8_t ttl,
+                       node_id_t app_sender, node_id_t app_receiver, const char *message)
 {
     packet_t packet;
     memset(&packet, 0, sizeof(packet_t));
 
+    packet.mac_packet.version = PACKET_VERSION;
     packet.mac_packet.mac_sender = mac_sender;
     packet.mac_packet.mac_receiver = mac_receiver;
 
@@ -30,15 +32,528 @@ packet_t create_packet(uint8_t mac_sender, uint8_t mac_receiver, uint8_t ttl,
     packet.mac_packet.app_packet.app_sender = app_sender;
     packet.mac_packet.app_packet.app_receiver = app_receiver;
     packet.mac_packet.app_packet.message_id = atomic_fetch_add(&message_id, 1);
-    packet.mac_packet.app_packet.message_length = strlen(message);
+    packet.mac_packet.app_packet.message_length = strnlen(message, MAX_MESSAGE_LENGTH - 1);
 
-    strncpy(packet.mac_packet.app_packet.message, message, MAX_MESSAGE_LENGTH);
+    memcpy(packet.mac_packet.app_packet.message, message, packet.mac_packet.app_packet.message_length);
 
-    packet.mac_packet.app_packet.crc = calculate_crc((const char *)&packet.mac_packet.app_packet.message, sizeof(packet.mac_packet.app_packet.message_length));
+    packet.mac_packet.app_packet.crc = packet_app_crc(&packet.mac_packet.app_packet);
 
-    packet.mac_packet.crc = calculate_crc((const char *)&packet.mac_packet.app_packet, sizeof(packet.mac_packet.app_packet));
+    packet.mac_packet.crc = packet_mac_crc(&packet);
 
     packet.mac_packet.message_length = sizeof(app_packet_t) - MAX_MESSAGE_LENGTH + packet.mac_packet.app_packet.message_length + 2;
 
     return packet;
-}
\ No newline at end of file
+}
+
+/**
+ * @brief Creates one fragment of a transfer.
+ *
+ * The fragment is a packet whose message is a slice of the transfer, up
+ * to FRAGMENT_PAYLOAD_SIZE bytes that may hold any value, numbered so the
+ * destination can put the slices back in order.
+ *
+ * @param sender The node the transfer is sent from.
+ * @param receiver The node the transfer is sent to.
+ * @param ttl Packet lifetime, which determines the number of hops in the network.
+ * @param transfer_id Identifies the transfer among those of the sender.
+ * @param fragment_index Position of the fragment in the transfer.
+ * @param fragment_count Number of fragments of the transfer.
+ * @param data The slice of the transfer.
+ * @param length The size of the slice, at most FRAGMENT_PAYLOAD_SIZE bytes.
+ * @return The fragment.
+ */
+packet_t create_fragment(node_id_t sender, node_id_t receiver, uint8_t ttl, uint16_t transfer_id,
+                         uint16_t fragment_index, uint16_t fragment_count, const char *data, size_t length)
+{
+    packet_t packet = create_packet(sender, receiver, ttl, sender, receiver, "");
+    app_packet_t *app_packet = &packet.mac_packet.app_packet;
+
+    if (length > FRAGMENT_PAYLOAD_SIZE)
+    {
+        length = FRAGMENT_PAYLOAD_SIZE;
+    }
+
+    packet.mac_packet.flags |= PACKET_FLAG_FRAGMENT;
+    app_packet->transfer_id = transfer_id;
+    app_packet->fragment_index = fragment_index;
+    app_packet->fragment_count = fragment_count;
+    app_packet->message_length = length;
+    memcpy(app_packet->message, data, length);
+
+    app_packet->crc = packet_app_crc(app_packet);
+    packet.mac_packet.crc = packet_mac_crc(&packet);
+    packet.mac_packet.message_length = sizeof(app_packet_t) - MAX_MESSAGE_LENGTH + length + 2;
+
+    return packet;
+}
+
+/**
+ * @brief Stores a 16-bit value in network byte order.
+ *
+ * @param output Where the value is stored.
+ * @param value The value.
+ */
+void packet_put_u16(unsigned char *output, uint16_t value)
+{
+    output[0] = value >> 8;
+    output[1] = value;
+}
+
+/**
+ * @brief Stores a 32-bit value in network byte order.
+ *
+ * @param output Where the value is stored.
+ * @param value The value.
+ */
+void packet_put_u32(unsigned char *output, uint32_t value)
+{
+    output[0] = value >> 24;
+    output[1] = value >> 16;
+    output[2] = value >> 8;
+    output[3] = value;
+}
+
+/**
+ * @brief Loads a 16-bit value stored in network byte order.
+ *
+ * @param input Where the value is stored.
+ * @return The value.
+ */
+uint16_t packet_get_u16(const unsigned char *input)
+{
+    return (uint16_t)(input[0] << 8 | input[1]);
+}
+
+/**
+ * @brief Loads a 32-bit value stored in network byte order.
+ *
+ * @param input Where the value is stored.
+ * @return The value.
+ */
+uint32_t packet_get_u32(const unsigned char *input)
+{
+    return (uint32_t)input[0] << 24 | (uint32_t)input[1] << 16 | (uint32_t)input[2] << 8 | input[3];
+}
+
+/**
+ * @brief Encodes the application header as it is laid out on the wire.
+ *
+ * @param app_packet The application packet.
+ * @param output Receives the 7 bytes of the header, without the checksum.
+ */
+static void encode_app_header(const app_packet_t *app_packet, unsigned char *output)
+{
+    packet_put_u16(output, app_packet->app_sender);
+    packet_put_u16(output + 2, app_packet->app_receiver);
+    packet_put_u16(output + 4, app_packet->message_id);
+    output[6] = app_packet->message_length;
+}
+
+/**
+ * @brief Encodes the fragment fields as they are laid out on the wire.
+ *
+ * @param app_packet The application packet.
+ * @param output Receives PACKET_FRAGMENT_SIZE bytes.
+ */
+static void encode_fragment(const app_packet_t *app_packet, unsigned char *output)
+{
+    packet_put_u16(output, app_packet->transfer_id);
+    packet_put_u16(output + 2, app_packet->fragment_index);
+    packet_put_u16(output + 4, app_packet->fragment_count);
+}
+
+/**
+ * @brief Encodes the MAC header up to the topology epoch as it is laid out on the wire.
+ *
+ * The compression flag is left clear, since it only describes the payload
+ * of one datagram.
+ *
+ * @param packet The packet.
+ * @param output Receives the 15 bytes of the header before the MAC checksum.
+ */
+static void encode_mac_header(const packet_t *packet, unsigned char *output)
+{
+    const mac_packet_t *mac_packet = &packet->mac_packet;
+
+    output[0] = mac_packet->version;
+    output[1] = mac_packet->flags & ~PACKET_FLAG_COMPRESSED;
+    output[2] = mac_packet->ttl;
+    output[3] = mac_packet->hops;
+    output[4] = mac_packet->radius;
+    packet_put_u16(output + 5, mac_packet->mac_sender);
+    packet_put_u16(output + 7, mac_packet->mac_receiver);
+    packet_put_u16(output + 9, mac_packet->relay);
+    packet_put_u32(output + 11, packet->topology_epoch);
+}
+
+/**
+ * @brief Encodes the link fields as they are laid out on the wire.
+ *
+ * @param link The link fields.
+ * @param output Receives PACKET_LINK_SIZE bytes.
+ */
+static void encode_link(const packet_link_t *link, unsigned char *output)
+{
+    packet_put_u16(output, link->session);
+    packet_put_u32(output + 2, link->sequence);
+    packet_put_u32(output + 6, link->base);
+}
+
+/**
+ * @brief Calculates the end-to-end checksum of the application packet.
+ *
+ * The checksum covers the encoded application header (senders, message ID
+ * and length), the fragment fields, which are zero for a whole message, and
+ * the message bytes up to its length, so it does not depend on the byte
+ * order or the padding of the host.
+ *
+ * @param app_packet The application packet.
+ * @return The CRC32C of the application header and message.
+ */
+uint32_t packet_app_crc(const app_packet_t *app_packet)
+{
+    unsigned char header[7 + PACKET_FRAGMENT_SIZE];
+    size_t length = app_packet->message_length < MAX_MESSAGE_LENGTH ? app_packet->message_length : MAX_MESSAGE_LENGTH;
+
+    encode_app_header(app_packet, header);
+    encode_fragment(app_packet, header + 7);
+    return checksum_crc32c(checksum_crc32c(0, header, sizeof(header)), app_packet->message, length);
+}
+
+/**
+ * @brief Calculates the MAC checksum from the encoded fields it covers.
+ *
+ * @param header The encoded header, whose MAC checksum is not read.
+ * @param link The encoded link fields, or NULL if the packet has none.
+ * @return The CRC32C of the MAC header, the application checksum and the link fields.
+ */
+static uint32_t mac_crc_encoded(const unsigned char *header, const unsigned char *link)
+{
+    unsigned char fields[15];
+
+    memcpy(fields, header, sizeof(fields));
+    fields[1] &= ~PACKET_FLAG_COMPRESSED;
+
+    uint32_t crc = checksum_crc32c(0, fields, sizeof(fields));
+    crc = checksum_crc32c(crc, header + 26, 4);
+    return link ? checksum_crc32c(crc, link, PACKET_LINK_SIZE) : crc;
+}
+
+/**
+ * @brief Calculates the per-hop checksum of the MAC packet.
+ *
+ * The checksum covers the encoded MAC header (version, flags, TTL, hop
+ * count, radius, addresses, relay and topology epoch), the checksum of the
+ * application packet, which in turn protects the application header and
+ * message, and the link fields of a reliable packet. It is cheap to
+ * recompute whenever a node forwards the packet and changes its TTL, hop or
+ * link fields.
+ *
+ * @param packet The packet.
+ * @return The CRC32C of the MAC header, the application checksum and the link fields.
+ */
+uint32_t packet_mac_crc(const packet_t *packet)
+{
+    unsigned char header[PACKET_HEADER_SIZE];
+    unsigned char link[PACKET_LINK_SIZE];
+
+    encode_mac_header(packet, header);
+    packet_put_u32(header + 26, packet->mac_packet.app_packet.crc);
+    encode_link(&packet->link, link);
+    return mac_crc_encoded(header, (packet->mac_packet.flags & PACKET_FLAG_RELIABLE) ? link : NULL);
+}
+
+/**
+ * @brief Stamps new link fields on an encoded reliable packet.
+ *
+ * The MAC checksum of the datagram is recomputed to cover them, so a
+ * packet can be retransmitted with the oldest sequence its link still
+ * waits for.
+ *
+ * @param datagram A datagram encoded with PACKET_FLAG_RELIABLE.
+ * @param link The link fields.
+ */
+void packet_stamp_link(char *datagram, const packet_link_t *link)
+{
+    unsigned char *header = (unsigned char *)datagram;
+
+    encode_link(link, header + PACKET_HEADER_SIZE);
+    packet_put_u32(header + 15, mac_crc_encoded(header, header + PACKET_HEADER_SIZE));
+}
+
+/**
+ * @brief Encodes the header of a packet into a wire buffer.
+ *
+ * A reliable packet has its link fields encoded right after the header,
+ * then a traced packet has its trace and a fragment its fragment fields,
+ * as part of the same buffer. The trace is not covered by the checksums,
+ * since it changes on every hop.
+ * Used on its own to send a packet that was already serialized with
+ * different header fields, such as a broadcast whose relay flag differs
+ * between neighbors. The payload and its compression flag are kept.
+ *
+ * @param packet The packet whose header is encoded.
+ * @param wire A wire buffer filled by packet_serialize().
+ */
+void packet_serialize_header(const packet_t *packet, packet_wire_t *wire)
+{
+    const mac_packet_t *mac_packet = &packet->mac_packet;
+    const app_packet_t *app_packet = &mac_packet->app_packet;
+    unsigned char *header = wire->header;
+    unsigned char compressed = header[1] & PACKET_FLAG_COMPRESSED;
+
+    encode_mac_header(packet, header);
+    header[1] |= compressed;
+    packet_put_u32(header + 15, mac_packet->crc);
+    encode_app_header(app_packet, header + PACKET_APP_HEADER_OFFSET);
+    packet_put_u32(header + 26, app_packet->crc);
+
+    wire->iov[0].iov_base = header;
+    wire->iov[0].iov_len = PACKET_HEADER_SIZE;
+
+    if (mac_packet->flags & PACKET_FLAG_RELIABLE)
+    {
+        encode_link(&packet->link, header + PACKET_HEADER_SIZE);
+        wire->iov[0].iov_len += PACKET_LINK_SIZE;
+    }
+
+    if (mac_packet->flags & PACKET_FLAG_TRACE)
+    {
+        wire->iov[0].iov_len += packet_trace_encode(&packet->trace, header + wire->iov[0].iov_len);
+    }
+
+    if (mac_packet->flags & PACKET_FLAG_FRAGMENT)
+    {
+        encode_fragment(app_packet, header + wire->iov[0].iov_len);
+        wire->iov[0].iov_len += PACKET_FRAGMENT_SIZE;
+    }
+}
+
+/**
+ * @brief Encodes a packet for the wire.
+ *
+ * The header is written in network byte order into the wire buffer. The
+ * payload is the message up to its length: it is compressed with the
+ * configured codec when that makes it smaller, and otherwise referenced
+ * in place in the packet. The two parts are described by iovecs, so the
+ * transport gathers them without another copy. The packet must stay
+ * unchanged until the wire buffer has been sent.
+ *
+ * @param packet The packet to encode.
+ * @param wire Receives the header, the compressed payload and the iovecs.
+ * @return The size of the datagram in bytes.
+ */
+size_t packet_serialize(const packet_t *packet, packet_wire_t *wire)
+{
+    const app_packet_t *app_packet = &packet->mac_packet.app_packet;
+    size_t length = app_packet->message_length < MAX_MESSAGE_LENGTH ? app_packet->message_length : MAX_MESSAGE_LENGTH - 1;
+
+    wire->header[1] = 0;
+    packet_serialize_header(packet, wire);
+
+    wire->iov[1].iov_base = (void *)app_packet->message;
+    wire->iov[1].iov_len = length;
+    wire->count = 2;
+
+    size_t compressed_size = length;
+    if (length > 0 && compression_enabled() &&
+        compress_data(app_packet->message, length, wire->payload, &compressed_size) == Z_OK && compressed_size < length)
+    {
+        wire->header[1] |= PACKET_FLAG_COMPRESSED;
+        wire->iov[1].iov_base = wire->payload;
+        wire->iov[1].iov_len = compressed_size;
+    }
+
+    wire->size = wire->iov[0].iov_len + wire->iov[1].iov_len;
+    return wire->size;
+}
+
+/**
+ * @brief Decodes a datagram received from the wire into a packet.
+ *
+ * The checksums are copied as received; the caller verifies them.
+ *
+ * @param data The datagram.
+ * @param size The size of the datagram in bytes.
+ * @param packet Receives the packet.
+ * @return PACKET_PARSE_OK, or why the datagram was rejected.
+ */
+packet_parse_result packet_parse(const char *data, size_t size, packet_t *packet)
+{
+    const unsigned char *header = (const unsigned char *)data;
+
+    if (size < PACKET_HEADER_SIZE)
+    {
+        return PACKET_PARSE_MALFORMED;
+    }
+
+    if (header[0] != PACKET_VERSION)
+    {
+        return PACKET_PARSE_VERSION;
+    }
+
+    mac_packet_t *mac_packet = &packet->mac_packet;
+    app_packet_t *app_packet = &mac_packet->app_packet;
+    const char *payload = data + PACKET_HEADER_SIZE;
+    size_t payload_size = size - PACKET_HEADER_SIZE;
+
+    memset(packet, 0, sizeof(packet_t));
+    mac_packet->version = header[0];
+    mac_packet->flags = header[1] & ~PACKET_FLAG_COMPRESSED;
+    mac_packet->ttl = header[2];
+    mac_packet->hops = header[3];
+    mac_packet->radius = header[4];
+    mac_packet->mac_sender = packet_get_u16(header + 5);
+    mac_packet->mac_receiver = packet_get_u16(header + 7);
+    mac_packet->relay = packet_get_u16(header + 9);
+    packet->topology_epoch = packet_get_u32(header + 11);
+    mac_packet->crc = packet_get_u32(header + 15);
+    app_packet->app_sender = packet_get_u16(header + 19);
+    app_packet->app_receiver = packet_get_u16(header + 21);
+    app_packet->message_id = packet_get_u16(header + 23);
+    app_packet->message_length = header[25];
+    app_packet->crc = packet_get_u32(header + 26);
+
+    if (app_packet->message_length >= MAX_MESSAGE_LENGTH)
+    {
+        return PACKET_PARSE_MALFORMED;
+    }
+
+    if (mac_packet->flags & PACKET_FLAG_RELIABLE)
+    {
+        if (payload_size < PACKET_LINK_SIZE)
+        {
+            return PACKET_PARSE_MALFORMED;
+        }
+
+        const unsigned char *link = (const unsigned char *)payload;
+        packet->link.session = packet_get_u16(link);
+        packet->link.sequence = packet_get_u32(link + 2);
+        packet->link.base = packet_get_u32(link + 6);
+        payload += PACKET_LINK_SIZE;
+        payload_size -= PACKET_LINK_SIZE;
+    }
+
+    if (mac_packet->flags & PACKET_FLAG_TRACE)
+    {
+        int trace_size = packet_trace_decode((const unsigned char *)payload, payload_size, &packet->trace);
+        if (trace_size == -1)
+        {
+            return PACKET_PARSE_MALFORMED;
+        }
+        payload += trace_size;
+        payload_size -= trace_size;
+    }
+
+    if (mac_packet->flags & PACKET_FLAG_FRAGMENT)
+    {
+        if (payload_size < PACKET_FRAGMENT_SIZE)
+        {
+            return PACKET_PARSE_MALFORMED;
+        }
+
+        const unsigned char *fragment = (const unsigned char *)payload;
+        app_packet->transfer_id = packet_get_u16(fragment);
+        app_packet->fragment_index = packet_get_u16(fragment + 2);
+        app_packet->fragment_count = packet_get_u16(fragment + 4);
+        payload += PACKET_FRAGMENT_SIZE;
+        payload_size -= PACKET_FRAGMENT_SIZE;
+    }
+
+    if (header[1] & PACKET_FLAG_COMPRESSED)
+    {
+        size_t decompressed_size = app_packet->message_length;
+        if (decompress_data(payload, payload_size, app_packet->message, &decompressed_size) != Z_OK ||
+            decompressed_size != app_packet->message_length)
+        {
+            return PACKET_PARSE_DECOMPRESSION;
+        }
+    }
+    else if (payload_size == app_packet->message_length)
+    {
+        memcpy(app_packet->message, payload, payload_size);
+    }
+    else
+    {
+        return PACKET_PARSE_MALFORMED;
+    }
+
+    mac_packet->message_length = sizeof(app_packet_t) - MAX_MESSAGE_LENGTH + app_packet->message_length + 2;
+    return PACKET_PARSE_OK;
+}
+
+/**
+ * @brief Encodes the trace of a packet as it is laid out on the wire.
+ *
+ * @param trace The trace.
+ * @param output Receives PACKET_TRACE_SIZE(trace->count) bytes.
+ * @return The size of the encoded trace in bytes.
+ */
+size_t packet_trace_encode(const packet_trace_t *trace, unsigned char *output)
+{
+    uint8_t count = trace->count < TRACE_MAX_HOPS ? trace->count : TRACE_MAX_HOPS;
+
+    packet_put_u32(output, trace->sent_at >> 32);
+    packet_put_u32(output + 4, trace->sent_at);
+    output[8] = count;
+
+    for (int i = 0; i < count; i++)
+    {
+        packet_put_u16(output + 9 + 6 * i, trace->hops[i].node);
+        packet_put_u32(output + 11 + 6 * i, trace->hops[i].elapsed);
+    }
+
+    return PACKET_TRACE_SIZE(count);
+}
+
+/**
+ * @brief Decodes a trace received from the wire.
+ *
+ * @param input The encoded trace.
+ * @param size The number of bytes available.
+ * @param trace Receives the trace.
+ * @return The size of the encoded trace in bytes, or -1 if it is malformed.
+ */
+int packet_trace_decode(const unsigned char *input, size_t size, packet_trace_t *trace)
+{
+    if (size < PACKET_TRACE_SIZE(0) || input[8] > TRACE_MAX_HOPS || size < (size_t)PACKET_TRACE_SIZE(input[8]))
+    {
+        return -1;
+    }
+
+    trace->sent_at = (uint64_t)packet_get_u32(input) << 32 | packet_get_u32(input + 4);
+    trace->count = input[8];
+
+    for (int i = 0; i < trace->count; i++)
+    {
+        trace->hops[i].node = packet_get_u16(input + 9 + 6 * i);
+        trace->hops[i].elapsed = packet_get_u32(input + 11 + 6 * i);
+    }
+
+    return PACKET_TRACE_SIZE(trace->count);
+}
+
+/**
+ * @brief Records that a traced packet reached a node.
+ *
+ * The time is stored as nanoseconds since the packet was sent, saturated
+ * at UINT32_MAX. Untraced packets and full traces are left unchanged.
+ *
+ * @param packet The packet.
+ * @param node The node the packet reached.
+ * @param now The current time in nanoseconds, as returned by metrics_clock().
+ */
+void packet_trace_hop(packet_t *packet, node_id_t node, uint64_t now)
+{
+    packet_trace_t *trace = &packet->trace;
+
+    if (!(packet->mac_packet.flags & PACKET_FLAG_TRACE) || trace->count >= TRACE_MAX_HOPS)
+    {
+        return;
+    }
+
+    uint64_t elapsed = now > trace->sent_at ? now - trace->sent_at : 0;
+    trace->hops[trace->count].node = node;
+    trace->hops[trace->count].elapsed = elapsed < UINT32_MAX ? elapsed : UINT32_MAX;
+    trace->count++;
+}
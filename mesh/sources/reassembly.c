@@ -0,0 +1,244 @@
+#include "reassembly.h"
+#include "logger.h"
+
+#define REASSEMBLY_MS 1000000ull
+
+/**
+ * @brief Releases the transfers a node is reassembling.
+ *
+ * @param table The transfers.
+ */
+void reassembly_free(reassembly_table_t *table)
+{
+    for (int i = 0; table->transfers && i < REASSEMBLY_TRANSFERS; i++)
+    {
+        reassembly_finish(&table->transfers[i]);
+    }
+    free(table->transfers);
+    table->transfers = NULL;
+}
+
+/**
+ * @brief Frees the slot of a transfer that completed or was given up.
+ *
+ * @param transfer The transfer.
+ */
+void reassembly_finish(reassembly_t *transfer)
+{
+    free(transfer->fragments);
+    transfer->fragments = NULL;
+    transfer->active = false;
+}
+
+/**
+ * @brief Gives up the transfers that received no fragment for REASSEMBLY_TIMEOUT_MS.
+ *
+ * @param table The transfers.
+ * @param now The current time in nanoseconds.
+ * @return The number of transfers given up.
+ */
+int reassembly_expire(reassembly_table_t *table, uint64_t now)
+{
+    int expired = 0;
+
+    for (int i = 0; table->transfers && i < REASSEMBLY_TRANSFERS; i++)
+    {
+        reassembly_t *transfer = &table->transfers[i];
+
+        if (transfer->active && now - transfer->last_seen >= REASSEMBLY_TIMEOUT_MS * REASSEMBLY_MS)
+        {
+            log_message("CLIENT", MSG_TYPE_ERROR, "Transfer %d from node %d timed out after %d of %d fragments",
+                        transfer->transfer_id, transfer->origin, transfer->next, transfer->fragment_count);
+            reassembly_finish(transfer);
+            expired++;
+        }
+    }
+
+    return expired;
+}
+
+/**
+ * @brief Tells when the next transfer times out if it receives no fragment.
+ *
+ * @param table The transfers.
+ * @param now The current time in nanoseconds.
+ * @return How long until reassembly_expire() has a transfer to give up, in
+ *         milliseconds, or -1 if no transfer is being reassembled.
+ */
+int reassembly_timeout(const reassembly_table_t *table, uint64_t now)
+{
+    uint64_t deadline = UINT64_MAX;
+
+    for (int i = 0; table->transfers && i < REASSEMBLY_TRANSFERS; i++)
+    {
+        const reassembly_t *transfer = &table->transfers[i];
+        uint64_t expiry = transfer->last_seen + REASSEMBLY_TIMEOUT_MS * REASSEMBLY_MS;
+
+        if (transfer->active && expiry < deadline)
+        {
+            deadline = expiry;
+        }
+    }
+
+    if (deadline == UINT64_MAX)
+    {
+        return -1;
+    }
+
+    return deadline <= now ? 0 : (int)((deadline - now + REASSEMBLY_MS - 1) / REASSEMBLY_MS);
+}
+
+/**
+ * @brief Finds the transfer a fragment belongs to, starting it if needed.
+ *
+ * @param table The transfers.
+ * @param app_packet The fragment.
+ * @param now The current time in nanoseconds.
+ * @return The transfer, or NULL if every slot is taken or memory allocation failed.
+ */
+static reassembly_t *reassembly_find(reassembly_table_t *table, const app_packet_t *app_packet, uint64_t now)
+{
+    reassembly_t *free_slot = NULL;
+
+    if (!table->transfers)
+    {
+        table->transfers = calloc(REASSEMBLY_TRANSFERS, sizeof(reassembly_t));
+        if (!table->transfers)
+        {
+            return NULL;
+        }
+    }
+
+    for (int i = 0; i < REASSEMBLY_TRANSFERS; i++)
+    {
+        reassembly_t *transfer = &table->transfers[i];
+
+        if (!transfer->active)
+        {
+            free_slot = free_slot ? free_slot : transfer;
+        }
+        else if (transfer->origin == app_packet->app_sender && transfer->transfer_id == app_packet->transfer_id)
+        {
+            return transfer;
+        }
+    }
+
+    if (!free_slot)
+    {
+        return NULL;
+    }
+
+    free_slot->fragments = malloc(REASSEMBLY_WINDOW * sizeof(*free_slot->fragments));
+    if (!free_slot->fragments)
+    {
+        return NULL;
+    }
+
+    free_slot->active = true;
+    free_slot->origin = app_packet->app_sender;
+    free_slot->transfer_id = app_packet->transfer_id;
+    free_slot->fragment_count = app_packet->fragment_count;
+    free_slot->next = 0;
+    free_slot->size = 0;
+    free_slot->crc = 0;
+    free_slot->started_at = now;
+    memset(free_slot->present, 0, sizeof(free_slot->present));
+    return free_slot;
+}
+
+/**
+ * @brief Appends the data of a fragment to the reassembled stream.
+ *
+ * The stream is consumed as it grows: only its size and checksum are kept.
+ *
+ * @param transfer The transfer.
+ * @param data The data of the fragment.
+ * @param length The size of the data in bytes.
+ */
+static void reassembly_consume(reassembly_t *transfer, const char *data, size_t length)
+{
+    transfer->crc = checksum_crc32c(transfer->crc, data, length);
+    transfer->size += length;
+    transfer->next++;
+}
+
+/**
+ * @brief Adds a fragment received by its destination to its transfer.
+ *
+ * Fragments are consumed in order as soon as they arrive. A fragment that
+ * arrives ahead of a missing one is buffered, as long as it is less than
+ * REASSEMBLY_WINDOW fragments ahead, and consumed once the gap is filled,
+ * so a transfer of any size takes a bounded amount of memory. The first
+ * fragment is kept, so the caller can report the transfer with its trace.
+ *
+ * @param table The transfers of the destination.
+ * @param packet The fragment.
+ * @param now The current time in nanoseconds.
+ * @param transfer Receives the transfer of the fragment, unless it was dropped.
+ *                 A complete transfer must be released with reassembly_finish().
+ * @return REASSEMBLY_COMPLETE if the fragment completed its transfer,
+ *         REASSEMBLY_PENDING if more fragments are expected, REASSEMBLY_DUPLICATE
+ *         if the fragment was already received, or REASSEMBLY_DROPPED if it
+ *         is invalid, too far ahead, or no transfer slot is free.
+ */
+reassembly_result reassembly_add(reassembly_table_t *table, const packet_t *packet, uint64_t now, reassembly_t **transfer)
+{
+    const app_packet_t *app_packet = &packet->mac_packet.app_packet;
+
+    if (app_packet->fragment_count == 0 || app_packet->fragment_index >= app_packet->fragment_count)
+    {
+        return REASSEMBLY_DROPPED;
+    }
+
+    reassembly_t *found = reassembly_find(table, app_packet, now);
+    if (!found || found->fragment_count != app_packet->fragment_count)
+    {
+        return REASSEMBLY_DROPPED;
+    }
+
+    *transfer = found;
+    found->last_seen = now;
+
+    uint16_t index = app_packet->fragment_index;
+    int slot = index % REASSEMBLY_WINDOW;
+
+    if (index < found->next)
+    {
+        return REASSEMBLY_DUPLICATE;
+    }
+
+    if (index - found->next >= REASSEMBLY_WINDOW)
+    {
+        return REASSEMBLY_DROPPED;
+    }
+
+    if (found->present[slot])
+    {
+        return REASSEMBLY_DUPLICATE;
+    }
+
+    if (index == 0)
+    {
+        found->first = *packet;
+    }
+
+    if (index == found->next)
+    {
+        reassembly_consume(found, app_packet->message, app_packet->message_length);
+    }
+    else
+    {
+        memcpy(found->fragments[slot], app_packet->message, app_packet->message_length);
+        found->lengths[slot] = app_packet->message_length;
+        found->present[slot] = true;
+    }
+
+    while (found->next < found->fragment_count && found->present[found->next % REASSEMBLY_WINDOW])
+    {
+        slot = found->next % REASSEMBLY_WINDOW;
+        found->present[slot] = false;
+        reassembly_consume(found, found->fragments[slot], found->lengths[slot]);
+    }
+
+    return found->next == found->fragment_count ? REASSEMBLY_COMPLETE : REASSEMBLY_PENDING;
+}
@@ -0,0 +1,321 @@
+#include "receipts.h"
+
+#define RECEIPTS_EMPTY UINT32_MAX
+
+/**
+ * @brief Builds the delivery receipt of a traced message.
+ *
+ * @param packet The message, as delivered to its destination.
+ * @param receipt Receives the receipt.
+ * @return true if the message was traced and has a receipt, false otherwise.
+ */
+bool receipt_from_packet(const packet_t *packet, receipt_t *receipt)
+{
+    if (!(packet->mac_packet.flags & PACKET_FLAG_TRACE) || packet->mac_packet.mac_receiver == BROADCAST_NODE)
+    {
+        return false;
+    }
+
+    receipt->origin = packet->mac_packet.app_packet.app_sender;
+    receipt->destination = packet->mac_packet.app_packet.app_receiver;
+    receipt->message_id = packet->mac_packet.app_packet.message_id;
+    receipt->trace = packet->trace;
+    return true;
+}
+
+/**
+ * @brief Encodes a receipt to send it to the server.
+ *
+ * @param receipt The receipt.
+ * @param output Receives at most RECEIPT_MAX_SIZE bytes.
+ * @return The size of the encoded receipt in bytes.
+ */
+size_t receipt_encode(const receipt_t *receipt, unsigned char *output)
+{
+    output[0] = RECEIPT_TYPE;
+    packet_put_u16(output + 1, receipt->origin);
+    packet_put_u16(output + 3, receipt->destination);
+    packet_put_u16(output + 5, receipt->message_id);
+
+    return RECEIPT_HEADER_SIZE + packet_trace_encode(&receipt->trace, output + RECEIPT_HEADER_SIZE);
+}
+
+/**
+ * @brief Decodes a receipt received by the server.
+ *
+ * @param data The datagram.
+ * @param size The size of the datagram in bytes.
+ * @param receipt Receives the receipt.
+ * @return 0 on success, -1 if the datagram is not a valid receipt.
+ */
+int receipt_decode(const char *data, size_t size, receipt_t *receipt)
+{
+    const unsigned char *input = (const unsigned char *)data;
+
+    if (size < RECEIPT_HEADER_SIZE || input[0] != RECEIPT_TYPE)
+    {
+        return -1;
+    }
+
+    receipt->origin = packet_get_u16(input + 1);
+    receipt->destination = packet_get_u16(input + 3);
+    receipt->message_id = packet_get_u16(input + 5);
+
+    int trace_size = packet_trace_decode(input + RECEIPT_HEADER_SIZE, size - RECEIPT_HEADER_SIZE, &receipt->trace);
+    return trace_size == -1 || (size_t)trace_size != size - RECEIPT_HEADER_SIZE ? -1 : 0;
+}
+
+/**
+ * @brief Initializes an empty set of delivery statistics.
+ *
+ * @param receipts The statistics.
+ * @return 0 on success, -1 on failure.
+ */
+int receipts_init(receipts_t *receipts)
+{
+    memset(receipts, 0, sizeof(receipts_t));
+    return pthread_mutex_init(&receipts->lock, NULL) == 0 ? 0 : -1;
+}
+
+/**
+ * @brief Releases the delivery statistics.
+ *
+ * @param receipts The statistics.
+ */
+void receipts_free(receipts_t *receipts)
+{
+    free(receipts->pairs);
+    receipts->pairs = NULL;
+    pthread_mutex_destroy(&receipts->lock);
+}
+
+/**
+ * @brief Returns the first slot of the hash table to probe for a pair.
+ *
+ * @param key The pair, origin in the high half and destination in the low half.
+ * @param capacity The size of the table, a power of two.
+ * @return The slot.
+ */
+static size_t receipts_slot(uint32_t key, size_t capacity)
+{
+    return (size_t)((key * 0x9E3779B97F4A7C15ull) >> 32) & (capacity - 1);
+}
+
+/**
+ * @brief Finds the statistics of a pair of nodes, adding them if needed.
+ *
+ * The pairs are kept in an open-addressing hash table that doubles when
+ * it is 70% full, so only the pairs that actually exchanged messages
+ * take memory. Must be called with the statistics locked.
+ *
+ * @param receipts The statistics.
+ * @param origin The node the messages were sent from.
+ * @param destination The node the messages were sent to.
+ * @param add Whether to add the pair if it is not in the table yet.
+ * @return The statistics of the pair, or NULL if the pair is not in the
+ *         table or memory allocation failed.
+ */
+static receipt_pair_t *receipts_pair(receipts_t *receipts, int origin, int destination, bool add)
+{
+    uint32_t key = (uint32_t)origin << 16 | (uint16_t)destination;
+
+    if (add && (receipts->count + 1) * 10 > receipts->capacity * 7)
+    {
+        size_t capacity = receipts->capacity ? receipts->capacity * 2 : 1024;
+        receipt_pair_t *pairs = malloc(capacity * sizeof(receipt_pair_t));
+        if (!pairs)
+        {
+            return NULL;
+        }
+
+        for (size_t i = 0; i < capacity; i++)
+        {
+            pairs[i].key = RECEIPTS_EMPTY;
+        }
+
+        for (size_t i = 0; i < receipts->capacity; i++)
+        {
+            if (receipts->pairs[i].key != RECEIPTS_EMPTY)
+            {
+                size_t slot = receipts_slot(receipts->pairs[i].key, capacity);
+                while (pairs[slot].key != RECEIPTS_EMPTY)
+                {
+                    slot = (slot + 1) & (capacity - 1);
+                }
+                pairs[slot] = receipts->pairs[i];
+            }
+        }
+
+        free(receipts->pairs);
+        receipts->pairs = pairs;
+        receipts->capacity = capacity;
+    }
+
+    if (receipts->capacity == 0)
+    {
+        return NULL;
+    }
+
+    size_t slot = receipts_slot(key, receipts->capacity);
+    while (receipts->pairs[slot].key != key)
+    {
+        if (receipts->pairs[slot].key == RECEIPTS_EMPTY)
+        {
+            if (!add)
+            {
+                return NULL;
+            }
+            memset(&receipts->pairs[slot], 0, sizeof(receipt_pair_t));
+            receipts->pairs[slot].key = key;
+            receipts->count++;
+            break;
+        }
+        slot = (slot + 1) & (receipts->capacity - 1);
+    }
+
+    return &receipts->pairs[slot];
+}
+
+/**
+ * @brief Counts a message sent between two nodes.
+ *
+ * @param receipts The statistics.
+ * @param origin The node the message is sent from.
+ * @param destination The node the message is sent to.
+ */
+void receipts_sent(receipts_t *receipts, int origin, int destination)
+{
+    pthread_mutex_lock(&receipts->lock);
+
+    receipt_pair_t *pair = receipts_pair(receipts, origin, destination, true);
+    if (pair)
+    {
+        pair->sent++;
+    }
+    receipts->total.sent++;
+
+    pthread_mutex_unlock(&receipts->lock);
+}
+
+/**
+ * @brief Adds a delivery to the statistics of a pair.
+ *
+ * @param pair The statistics of the pair, or the totals.
+ * @param receipt The receipt of the delivery.
+ * @param latency The time from the send to the delivery in nanoseconds.
+ */
+static void receipts_add(receipt_pair_t *pair, const receipt_t *receipt, uint64_t latency)
+{
+    pair->delivered++;
+    pair->hops += receipt->trace.count > 0 ? receipt->trace.count - 1 : 0;
+    pair->latency_total += latency;
+    pair->buckets[metrics_bucket(latency)]++;
+    if (latency > pair->latency_max)
+    {
+        pair->latency_max = latency;
+    }
+    pair->last = *receipt;
+}
+
+/**
+ * @brief Records a delivery receipt.
+ *
+ * The end-to-end latency is the time from the send by the server to the
+ * last hop of the trace, which is the destination. The source node counts
+ * as the first hop, so the hop count is one less than the trace length.
+ *
+ * @param receipts The statistics.
+ * @param receipt The receipt.
+ */
+void receipts_record(receipts_t *receipts, const receipt_t *receipt)
+{
+    uint64_t latency = receipt->trace.count > 0 ? receipt->trace.hops[receipt->trace.count - 1].elapsed : 0;
+
+    pthread_mutex_lock(&receipts->lock);
+
+    receipt_pair_t *pair = receipts_pair(receipts, receipt->origin, receipt->destination, true);
+    if (pair)
+    {
+        receipts_add(pair, receipt, latency);
+    }
+    receipts_add(&receipts->total, receipt, latency);
+
+    pthread_mutex_unlock(&receipts->lock);
+}
+
+/**
+ * @brief Prints the delivery rate, hop count and latency of a pair.
+ *
+ * @param pair The statistics of the pair, or the totals.
+ */
+static void receipts_print_pair(const receipt_pair_t *pair)
+{
+    printf("  %-24s %lu\n", "sent", pair->sent);
+    printf("  %-24s %lu (%.2f%%)\n", "delivered", pair->delivered,
+           pair->sent ? 100.0 * pair->delivered / pair->sent : 0.0);
+
+    if (pair->delivered == 0)
+    {
+        return;
+    }
+
+    printf("  %-24s mean %.2f\n", "hops", (double)pair->hops / pair->delivered);
+    printf("  %-24s mean %llu ns, p50 < %llu ns, p99 < %llu ns, max %llu ns\n", "latency",
+           (unsigned long long)(pair->latency_total / pair->delivered),
+           (unsigned long long)metrics_quantile(pair->buckets, pair->delivered, 0.5),
+           (unsigned long long)metrics_quantile(pair->buckets, pair->delivered, 0.99),
+           (unsigned long long)pair->latency_max);
+}
+
+/**
+ * @brief Prints the delivery statistics of all messages or of one pair.
+ *
+ * For a pair, the trace of the last delivered message is printed as well,
+ * with the time each hop was reached after the send.
+ *
+ * @param receipts The statistics.
+ * @param origin The node the messages were sent from, or -1 for all messages.
+ * @param destination The node the messages were sent to.
+ */
+void receipts_print(receipts_t *receipts, int origin, int destination)
+{
+    pthread_mutex_lock(&receipts->lock);
+
+    if (origin < 0)
+    {
+        unsigned long lossy = 0;
+        for (size_t i = 0; i < receipts->capacity; i++)
+        {
+            if (receipts->pairs[i].key != RECEIPTS_EMPTY && receipts->pairs[i].delivered < receipts->pairs[i].sent)
+            {
+                lossy++;
+            }
+        }
+
+        printf("Delivery receipts of %zu pairs:\n", receipts->count);
+        receipts_print_pair(&receipts->total);
+        printf("  %-24s %lu\n", "pairs with losses", lossy);
+        pthread_mutex_unlock(&receipts->lock);
+        return;
+    }
+
+    printf("Delivery receipts from %d to %d:\n", origin, destination);
+
+    receipt_pair_t *pair = receipts_pair(receipts, origin, destination, false);
+    if (!pair)
+    {
+        printf("  No messages were sent.\n");
+    }
+    else
+    {
+        receipts_print_pair(pair);
+
+        const packet_trace_t *trace = &pair->last.trace;
+        for (int i = 0; pair->delivered > 0 && i < trace->count; i++)
+        {
+            printf("  %-24s node %d after %u ns\n", i == 0 ? "last message" : "", trace->hops[i].node, trace->hops[i].elapsed);
+        }
+    }
+
+    pthread_mutex_unlock(&receipts->lock);
+}
@@ -0,0 +1,472 @@
+#include "routing.h"
+#include "graph.h"
+
+#define ROUTE_UNRESOLVED -2
+
+// Whether the set of equal-cost next hops of a destination has been collected
+#define ROUTE_SPREAD_UNKNOWN 0
+#define ROUTE_SPREAD_VISITING 1
+#define ROUTE_SPREAD_DONE 2
+
+/**
+ * @brief Determines the first hop on the shortest path to a node.
+ *
+ * The function walks the predecessor chain up to the first node whose next hop
+ * is already known (or to a direct neighbor of the source), then assigns that
+ * next hop to every node on the walked chain, so that each entry is resolved once.
+ *
+ * @param table The routing table being filled.
+ * @param node The destination whose next hop is needed.
+ */
+static void route_table_resolve(route_table_t *table, int node)
+{
+    int current = node;
+    int next_hop = -1;
+
+    while (table->next_hops[current] == ROUTE_UNRESOLVED)
+    {
+        int predecessor = table->predecessors[current];
+        if (predecessor == -1)
+        {
+            break;
+        }
+        if (predecessor == table->source)
+        {
+            next_hop = current;
+            break;
+        }
+        current = predecessor;
+    }
+
+    if (table->next_hops[current] != ROUTE_UNRESOLVED)
+    {
+        next_hop = table->next_hops[current];
+    }
+
+    for (current = node; current != -1 && table->next_hops[current] == ROUTE_UNRESOLVED; current = table->predecessors[current])
+    {
+        table->next_hops[current] = next_hop;
+    }
+}
+
+/**
+ * @brief Tells whether an edge into a node lies on a shortest path from the source.
+ *
+ * @param table The routing table.
+ * @param e The edge, in the adjacency of v.
+ * @param v The node the edge leads to.
+ * @return true if the other end of the edge is not the source and a shortest path to v runs through it.
+ */
+static bool route_table_tied(const route_table_t *table, int e, int v)
+{
+    const csr_graph_t *graph = table->graph;
+    int u = graph->targets[e];
+
+    return u != table->source && graph->weights[e] != INF && table->distances[u] != INF &&
+           table->distances[u] + graph->weights[e] == table->distances[v];
+}
+
+/**
+ * @brief Collects every neighbor that lies on a shortest path to a destination.
+ *
+ * A neighbor whose shortest path is its direct edge starts with itself, and
+ * every other node inherits the sets of all nodes one edge before it on a
+ * shortest path. The sets are collected the first time a destination is
+ * looked up, depth first through the nodes before it, and kept until the
+ * table is rebuilt or repaired. The heap of the table holds the stack and the
+ * edge each node on it has reached, so the walk does not allocate. Only the
+ * first ROUTE_MULTIPATH_NEIGHBORS neighbors of the source are tracked; a
+ * destination reached through the others alone keeps a single next hop.
+ *
+ * @param table The routing table.
+ * @param destination A destination with a known path.
+ * @return The set of neighbors, as in next_hop_sets.
+ */
+static uint64_t route_table_spread(route_table_t *table, int destination)
+{
+    const csr_graph_t *graph = table->graph;
+    int *stack = table->heap.nodes;
+    int *cursors = table->heap.positions;
+    int depth = 0;
+
+    if (table->spread[destination] == ROUTE_SPREAD_DONE)
+    {
+        return table->next_hop_sets[destination];
+    }
+
+    table->spread[destination] = ROUTE_SPREAD_VISITING;
+    cursors[destination] = graph->offsets[destination];
+    stack[depth++] = destination;
+
+    while (depth > 0)
+    {
+        int v = stack[depth - 1];
+        int end = graph->offsets[v + 1];
+
+        while (cursors[v] < end && (table->spread[graph->targets[cursors[v]]] != ROUTE_SPREAD_UNKNOWN ||
+                                    !route_table_tied(table, cursors[v], v)))
+        {
+            cursors[v]++;
+        }
+
+        if (cursors[v] < end)
+        {
+            int u = graph->targets[cursors[v]];
+            table->spread[u] = ROUTE_SPREAD_VISITING;
+            cursors[u] = graph->offsets[u];
+            stack[depth++] = u;
+            continue;
+        }
+
+        uint64_t set = 0;
+        for (int e = graph->offsets[v]; e < end; e++)
+        {
+            int u = graph->targets[e];
+
+            if (u == table->source && graph->weights[e] != INF && graph->weights[e] == table->distances[v])
+            {
+                for (int i = 0; i < table->neighbor_count; i++)
+                {
+                    if (table->neighbors[i] == v)
+                    {
+                        set |= 1ull << i;
+                    }
+                }
+            }
+            else if (route_table_tied(table, e, v))
+            {
+                set |= table->next_hop_sets[u];
+            }
+        }
+
+        table->next_hop_sets[v] = set;
+        table->spread[v] = ROUTE_SPREAD_DONE;
+        depth--;
+    }
+
+    return table->next_hop_sets[destination];
+}
+
+/**
+ * @brief Forgets the next-hop sets that ran through a removed node.
+ *
+ * Must be called before the distances are repaired. The sets that can change
+ * are those of the nodes after the removed one on a shortest path, which
+ * includes every node whose distance grows. A set is only collected after the
+ * sets of all nodes before it, so the walk stops at sets not collected yet.
+ *
+ * @param table The routing table, with the distances from before the removal.
+ * @param node_id The removed node.
+ */
+static void route_table_forget_spread(route_table_t *table, int node_id)
+{
+    const csr_graph_t *graph = table->graph;
+    int *stack = table->heap.nodes;
+    int depth = 0;
+
+    table->spread[node_id] = ROUTE_SPREAD_UNKNOWN;
+
+    // The edges of the removed node lost their weights, so every farther neighbor may have come through it
+    for (int e = graph->offsets[node_id]; e < graph->offsets[node_id + 1]; e++)
+    {
+        int v = graph->targets[e];
+        if (table->spread[v] == ROUTE_SPREAD_DONE && table->distances[v] > table->distances[node_id])
+        {
+            table->spread[v] = ROUTE_SPREAD_UNKNOWN;
+            stack[depth++] = v;
+        }
+    }
+
+    while (depth > 0)
+    {
+        int u = stack[--depth];
+
+        for (int e = graph->offsets[u]; e < graph->offsets[u + 1]; e++)
+        {
+            int v = graph->targets[e];
+            if (table->spread[v] == ROUTE_SPREAD_DONE && graph->weights[e] != INF &&
+                table->distances[u] + graph->weights[e] == table->distances[v])
+            {
+                table->spread[v] = ROUTE_SPREAD_UNKNOWN;
+                stack[depth++] = v;
+            }
+        }
+    }
+}
+
+/**
+ * @brief Builds the next-hop table of a node from scratch.
+ *
+ * Shortest paths are computed once for the whole graph. Afterwards, forwarding
+ * a packet is a single lookup in the next_hops array. The sets of equal-cost
+ * next hops are only collected when a flow is looked up. The table keeps the
+ * heap of the search, so rebuilding it does not allocate.
+ *
+ * @param table The routing table to build. Must be zeroed before the first build.
+ * @param graph The CSR graph.
+ * @param source The node that owns the table.
+ * @return 0 on success, -1 if memory allocation failed.
+ */
+int route_table_build(route_table_t *table, const csr_graph_t *graph, int source)
+{
+    int num_nodes = graph->num_nodes;
+
+    if (table->num_nodes != num_nodes || !table->distances)
+    {
+        route_table_free(table);
+        table->distances = malloc(num_nodes * sizeof(int));
+        table->predecessors = malloc(num_nodes * sizeof(int));
+        table->next_hops = malloc(num_nodes * sizeof(int));
+        table->next_hop_sets = malloc(num_nodes * sizeof(uint64_t));
+        table->spread = malloc(num_nodes * sizeof(uint8_t));
+
+        if (!table->distances || !table->predecessors || !table->next_hops || !table->next_hop_sets || !table->spread ||
+            node_heap_init(&table->heap, num_nodes) == -1)
+        {
+            route_table_free(table);
+            return -1;
+        }
+    }
+
+    table->source = source;
+    table->num_nodes = num_nodes;
+    table->graph = graph;
+
+    if (dijkstra(graph, source, table->distances, table->predecessors, &table->heap) == -1)
+    {
+        return -1;
+    }
+
+    for (int i = 0; i < num_nodes; i++)
+    {
+        table->next_hops[i] = ROUTE_UNRESOLVED;
+    }
+    table->next_hops[source] = -1;
+
+    for (int i = 0; i < num_nodes; i++)
+    {
+        route_table_resolve(table, i);
+    }
+
+    memset(table->spread, ROUTE_SPREAD_UNKNOWN, num_nodes * sizeof(uint8_t));
+    table->neighbor_count = 0;
+    for (int e = graph->offsets[source]; e < graph->offsets[source + 1] && table->neighbor_count < ROUTE_MULTIPATH_NEIGHBORS; e++)
+    {
+        table->neighbors[table->neighbor_count++] = graph->targets[e];
+    }
+    return 0;
+}
+
+/**
+ * @brief Repairs the routing table after a node has been removed from the graph.
+ *
+ * Only destinations whose shortest path ran through the removed node can change.
+ * Their distances are seeded from unaffected neighbors, and Dijkstra is resumed
+ * from that frontier, so it only settles nodes in the affected set. All other
+ * distances and next hops are left untouched. The sets of equal-cost next hops
+ * are forgotten for the nodes after the removed one on a shortest path, which
+ * includes the affected set, and collected again when they are looked up.
+ * If the repair runs out of memory, the table is rebuilt from scratch instead.
+ *
+ * @param table The routing table to repair.
+ * @param graph The CSR graph, with the node already removed.
+ * @param node_id The removed node.
+ * @return 0 on success, -1 if memory allocation failed.
+ */
+int route_table_remove_node(route_table_t *table, const csr_graph_t *graph, int node_id)
+{
+    int num_nodes = table->num_nodes;
+
+    if (node_id == table->source)
+    {
+        for (int i = 0; i < num_nodes; i++)
+        {
+            table->distances[i] = INF;
+            table->predecessors[i] = -1;
+            table->next_hops[i] = -1;
+            table->spread[i] = ROUTE_SPREAD_UNKNOWN;
+        }
+        table->distances[node_id] = 0;
+        return 0;
+    }
+
+    if (table->distances[node_id] == INF)
+    {
+        return 0;
+    }
+
+    table->graph = graph;
+    route_table_forget_spread(table, node_id);
+
+    // 0 - not yet classified, 1 - path runs through the removed node, 2 - unaffected
+    char *state = calloc(num_nodes, sizeof(char));
+    int *affected = malloc(num_nodes * sizeof(int));
+    int affected_count = 0;
+
+    if (!state || !affected)
+    {
+        free(state);
+        free(affected);
+        return route_table_build(table, graph, table->source);
+    }
+
+    state[node_id] = 1;
+    state[table->source] = 2;
+
+    for (int i = 0; i < num_nodes; i++)
+    {
+        int current = i;
+        while (state[current] == 0 && table->predecessors[current] != -1)
+        {
+            current = table->predecessors[current];
+        }
+
+        char result = state[current] == 1 ? 1 : 2;
+        for (current = i; state[current] == 0; current = table->predecessors[current])
+        {
+            state[current] = result;
+            if (table->predecessors[current] == -1)
+            {
+                break;
+            }
+        }
+    }
+
+    for (int i = 0; i < num_nodes; i++)
+    {
+        if (state[i] == 1)
+        {
+            table->distances[i] = INF;
+            table->predecessors[i] = -1;
+            table->next_hops[i] = i == node_id ? -1 : ROUTE_UNRESOLVED;
+            if (i != node_id)
+            {
+                affected[affected_count++] = i;
+            }
+        }
+    }
+
+    for (int i = 0; i < affected_count; i++)
+    {
+        int v = affected[i];
+        for (int e = graph->offsets[v]; e < graph->offsets[v + 1]; e++)
+        {
+            int u = graph->targets[e];
+            if (state[u] == 2 && graph->weights[e] != INF && table->distances[u] != INF)
+            {
+                int alt = table->distances[u] + graph->weights[e];
+                if (alt < table->distances[v])
+                {
+                    table->distances[v] = alt;
+                    table->predecessors[v] = u;
+                }
+            }
+        }
+    }
+
+    if (dijkstra_resume(graph, affected, affected_count, table->distances, table->predecessors, &table->heap) == -1)
+    {
+        free(state);
+        free(affected);
+        return route_table_build(table, graph, table->source);
+    }
+
+    for (int i = 0; i < affected_count; i++)
+    {
+        route_table_resolve(table, affected[i]);
+    }
+
+    free(state);
+    free(affected);
+    return 0;
+}
+
+/**
+ * @brief Looks up the next hop towards a destination.
+ *
+ * @param table The routing table of the current node.
+ * @param destination The destination node.
+ * @return The next node to forward the packet to, or -1 if no path is known.
+ */
+int route_table_next_hop(const route_table_t *table, int destination)
+{
+    if (destination < 0 || destination >= table->num_nodes || destination == table->source)
+    {
+        return -1;
+    }
+    return table->next_hops[destination];
+}
+
+/**
+ * @brief Returns the neighbors that lie on a shortest path to a destination.
+ *
+ * @param table The routing table of the current node.
+ * @param destination The destination node.
+ * @return Bit i is set if neighbors[i] of the table is on a shortest path, 0 if no path is known.
+ */
+uint64_t route_table_next_hop_set(route_table_t *table, int destination)
+{
+    if (route_table_next_hop(table, destination) == -1)
+    {
+        return 0;
+    }
+    return route_table_spread(table, destination);
+}
+
+/**
+ * @brief Looks up the next hop of a flow towards a destination.
+ *
+ * When several neighbors lie on shortest paths to the destination, the flow
+ * key picks one of them, so the packets of a flow keep one path and stay in
+ * order while different flows spread over all of them. The key is mixed with
+ * the id of the node, so that consecutive nodes do not make correlated choices.
+ *
+ * @param table The routing table of the current node.
+ * @param destination The destination node.
+ * @param flow The flow key of the packet.
+ * @return The next node to forward the packet to, or -1 if no path is known.
+ */
+int route_table_next_hop_flow(route_table_t *table, int destination, uint32_t flow)
+{
+    int next_hop = route_table_next_hop(table, destination);
+    if (next_hop == -1)
+    {
+        return -1;
+    }
+
+    uint64_t set = route_table_spread(table, destination);
+    int count = __builtin_popcountll(set);
+    if (count < 2)
+    {
+        return next_hop;
+    }
+
+    uint32_t hash = flow ^ (uint32_t)table->source * 0x9E3779B9u;
+    hash ^= hash >> 16;
+    hash *= 0x85EBCA6Bu;
+    hash ^= hash >> 13;
+    hash *= 0xC2B2AE35u;
+    hash ^= hash >> 16;
+
+    for (int skip = (int)(((uint64_t)hash * count) >> 32); skip > 0; skip--)
+    {
+        set &= set - 1;
+    }
+    return table->neighbors[__builtin_ctzll(set)];
+}
+
+/**
+ * @brief Releases the memory owned by a routing table.
+ *
+ * @param table The routing table to release.
+ */
+void route_table_free(route_table_t *table)
+{
+    free(table->distances);
+    free(table->predecessors);
+    free(table->next_hops);
+    free(table->next_hop_sets);
+    free(table->spread);
+    node_heap_free(&table->heap);
+    memset(table, 0, sizeof(route_table_t));
+}
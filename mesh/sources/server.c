@@ -1,18 +1,55 @@
 #include <signal.h>
+#include <stdatomic.h>
 #include <sys/wait.h>
 
 #include "user_interface.h"
 
-pid_t node_pids[MAX_NODES];
-int server_socket;
-struct sockaddr_in server_address;
+pid_t *node_pids;
+int num_nodes;
+topology_shared_t *topology;
+csr_graph_t csr_graph;
+pthread_mutex_t topology_lock = PTHREAD_MUTEX_INITIALIZER;
+weights_t weights;
+metrics_shared_t *metrics;
+receipts_t receipts;
+pthread_t receipts_thread;
+atomic_bool receipts_running;
+atomic_bool interrupted;
+simulation_t *simulation;
+transport_t *transport;
+transport_kind node_transport = TRANSPORT_UDP;
+const char *compression = "fast";
+const char *logging = "block";
+bool reliable = false;
+bool adaptive = false;
+broadcast_config_t broadcast_config = {.mode = BROADCAST_MPR, .radius = BROADCAST_RADIUS};
+uint16_t next_transfer_id;
+
+/**
+ * @brief Blocks or unblocks SIGINT in the calling thread.
+ *
+ * The server blocks it before starting any thread, so that only the main
+ * thread takes it and the command it is reading gets interrupted.
+ *
+ * @param how SIG_BLOCK or SIG_UNBLOCK.
+ */
+void set_interrupt_mask(int how)
+{
+    sigset_t interrupt;
+
+    sigemptyset(&interrupt);
+    sigaddset(&interrupt, SIGINT);
+    pthread_sigmask(how, &interrupt, NULL);
+}
 
 /**
  * @brief Starts the node in a separate process.
  *
  * The function creates a new process to start the node.
- * Uses fork() to create a child process,
- * which is then replaced by the node executable using execl().
+ * Uses fork() to create a child process, which takes SIGINT again and is
+ * then replaced by the node executable using execl().
+ * The node is told which transport the server has set up, how to compress packets, how to log,
+ * whether to retransmit lost packets to its neighbors and whether to report the cost of its links.
  *
  * @param node_id The identifier of the node to run.
  */
@@ -21,9 +58,12 @@ void start_node(const int node_id)
     pid_t pid = fork();
     if (pid == 0)
     {
-        char node_id_str[4];
-        snprintf(node_id_str, 4, "%d", node_id);
-        execl("./app-node", "app-node", node_id_str, NULL);
+        set_interrupt_mask(SIG_UNBLOCK);
+
+        char node_id_str[16];
+        snprintf(node_id_str, sizeof(node_id_str), "%d", node_id);
+        execl("./app-node", "app-node", node_id_str, transport_name(node_transport), compression, logging,
+              adaptive ? "adaptive" : reliable ? "reliable" : "unreliable", NULL);
         log_message("SERVER", MSG_TYPE_ERROR, "execl failed");
         exit(EXIT_FAILURE);
     }
@@ -42,13 +82,18 @@ void start_node(const int node_id)
  *
  * The function sends a SIGTERM signal to a running node
  * * and waits for it to complete. If the node is not running, the function
- * writes an error to the log.
+ * writes an error to the log. A simulated node is stopped in place.
  *
  * @param node_id Identifier of the node to stop.
  */
 void stop_node(const int node_id)
 {
-    if (node_pids[node_id] > 0)
+    if (simulation)
+    {
+        simulation_stop_node(simulation, node_id);
+        log_message("SERVER", MSG_TYPE_INFO, "Node %d stopped", node_id);
+    }
+    else if (node_pids[node_id] > 0)
     {
         kill(node_pids[node_id], SIGTERM);
         waitpid(node_pids[node_id], NULL, 0);
@@ -62,103 +107,706 @@ void stop_node(const int node_id)
 }
 
 /**
- * @brief Processes the termination signal and stops all active nodes.
+ * @brief Processes the termination signal.
  *
- * The function is called when a signal (such as SIGINT) is received.
- * It traverses all nodes and calls a function to stop them.
- * After stopping the nodes, it closes the server socket and terminates the program.
+ * The handler only records the signal. The read of the next command fails
+ * with EINTR, and the main thread then stops the server, since the
+ * shutdown joins threads and takes locks that the interrupted code may hold.
  *
  * @param sig The identifier of the signal that was received.
  */
 void handle_signal(const int sig)
 {
-    for (int i = 0; i < MAX_NODES; ++i)
+    atomic_store(&interrupted, true);
+}
+
+/**
+ * @brief Stops all active nodes and terminates the program.
+ *
+ * It traverses all nodes and calls a function to stop them.
+ * After stopping the receipt thread and the nodes, it closes the transport and terminates the program.
+ */
+void shutdown_server(void)
+{
+    if (atomic_exchange(&receipts_running, false))
     {
-        if (node_pids[i] > 0)
+        struct iovec wake_up = {.iov_base = NULL, .iov_len = 0};
+        transport->send(transport, TRANSPORT_SERVER, &wake_up, 1);
+        pthread_join(receipts_thread, NULL);
+    }
+
+    if (simulation)
+    {
+        simulation_destroy(simulation);
+    }
+    else if (transport)
+    {
+        for (int i = 0; i < num_nodes; ++i)
         {
-            stop_node(i);
+            if (node_pids[i] > 0)
+            {
+                stop_node(i);
+            }
         }
+        transport->close(transport);
     }
-    close(server_socket);
+    topology_destroy(topology);
+    metrics_destroy(metrics);
+    csr_free(&csr_graph);
+    weights_free(&weights);
     exit(EXIT_SUCCESS);
 }
 
 /**
- * @brief Processes user commands to manage a network of nodes.
+ * @brief Applies the link costs reported by a node to the topology.
  *
- * The function constantly waits for commands from the user and performs the appropriate actions
- * depending on the command entered. Commands include sending messages, broadcasting,
- * stopping nodes, and displaying help information.
+ * Edges whose weight changed are published to the nodes as one topology
+ * delta, and changed in the graph the server prints paths from.
  *
- * @param graph The adjacency matrix of the node network graph.
- * @param client_socket The socket for sending data.
+ * @param report The report.
  */
-void handle_user_commands(int graph[MAX_NODES][MAX_NODES], int client_socket)
+void apply_link_report(const link_report_t *report)
 {
-    while (1)
+    topology_edge_t changes[LINK_REPORT_MAX_LINKS];
+
+    pthread_mutex_lock(&topology_lock);
+
+    int count = weights_update(&weights, report, metrics_clock(), changes);
+    count = count > 0 ? topology_set_weights(topology, changes, count) : 0;
+
+    for (int i = 0; i < count; i++)
     {
-        char command[256];
-        printf("Enter command: ");
-        fgets(command, sizeof(command), stdin);
+        csr_set_weight(&csr_graph, changes[i].u, changes[i].v, changes[i].weight);
+        log_message("SERVER", MSG_TYPE_INFO, "Weight of edge %d - %d set to %d", changes[i].u, changes[i].v, changes[i].weight);
+    }
+
+    pthread_mutex_unlock(&topology_lock);
+}
 
-        int src_node, dest_node, node_id;
-        char message[MAX_MESSAGE_LENGTH];
+/**
+ * @brief Receives the delivery receipts and link cost reports sent by the nodes.
+ *
+ * Runs in its own thread next to the command loop, until the server
+ * clears receipts_running and wakes it up with an empty datagram.
+ *
+ * @param argument Unused.
+ * @return NULL.
+ */
+void *receive_receipts(void *argument)
+{
+    static transport_batch_t batch;
 
-        if (sscanf(command, "send %d %d %[^\n]", &src_node, &dest_node, message) == 3)
+    while (atomic_load(&receipts_running))
+    {
+        int received = transport->receive(transport, &batch, -1);
+        if (received == -1)
         {
-            create_and_send_message(src_node, dest_node, graph, MAX_NODES, message, client_socket);
+            break;
         }
-        else if (sscanf(command, "broadcast %d %[^\n]", &src_node, message) == 2)
+
+        for (int i = 0; i < received; i++)
         {
-            create_and_send_broadcast(src_node, graph, MAX_NODES, message, client_socket);
+            receipt_t receipt;
+            link_report_t report;
+
+            if (receipt_decode(batch.data[i], batch.sizes[i], &receipt) == 0)
+            {
+                receipts_record(&receipts, &receipt);
+            }
+            else if (link_report_decode(batch.data[i], batch.sizes[i], &report) == 0)
+            {
+                apply_link_report(&report);
+            }
+            else if (batch.sizes[i] > 0)
+            {
+                log_message("SERVER", MSG_TYPE_NOT_VALID_DATA, "Malformed delivery receipt of %zu bytes", batch.sizes[i]);
+            }
         }
-        else if (sscanf(command, "stop %d", &node_id) == 1)
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief Records the delivery of a traced message in the simulation.
+ *
+ * Simulated nodes run inside the server, so their deliveries are recorded
+ * directly instead of being sent back as receipts.
+ *
+ * @param node The node the message was delivered to.
+ * @param packet The delivered message.
+ * @param context The delivery statistics.
+ */
+void record_delivery(node_t *node, const packet_t *packet, void *context)
+{
+    receipt_t receipt;
+
+    if (receipt_from_packet(packet, &receipt))
+    {
+        receipts_record(context, &receipt);
+    }
+}
+
+/**
+ * @brief Sends a traced message and counts it in the delivery statistics.
+ *
+ * @param src Source node sending the message.
+ * @param dest The destination node.
+ * @param message The message to be sent.
+ */
+void send_message(const int src, const int dest, const char *message)
+{
+    receipts_sent(&receipts, src, dest);
+    create_and_send_message(src, dest, topology_current_epoch(topology), true, message, transport);
+}
+
+/**
+ * @brief Sends data in fragments and counts it as one message in the delivery statistics.
+ *
+ * @param src Source node sending the data.
+ * @param dest The destination node.
+ * @param data The data to send.
+ * @param size The size of the data in bytes.
+ * @param rate Fragments per second, 0 to send as fast as possible.
+ */
+void send_transfer(const int src, const int dest, const char *data, const size_t size, const double rate)
+{
+    uint16_t transfer_id = next_transfer_id++;
+    uint64_t start = metrics_clock();
+
+    receipts_sent(&receipts, src, dest);
+    int count = create_and_send_transfer(src, dest, topology_current_epoch(topology), transfer_id, data, size, rate, transport);
+
+    if (count == -1)
+    {
+        printf("Transfers are limited to %d bytes.\n", FRAGMENT_MAX_COUNT * FRAGMENT_PAYLOAD_SIZE);
+        return;
+    }
+
+    double elapsed = (double)(metrics_clock() - start) / 1e9;
+    printf("Sent transfer %d of %zu bytes in %d fragments in %.3f s, CRC32C %08x\n",
+           transfer_id, size, count, elapsed, checksum_crc32c(0, data, size));
+    log_message("SERVER", MSG_TYPE_INFO, "Sent transfer %d of %zu bytes from %d to %d in %d fragments", transfer_id, size, src, dest, count);
+}
+
+/**
+ * @brief Sends a file in fragments.
+ *
+ * @param src Source node sending the file.
+ * @param dest The destination node.
+ * @param path The file to send.
+ * @param rate Fragments per second, 0 to send as fast as possible.
+ */
+void send_file(const int src, const int dest, const char *path, const double rate)
+{
+    FILE *file = fopen(path, "rb");
+    if (!file)
+    {
+        printf("Cannot open %s.\n", path);
+        return;
+    }
+
+    size_t capacity = (size_t)FRAGMENT_MAX_COUNT * FRAGMENT_PAYLOAD_SIZE;
+    char *data = malloc(capacity + 1);
+    size_t size = data ? fread(data, 1, capacity + 1, file) : 0;
+    fclose(file);
+
+    if (!data)
+    {
+        log_message("SERVER", MSG_TYPE_ERROR, "Failed to allocate the file buffer");
+        return;
+    }
+
+    if (size > capacity)
+    {
+        printf("Transfers are limited to %zu bytes.\n", capacity);
+    }
+    else
+    {
+        send_transfer(src, dest, data, size, rate);
+    }
+    free(data);
+}
+
+/**
+ * @brief Checks that a node identifier entered by the user exists in the network.
+ *
+ * @param node_id The identifier to check.
+ * @return true if the node exists, false otherwise.
+ */
+bool is_valid_node(const int node_id)
+{
+    if (node_id >= 0 && node_id < num_nodes)
+    {
+        return true;
+    }
+
+    printf("Node %d does not exist. Valid nodes are 0..%d.\n", node_id, num_nodes - 1);
+    return false;
+}
+
+/**
+ * @brief Checks that a node still takes part in the network.
+ *
+ * Stopped nodes are removed from the graph and have no links left.
+ *
+ * @param graph The node network graph.
+ * @param node_id The identifier of the node.
+ * @return true if the node has at least one link.
+ */
+static bool is_linked_node(const graph_t *graph, const int node_id)
+{
+    return graph->degrees[node_id] > 0;
+}
+
+/**
+ * @brief Sends a batch of messages at a steady rate.
+ *
+ * Message i is sent at start + i / rate seconds, so a slow send is made up
+ * for by the following ones instead of lowering the overall rate. Every
+ * round sends one message from each running node to each other running
+ * node, or one broadcast from each running node.
+ *
+ * @param graph The node network graph.
+ * @param rounds Number of rounds.
+ * @param rate Messages per second, 0 to send as fast as possible.
+ * @param broadcast Whether to broadcast instead of sending to every pair.
+ * @param message The message to send.
+ */
+static void send_bulk(const graph_t *graph, int rounds, double rate, bool broadcast, const char *message)
+{
+    uint64_t start = metrics_clock();
+    long sent = 0;
+
+    for (int round = 0; round < rounds; round++)
+    {
+        for (int src = 0; src < num_nodes; src++)
         {
-            stop_node(node_id);
-            remove_node(node_id, graph);
+            if (!is_linked_node(graph, src))
+            {
+                continue;
+            }
+
+            if (broadcast)
+            {
+                if (rate > 0)
+                {
+                    metrics_sleep_until(start + (uint64_t)(sent * 1e9 / rate));
+                }
+                create_and_send_broadcast(src, topology_current_epoch(topology), &broadcast_config, message, transport);
+                sent++;
+                continue;
+            }
+
+            for (int dest = 0; dest < num_nodes; dest++)
+            {
+                if (dest == src || !is_linked_node(graph, dest))
+                {
+                    continue;
+                }
+
+                if (rate > 0)
+                {
+                    metrics_sleep_until(start + (uint64_t)(sent * 1e9 / rate));
+                }
+                send_message(src, dest, message);
+                sent++;
+            }
         }
-        else if (strncmp(command, "help", 4) == 0)
+    }
+
+    double elapsed = (double)(metrics_clock() - start) / 1e9;
+    printf("Sent %ld messages in %.3f s (%.0f messages/s)\n", sent, elapsed, elapsed > 0 ? sent / elapsed : 0.0);
+    log_message("SERVER", MSG_TYPE_INFO, "Sent %ld messages in %.3f s", sent, elapsed);
+}
+
+/**
+ * @brief Executes a single command.
+ *
+ * Commands include sending messages and files, broadcasting, sending messages in
+ * bulk, pausing, stopping nodes, printing paths, delivery statistics and
+ * node metrics and displaying help information. Empty lines and lines starting with '#'
+ * are ignored, so command files can be commented.
+ *
+ * Stopping a node removes it from the graph and publishes the change
+ * as a new topology epoch. The topology is locked meanwhile, since link
+ * cost reports change it from the receipt thread.
+ *
+ * @param command The command line.
+ * @param graph The node network graph.
+ */
+void execute_command(const char *command, graph_t *graph)
+{
+    int src_node, dest_node, node_id, count, delay;
+    double rate;
+    char message[COMMAND_MAX_LENGTH];
+
+    command += strspn(command, " \t");
+
+    if (*command == '\0' || *command == '\n' || *command == '#')
+    {
+        return;
+    }
+
+    if (sscanf(command, "sendall %d %lf %[^\n]", &count, &rate, message) == 3 ||
+        sscanf(command, "broadcastall %d %lf %[^\n]", &count, &rate, message) == 3)
+    {
+        if (count < 0 || rate < 0)
+        {
+            printf("The count and the rate must not be negative.\n");
+            return;
+        }
+        send_bulk(graph, count, rate, command[0] == 'b', message);
+    }
+    else if (sscanf(command, "send %d %d %[^\n]", &src_node, &dest_node, message) == 3)
+    {
+        if (!is_valid_node(src_node) || !is_valid_node(dest_node))
+            return;
+        if (strlen(message) >= MAX_MESSAGE_LENGTH)
         {
-            print_help();
+            send_transfer(src_node, dest_node, message, strlen(message), 0);
         }
         else
         {
-            printf("Invalid command format. Type 'help' for a list of commands.\n");
+            send_message(src_node, dest_node, message);
+        }
+    }
+    else if (sscanf(command, "sendfile %d %d %s %lf", &src_node, &dest_node, message, &rate) >= 3)
+    {
+        if (!is_valid_node(src_node) || !is_valid_node(dest_node))
+            return;
+        if (sscanf(command, "sendfile %*d %*d %*s %lf", &rate) != 1 || rate < 0)
+        {
+            rate = 0;
         }
+        send_file(src_node, dest_node, message, rate);
+    }
+    else if (sscanf(command, "broadcast %d %[^\n]", &src_node, message) == 2)
+    {
+        if (!is_valid_node(src_node))
+            return;
+        create_and_send_broadcast(src_node, topology_current_epoch(topology), &broadcast_config, message, transport);
+    }
+    else if (sscanf(command, "sleep %d", &delay) == 1)
+    {
+        uint64_t deadline = metrics_clock() + (uint64_t)(delay > 0 ? delay : 0) * 1000000;
+        uint64_t now;
+
+        while (!atomic_load(&interrupted) && (now = metrics_clock()) < deadline)
+        {
+            uint64_t slice = now + SERVER_SLEEP_SLICE_MS * 1000000ull;
+            metrics_sleep_until(slice < deadline ? slice : deadline);
+        }
+    }
+    else if (sscanf(command, "stop %d", &node_id) == 1)
+    {
+        if (!is_valid_node(node_id))
+            return;
+        stop_node(node_id);
+        pthread_mutex_lock(&topology_lock);
+        remove_node(node_id, graph);
+        csr_remove_node(&csr_graph, node_id);
+        topology_remove_node(topology, node_id);
+        pthread_mutex_unlock(&topology_lock);
+    }
+    else if (sscanf(command, "paths %d", &src_node) == 1)
+    {
+        if (!is_valid_node(src_node))
+            return;
+
+        int *distances = malloc(num_nodes * sizeof(int));
+        int *predecessors = malloc(num_nodes * sizeof(int));
+        if (distances && predecessors)
+        {
+            pthread_mutex_lock(&topology_lock);
+            int result = dijkstra(&csr_graph, src_node, distances, predecessors, NULL);
+            pthread_mutex_unlock(&topology_lock);
+
+            if (result == -1)
+            {
+                log_message("SERVER", MSG_TYPE_ERROR, "Failed to compute the paths from node %d", src_node);
+            }
+            else
+            {
+                print_paths(src_node, num_nodes, predecessors);
+            }
+        }
+        free(distances);
+        free(predecessors);
+    }
+    else if (sscanf(command, "receipts %d %d", &src_node, &dest_node) == 2)
+    {
+        if (!is_valid_node(src_node) || !is_valid_node(dest_node))
+            return;
+        receipts_print(&receipts, src_node, dest_node);
+    }
+    else if (strncmp(command, "receipts", 8) == 0)
+    {
+        receipts_print(&receipts, -1, -1);
+    }
+    else if (sscanf(command, "stats %d", &node_id) == 1)
+    {
+        if (!is_valid_node(node_id))
+            return;
+        metrics_print(metrics, node_id);
+    }
+    else if (strncmp(command, "stats", 5) == 0)
+    {
+        metrics_print(metrics, -1);
+    }
+    else if (strncmp(command, "weights", 7) == 0)
+    {
+        pthread_mutex_lock(&topology_lock);
+        weights_print(&weights);
+        pthread_mutex_unlock(&topology_lock);
+    }
+    else if (strncmp(command, "help", 4) == 0)
+    {
+        print_help();
+    }
+    else
+    {
+        printf("Invalid command format. Type 'help' for a list of commands.\n");
     }
 }
 
-int main()
+/**
+ * @brief Processes user commands to manage a network of nodes.
+ *
+ * The function reads commands line by line until the end of the input or
+ * SIGINT and executes them. The prompt is only shown when reading from a terminal,
+ * so commands can also be piped in or read from a file.
+ *
+ * @param input Where the commands are read from.
+ * @param graph The node network graph.
+ */
+void handle_user_commands(FILE *input, graph_t *graph)
 {
-    signal(SIGINT, handle_signal);
+    bool interactive = isatty(fileno(input));
+    char command[COMMAND_MAX_LENGTH];
 
-    int graph[MAX_NODES][MAX_NODES];
-    int matrix_size = 10;
+    while (!atomic_load(&interrupted))
+    {
+        if (interactive)
+        {
+            printf("Enter command: ");
+            fflush(stdout);
+        }
 
-    int distances[MAX_NODES];
-    int predecessors[MAX_NODES];
+        if (!fgets(command, sizeof(command), input))
+        {
+            break;
+        }
 
-    initialize_graph(MAX_NODES, graph);
-    add_edges(matrix_size, graph);
+        execute_command(command, graph);
+    }
+}
 
-    server_socket = socket(AF_INET, SOCK_DGRAM, 0);
-    if (server_socket == -1)
+/**
+ * @brief Prints how to start the server.
+ *
+ * @param program The name of the executable.
+ */
+void print_usage(const char *program)
+{
+    fprintf(stderr, "Usage: %s [-s] [-t threads] [-T udp|shm] [-z level[:dict]] [-l logging] [-B mode[:radius]] [-R] [-A] [-f file] [matrix_size]\n", program);
+    fprintf(stderr, "  -s          Run all nodes as actors inside the server process\n");
+    fprintf(stderr, "  -t threads  Number of simulation worker threads (default: one per CPU)\n");
+    fprintf(stderr, "  -T udp|shm  Transport between node processes: loopback UDP sockets (default)\n");
+    fprintf(stderr, "              or lock-free inboxes in shared memory\n");
+    fprintf(stderr, "  -z level    Packet compression: none, fast (default) or best,\n");
+    fprintf(stderr, "              with :dict to use the preset packet dictionary\n");
+    fprintf(stderr, "  -l logging  Log policy sync, block (default) or drop, optionally with\n");
+    fprintf(stderr, "              a buffer size per process, for example drop,64k; add binary\n");
+    fprintf(stderr, "              to write logs.bin and level=warning|error to skip INFO records\n");
+    fprintf(stderr, "  -B mode     Broadcast through multipoint relays (mpr, default) or to every\n");
+    fprintf(stderr, "              neighbor (flood), within radius hops (default %d, 0 for all)\n", BROADCAST_RADIUS);
+    fprintf(stderr, "  -R          Acknowledge packets hop by hop and retransmit the lost ones;\n");
+    fprintf(stderr, "              simulated nodes never lose packets and ignore it\n");
+    fprintf(stderr, "  -A          Like -R, and raise the weight of congested links so that routes\n");
+    fprintf(stderr, "              avoid them; simulated nodes ignore it\n");
+    fprintf(stderr, "  -f file     Read the commands from a file instead of the standard input;\n");
+    fprintf(stderr, "              the server stops at the end of the commands\n");
+    fprintf(stderr, "The grid of matrix_size x matrix_size nodes must contain 1..%d nodes.\n", MAX_NODE_COUNT);
+}
+
+int main(int argc, char *argv[])
+{
+    // Without SA_RESTART, SIGINT interrupts the read of a command
+    struct sigaction action = {.sa_handler = handle_signal};
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, NULL);
+    set_interrupt_mask(SIG_BLOCK);
+
+    bool simulate = false;
+    const char *script = NULL;
+    int num_workers = sysconf(_SC_NPROCESSORS_ONLN);
+    int option;
+
+    while ((option = getopt(argc, argv, "st:T:z:l:B:RAf:")) != -1)
+    {
+        switch (option)
+        {
+        case 's':
+            simulate = true;
+            break;
+        case 't':
+            num_workers = atoi(optarg);
+            break;
+        case 'z':
+            compression = optarg;
+            break;
+        case 'l':
+            logging = optarg;
+            break;
+        case 'f':
+            script = optarg;
+            break;
+        case 'R':
+            reliable = true;
+            break;
+        case 'A':
+            reliable = true;
+            adaptive = true;
+            break;
+        case 'B':
+            if (broadcast_parse(optarg, &broadcast_config) == -1)
+            {
+                print_usage(argv[0]);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'T':
+            if (transport_parse(optarg, &node_transport) == -1)
+            {
+                print_usage(argv[0]);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        default:
+            print_usage(argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    int matrix_size = DEFAULT_MATRIX_SIZE;
+    if (optind < argc)
+    {
+        matrix_size = atoi(argv[optind]);
+    }
+
+    compression_level level;
+    bool dictionary;
+    log_config_t log_config;
+
+    if (matrix_size <= 0 || matrix_size * matrix_size > MAX_NODE_COUNT || num_workers <= 0 ||
+        compression_parse(compression, &level, &dictionary) == -1 || logger_parse(logging, &log_config) == -1)
     {
-        log_message("SERVER", MSG_TYPE_ERROR, "Socket creation failed");
+        print_usage(argv[0]);
         exit(EXIT_FAILURE);
     }
 
-    server_address.sin_family = AF_INET;
-    server_address.sin_port = htons(SERVER_PORT);
-    server_address.sin_addr.s_addr = INADDR_ANY;
+    compression_configure(level, dictionary);
 
-    for (int i = 0; i < MAX_NODES; ++i)
+    if (logger_start(&log_config) == -1)
     {
-        start_node(i);
+        log_message("SERVER", MSG_TYPE_ERROR, "Failed to start the background logger");
     }
 
-    handle_user_commands(graph, server_socket);
+    num_nodes = matrix_size * matrix_size;
+
+    graph_t graph;
+    node_pids = calloc(num_nodes, sizeof(pid_t));
+    if (!node_pids || initialize_graph(&graph, num_nodes) == -1)
+    {
+        log_message("SERVER", MSG_TYPE_ERROR, "Graph allocation failed");
+        exit(EXIT_FAILURE);
+    }
+
+    add_edges(matrix_size, &graph);
+
+    topology = topology_create(&graph);
+    if (!topology)
+    {
+        log_message("SERVER", MSG_TYPE_ERROR, "Topology segment creation failed");
+        exit(EXIT_FAILURE);
+    }
+
+    topology_publish(topology, &graph);
+
+    metrics = metrics_create(num_nodes);
+    if (!metrics)
+    {
+        log_message("SERVER", MSG_TYPE_ERROR, "Metrics segment creation failed");
+        exit(EXIT_FAILURE);
+    }
+
+    if (csr_build(&csr_graph, &graph) == -1 || weights_init(&weights, &graph) == -1)
+    {
+        log_message("SERVER", MSG_TYPE_ERROR, "Graph allocation failed");
+        exit(EXIT_FAILURE);
+    }
+
+    if (receipts_init(&receipts) == -1)
+    {
+        log_message("SERVER", MSG_TYPE_ERROR, "Delivery statistics initialization failed");
+        exit(EXIT_FAILURE);
+    }
+
+    if (simulate)
+    {
+        simulation = simulation_create(topology, metrics, num_workers);
+        if (!simulation)
+        {
+            log_message("SERVER", MSG_TYPE_ERROR, "Simulation startup failed");
+            exit(EXIT_FAILURE);
+        }
+        transport = &simulation->transport;
+        simulation_set_delivery_handler(simulation, record_delivery, &receipts);
+    }
+    else
+    {
+        transport = node_transport == TRANSPORT_SHM ? transport_shm_create(num_nodes) : transport_udp_open(TRANSPORT_SERVER);
+        if (!transport)
+        {
+            log_message("SERVER", MSG_TYPE_ERROR, "Transport creation failed");
+            exit(EXIT_FAILURE);
+        }
+
+        atomic_store(&receipts_running, transport->receive != NULL);
+        if (transport->receive && pthread_create(&receipts_thread, NULL, receive_receipts, NULL) != 0)
+        {
+            log_message("SERVER", MSG_TYPE_ERROR, "Failed to start the delivery receipt thread");
+            atomic_store(&receipts_running, false);
+        }
+
+        for (int i = 0; i < num_nodes; ++i)
+        {
+            start_node(i);
+        }
+
+        int ready = metrics_wait_ready(metrics, num_nodes, NODE_READY_TIMEOUT_MS);
+        if (ready < num_nodes)
+        {
+            log_message("SERVER", MSG_TYPE_ERROR, "Only %d of %d nodes ready after %d ms", ready, num_nodes, NODE_READY_TIMEOUT_MS);
+        }
+    }
+
+    FILE *input = script ? fopen(script, "r") : stdin;
+    if (!input)
+    {
+        log_message("SERVER", MSG_TYPE_ERROR, "Failed to open the command file %s", script);
+        shutdown_server();
+    }
+
+    set_interrupt_mask(SIG_UNBLOCK);
+    handle_user_commands(input, &graph);
+
+    if (input != stdin)
+    {
+        fclose(input);
+    }
 
-    handle_signal(SIGINT);
+    shutdown_server();
     return EXIT_SUCCESS;
 }
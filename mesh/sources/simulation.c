@@ -0,0 +1,592 @@
+#include "simulation.h"
+#include "logger.h"
+
+static _Thread_local worker_t *current_worker;
+
+/**
+ * @brief Allocates the ring of a work-stealing deque.
+ *
+ * An actor is queued at most once at any time, so a deque never holds more
+ * entries than there are nodes and its ring does not need to grow.
+ *
+ * @param deque The deque to initialize.
+ * @param capacity Minimum number of entries, rounded up to a power of two.
+ * @return 0 on success, -1 if memory allocation failed.
+ */
+static int work_deque_init(work_deque_t *deque, int capacity)
+{
+    long size = 1;
+    while (size < capacity)
+    {
+        size <<= 1;
+    }
+
+    atomic_init(&deque->top, 0);
+    atomic_init(&deque->bottom, 0);
+    deque->mask = size - 1;
+    deque->buffer = calloc(size, sizeof(*deque->buffer));
+    return deque->buffer ? 0 : -1;
+}
+
+/**
+ * @brief Pushes an actor onto the bottom of the owner's deque.
+ *
+ * Only the worker owning the deque may call this function.
+ *
+ * @param deque The deque of the current worker.
+ * @param actor The actor to queue.
+ */
+static void work_deque_push(work_deque_t *deque, actor_t *actor)
+{
+    long bottom = atomic_load_explicit(&deque->bottom, memory_order_relaxed);
+    atomic_store_explicit(&deque->buffer[bottom & deque->mask], actor, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(&deque->bottom, bottom + 1, memory_order_relaxed);
+}
+
+/**
+ * @brief Takes the most recently pushed actor from the owner's deque.
+ *
+ * Only the worker owning the deque may call this function. When a single
+ * entry is left, the owner races with thieves for it on the top index.
+ *
+ * @param deque The deque of the current worker.
+ * @return The actor, or NULL if the deque is empty.
+ */
+static actor_t *work_deque_take(work_deque_t *deque)
+{
+    long bottom = atomic_load_explicit(&deque->bottom, memory_order_relaxed) - 1;
+    atomic_store_explicit(&deque->bottom, bottom, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    long top = atomic_load_explicit(&deque->top, memory_order_relaxed);
+
+    actor_t *actor = NULL;
+
+    if (top <= bottom)
+    {
+        actor = atomic_load_explicit(&deque->buffer[bottom & deque->mask], memory_order_relaxed);
+        if (top == bottom)
+        {
+            if (!atomic_compare_exchange_strong_explicit(&deque->top, &top, top + 1, memory_order_seq_cst, memory_order_relaxed))
+            {
+                actor = NULL;
+            }
+            atomic_store_explicit(&deque->bottom, bottom + 1, memory_order_relaxed);
+        }
+    }
+    else
+    {
+        atomic_store_explicit(&deque->bottom, bottom + 1, memory_order_relaxed);
+    }
+
+    return actor;
+}
+
+/**
+ * @brief Steals the oldest actor from another worker's deque.
+ *
+ * @param deque The deque of the victim worker.
+ * @return The actor, or NULL if the deque was empty or the steal lost a race.
+ */
+static actor_t *work_deque_steal(work_deque_t *deque)
+{
+    long top = atomic_load_explicit(&deque->top, memory_order_acquire);
+    atomic_thread_fence(memory_order_seq_cst);
+    long bottom = atomic_load_explicit(&deque->bottom, memory_order_acquire);
+
+    if (top >= bottom)
+    {
+        return NULL;
+    }
+
+    actor_t *actor = atomic_load_explicit(&deque->buffer[top & deque->mask], memory_order_relaxed);
+    if (!atomic_compare_exchange_strong_explicit(&deque->top, &top, top + 1, memory_order_seq_cst, memory_order_relaxed))
+    {
+        return NULL;
+    }
+    return actor;
+}
+
+/**
+ * @brief Appends a message to an actor's mailbox.
+ *
+ * The mailbox is an intrusive multi-producer single-consumer queue:
+ * any thread may push, only the worker running the actor pops.
+ *
+ * @param actor The receiving actor.
+ * @param message The message to append.
+ */
+static void mailbox_push(actor_t *actor, mailbox_message_t *message)
+{
+    atomic_store_explicit(&message->next, NULL, memory_order_relaxed);
+    mailbox_message_t *previous = atomic_exchange(&actor->head, message);
+    atomic_store_explicit(&previous->next, message, memory_order_release);
+}
+
+/**
+ * @brief Removes the oldest message from an actor's mailbox.
+ *
+ * @param actor The actor being run.
+ * @return The message, or NULL if the mailbox is empty or a push is still in progress.
+ */
+static mailbox_message_t *mailbox_pop(actor_t *actor)
+{
+    mailbox_message_t *tail = actor->tail;
+    mailbox_message_t *next = atomic_load_explicit(&tail->next, memory_order_acquire);
+
+    if (tail == &actor->stub)
+    {
+        if (!next)
+        {
+            return NULL;
+        }
+        actor->tail = next;
+        tail = next;
+        next = atomic_load_explicit(&next->next, memory_order_acquire);
+    }
+
+    if (next)
+    {
+        actor->tail = next;
+        return tail;
+    }
+
+    if (tail != atomic_load(&actor->head))
+    {
+        return NULL;
+    }
+
+    mailbox_push(actor, &actor->stub);
+
+    next = atomic_load_explicit(&tail->next, memory_order_acquire);
+    if (next)
+    {
+        actor->tail = next;
+        return tail;
+    }
+    return NULL;
+}
+
+/**
+ * @brief Checks whether an actor's mailbox holds messages, including ones still being pushed.
+ *
+ * Only the worker running the actor may call this function.
+ *
+ * @param actor The actor being run.
+ * @return true if the mailbox is not empty.
+ */
+static bool mailbox_has_messages(actor_t *actor)
+{
+    return actor->tail != &actor->stub || atomic_load(&actor->stub.next) != NULL || atomic_load(&actor->head) != &actor->stub;
+}
+
+/**
+ * @brief Queues an actor that has pending messages for execution.
+ *
+ * Workers queue actors on their own deque, where they are picked up without
+ * contention. Other threads, and actors that used up their batch, go through
+ * the shared injection queue, so that a busy actor cannot starve the others.
+ * A parked worker is woken up if there is one.
+ *
+ * @param simulation The simulation.
+ * @param actor The actor to queue. Its scheduled flag must already be set.
+ * @param fair Whether the actor must go through the injection queue.
+ */
+static void simulation_schedule(simulation_t *simulation, actor_t *actor, bool fair)
+{
+    atomic_fetch_add(&simulation->pending, 1);
+
+    if (!fair && current_worker && current_worker->simulation == simulation)
+    {
+        work_deque_push(&current_worker->deque, actor);
+    }
+    else
+    {
+        pthread_mutex_lock(&simulation->inject_lock);
+        simulation->inject_queue[(simulation->inject_head + simulation->inject_count) % simulation->num_nodes] = actor;
+        simulation->inject_count++;
+        pthread_mutex_unlock(&simulation->inject_lock);
+    }
+
+    if (atomic_load(&simulation->sleepers) > 0)
+    {
+        pthread_mutex_lock(&simulation->park_lock);
+        pthread_cond_signal(&simulation->park_cond);
+        pthread_mutex_unlock(&simulation->park_lock);
+    }
+}
+
+/**
+ * @brief Takes an actor from the shared injection queue.
+ *
+ * @param simulation The simulation.
+ * @return The actor, or NULL if the queue is empty.
+ */
+static actor_t *simulation_take_injected(simulation_t *simulation)
+{
+    actor_t *actor = NULL;
+
+    pthread_mutex_lock(&simulation->inject_lock);
+    if (simulation->inject_count > 0)
+    {
+        actor = simulation->inject_queue[simulation->inject_head];
+        simulation->inject_head = (simulation->inject_head + 1) % simulation->num_nodes;
+        simulation->inject_count--;
+    }
+    pthread_mutex_unlock(&simulation->inject_lock);
+
+    return actor;
+}
+
+/**
+ * @brief Finds the next actor for a worker to run.
+ *
+ * The worker looks at its own deque first, then at the injection queue,
+ * and finally tries to steal from the other workers, starting at a random one.
+ *
+ * @param worker The current worker.
+ * @return The actor, or NULL if no work was found.
+ */
+static actor_t *worker_find_work(worker_t *worker)
+{
+    simulation_t *simulation = worker->simulation;
+
+    actor_t *actor = work_deque_take(&worker->deque);
+    if (actor)
+    {
+        return actor;
+    }
+
+    if (atomic_load_explicit(&simulation->pending, memory_order_relaxed) <= 0)
+    {
+        return NULL;
+    }
+
+    actor = simulation_take_injected(simulation);
+    if (actor)
+    {
+        return actor;
+    }
+
+    int start = rand_r(&worker->seed) % simulation->num_workers;
+    for (int i = 0; i < simulation->num_workers; i++)
+    {
+        worker_t *victim = &simulation->workers[(start + i) % simulation->num_workers];
+        if (victim != worker && (actor = work_deque_steal(&victim->deque)))
+        {
+            return actor;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Runs an actor on the current worker.
+ *
+ * The actor handles up to ACTOR_BATCH_SIZE messages. If messages are left,
+ * it is queued again right away. Otherwise it is marked idle, and only the
+ * head of the mailbox is looked at afterwards, since another worker may
+ * already be running the actor. Messages for a stopped node are discarded.
+ *
+ * @param actor The actor to run.
+ */
+static void actor_run(actor_t *actor)
+{
+    int processed = 0;
+    mailbox_message_t *message;
+
+    logger_set_node(actor->node.id);
+
+    while (processed < ACTOR_BATCH_SIZE && (message = mailbox_pop(actor)))
+    {
+        if (!atomic_load_explicit(&actor->stopped, memory_order_relaxed))
+        {
+            node_handle_packet(&actor->node, message->data, message->size);
+        }
+        free(message);
+        processed++;
+    }
+
+    if (mailbox_has_messages(actor))
+    {
+        simulation_schedule(actor->simulation, actor, true);
+        return;
+    }
+
+    atomic_store(&actor->scheduled, false);
+
+    if (atomic_load(&actor->head) != &actor->stub && !atomic_exchange(&actor->scheduled, true))
+    {
+        simulation_schedule(actor->simulation, actor, false);
+    }
+}
+
+/**
+ * @brief Main loop of a worker thread.
+ *
+ * The worker runs actors while there is work and parks on a condition
+ * variable when there is none.
+ *
+ * @param argument The worker.
+ * @return Always NULL.
+ */
+static void *worker_run(void *argument)
+{
+    worker_t *worker = (worker_t *)argument;
+    simulation_t *simulation = worker->simulation;
+
+    current_worker = worker;
+
+    while (atomic_load(&simulation->running))
+    {
+        actor_t *actor = worker_find_work(worker);
+        if (actor)
+        {
+            atomic_fetch_sub(&simulation->pending, 1);
+            actor_run(actor);
+            continue;
+        }
+
+        if (atomic_load(&simulation->pending) > 0)
+        {
+            continue;
+        }
+
+        pthread_mutex_lock(&simulation->park_lock);
+        atomic_fetch_add(&simulation->sleepers, 1);
+        while (atomic_load(&simulation->pending) <= 0 && atomic_load(&simulation->running))
+        {
+            pthread_cond_wait(&simulation->park_cond, &simulation->park_lock);
+        }
+        atomic_fetch_sub(&simulation->sleepers, 1);
+        pthread_mutex_unlock(&simulation->park_lock);
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief Hands a datagram to a node of the simulation.
+ *
+ * This is the send function of the simulation's transport, which is shared by
+ * every simulated node and by the server to inject commands. Datagrams for a
+ * stopped node are silently lost, as they would be for a node process that
+ * is no longer listening.
+ *
+ * @param transport The transport of the simulation.
+ * @param destination The receiving node.
+ * @param iov The parts of the datagram, gathered into the mailbox message.
+ * @param iov_count Number of parts.
+ * @return The number of bytes delivered, or -1 on failure.
+ */
+static int simulation_deliver(transport_t *transport, int destination, const struct iovec *iov, int iov_count)
+{
+    simulation_t *simulation = (simulation_t *)transport;
+    size_t size = transport_iov_size(iov, iov_count);
+
+    if (destination < 0 || destination >= simulation->num_nodes)
+    {
+        return -1;
+    }
+
+    actor_t *actor = &simulation->actors[destination];
+
+    if (atomic_load_explicit(&actor->stopped, memory_order_relaxed))
+    {
+        return size;
+    }
+
+    mailbox_message_t *message = malloc(sizeof(mailbox_message_t) + size);
+    if (!message)
+    {
+        return -1;
+    }
+
+    message->size = size;
+    transport_gather(message->data, iov, iov_count);
+    mailbox_push(actor, message);
+
+    if (!atomic_exchange(&actor->scheduled, true))
+    {
+        simulation_schedule(simulation, actor, false);
+    }
+
+    return size;
+}
+
+/**
+ * @brief Creates the in-process simulation and starts its worker threads.
+ *
+ * Every node of the topology becomes an actor with its own mailbox and
+ * forwarding state. All actors share one topology view. Actors are executed
+ * by a fixed pool of workers that balance the load by stealing from each other.
+ *
+ * @param topology The shared topology segment.
+ * @param metrics The metrics segment the actors count into.
+ * @param num_workers Number of worker threads.
+ * @return The running simulation, or NULL on failure.
+ */
+simulation_t *simulation_create(const topology_shared_t *topology, metrics_shared_t *metrics, int num_workers)
+{
+    simulation_t *simulation = calloc(1, sizeof(simulation_t));
+    if (!simulation)
+    {
+        return NULL;
+    }
+
+    if (topology_view_init(&simulation->view, topology, true) == -1)
+    {
+        free(simulation);
+        return NULL;
+    }
+
+    simulation->transport.send = simulation_deliver;
+    simulation->transport.send_many = transport_send_each;
+
+    pthread_mutex_init(&simulation->inject_lock, NULL);
+    pthread_mutex_init(&simulation->park_lock, NULL);
+    pthread_cond_init(&simulation->park_cond, NULL);
+    atomic_init(&simulation->pending, 0);
+    atomic_init(&simulation->sleepers, 0);
+    atomic_init(&simulation->running, true);
+
+    simulation->num_nodes = simulation->view.cache.graph.num_nodes;
+    simulation->actors = calloc(simulation->num_nodes, sizeof(actor_t));
+    simulation->inject_queue = malloc(simulation->num_nodes * sizeof(actor_t *));
+    simulation->workers = calloc(num_workers, sizeof(worker_t));
+    simulation->num_workers = num_workers;
+
+    if (!simulation->actors || !simulation->inject_queue || !simulation->workers)
+    {
+        simulation_destroy(simulation);
+        return NULL;
+    }
+
+    for (int i = 0; i < simulation->num_nodes; i++)
+    {
+        actor_t *actor = &simulation->actors[i];
+        actor->simulation = simulation;
+        atomic_init(&actor->stub.next, NULL);
+        atomic_init(&actor->head, &actor->stub);
+        actor->tail = &actor->stub;
+        atomic_init(&actor->scheduled, false);
+        atomic_init(&actor->stopped, false);
+
+        if (node_init(&actor->node, i, &simulation->view, &simulation->transport, metrics_node(metrics, i)) == -1)
+        {
+            simulation_destroy(simulation);
+            return NULL;
+        }
+    }
+
+    for (int i = 0; i < num_workers; i++)
+    {
+        worker_t *worker = &simulation->workers[i];
+        worker->simulation = simulation;
+        worker->index = i;
+        worker->seed = i + 1;
+
+        if (work_deque_init(&worker->deque, simulation->num_nodes) == -1)
+        {
+            simulation_destroy(simulation);
+            return NULL;
+        }
+    }
+
+    for (int i = 0; i < num_workers; i++)
+    {
+        if (pthread_create(&simulation->workers[i].thread, NULL, worker_run, &simulation->workers[i]) != 0)
+        {
+            log_message("SERVER", MSG_TYPE_ERROR, "Failed to start worker %d", i);
+            break;
+        }
+        simulation->num_threads++;
+    }
+
+    if (simulation->num_threads == 0)
+    {
+        simulation_destroy(simulation);
+        return NULL;
+    }
+
+    return simulation;
+}
+
+/**
+ * @brief Sets the function every simulated node calls when a message reaches it.
+ *
+ * Must be called before messages are injected. The handler runs on the
+ * worker threads, possibly for several nodes at once.
+ *
+ * @param simulation The simulation.
+ * @param handler The delivery handler, or NULL.
+ * @param context Passed to the handler.
+ */
+void simulation_set_delivery_handler(simulation_t *simulation, node_delivery_handler handler, void *context)
+{
+    for (int i = 0; i < simulation->num_nodes; i++)
+    {
+        simulation->actors[i].node.on_delivery = handler;
+        simulation->actors[i].node.delivery_context = context;
+    }
+}
+
+/**
+ * @brief Stops a simulated node.
+ *
+ * The actor stays allocated, but discards everything it receives from now on.
+ *
+ * @param simulation The simulation.
+ * @param node_id The node to stop.
+ */
+void simulation_stop_node(simulation_t *simulation, int node_id)
+{
+    atomic_store(&simulation->actors[node_id].stopped, true);
+}
+
+/**
+ * @brief Stops the worker threads and releases the simulation.
+ *
+ * @param simulation The simulation to destroy.
+ */
+void simulation_destroy(simulation_t *simulation)
+{
+    pthread_mutex_lock(&simulation->park_lock);
+    atomic_store(&simulation->running, false);
+    pthread_cond_broadcast(&simulation->park_cond);
+    pthread_mutex_unlock(&simulation->park_lock);
+
+    for (int i = 0; i < simulation->num_threads; i++)
+    {
+        pthread_join(simulation->workers[i].thread, NULL);
+    }
+
+    for (int i = 0; simulation->workers && i < simulation->num_workers; i++)
+    {
+        free(simulation->workers[i].deque.buffer);
+    }
+
+    if (simulation->actors)
+    {
+        for (int i = 0; i < simulation->num_nodes; i++)
+        {
+            actor_t *actor = &simulation->actors[i];
+            mailbox_message_t *message;
+            while ((message = mailbox_pop(actor)))
+            {
+                free(message);
+            }
+            node_free(&actor->node);
+        }
+    }
+
+    topology_view_free(&simulation->view);
+    pthread_mutex_destroy(&simulation->inject_lock);
+    pthread_mutex_destroy(&simulation->park_lock);
+    pthread_cond_destroy(&simulation->park_cond);
+
+    free(simulation->workers);
+    free(simulation->actors);
+    free(simulation->inject_queue);
+    free(simulation);
+}
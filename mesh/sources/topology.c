@@ -0,0 +1,440 @@
+#include "topology.h"
+#include "graph.h"
+
+/**
+ * @brief Maps the shared topology segment into the address space.
+ *
+ * @param flags Flags passed to shm_open().
+ * @param protection Memory protection passed to mmap().
+ * @param size Size of the segment. When creating, the segment is resized to it.
+ *             When attaching with 0, the size is read from the segment header.
+ * @return Pointer to the mapped segment, or NULL on failure.
+ */
+static topology_shared_t *topology_map(int flags, int protection, size_t size)
+{
+    int fd = shm_open(TOPOLOGY_SHM_NAME, flags, 0600);
+    if (fd == -1)
+    {
+        return NULL;
+    }
+
+    if ((flags & O_CREAT) && ftruncate(fd, size) == -1)
+    {
+        close(fd);
+        return NULL;
+    }
+
+    if (size == 0)
+    {
+        topology_shared_t header;
+        if (pread(fd, &header, sizeof(header), 0) != sizeof(header))
+        {
+            close(fd);
+            return NULL;
+        }
+        size = header.size;
+    }
+
+    void *memory = mmap(NULL, size, protection, MAP_SHARED, fd, 0);
+    close(fd);
+
+    return memory == MAP_FAILED ? NULL : (topology_shared_t *)memory;
+}
+
+/**
+ * @brief Opens the writer side of a topology update.
+ *
+ * The sequence counter becomes odd while the segment is being modified,
+ * which tells readers that any copy they take in the meantime is torn.
+ *
+ * @param topology The shared topology segment.
+ */
+static void topology_write_begin(topology_shared_t *topology)
+{
+    unsigned sequence = atomic_load_explicit(&topology->sequence, memory_order_relaxed);
+    atomic_store_explicit(&topology->sequence, sequence + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+}
+
+/**
+ * @brief Closes the writer side of a topology update.
+ *
+ * @param topology The shared topology segment.
+ */
+static void topology_write_end(topology_shared_t *topology)
+{
+    unsigned sequence = atomic_load_explicit(&topology->sequence, memory_order_relaxed);
+    atomic_store_explicit(&topology->sequence, sequence + 1, memory_order_release);
+}
+
+/**
+ * @brief Appends a change to the delta log under the current epoch.
+ *
+ * When the log wraps, the overwritten entry is no longer available to
+ * readers, so caches at an older epoch must fall back to a full copy.
+ *
+ * @param topology The shared topology segment.
+ * @param change The change to record.
+ */
+static void topology_log_change(topology_shared_t *topology, topology_change_t change)
+{
+    topology_change_t *slot = &topology->log[topology->log_count % TOPOLOGY_LOG_SIZE];
+
+    if (topology->log_count >= TOPOLOGY_LOG_SIZE && slot->epoch > topology->delta_floor)
+    {
+        topology->delta_floor = slot->epoch;
+    }
+
+    change.epoch = topology->epoch;
+    *slot = change;
+    topology->log_count++;
+}
+
+/**
+ * @brief Creates the shared topology segment on the server side.
+ *
+ * The segment is sized for the edges of the graph plus some headroom,
+ * which leaves room for edges added after startup.
+ *
+ * @param graph The graph the segment will hold.
+ * @return Pointer to the writable segment, or NULL on failure.
+ */
+topology_shared_t *topology_create(const graph_t *graph)
+{
+    int edge_count = 0;
+    for (int u = 0; u < graph->num_nodes; u++)
+    {
+        edge_count += graph->degrees[u];
+    }
+
+    int edge_capacity = edge_count + TOPOLOGY_LOG_SIZE;
+    size_t size = sizeof(topology_shared_t) + edge_capacity * sizeof(topology_edge_t);
+
+    topology_shared_t *topology = topology_map(O_CREAT | O_RDWR, PROT_READ | PROT_WRITE, size);
+    if (topology)
+    {
+        memset(topology, 0, size);
+        topology->size = size;
+        topology->num_nodes = graph->num_nodes;
+        topology->edge_capacity = edge_capacity;
+    }
+    return topology;
+}
+
+/**
+ * @brief Attaches to the topology segment published by the server.
+ *
+ * @return Pointer to the read-only segment, or NULL on failure.
+ */
+topology_shared_t *topology_attach(void)
+{
+    return topology_map(O_RDONLY, PROT_READ, 0);
+}
+
+/**
+ * @brief Unmaps and removes the shared topology segment.
+ *
+ * @param topology The segment returned by topology_create().
+ */
+void topology_destroy(topology_shared_t *topology)
+{
+    munmap(topology, topology->size);
+    shm_unlink(TOPOLOGY_SHM_NAME);
+}
+
+/**
+ * @brief Unmaps the topology segment without removing it.
+ *
+ * @param topology The segment returned by topology_attach().
+ */
+void topology_detach(topology_shared_t *topology)
+{
+    munmap((void *)topology, topology->size);
+}
+
+/**
+ * @brief Publishes a complete topology under a new epoch.
+ *
+ * Each undirected edge is stored once in the segment's edge list.
+ * Caches older than this epoch cannot be brought up to date with deltas
+ * and will copy the whole edge list on their next sync.
+ *
+ * @param topology The shared topology segment.
+ * @param graph The graph to publish.
+ * @return The new topology epoch.
+ */
+uint32_t topology_publish(topology_shared_t *topology, const graph_t *graph)
+{
+    topology_write_begin(topology);
+
+    int count = 0;
+    for (int u = 0; u < graph->num_nodes; u++)
+    {
+        for (int i = 0; i < graph->degrees[u]; i++)
+        {
+            const edge_t *edge = &graph->adjacency[u][i];
+            if (u < edge->target && count < topology->edge_capacity)
+            {
+                topology->edges[count++] =
+                    (topology_edge_t){.u = u, .v = edge->target, .weight = edge->weight, .penalty = edge->penalty};
+            }
+        }
+    }
+
+    topology->edge_count = count;
+    topology->epoch++;
+    topology->delta_floor = topology->epoch;
+
+    topology_write_end(topology);
+    return topology->epoch;
+}
+
+/**
+ * @brief Removes a node from the published topology as a delta.
+ *
+ * @param topology The shared topology segment.
+ * @param node_id The node to remove.
+ * @return The new topology epoch.
+ */
+uint32_t topology_remove_node(topology_shared_t *topology, int node_id)
+{
+    topology_write_begin(topology);
+
+    int count = 0;
+    for (int i = 0; i < topology->edge_count; i++)
+    {
+        if (topology->edges[i].u != node_id && topology->edges[i].v != node_id)
+        {
+            topology->edges[count++] = topology->edges[i];
+        }
+    }
+    topology->edge_count = count;
+
+    topology->epoch++;
+    topology_log_change(topology, (topology_change_t){.kind = TOPOLOGY_CHANGE_NODE_REMOVED, .u = node_id});
+
+    topology_write_end(topology);
+    return topology->epoch;
+}
+
+/**
+ * @brief Changes the weights of existing edges as one delta.
+ *
+ * Edges that are not in the published topology, for example because one of
+ * their nodes was removed, are skipped rather than added back. The edges
+ * that were changed are moved to the front of the array.
+ *
+ * @param topology The shared topology segment.
+ * @param edges The edges with their new weights and the congestion penalties included in them.
+ * @param count Number of edges.
+ * @return The number of edges changed. A new epoch is published if it is not 0.
+ */
+int topology_set_weights(topology_shared_t *topology, topology_edge_t *edges, int count)
+{
+    int changed = 0;
+
+    topology_write_begin(topology);
+
+    for (int k = 0; k < count; k++)
+    {
+        int u = edges[k].u < edges[k].v ? edges[k].u : edges[k].v;
+        int v = edges[k].u < edges[k].v ? edges[k].v : edges[k].u;
+
+        for (int i = 0; i < topology->edge_count; i++)
+        {
+            if (topology->edges[i].u == u && topology->edges[i].v == v)
+            {
+                topology->edges[i].weight = edges[k].weight;
+                topology->edges[i].penalty = edges[k].penalty;
+                edges[changed++] = edges[k];
+                break;
+            }
+        }
+    }
+
+    if (changed > 0)
+    {
+        topology->epoch++;
+        for (int k = 0; k < changed; k++)
+        {
+            topology_log_change(topology, (topology_change_t){.kind = TOPOLOGY_CHANGE_EDGE, .u = edges[k].u, .v = edges[k].v,
+                                                              .weight = edges[k].weight, .penalty = edges[k].penalty});
+        }
+    }
+
+    topology_write_end(topology);
+    return changed;
+}
+
+/**
+ * @brief Returns the epoch of the most recently published topology.
+ *
+ * @param topology The shared topology segment.
+ * @return The current topology epoch.
+ */
+uint32_t topology_current_epoch(const topology_shared_t *topology)
+{
+    return topology->epoch;
+}
+
+/**
+ * @brief Applies a single logged change to a local graph.
+ *
+ * @param change The change to apply.
+ * @param graph The graph to update.
+ * @return 0 on success, -1 if memory allocation failed.
+ */
+static int topology_apply_change(const topology_change_t *change, graph_t *graph)
+{
+    switch (change->kind)
+    {
+    case TOPOLOGY_CHANGE_EDGE:
+        return add_penalized_edge(change->u, change->v, change->weight, change->penalty, graph);
+    case TOPOLOGY_CHANGE_NODE_REMOVED:
+        remove_node(change->u, graph);
+        break;
+    }
+    return 0;
+}
+
+/**
+ * @brief Rebuilds a cached graph from an edge list copied out of the segment.
+ *
+ * @return 0 on success, -1 if memory allocation failed.
+ */
+static int topology_load_edges(topology_cache_t *cache, int num_nodes, int edge_count)
+{
+    free_graph(&cache->graph);
+    if (initialize_graph(&cache->graph, num_nodes) == -1)
+    {
+        return -1;
+    }
+
+    for (int i = 0; i < edge_count; i++)
+    {
+        const topology_edge_t *edge = &cache->edges[i];
+        if (add_penalized_edge(edge->u, edge->v, edge->weight, edge->penalty, &cache->graph) == -1)
+        {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Brings a node's cached topology up to the published epoch.
+ *
+ * If the cache is recent enough, only the logged changes since its epoch are
+ * copied out and applied. Otherwise the whole edge list is copied and the graph rebuilt.
+ * Both paths retry when the server modified the segment during the read.
+ * The handler is called after each delta is applied, so that state derived
+ * from the topology can be repaired incrementally.
+ *
+ * @param topology The shared topology segment.
+ * @param cache The node's local topology cache. Must be zeroed before the first sync.
+ * @param handler Function called for every applied delta, or NULL.
+ * @param context Argument passed to the handler.
+ * @return How the cache was brought up to date.
+ */
+topology_sync_result topology_sync(const topology_shared_t *topology, topology_cache_t *cache,
+                                   topology_change_handler handler, void *context)
+{
+    topology_change_t pending[TOPOLOGY_LOG_SIZE];
+
+    if (!cache->edges)
+    {
+        cache->edges = malloc((topology->edge_capacity ? topology->edge_capacity : 1) * sizeof(topology_edge_t));
+        if (!cache->edges)
+        {
+            return TOPOLOGY_SYNC_ERROR;
+        }
+    }
+
+    while (1)
+    {
+        unsigned sequence = atomic_load_explicit(&topology->sequence, memory_order_acquire);
+        if (sequence & 1)
+        {
+            continue;
+        }
+
+        uint32_t epoch = topology->epoch;
+        if (epoch == cache->epoch)
+        {
+            return TOPOLOGY_SYNC_NONE;
+        }
+
+        bool full_copy = cache->epoch < topology->delta_floor;
+        int pending_count = 0;
+        int edge_count = 0;
+
+        if (full_copy)
+        {
+            edge_count = topology->edge_count;
+            if (edge_count > topology->edge_capacity)
+            {
+                continue;
+            }
+            memcpy(cache->edges, topology->edges, edge_count * sizeof(topology_edge_t));
+        }
+        else
+        {
+            uint32_t count = topology->log_count;
+            uint32_t first = count > TOPOLOGY_LOG_SIZE ? count - TOPOLOGY_LOG_SIZE : 0;
+
+            for (uint32_t i = first; i < count; i++)
+            {
+                const topology_change_t *change = &topology->log[i % TOPOLOGY_LOG_SIZE];
+                if (change->epoch > cache->epoch && change->epoch <= epoch)
+                {
+                    pending[pending_count++] = *change;
+                }
+            }
+        }
+
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&topology->sequence, memory_order_relaxed) != sequence)
+        {
+            continue;
+        }
+
+        if (full_copy)
+        {
+            if (topology_load_edges(cache, topology->num_nodes, edge_count) == -1)
+            {
+                return TOPOLOGY_SYNC_ERROR;
+            }
+            cache->epoch = epoch;
+            return TOPOLOGY_SYNC_FULL;
+        }
+
+        cache->epoch = epoch;
+
+        for (int i = 0; i < pending_count; i++)
+        {
+            if (topology_apply_change(&pending[i], &cache->graph) == -1)
+            {
+                cache->epoch = 0;
+                return TOPOLOGY_SYNC_ERROR;
+            }
+            if (handler)
+            {
+                handler(&pending[i], cache, context);
+            }
+        }
+
+        return TOPOLOGY_SYNC_DELTA;
+    }
+}
+
+/**
+ * @brief Releases the memory owned by a topology cache.
+ *
+ * @param cache The cache to release.
+ */
+void topology_cache_free(topology_cache_t *cache)
+{
+    free_graph(&cache->graph);
+    free(cache->edges);
+    memset(cache, 0, sizeof(topology_cache_t));
+}
@@ -0,0 +1,100 @@
+#include "transport.h"
+
+/**
+ * @brief Sends the same datagram to several nodes, one at a time.
+ *
+ * Used as the send_many operation of transports that have no batched send.
+ *
+ * @param transport The transport.
+ * @param destinations The nodes the datagram is sent to.
+ * @param count Number of destinations.
+ * @param iov The parts of the datagram.
+ * @param iov_count Number of parts.
+ * @return The number of destinations the datagram was sent to.
+ */
+int transport_send_each(transport_t *transport, const int *destinations, int count, const struct iovec *iov, int iov_count)
+{
+    int sent = 0;
+
+    for (int i = 0; i < count; i++)
+    {
+        if (transport->send(transport, destinations[i], iov, iov_count) != -1)
+        {
+            sent++;
+        }
+    }
+
+    return sent;
+}
+
+/**
+ * @brief Returns the size of a datagram given as parts.
+ *
+ * @param iov The parts of the datagram.
+ * @param iov_count Number of parts.
+ * @return The total size of the parts in bytes.
+ */
+size_t transport_iov_size(const struct iovec *iov, int iov_count)
+{
+    size_t size = 0;
+
+    for (int i = 0; i < iov_count; i++)
+    {
+        size += iov[i].iov_len;
+    }
+
+    return size;
+}
+
+/**
+ * @brief Copies the parts of a datagram one after another.
+ *
+ * Used by transports that deliver through memory instead of a socket.
+ *
+ * @param output Receives the datagram, at least transport_iov_size() bytes.
+ * @param iov The parts of the datagram.
+ * @param iov_count Number of parts.
+ */
+void transport_gather(char *output, const struct iovec *iov, int iov_count)
+{
+    for (int i = 0; i < iov_count; i++)
+    {
+        memcpy(output, iov[i].iov_base, iov[i].iov_len);
+        output += iov[i].iov_len;
+    }
+}
+
+/**
+ * @brief Returns the command-line name of a transport.
+ *
+ * @param kind The transport kind.
+ * @return The name of the transport.
+ */
+const char *transport_name(transport_kind kind)
+{
+    return kind == TRANSPORT_SHM ? "shm" : "udp";
+}
+
+/**
+ * @brief Parses the command-line name of a transport.
+ *
+ * @param name The name to parse.
+ * @param kind Receives the transport kind.
+ * @return 0 on success, -1 if the name is unknown.
+ */
+int transport_parse(const char *name, transport_kind *kind)
+{
+    if (strcmp(name, "udp") == 0)
+    {
+        *kind = TRANSPORT_UDP;
+    }
+    else if (strcmp(name, "shm") == 0)
+    {
+        *kind = TRANSPORT_SHM;
+    }
+    else
+    {
+        return -1;
+    }
+    return 0;
+}
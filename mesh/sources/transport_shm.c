@@ -0,0 +1,342 @@
+#include <errno.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <time.h>
+
+#include "transport.h"
+#include "common.h"
+#include "logger.h"
+
+typedef struct
+{
+    transport_t base;
+    transport_shared_t *shared;
+    transport_ring_t *inbox;
+    bool owner;
+} shm_transport_t;
+
+/**
+ * @brief Blocks while a shared word still holds the given value.
+ *
+ * @param address The word to wait on. It may live in memory shared between processes.
+ * @param value The value the word is expected to hold.
+ * @param timeout How long to wait in milliseconds, or -1 to wait until woken up.
+ */
+static void futex_wait(atomic_uint *address, unsigned value, int timeout)
+{
+    struct timespec duration = {.tv_sec = timeout / 1000, .tv_nsec = (long)(timeout % 1000) * 1000000};
+
+    syscall(SYS_futex, address, FUTEX_WAIT, value, timeout < 0 ? NULL : &duration, NULL, 0);
+}
+
+/**
+ * @brief Wakes up one process blocked on a shared word.
+ *
+ * @param address The word to wake up on.
+ */
+static void futex_wake(atomic_uint *address)
+{
+    syscall(SYS_futex, address, FUTEX_WAKE, 1, NULL, NULL, 0);
+}
+
+/**
+ * @brief Maps the shared segment that holds the inbox of every node.
+ *
+ * @param flags Flags passed to shm_open().
+ * @param size Size of the segment. When creating, the segment is resized to it.
+ *             When attaching with 0, the size is read from the segment header.
+ * @return Pointer to the mapped segment, or NULL on failure.
+ */
+static transport_shared_t *transport_shm_map(int flags, size_t size)
+{
+    int fd = shm_open(TRANSPORT_SHM_NAME, flags, 0600);
+    if (fd == -1)
+    {
+        return NULL;
+    }
+
+    if ((flags & O_CREAT) && ftruncate(fd, size) == -1)
+    {
+        close(fd);
+        return NULL;
+    }
+
+    if (size == 0)
+    {
+        transport_shared_t header;
+        if (pread(fd, &header, sizeof(header), 0) != sizeof(header))
+        {
+            close(fd);
+            return NULL;
+        }
+        size = header.size;
+    }
+
+    void *memory = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+
+    return memory == MAP_FAILED ? NULL : (transport_shared_t *)memory;
+}
+
+/**
+ * @brief Appends a datagram to the inbox of a node.
+ *
+ * The inbox is a bounded multi-producer single-consumer ring. Producers claim
+ * a slot by advancing the tail, copy the datagram and then publish the slot
+ * through its sequence number. A full inbox drops the datagram, as a full
+ * socket buffer would. The receiver is woken up only if it is waiting.
+ *
+ * The parts of the datagram are gathered directly into the claimed slot.
+ *
+ * @param transport The shared-memory transport.
+ * @param destination The node the datagram is sent to, or TRANSPORT_SERVER.
+ * @param iov The parts of the datagram.
+ * @param iov_count Number of parts.
+ * @return The number of bytes sent, or -1 on failure.
+ */
+static int shm_send(transport_t *transport, int destination, const struct iovec *iov, int iov_count)
+{
+    shm_transport_t *shm = (shm_transport_t *)transport;
+    size_t size = transport_iov_size(iov, iov_count);
+
+    if (destination == TRANSPORT_SERVER)
+    {
+        destination = shm->shared->num_nodes;
+    }
+
+    if (destination < 0 || destination > shm->shared->num_nodes || size > PACKET_DATAGRAM_SIZE)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    transport_ring_t *ring = &shm->shared->rings[destination];
+    unsigned position = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    transport_slot_t *slot;
+
+    while (1)
+    {
+        slot = &ring->slots[position % TRANSPORT_RING_SIZE];
+        unsigned sequence = atomic_load_explicit(&slot->sequence, memory_order_acquire);
+        int difference = (int)(sequence - position);
+
+        if (difference == 0)
+        {
+            if (atomic_compare_exchange_weak_explicit(&ring->tail, &position, position + 1, memory_order_relaxed, memory_order_relaxed))
+            {
+                break;
+            }
+        }
+        else if (difference < 0)
+        {
+            errno = ENOBUFS;
+            return -1;
+        }
+        else
+        {
+            position = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+        }
+    }
+
+    slot->size = size;
+    transport_gather(slot->data, iov, iov_count);
+    atomic_store_explicit(&slot->sequence, position + 1, memory_order_release);
+
+    atomic_thread_fence(memory_order_seq_cst);
+    atomic_fetch_add_explicit(&ring->signal, 1, memory_order_relaxed);
+    if (atomic_load_explicit(&ring->waiting, memory_order_relaxed))
+    {
+        futex_wake(&ring->signal);
+    }
+
+    return size;
+}
+
+/**
+ * @brief Moves the datagrams waiting in the node's inbox into a batch.
+ *
+ * @param ring The inbox of the current node.
+ * @param batch Buffers for the received datagrams.
+ * @return The number of datagrams taken.
+ */
+static int shm_drain(transport_ring_t *ring, transport_batch_t *batch)
+{
+    int count = 0;
+
+    while (count < RECV_BATCH_SIZE)
+    {
+        transport_slot_t *slot = &ring->slots[ring->head % TRANSPORT_RING_SIZE];
+        if (atomic_load_explicit(&slot->sequence, memory_order_acquire) != ring->head + 1)
+        {
+            break;
+        }
+
+        batch->sizes[count] = slot->size;
+        memcpy(batch->data[count], slot->data, slot->size);
+        count++;
+
+        atomic_store_explicit(&slot->sequence, ring->head + TRANSPORT_RING_SIZE, memory_order_release);
+        ring->head++;
+    }
+
+    return count;
+}
+
+/**
+ * @brief Waits for datagrams in the inbox of the node or server and receives them in a batch.
+ *
+ * The node only sleeps on the futex after announcing that it is waiting
+ * and checking the inbox once more, so a datagram published in between
+ * either is seen by the check or wakes the node up. With a timeout, the
+ * node sleeps at most once, so it may return early with nothing.
+ *
+ * @param transport The shared-memory transport.
+ * @param batch Buffers for the received datagrams.
+ * @param timeout How long to wait for a datagram in milliseconds, or -1 to wait indefinitely.
+ * @return The number of datagrams received, 0 on timeout.
+ */
+static int shm_receive(transport_t *transport, transport_batch_t *batch, int timeout)
+{
+    shm_transport_t *shm = (shm_transport_t *)transport;
+    transport_ring_t *ring = shm->inbox;
+
+    while (1)
+    {
+        int count = shm_drain(ring, batch);
+        if (count > 0 || timeout == 0)
+        {
+            return count;
+        }
+
+        unsigned signal = atomic_load_explicit(&ring->signal, memory_order_relaxed);
+        atomic_store_explicit(&ring->waiting, 1, memory_order_relaxed);
+        atomic_thread_fence(memory_order_seq_cst);
+
+        count = shm_drain(ring, batch);
+        if (count == 0)
+        {
+            futex_wait(&ring->signal, signal, timeout);
+        }
+
+        atomic_store_explicit(&ring->waiting, 0, memory_order_relaxed);
+
+        if (count == 0 && timeout > 0)
+        {
+            count = shm_drain(ring, batch);
+        }
+
+        if (count > 0 || timeout > 0)
+        {
+            return count;
+        }
+    }
+}
+
+/**
+ * @brief Unmaps the shared inboxes and releases the transport.
+ *
+ * The server, which created the segment, also removes it.
+ *
+ * @param transport The shared-memory transport.
+ */
+static void shm_close(transport_t *transport)
+{
+    shm_transport_t *shm = (shm_transport_t *)transport;
+
+    munmap(shm->shared, shm->shared->size);
+    if (shm->owner)
+    {
+        shm_unlink(TRANSPORT_SHM_NAME);
+    }
+    free(shm);
+}
+
+/**
+ * @brief Allocates a shared-memory transport around a mapped segment.
+ *
+ * @param shared The mapped segment.
+ * @param node_id The node whose inbox is read, or TRANSPORT_SERVER.
+ * @param owner Whether the segment is removed on close.
+ * @return The transport, or NULL on failure.
+ */
+static transport_t *transport_shm_wrap(transport_shared_t *shared, int node_id, bool owner)
+{
+    shm_transport_t *shm = calloc(1, sizeof(shm_transport_t));
+    if (!shm)
+    {
+        munmap(shared, shared->size);
+        return NULL;
+    }
+
+    shm->base.send = shm_send;
+    shm->base.send_many = transport_send_each;
+    shm->base.receive = shm_receive;
+    shm->base.close = shm_close;
+    shm->shared = shared;
+    shm->inbox = &shared->rings[node_id == TRANSPORT_SERVER ? shared->num_nodes : node_id];
+    shm->owner = owner;
+    return &shm->base;
+}
+
+/**
+ * @brief Creates the inboxes of all nodes on the server side.
+ *
+ * The server can send into any inbox and reads its own inbox, which comes
+ * after those of the nodes.
+ *
+ * @param num_nodes Number of nodes in the network.
+ * @return The transport, or NULL on failure.
+ */
+transport_t *transport_shm_create(int num_nodes)
+{
+    size_t size = sizeof(transport_shared_t) + (num_nodes + 1) * sizeof(transport_ring_t);
+
+    transport_shared_t *shared = transport_shm_map(O_CREAT | O_RDWR, size);
+    if (!shared)
+    {
+        log_message("SERVER", MSG_TYPE_ERROR, "Failed to create the transport segment");
+        return NULL;
+    }
+
+    shared->size = size;
+    shared->num_nodes = num_nodes;
+
+    for (int i = 0; i <= num_nodes; i++)
+    {
+        transport_ring_t *ring = &shared->rings[i];
+        atomic_init(&ring->tail, 0);
+        ring->head = 0;
+        atomic_init(&ring->signal, 0);
+        atomic_init(&ring->waiting, 0);
+        for (unsigned slot = 0; slot < TRANSPORT_RING_SIZE; slot++)
+        {
+            atomic_init(&ring->slots[slot].sequence, slot);
+        }
+    }
+
+    return transport_shm_wrap(shared, TRANSPORT_SERVER, true);
+}
+
+/**
+ * @brief Attaches a node to the inboxes created by the server.
+ *
+ * @param node_id The node whose inbox is read.
+ * @return The transport, or NULL on failure.
+ */
+transport_t *transport_shm_attach(int node_id)
+{
+    transport_shared_t *shared = transport_shm_map(O_RDWR, 0);
+    if (!shared)
+    {
+        log_message("CLIENT", MSG_TYPE_ERROR, "Failed to attach to the transport segment");
+        return NULL;
+    }
+
+    if (node_id < 0 || node_id >= shared->num_nodes)
+    {
+        munmap(shared, shared->size);
+        return NULL;
+    }
+
+    return transport_shm_wrap(shared, node_id, false);
+}
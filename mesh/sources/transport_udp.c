@@ -0,0 +1,265 @@
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <sys/epoll.h>
+
+#include "transport.h"
+#include "common.h"
+#include "logger.h"
+
+typedef struct
+{
+    transport_t base;
+    int socket;
+    int epoll_fd;
+    struct iovec iovecs[RECV_BATCH_SIZE];
+    struct mmsghdr messages[RECV_BATCH_SIZE];
+} udp_transport_t;
+
+/**
+ * @brief Returns the port a node or the server listens on.
+ *
+ * @param node_id The node, or TRANSPORT_SERVER.
+ * @return The port in host byte order.
+ */
+static int udp_port(int node_id)
+{
+    return node_id == TRANSPORT_SERVER ? SERVER_PORT : CLIENT_BASE_PORT + node_id;
+}
+
+/**
+ * @brief Sends a datagram to a node over the loopback UDP socket.
+ *
+ * The parts of the datagram are gathered by the kernel with sendmsg.
+ *
+ * @param transport The UDP transport.
+ * @param destination The node the datagram is sent to, or TRANSPORT_SERVER.
+ * @param iov The parts of the datagram.
+ * @param iov_count Number of parts.
+ * @return The number of bytes sent, or -1 on failure.
+ */
+static int udp_send(transport_t *transport, int destination, const struct iovec *iov, int iov_count)
+{
+    udp_transport_t *udp = (udp_transport_t *)transport;
+
+    struct sockaddr_in node_address;
+    node_address.sin_family = AF_INET;
+    node_address.sin_port = htons(udp_port(destination));
+    node_address.sin_addr.s_addr = INADDR_ANY;
+
+    struct msghdr message = {
+        .msg_name = &node_address,
+        .msg_namelen = sizeof(node_address),
+        .msg_iov = (struct iovec *)iov,
+        .msg_iovlen = iov_count,
+    };
+
+    return sendmsg(udp->socket, &message, 0);
+}
+
+/**
+ * @brief Sends the same datagram to several nodes with one sendmmsg call.
+ *
+ * All messages share the same parts. A destination that fails is skipped
+ * and the remaining ones are sent with another call.
+ *
+ * @param transport The UDP transport.
+ * @param destinations The nodes the datagram is sent to.
+ * @param count Number of destinations, at most SEND_BATCH_SIZE.
+ * @param iov The parts of the datagram.
+ * @param iov_count Number of parts.
+ * @return The number of destinations the datagram was sent to.
+ */
+static int udp_send_many(transport_t *transport, const int *destinations, int count, const struct iovec *iov, int iov_count)
+{
+    udp_transport_t *udp = (udp_transport_t *)transport;
+
+    struct sockaddr_in addresses[SEND_BATCH_SIZE];
+    struct mmsghdr messages[SEND_BATCH_SIZE];
+
+    if (count > SEND_BATCH_SIZE)
+    {
+        count = SEND_BATCH_SIZE;
+    }
+
+    memset(messages, 0, count * sizeof(struct mmsghdr));
+
+    for (int i = 0; i < count; i++)
+    {
+        addresses[i].sin_family = AF_INET;
+        addresses[i].sin_port = htons(CLIENT_BASE_PORT + destinations[i]);
+        addresses[i].sin_addr.s_addr = INADDR_ANY;
+
+        messages[i].msg_hdr.msg_name = &addresses[i];
+        messages[i].msg_hdr.msg_namelen = sizeof(addresses[i]);
+        messages[i].msg_hdr.msg_iov = (struct iovec *)iov;
+        messages[i].msg_hdr.msg_iovlen = iov_count;
+    }
+
+    int sent = 0;
+    int offset = 0;
+
+    while (offset < count)
+    {
+        int result = sendmmsg(udp->socket, messages + offset, count - offset, 0);
+
+        if (result > 0)
+        {
+            sent += result;
+            offset += result;
+        }
+        else if (result == -1 && errno == EINTR)
+        {
+            continue;
+        }
+        else
+        {
+            offset++;
+        }
+    }
+
+    return sent;
+}
+
+/**
+ * @brief Waits for datagrams and receives them in a batch.
+ *
+ * The socket is drained with recvmmsg, and the function only blocks
+ * in epoll_wait when the kernel queue is empty.
+ *
+ * @param transport The UDP transport.
+ * @param batch Buffers for the received datagrams.
+ * @param timeout How long to wait for a datagram in milliseconds, or -1 to wait indefinitely.
+ * @return The number of datagrams received, 0 on timeout, or -1 on failure.
+ */
+static int udp_receive(transport_t *transport, transport_batch_t *batch, int timeout)
+{
+    udp_transport_t *udp = (udp_transport_t *)transport;
+
+    for (int i = 0; i < RECV_BATCH_SIZE; i++)
+    {
+        udp->iovecs[i].iov_base = batch->data[i];
+        udp->iovecs[i].iov_len = sizeof(batch->data[i]);
+    }
+
+    while (1)
+    {
+        int received = recvmmsg(udp->socket, udp->messages, RECV_BATCH_SIZE, MSG_DONTWAIT, NULL);
+
+        if (received > 0)
+        {
+            for (int i = 0; i < received; i++)
+            {
+                batch->sizes[i] = udp->messages[i].msg_len;
+            }
+            return received;
+        }
+
+        if (received == -1 && errno != EWOULDBLOCK && errno != EAGAIN && errno != EINTR)
+        {
+            log_message("CLIENT", MSG_TYPE_ERROR, "recvmmsg failed");
+            return -1;
+        }
+
+        struct epoll_event ready;
+        int events = epoll_wait(udp->epoll_fd, &ready, 1, timeout);
+        if (events == -1 && errno != EINTR)
+        {
+            log_message("CLIENT", MSG_TYPE_ERROR, "epoll_wait failed");
+            return -1;
+        }
+        else if (events == 0)
+        {
+            return 0;
+        }
+    }
+}
+
+/**
+ * @brief Closes the socket and releases the UDP transport.
+ *
+ * @param transport The UDP transport.
+ */
+static void udp_close(transport_t *transport)
+{
+    udp_transport_t *udp = (udp_transport_t *)transport;
+
+    close(udp->socket);
+    if (udp->epoll_fd != -1)
+    {
+        close(udp->epoll_fd);
+    }
+    free(udp);
+}
+
+/**
+ * @brief Opens the UDP transport.
+ *
+ * A node binds its socket to CLIENT_BASE_PORT + node_id and waits on it with epoll.
+ * The server passes TRANSPORT_SERVER and binds SERVER_PORT. If that port
+ * cannot be bound, the server still gets a socket that can only send.
+ *
+ * @param node_id The node that owns the transport, or TRANSPORT_SERVER.
+ * @return The transport, or NULL on failure.
+ */
+transport_t *transport_udp_open(int node_id)
+{
+    udp_transport_t *udp = calloc(1, sizeof(udp_transport_t));
+    if (!udp)
+    {
+        return NULL;
+    }
+
+    udp->base.send = udp_send;
+    udp->base.send_many = udp_send_many;
+    udp->base.receive = udp_receive;
+    udp->base.close = udp_close;
+    udp->epoll_fd = -1;
+
+    udp->socket = socket(AF_INET, SOCK_DGRAM, 0);
+    if (udp->socket == -1)
+    {
+        log_message("CLIENT", MSG_TYPE_ERROR, "Error in calling socket()");
+        free(udp);
+        return NULL;
+    }
+
+    struct sockaddr_in node_address;
+    node_address.sin_family = AF_INET;
+    node_address.sin_port = htons(udp_port(node_id));
+    node_address.sin_addr.s_addr = INADDR_ANY;
+
+    if (bind(udp->socket, (struct sockaddr *)&node_address, sizeof(node_address)) == -1)
+    {
+        if (node_id == TRANSPORT_SERVER)
+        {
+            log_message("SERVER", MSG_TYPE_ERROR, "Error in calling bind() on port %d, delivery receipts are disabled", SERVER_PORT);
+            udp->base.receive = NULL;
+            return &udp->base;
+        }
+        log_message("CLIENT", MSG_TYPE_ERROR, "Error in calling bind()");
+        udp_close(&udp->base);
+        return NULL;
+    }
+
+    int flags = fcntl(udp->socket, F_GETFL, 0);
+    fcntl(udp->socket, F_SETFL, flags | O_NONBLOCK);
+
+    udp->epoll_fd = epoll_create1(0);
+    struct epoll_event event = {.events = EPOLLIN, .data.fd = udp->socket};
+
+    if (udp->epoll_fd == -1 || epoll_ctl(udp->epoll_fd, EPOLL_CTL_ADD, udp->socket, &event) == -1)
+    {
+        log_message("CLIENT", MSG_TYPE_ERROR, "Error in setting up epoll");
+        udp_close(&udp->base);
+        return NULL;
+    }
+
+    for (int i = 0; i < RECV_BATCH_SIZE; i++)
+    {
+        udp->messages[i].msg_hdr.msg_iov = &udp->iovecs[i];
+        udp->messages[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    return &udp->base;
+}
@@ -1,18 +1,25 @@
+#include <errno.h>
+#include <sched.h>
+
 #include "user_interface.h"
 
+// Next broadcast message ID of each origin
+static atomic_ushort broadcast_sequences[MAX_NODE_COUNT];
+
 /**
  * @brief Sends a command to the node.
  *
  * The function checks the TTL value of the packet. If TTL is 0, the packet is rejected and a message is logged.
- * a message is written to the log. Otherwise, the TTL is decremented by 1.
- * Next, the node address is created and the packet is compressed for sending. If the compression
- * fails, an error message is logged. Otherwise.
- * The packet is sent over the socket.
+ * a message is written to the log. Otherwise, the TTL is decremented by 1
+ * and the MAC checksum, which covers it, is recalculated.
+ * Next, the packet is encoded for the wire and handed to the source node
+ * over the transport. While the inbox of the node is full, the server
+ * yields to the nodes and tries again, for up to SERVER_SEND_TIMEOUT_MS.
  *
  * @param packet Pointer to the packet to be sent.
- * @param client_socket The client socket to send the packet.
+ * @param transport The transport used to reach the nodes.
  */
-void send_command_to_node(packet_t *packet, int client_socket)
+void send_command_to_node(packet_t *packet, transport_t *transport)
 {
     if (packet->mac_packet.ttl == 0)
     {
@@ -21,25 +28,20 @@ void send_command_to_node(packet_t *packet, int client_socket)
     }
 
     packet->mac_packet.ttl--;
+    packet->mac_packet.crc = packet_mac_crc(packet);
 
-    struct sockaddr_in node_address;
-    node_address.sin_family = AF_INET;
-    node_address.sin_port = htons(CLIENT_BASE_PORT + packet->mac_packet.mac_sender);
-    node_address.sin_addr.s_addr = INADDR_ANY;
+    packet_wire_t wire;
+    packet_serialize(packet, &wire);
 
-    char compressed_data[sizeof(packet_t)];
-    size_t compressed_size = sizeof(packet_t);
+    uint64_t deadline = metrics_clock() + SERVER_SEND_TIMEOUT_MS * 1000000ull;
+    int sent_bytes;
 
-    int compress_result = compress_data((char *)packet, sizeof(packet_t), compressed_data, &compressed_size);
-
-    if (compress_result)
+    while ((sent_bytes = transport->send(transport, packet->mac_packet.mac_sender, wire.iov, wire.count)) == -1 &&
+           errno == ENOBUFS && metrics_clock() < deadline)
     {
-        log_message("SERVER", MSG_TYPE_ERROR, "Compression failed");
-        return;
+        sched_yield();
     }
 
-    int sent_bytes = sendto(client_socket, compressed_data, compressed_size, 0, (struct sockaddr *)&node_address, sizeof(node_address));
-
     if (sent_bytes == -1)
     {
         log_message("SERVER", MSG_TYPE_ERROR, "sendto() failed");
@@ -49,44 +51,121 @@ void send_command_to_node(packet_t *packet, int client_socket)
 /**
  * @brief Creates and sends a message from one node to another.
  *
- * The function creates a packet with the given parameters, including the network graph,
- * and sends it to a node. The graph is copied into the packet before sending.
+ * The function creates a packet with the given parameters and stamps it with
+ * the topology epoch the server has published, so that nodes along the route
+ * can tell whether their cached topology is current. A traced message records
+ * the time it is sent and every node it reaches, and its destination sends
+ * the trace back to the server as a delivery receipt.
  *
  * @param src Source node sending the message.
  * @param dest The destination node to which the message is sent.
- * @param graph The adjacency matrix of the network graph.
- * @param size_graph The size of the graph (number of nodes).
+ * @param topology_epoch The epoch of the currently published topology.
+ * @param trace Whether to trace the message.
  * @param message The message to be sent.
- * @param client_socket The client socket to send the packet.
+ * @param transport The transport used to reach the nodes.
  */
-void create_and_send_message(const int src, const int dest, int graph[MAX_NODES][MAX_NODES], const int size_graph, const char *message, int client_socket)
+void create_and_send_message(const int src, const int dest, const uint32_t topology_epoch, const bool trace,
+                             const char *message, transport_t *transport)
 {
     packet_t packet = create_packet(src, dest, TTL_LIMIT, src, dest, message);
 
-    memcpy(packet.network_graph, graph, size_graph * size_graph * sizeof(int));
+    packet.topology_epoch = topology_epoch;
+    if (trace)
+    {
+        packet.mac_packet.flags |= PACKET_FLAG_TRACE;
+        packet.trace.sent_at = metrics_clock();
+    }
+
+    send_command_to_node(&packet, transport);
+}
+
+/**
+ * @brief Splits data into fragments and sends them from one node to another.
+ *
+ * Each fragment carries up to FRAGMENT_PAYLOAD_SIZE bytes of the data and
+ * travels on its own, so the fragments follow each other along the route.
+ * The first fragment is traced, and the destination returns its trace as
+ * the delivery receipt of the whole transfer once it is reassembled.
+ *
+ * @param src Source node sending the data.
+ * @param dest The destination node.
+ * @param topology_epoch The epoch of the currently published topology.
+ * @param transfer_id Identifies the transfer among those sent from src.
+ * @param data The data to send, which may hold any byte value.
+ * @param size The size of the data in bytes.
+ * @param rate Fragments per second, 0 to send as fast as possible.
+ * @param transport The transport used to reach the nodes.
+ * @return The number of fragments sent, or -1 if the data needs more than FRAGMENT_MAX_COUNT fragments.
+ */
+int create_and_send_transfer(const int src, const int dest, const uint32_t topology_epoch, const uint16_t transfer_id,
+                             const char *data, const size_t size, const double rate, transport_t *transport)
+{
+    size_t count = size == 0 ? 1 : (size + FRAGMENT_PAYLOAD_SIZE - 1) / FRAGMENT_PAYLOAD_SIZE;
+
+    if (count > FRAGMENT_MAX_COUNT)
+    {
+        return -1;
+    }
+
+    uint64_t start = metrics_clock();
+
+    for (size_t i = 0; i < count; i++)
+    {
+        size_t offset = i * FRAGMENT_PAYLOAD_SIZE;
+        size_t length = size - offset < FRAGMENT_PAYLOAD_SIZE ? size - offset : FRAGMENT_PAYLOAD_SIZE;
+
+        if (rate > 0)
+        {
+            metrics_sleep_until(start + (uint64_t)(i * 1e9 / rate));
+        }
+
+        packet_t packet = create_fragment(src, dest, TTL_LIMIT, transfer_id, i, count, data + offset, length);
 
-    send_command_to_node(&packet, client_socket);
+        packet.topology_epoch = topology_epoch;
+        if (i == 0)
+        {
+            packet.mac_packet.flags |= PACKET_FLAG_TRACE;
+            packet.trace.sent_at = start;
+        }
+
+        send_command_to_node(&packet, transport);
+    }
+
+    return count;
 }
 
 /**
  * @brief Creates and sends a broadcast message to the specified node.
  *
- * The function creates a packet with the given parameters, including the network graph,
- * and sends it to a node. The graph is copied into the packet before sending.
+ * The function creates a packet with the given parameters, stamps it with
+ * the published topology epoch and the broadcast mode and radius, and sends
+ * it to a node. Broadcasts are numbered per origin rather than from the
+ * global message counter, so the duplicate window each node keeps for an
+ * origin covers that origin's last BROADCAST_WINDOW_SIZE broadcasts however
+ * many other messages are sent in between.
  *
  * @param src Source node sending the message.
- * @param graph The adjacency matrix of the network graph.
- * @param size_graph The size of the graph (number of nodes).
+ * @param topology_epoch The epoch of the currently published topology.
+ * @param config How the broadcast is flooded through the network.
  * @param message The message to be sent.
- * @param client_socket The client socket to send the packet.
+ * @param transport The transport used to reach the nodes.
  */
-void create_and_send_broadcast(const int src, int graph[MAX_NODES][MAX_NODES], const int size_graph, const char *message, int client_socket)
+void create_and_send_broadcast(const int src, const uint32_t topology_epoch, const broadcast_config_t *config,
+                               const char *message, transport_t *transport)
 {
     packet_t packet = create_packet(src, BROADCAST_NODE, TTL_LIMIT, src, BROADCAST_NODE, message);
 
-    memcpy(packet.network_graph, graph, size_graph * size_graph * sizeof(int));
+    packet.mac_packet.app_packet.message_id = atomic_fetch_add(&broadcast_sequences[src], 1);
+    packet.mac_packet.app_packet.crc = packet_app_crc(&packet.mac_packet.app_packet);
+    packet.topology_epoch = topology_epoch;
+    packet.mac_packet.radius = config->radius;
+    packet.mac_packet.relay = src;
+    if (config->mode == BROADCAST_MPR)
+    {
+        packet.mac_packet.flags |= PACKET_FLAG_MPR;
+    }
 
-    send_command_to_node(&packet, client_socket);
+    send_command_to_node(&packet, transport);
 }
 
 /**
@@ -99,8 +178,21 @@ void print_help()
 {
     printf("Available commands:\n");
     printf("  send <source_node> <dest_node> <message>  - Send a message from source_node to dest_node\n");
+    printf("                                              (messages of %d bytes or more are fragmented)\n", MAX_MESSAGE_LENGTH);
+    printf("  sendfile <source_node> <dest_node> <path> [rate]\n");
+    printf("                                            - Send a file in fragments, rate fragments per second\n");
+    printf("                                              (0 or none for no limit)\n");
     printf("  broadcast <source_node> <message>         - Broadcast a message from source_node to all nodes in range\n");
+    printf("  sendall <count> <rate> <message>          - Send count messages between every pair of nodes,\n");
+    printf("                                              rate messages per second (0 for no limit)\n");
+    printf("  broadcastall <count> <rate> <message>     - Broadcast count messages from every node\n");
+    printf("  sleep <milliseconds>                      - Wait before the next command\n");
     printf("  stop <node_id>                            - Stops the node\n");
+    printf("  paths <node_id>                           - Print shortest paths from node_id to all nodes\n");
+    printf("  receipts [src dest]                       - Print the delivery rate and latency of all messages or\n");
+    printf("                                              of one pair, with the hops of its last message\n");
+    printf("  stats [node_id]                           - Print packet counters and timings of one or all nodes\n");
+    printf("  weights                                   - Print the edges whose weight was raised by congestion\n");
     printf("  help                                      - Display this help message\n");
-    printf("  Ctrl+C                                    - Exit the server program\n");
+    printf("  Ctrl+C                                    - Exit the server program (or end of input)\n");
 }
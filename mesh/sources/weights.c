@@ -0,0 +1,209 @@
+#include "weights.h"
+
+#define WEIGHTS_MS 1000000ull
+
+/**
+ * @brief Collects the edges whose weights follow the link costs reported by the nodes.
+ *
+ * Each undirected edge of the graph is kept once, with its configured weight
+ * as the base that penalties are added to, and indexed from both of its nodes.
+ *
+ * @param weights The edges to initialize. Must be released with weights_free().
+ * @param graph The graph with the configured weights.
+ * @return 0 on success, -1 if memory allocation failed.
+ */
+int weights_init(weights_t *weights, const graph_t *graph)
+{
+    int num_nodes = graph->num_nodes;
+    int count = 0;
+
+    memset(weights, 0, sizeof(weights_t));
+
+    for (int u = 0; u < num_nodes; u++)
+    {
+        for (int i = 0; i < graph->degrees[u]; i++)
+        {
+            count += u < graph->adjacency[u][i].target;
+        }
+    }
+
+    weights->num_nodes = num_nodes;
+    weights->edges = calloc(count ? count : 1, sizeof(weights_edge_t));
+    weights->offsets = calloc(num_nodes + 1, sizeof(int));
+    weights->indices = malloc((count ? 2 * count : 1) * sizeof(int));
+
+    if (!weights->edges || !weights->offsets || !weights->indices)
+    {
+        weights_free(weights);
+        return -1;
+    }
+
+    for (int u = 0; u < num_nodes; u++)
+    {
+        for (int i = 0; i < graph->degrees[u]; i++)
+        {
+            const edge_t *edge = &graph->adjacency[u][i];
+            if (u < edge->target)
+            {
+                weights->edges[weights->edge_count++] = (weights_edge_t){.u = u, .v = edge->target, .base = edge->weight};
+                weights->offsets[u + 1]++;
+                weights->offsets[edge->target + 1]++;
+            }
+        }
+    }
+
+    for (int u = 0; u < num_nodes; u++)
+    {
+        weights->offsets[u + 1] += weights->offsets[u];
+    }
+
+    int *next = malloc((num_nodes ? num_nodes : 1) * sizeof(int));
+    if (!next)
+    {
+        weights_free(weights);
+        return -1;
+    }
+
+    memcpy(next, weights->offsets, num_nodes * sizeof(int));
+    for (int k = 0; k < weights->edge_count; k++)
+    {
+        weights->indices[next[weights->edges[k].u]++] = k;
+        weights->indices[next[weights->edges[k].v]++] = k;
+    }
+
+    free(next);
+    return 0;
+}
+
+/**
+ * @brief Releases the edges tracked for adaptive weights.
+ *
+ * @param weights The edges to release.
+ */
+void weights_free(weights_t *weights)
+{
+    free(weights->edges);
+    free(weights->offsets);
+    free(weights->indices);
+    memset(weights, 0, sizeof(weights_t));
+}
+
+/**
+ * @brief Finds the edge between two nodes.
+ *
+ * @return The edge, or NULL if the graph had no such edge.
+ */
+static weights_edge_t *weights_find(weights_t *weights, int u, int v)
+{
+    if (u < 0 || u >= weights->num_nodes)
+    {
+        return NULL;
+    }
+
+    for (int i = weights->offsets[u]; i < weights->offsets[u + 1]; i++)
+    {
+        weights_edge_t *edge = &weights->edges[weights->indices[i]];
+        if (edge->u == v || edge->v == v)
+        {
+            return edge;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Decides the penalty of an edge from the costs reported for it.
+ *
+ * The edge costs as much as the worse of its two directions. The penalty is
+ * that cost in whole hops, but it only rises once the cost is
+ * WEIGHT_HYSTERESIS above the next hop and only falls once the cost is more
+ * than WEIGHT_HYSTERESIS below the current one. It then does not move again
+ * within WEIGHT_HOLD_MS, so a cost hovering around a boundary does not make
+ * routes flap.
+ *
+ * @param edge The edge.
+ * @param now The current time in nanoseconds.
+ * @return The penalty in hops.
+ */
+static int weights_penalty(const weights_edge_t *edge, uint64_t now)
+{
+    if (edge->changed_at && now - edge->changed_at < WEIGHT_HOLD_MS * WEIGHTS_MS)
+    {
+        return edge->penalty;
+    }
+
+    int cost = edge->costs[0] > edge->costs[1] ? edge->costs[0] : edge->costs[1];
+    int raised = (cost - WEIGHT_HYSTERESIS) / LINK_COST_HOP;
+    int lowered = (cost + WEIGHT_HYSTERESIS) / LINK_COST_HOP;
+    int penalty = edge->penalty;
+
+    if (raised > penalty)
+    {
+        penalty = raised;
+    }
+    else if (lowered < penalty)
+    {
+        penalty = lowered;
+    }
+
+    return penalty > WEIGHT_MAX_PENALTY ? WEIGHT_MAX_PENALTY : penalty;
+}
+
+/**
+ * @brief Records the link costs reported by a node.
+ *
+ * @param weights The edges.
+ * @param report The report.
+ * @param now The current time in nanoseconds.
+ * @param changes Receives the edges whose weight changed, at most LINK_REPORT_MAX_LINKS.
+ * @return The number of edges whose weight changed.
+ */
+int weights_update(weights_t *weights, const link_report_t *report, uint64_t now, topology_edge_t *changes)
+{
+    int count = 0;
+
+    for (int i = 0; i < report->count; i++)
+    {
+        weights_edge_t *edge = weights_find(weights, report->node_id, report->links[i].neighbor);
+        if (!edge)
+        {
+            continue;
+        }
+
+        edge->costs[edge->u == report->node_id ? 0 : 1] = report->links[i].cost;
+
+        int penalty = weights_penalty(edge, now);
+        if (penalty != edge->penalty)
+        {
+            edge->penalty = penalty;
+            edge->changed_at = now;
+            changes[count++] = (topology_edge_t){.u = edge->u, .v = edge->v, .weight = edge->base + penalty, .penalty = penalty};
+        }
+    }
+
+    return count;
+}
+
+/**
+ * @brief Prints the edges that currently carry a penalty.
+ *
+ * @param weights The edges.
+ */
+void weights_print(const weights_t *weights)
+{
+    int count = 0;
+
+    for (int k = 0; k < weights->edge_count; k++)
+    {
+        const weights_edge_t *edge = &weights->edges[k];
+        if (edge->penalty > 0)
+        {
+            printf("  %d - %d: weight %d, costs %d.%02d / %d.%02d hops\n", edge->u, edge->v, edge->base + edge->penalty,
+                   edge->costs[0] / LINK_COST_HOP, edge->costs[0] % LINK_COST_HOP, edge->costs[1] / LINK_COST_HOP,
+                   edge->costs[1] % LINK_COST_HOP);
+            count++;
+        }
+    }
+
+    printf("%d of %d edges are penalized.\n", count, weights->edge_count);
+}
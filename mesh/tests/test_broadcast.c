@@ -0,0 +1,247 @@
+#include "user_interface.h"
+#include "simulation.h"
+#include "metrics.h"
+
+#define MATRIX_SIZE 10
+#define NUM_NODES (MATRIX_SIZE * MATRIX_SIZE)
+// Far more broadcasts than the duplicate window of an origin remembers
+#define BROADCASTS 1000
+#define TIMEOUT_MS 10000
+
+/**
+ * A transport that keeps the message IDs of the broadcasts the server hands to node 0.
+ */
+typedef struct
+{
+    transport_t base;
+    int count;
+    uint16_t message_ids[BROADCASTS];
+} recording_transport_t;
+
+int record_send(transport_t *transport, int destination, const struct iovec *iov, int iov_count)
+{
+    recording_transport_t *recording = (recording_transport_t *)transport;
+    char data[PACKET_DATAGRAM_SIZE];
+    packet_t packet;
+
+    size_t size = transport_iov_size(iov, iov_count);
+    transport_gather(data, iov, iov_count);
+
+    if (packet_parse(data, size, &packet) == PACKET_PARSE_OK && destination == 0 &&
+        packet.mac_packet.app_packet.app_receiver == BROADCAST_NODE && recording->count < BROADCASTS)
+    {
+        recording->message_ids[recording->count++] = packet.mac_packet.app_packet.message_id;
+    }
+    return size;
+}
+
+/**
+ * Counts the broadcasts delivered to the nodes.
+ */
+void count_delivery(node_t *node, const packet_t *packet, void *context)
+{
+    atomic_fetch_add((atomic_int *)context, 1);
+}
+
+/**
+ * Sends BROADCASTS broadcasts from random nodes of a grid and waits until all of them have reached every node.
+ * Every edge of the grid carries the given congestion penalty, as the server publishes it.
+ */
+int run_broadcasts(const char *spec, int penalty, int *receptions, unsigned long *transmissions)
+{
+    broadcast_config_t config;
+    graph_t graph;
+
+    if (broadcast_parse(spec, &config) == -1 || initialize_graph(&graph, NUM_NODES) == -1)
+    {
+        return -1;
+    }
+    add_edges(MATRIX_SIZE, &graph);
+
+    topology_shared_t *topology = topology_create(&graph);
+    metrics_shared_t *metrics = metrics_create(NUM_NODES);
+    if (!topology || !metrics)
+    {
+        return -1;
+    }
+    topology_publish(topology, &graph);
+
+    topology_edge_t *penalized = malloc(topology->edge_count * sizeof(topology_edge_t));
+    if (!penalized)
+    {
+        return -1;
+    }
+    for (int i = 0; i < topology->edge_count; i++)
+    {
+        penalized[i] = (topology_edge_t){.u = topology->edges[i].u, .v = topology->edges[i].v,
+                                         .weight = topology->edges[i].weight + penalty, .penalty = penalty};
+    }
+    if (penalty > 0)
+    {
+        topology_set_weights(topology, penalized, topology->edge_count);
+    }
+    free(penalized);
+
+    atomic_int delivered = 0;
+    simulation_t *simulation = simulation_create(topology, metrics, 1);
+    if (!simulation)
+    {
+        return -1;
+    }
+    simulation_set_delivery_handler(simulation, count_delivery, &delivered);
+
+    uint32_t epoch = topology_current_epoch(topology);
+    unsigned seed = 1;
+    for (int i = 0; i < BROADCASTS; i++)
+    {
+        create_and_send_broadcast(rand_r(&seed) % NUM_NODES, epoch, &config, "broadcast", &simulation->transport);
+    }
+
+    uint64_t start = metrics_clock();
+    while (atomic_load(&delivered) < BROADCASTS * NUM_NODES && metrics_clock() - start < TIMEOUT_MS * 1000000ULL)
+    {
+        metrics_sleep_until(metrics_clock() + 10000000);
+    }
+    simulation_destroy(simulation);
+
+    *receptions = atomic_load(&delivered);
+    *transmissions = 0;
+    for (int i = 0; i < NUM_NODES; i++)
+    {
+        *transmissions += atomic_load(&metrics_node(metrics, i)->counters[METRIC_FORWARDED]);
+    }
+
+    metrics_destroy(metrics);
+    topology_destroy(topology);
+    free_graph(&graph);
+    return 0;
+}
+
+/**
+ * Each origin numbers its broadcasts with its own sequence, whatever other nodes send in between.
+ */
+int test_numbering()
+{
+    recording_transport_t transport = {.base.send = record_send};
+    broadcast_config_t config = {.mode = BROADCAST_MPR};
+
+    for (int i = 0; i < BROADCASTS; i++)
+    {
+        create_and_send_broadcast(0, 1, &config, "broadcast", &transport.base);
+        create_and_send_broadcast(1, 1, &config, "broadcast", &transport.base);
+        create_and_send_message(2, 3, 1, false, "message", &transport.base);
+    }
+
+    for (int i = 1; i < transport.count; i++)
+    {
+        if ((uint16_t)(transport.message_ids[i] - transport.message_ids[i - 1]) != 1)
+        {
+            printf("Test failed: Broadcast %d of node 0 has ID %d after %d.\n", i, transport.message_ids[i],
+                   transport.message_ids[i - 1]);
+            return 1;
+        }
+    }
+
+    if (transport.count != BROADCASTS)
+    {
+        printf("Test failed: %d of %d broadcasts of node 0 recorded.\n", transport.count, BROADCASTS);
+        return 1;
+    }
+
+    printf("Test passed: Broadcasts are numbered per origin.\n");
+    return 0;
+}
+
+/**
+ * Broadcasts through multipoint relays reach every node, each with a single copy, however many are sent.
+ */
+int test_mpr_reach()
+{
+    int receptions;
+    unsigned long transmissions;
+
+    if (run_broadcasts("mpr:0", 0, &receptions, &transmissions) == -1)
+    {
+        printf("Test failed: MPR broadcast setup failed.\n");
+        return 1;
+    }
+
+    if (receptions != BROADCASTS * NUM_NODES || transmissions != (unsigned long)BROADCASTS * (NUM_NODES - 1))
+    {
+        printf("Test failed: MPR broadcasts reached %d of %d nodes with %lu copies.\n", receptions,
+               BROADCASTS * NUM_NODES, transmissions);
+        return 1;
+    }
+
+    printf("Test passed: MPR broadcasts reach every node with one copy each.\n");
+    return 0;
+}
+
+/**
+ * Flooded broadcasts reach every node too, at the cost of duplicate copies.
+ */
+int test_flood_reach()
+{
+    int receptions;
+    unsigned long transmissions;
+
+    if (run_broadcasts("flood:0", 0, &receptions, &transmissions) == -1)
+    {
+        printf("Test failed: Flood broadcast setup failed.\n");
+        return 1;
+    }
+
+    if (receptions != BROADCASTS * NUM_NODES || transmissions <= (unsigned long)BROADCASTS * (NUM_NODES - 1))
+    {
+        printf("Test failed: Flooded broadcasts reached %d of %d nodes with %lu copies.\n", receptions,
+               BROADCASTS * NUM_NODES, transmissions);
+        return 1;
+    }
+
+    printf("Test passed: Flooded broadcasts reach every node.\n");
+    return 0;
+}
+
+/**
+ * Congested links still carry broadcasts, however much their penalty raises their weight.
+ */
+int test_penalized_reach()
+{
+    int receptions;
+    unsigned long transmissions;
+
+    if (run_broadcasts("mpr:0", WEIGHT_MAX_PENALTY, &receptions, &transmissions) == -1)
+    {
+        printf("Test failed: Penalized broadcast setup failed.\n");
+        return 1;
+    }
+
+    if (receptions != BROADCASTS * NUM_NODES || transmissions != (unsigned long)BROADCASTS * (NUM_NODES - 1))
+    {
+        printf("Test failed: Broadcasts over penalized links reached %d of %d nodes with %lu copies.\n", receptions,
+               BROADCASTS * NUM_NODES, transmissions);
+        return 1;
+    }
+
+    printf("Test passed: Broadcasts reach every node over penalized links.\n");
+    return 0;
+}
+
+int main()
+{
+    log_config_t log_config;
+
+    if (logger_parse("drop,level=error", &log_config) == -1 || logger_start(&log_config) == -1)
+    {
+        return EXIT_FAILURE;
+    }
+
+    int failures = 0;
+    failures += test_numbering();
+    failures += test_mpr_reach();
+    failures += test_flood_reach();
+    failures += test_penalized_reach();
+
+    logger_stop();
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
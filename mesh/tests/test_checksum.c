@@ -0,0 +1,106 @@
+#include "stdafx.h"
+#include "checksum.h"
+
+/**
+ * Reference CRC32C computed one bit at a time.
+ */
+uint32_t reference_crc32c(const unsigned char *data, size_t length)
+{
+    uint32_t crc = 0xFFFFFFFF;
+
+    for (size_t i = 0; i < length; i++)
+    {
+        crc ^= data[i];
+        for (int bit = 0; bit < 8; bit++)
+        {
+            crc = (crc >> 1) ^ (0x82F63B78 & -(crc & 1));
+        }
+    }
+
+    return ~crc;
+}
+
+int test_known_vectors()
+{
+    unsigned char zeros[32] = {0};
+    unsigned char ones[32];
+    unsigned char ascending[32];
+
+    memset(ones, 0xFF, sizeof(ones));
+    for (int i = 0; i < 32; i++)
+    {
+        ascending[i] = i;
+    }
+
+    // Check values from RFC 3720, appendix B.4
+    struct
+    {
+        const void *data;
+        size_t length;
+        uint32_t expected;
+    } vectors[] = {
+        {"123456789", 9, 0xE3069283},
+        {zeros, sizeof(zeros), 0x8A9136AA},
+        {ones, sizeof(ones), 0x62A8AB43},
+        {ascending, sizeof(ascending), 0x46DD794E},
+        {"", 0, 0},
+    };
+
+    for (size_t i = 0; i < sizeof(vectors) / sizeof(vectors[0]); i++)
+    {
+        uint32_t crc = checksum_crc32c(0, vectors[i].data, vectors[i].length);
+        if (crc != vectors[i].expected)
+        {
+            printf("Test failed: vector %zu gives 0x%08X, expected 0x%08X.\n", i, crc, vectors[i].expected);
+            return 1;
+        }
+    }
+
+    printf("Test passed: Known vectors match with the %s implementation.\n", checksum_implementation());
+    return 0;
+}
+
+int test_lengths_alignments_and_chaining()
+{
+    unsigned char buffer[300];
+    unsigned seed = 1;
+
+    for (size_t i = 0; i < sizeof(buffer); i++)
+    {
+        buffer[i] = rand_r(&seed);
+    }
+
+    for (size_t offset = 0; offset < 8; offset++)
+    {
+        for (size_t length = 0; length + offset <= sizeof(buffer) - 8; length++)
+        {
+            uint32_t expected = reference_crc32c(buffer + offset, length);
+            uint32_t crc = checksum_crc32c(0, buffer + offset, length);
+
+            if (crc != expected)
+            {
+                printf("Test failed: length %zu at offset %zu gives 0x%08X, expected 0x%08X.\n", length, offset, crc, expected);
+                return 1;
+            }
+
+            size_t split = length / 3;
+            uint32_t chained = checksum_crc32c(checksum_crc32c(0, buffer + offset, split), buffer + offset + split, length - split);
+            if (chained != expected)
+            {
+                printf("Test failed: chained checksum of length %zu split at %zu differs.\n", length, split);
+                return 1;
+            }
+        }
+    }
+
+    printf("Test passed: All lengths, alignments and chained ranges match the reference.\n");
+    return 0;
+}
+
+int main()
+{
+    int failures = 0;
+    failures += test_known_vectors();
+    failures += test_lengths_alignments_and_chaining();
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
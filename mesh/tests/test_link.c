@@ -0,0 +1,339 @@
+#include "stdafx.h"
+#include "link.h"
+
+#define SENT_LIMIT 256
+
+/**
+ * A transport that keeps the datagrams it is given, so the tests decide which ones arrive.
+ */
+typedef struct
+{
+    transport_t base;
+    int count;
+    int destinations[SENT_LIMIT];
+    size_t sizes[SENT_LIMIT];
+    char data[SENT_LIMIT][PACKET_DATAGRAM_SIZE];
+} recording_transport_t;
+
+int record_send(transport_t *transport, int destination, const struct iovec *iov, int iov_count)
+{
+    recording_transport_t *recording = (recording_transport_t *)transport;
+
+    if (recording->count == SENT_LIMIT)
+    {
+        return -1;
+    }
+
+    recording->destinations[recording->count] = destination;
+    recording->sizes[recording->count] = transport_iov_size(iov, iov_count);
+    transport_gather(recording->data[recording->count], iov, iov_count);
+    recording->count++;
+    return recording->sizes[recording->count - 1];
+}
+
+recording_transport_t sender_transport = {.base.send = record_send};
+recording_transport_t receiver_transport = {.base.send = record_send};
+node_metrics_t sender_metrics;
+node_metrics_t receiver_metrics;
+
+/**
+ * Sends a reliable packet stamped with the link fields, as send_packet() would.
+ */
+void send_sequenced(link_table_t *table, link_t *link)
+{
+    packet_t packet = create_packet(table->node_id, link->neighbor, 10, table->node_id, link->neighbor, "Link packet");
+    packet_wire_t wire;
+
+    packet.mac_packet.flags |= PACKET_FLAG_RELIABLE;
+    packet.link = (packet_link_t){.session = table->session, .sequence = link->next_sequence, .base = link->base};
+    packet.mac_packet.crc = packet_mac_crc(&packet);
+    packet_serialize(&packet, &wire);
+
+    link_send(table, link, wire.iov, wire.count);
+}
+
+/**
+ * Reads the link fields of a datagram recorded from the sender, which must pass the MAC checksum.
+ */
+int recorded_link(int index, packet_link_t *header)
+{
+    packet_t packet;
+
+    if (packet_parse(sender_transport.data[index], sender_transport.sizes[index], &packet) != PACKET_PARSE_OK ||
+        packet_mac_crc(&packet) != packet.mac_packet.crc)
+    {
+        return -1;
+    }
+
+    *header = packet.link;
+    return 0;
+}
+
+/**
+ * Hands the data packets recorded from the sender to the receiver, except the one with the given sequence.
+ */
+void deliver_except(link_table_t *receiver, int first, uint32_t lost)
+{
+    for (int i = first; i < sender_transport.count; i++)
+    {
+        packet_link_t header;
+
+        if (recorded_link(i, &header) == 0 && header.sequence != lost)
+        {
+            link_accept(receiver, 0, &header);
+        }
+    }
+}
+
+/**
+ * Hands the acknowledgements recorded from the receiver to the sender.
+ */
+void deliver_acks(link_table_t *sender)
+{
+    for (int i = 0; i < receiver_transport.count; i++)
+    {
+        link_handle_ack(sender, receiver_transport.data[i], receiver_transport.sizes[i]);
+    }
+    receiver_transport.count = 0;
+}
+
+int test_window_and_repair()
+{
+    link_table_t sender;
+    link_table_t receiver;
+    link_table_init(&sender, 0, 2, &sender_transport.base, &sender_metrics);
+    link_table_init(&receiver, 1, 2, &receiver_transport.base, &receiver_metrics);
+
+    link_t *link = link_open(&sender, 1);
+    for (int i = 0; i < LINK_WINDOW_SIZE + 10; i++)
+    {
+        send_sequenced(&sender, link);
+    }
+
+    if (sender_transport.count != LINK_WINDOW_SIZE || link->pending_count != 10)
+    {
+        printf("Test failed: %d packets sent past a window of %d.\n", sender_transport.count, LINK_WINDOW_SIZE);
+        return 1;
+    }
+
+    deliver_except(&receiver, 0, 3);
+    link_poll(&receiver, metrics_clock());
+    deliver_acks(&sender);
+
+    if (link->base != 3 || sender_transport.count != LINK_WINDOW_SIZE + 3 || link->pending_count != 7)
+    {
+        printf("Test failed: Selective acknowledgement moved the window to %u with %d packets sent.\n", link->base, sender_transport.count);
+        return 1;
+    }
+
+    packet_link_t duplicate = {.session = sender.session, .sequence = 5, .base = 3};
+    if (link_accept(&receiver, 0, &duplicate))
+    {
+        printf("Test failed: Duplicate link packet accepted.\n");
+        return 1;
+    }
+
+    int before = sender_transport.count;
+    link_poll(&sender, metrics_clock() + (uint64_t)LINK_RTO_MAX_MS * 1000000);
+
+    packet_link_t retransmitted;
+    if (sender_transport.count == before || recorded_link(before, &retransmitted) == -1 ||
+        retransmitted.sequence != 3 || retransmitted.base != 3)
+    {
+        printf("Test failed: Lost link packet was not retransmitted first with the current window.\n");
+        return 1;
+    }
+
+    deliver_except(&receiver, before, UINT32_MAX);
+    link_poll(&receiver, metrics_clock());
+    deliver_acks(&sender);
+
+    if (link->base != LINK_WINDOW_SIZE + 3 || link->pending_count != 0)
+    {
+        printf("Test failed: Retransmission did not reopen the window, base is %u.\n", link->base);
+        return 1;
+    }
+
+    link_table_free(&sender);
+    link_table_free(&receiver);
+    sender_transport.count = 0;
+    receiver_transport.count = 0;
+
+    printf("Test passed: Lost link packets are acknowledged selectively and retransmitted.\n");
+    return 0;
+}
+
+int test_sessions()
+{
+    link_table_t receiver;
+    link_table_init(&receiver, 1, 2, &receiver_transport.base, &receiver_metrics);
+
+    packet_link_t header = {.session = 7, .sequence = 40, .base = 38};
+    bool first = link_accept(&receiver, 0, &header);
+    bool again = link_accept(&receiver, 0, &header);
+
+    header.sequence = 39;
+    bool missing = link_accept(&receiver, 0, &header);
+
+    header.session = 8;
+    header.sequence = 0;
+    header.base = 0;
+    bool restarted = link_accept(&receiver, 0, &header);
+
+    header.sequence = 200;
+    header.base = 150;
+    bool skipped = link_accept(&receiver, 0, &header);
+
+    link_t *link = link_open(&receiver, 0);
+    bool given_up = link->expected == 150;
+
+    link_table_free(&receiver);
+    receiver_transport.count = 0;
+
+    if (!first || again || !missing || !restarted || !skipped || !given_up)
+    {
+        printf("Test failed: Link sessions and abandoned sequences are not followed.\n");
+        return 1;
+    }
+
+    printf("Test passed: Receivers follow new sessions and packets the sender gave up on.\n");
+    return 0;
+}
+
+int test_cost_reports()
+{
+    link_table_t sender;
+    link_table_init(&sender, 0, 2, &sender_transport.base, &sender_metrics);
+    sender.reports = true;
+
+    link_t *link = link_open(&sender, 1);
+    for (int i = 0; i < 40; i++)
+    {
+        send_sequenced(&sender, link);
+    }
+
+    int timeout = link_poll(&sender, metrics_clock());
+    int last = sender_transport.count - 1;
+    link_report_t report;
+
+    if (sender_transport.destinations[last] != TRANSPORT_SERVER ||
+        link_report_decode(sender_transport.data[last], sender_transport.sizes[last], &report) != 0)
+    {
+        printf("Test failed: No link cost report sent to the server.\n");
+        return 1;
+    }
+
+    // 40 packets waiting on the link cost 1.25 hops, and the first sample is smoothed from 0
+    if (report.node_id != 0 || report.count != 1 || report.links[0].neighbor != 1 ||
+        report.links[0].cost != 40 * LINK_COST_HOP / LINK_COST_QUEUE / 4 || link->sent != 0)
+    {
+        printf("Test failed: Link cost report of node %d has %d links, the first to %d costing %d.\n", report.node_id,
+               report.count, report.links[0].neighbor, report.links[0].cost);
+        return 1;
+    }
+
+    if (link_report_decode(sender_transport.data[last], sender_transport.sizes[last] - 1, &report) != -1 ||
+        timeout > LINK_REPORT_INTERVAL_MS)
+    {
+        printf("Test failed: Truncated report accepted, or next report in %d ms.\n", timeout);
+        return 1;
+    }
+
+    link_table_free(&sender);
+    sender_transport.count = 0;
+
+    printf("Test passed: Nodes report the smoothed cost of their links.\n");
+    return 0;
+}
+
+int test_give_up()
+{
+    link_table_t sender;
+    link_table_init(&sender, 0, 2, &sender_transport.base, &sender_metrics);
+
+    link_t *link = link_open(&sender, 1);
+    for (int i = 0; i < LINK_WINDOW_SIZE + 10; i++)
+    {
+        send_sequenced(&sender, link);
+    }
+
+    // Nothing is acknowledged, so every packet in flight is retransmitted until the link gives up
+    uint64_t now = metrics_clock();
+    for (int i = 0; i <= LINK_MAX_RETRIES; i++)
+    {
+        now += (uint64_t)LINK_RTO_MAX_MS * 1000000;
+        sender_transport.count = 0;
+        link_poll(&sender, now);
+    }
+
+    sender_transport.count = 0;
+    send_sequenced(&sender, link);
+
+    packet_link_t header = {0};
+    int sent = sender_transport.count;
+    recorded_link(0, &header);
+
+    link_table_free(&sender);
+    sender_transport.count = 0;
+
+    if (sent != 1 || header.sequence != LINK_WINDOW_SIZE)
+    {
+        printf("Test failed: %d packets sent after giving up, the first with sequence %u.\n", sent, header.sequence);
+        return 1;
+    }
+
+    printf("Test passed: Sequences of packets dropped from the queue are used again.\n");
+    return 0;
+}
+
+int test_corrupted_ack()
+{
+    link_table_t sender;
+    link_table_t receiver;
+    link_table_init(&sender, 0, 2, &sender_transport.base, &sender_metrics);
+    link_table_init(&receiver, 1, 2, &receiver_transport.base, &receiver_metrics);
+
+    link_t *link = link_open(&sender, 1);
+    for (int i = 0; i < 5; i++)
+    {
+        send_sequenced(&sender, link);
+    }
+
+    deliver_except(&receiver, 0, UINT32_MAX);
+    link_poll(&receiver, metrics_clock());
+
+    // A flipped bit in the next expected sequence would release packets the receiver never got
+    receiver_transport.data[0][8] ^= 0x40;
+    link_handle_ack(&sender, receiver_transport.data[0], receiver_transport.sizes[0]);
+    bool ignored = link->base == 0;
+
+    receiver_transport.data[0][8] ^= 0x40;
+    deliver_acks(&sender);
+    bool accepted = link->base == 5;
+
+    link_table_free(&sender);
+    link_table_free(&receiver);
+    sender_transport.count = 0;
+    receiver_transport.count = 0;
+
+    if (!ignored || !accepted)
+    {
+        printf("Test failed: Corrupted acknowledgement %s, intact one %s.\n", ignored ? "ignored" : "accepted",
+               accepted ? "accepted" : "ignored");
+        return 1;
+    }
+
+    printf("Test passed: Acknowledgements that fail their checksum are ignored.\n");
+    return 0;
+}
+
+int main()
+{
+    int failures = 0;
+    failures += test_window_and_repair();
+    failures += test_sessions();
+    failures += test_cost_reports();
+    failures += test_give_up();
+    failures += test_corrupted_ack();
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,315 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/wait.h>
+
+#include "stdafx.h"
+#include "logger.h"
+
+#define LINE_SIZE (LOG_RECORD_SIZE * 4)
+#define WRITERS 4
+#define STOPS 20
+
+char decoder[PATH_MAX];
+log_config_t config;
+atomic_bool stopped;
+
+/**
+ * Writes out the records logged so far by restarting the background logger.
+ */
+void flush_log()
+{
+    logger_stop();
+    logger_start(&config);
+}
+
+/**
+ * Decodes the binary log with app-logdecode and counts the records with a message,
+ * or with any message if it is NULL. The time of the records is ignored.
+ */
+int decoded(const char *creator, const char *type, const char *message)
+{
+    char command[PATH_MAX + 64];
+    char line[LINE_SIZE];
+    char prefix[LOG_RECORD_SIZE];
+    int found = 0;
+
+    snprintf(command, sizeof(command), "%s %s", decoder, LOG_BINARY_FILE);
+    snprintf(prefix, sizeof(prefix), "[%s] [%s] [", creator, type);
+
+    FILE *output = popen(command, "r");
+    if (!output)
+    {
+        return 0;
+    }
+
+    while (fgets(line, sizeof(line), output))
+    {
+        line[strcspn(line, "\n")] = '\0';
+
+        char *text = strstr(line, "] ");
+        text = text ? strstr(text + 2, "] ") : NULL;
+        text = text ? strstr(text + 2, "] ") : NULL;
+
+        if (text && strncmp(line, prefix, strlen(prefix)) == 0 && (!message || strcmp(text + 2, message) == 0))
+        {
+            found++;
+        }
+    }
+
+    pclose(output);
+    return found;
+}
+
+int test_conversions()
+{
+    char expected[6][LOG_RECORD_SIZE];
+    int value = -42;
+    size_t size = (size_t)UINT32_MAX + 2;
+    long long wide = LLONG_MIN;
+    void *pointer = &value;
+
+    log_message_write("TEST", MSG_TYPE_INFO, "int %d, unsigned %u, hex %#x", value, 7u, 255u);
+    log_message_write("TEST", MSG_TYPE_INFO, "size %zu, long long %lld", size, wide);
+    log_message_write("TEST", MSG_TYPE_ERROR, "pointer %p, string '%-6s', 100%% %.2f", pointer, "ab", 2.5);
+    log_message_write("TEST", MSG_TYPE_INFO, "width %*d, string %.*s", 5, 3, 2, "abc");
+    log_message_write("TEST", MSG_TYPE_INFO, "char %c, short %hd, long %ld", 'x', (short)-3, -5L);
+    log_message_write("TEST", MSG_TYPE_INFO, "null %s", (char *)NULL);
+    flush_log();
+
+    snprintf(expected[0], LOG_RECORD_SIZE, "int %d, unsigned %u, hex %#x", value, 7u, 255u);
+    snprintf(expected[1], LOG_RECORD_SIZE, "size %zu, long long %lld", size, wide);
+    snprintf(expected[2], LOG_RECORD_SIZE, "pointer %p, string '%-6s', 100%% %.2f", pointer, "ab", 2.5);
+    snprintf(expected[3], LOG_RECORD_SIZE, "width %*d, string %.*s", 5, 3, 2, "abc");
+    snprintf(expected[4], LOG_RECORD_SIZE, "char %c, short %hd, long %ld", 'x', (short)-3, -5L);
+    snprintf(expected[5], LOG_RECORD_SIZE, "null %s", "(null)");
+
+    char signature[LOG_MAX_ARGUMENTS + 1];
+    int text = log_format_signature("width %*d", signature);
+    int count = log_format_signature("%zu %lld %p %s %hhd %f", signature);
+
+    if (text != -1 || count != 6 || strcmp(signature, "zqpsif") != 0)
+    {
+        printf("Test failed: Format signature is %d '%s', '*' gives %d.\n", count, signature, text);
+        return 1;
+    }
+
+    for (int i = 0; i < 6; i++)
+    {
+        if (!decoded("TEST", i == 2 ? "ERROR" : "INFORMATION", expected[i]))
+        {
+            printf("Test failed: '%s' does not survive the binary log.\n", expected[i]);
+            return 1;
+        }
+    }
+
+    printf("Test passed: Binary records decode to the same text as printf.\n");
+    return 0;
+}
+
+int test_truncation()
+{
+    char argument[LOG_RECORD_SIZE * 2];
+    char expected[LOG_RECORD_SIZE * 2];
+
+    memset(argument, 'a', sizeof(argument) - 1);
+    argument[sizeof(argument) - 1] = '\0';
+
+    // An argument is cut to the space left in the record after its length
+    log_message_write("TEST", MSG_TYPE_INFO, "long %s", argument);
+
+    // A message recorded as text is cut to LOG_RECORD_SIZE when it is formatted
+    log_message_write("TEST", MSG_TYPE_INFO, "long %*s", (int)strlen(argument), "b");
+    flush_log();
+
+    size_t space = LOG_RECORD_SIZE - sizeof(log_record_header_t) - sizeof(uint16_t);
+    snprintf(expected, sizeof(expected), "long %.*s", (int)space, argument);
+
+    if (!decoded("TEST", "INFORMATION", expected))
+    {
+        printf("Test failed: A long string argument is not cut to %zu bytes.\n", space);
+        return 1;
+    }
+
+    space -= sizeof(uint16_t) + strlen("TEST");
+    snprintf(expected, sizeof(expected), "long %*s", (int)strlen(argument), "b");
+    expected[space] = '\0';
+
+    if (!decoded("TEST", "INFORMATION", expected))
+    {
+        printf("Test failed: A long text message is not cut to %zu bytes.\n", space);
+        return 1;
+    }
+
+    printf("Test passed: Long messages are truncated to the record size.\n");
+    return 0;
+}
+
+int test_processes()
+{
+    const char *format = "process %s, value %d";
+
+    log_message_write("TEST", MSG_TYPE_INFO, format, "parent", 1);
+    flush_log();
+
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        // The child logs under its own pid, so it has to define the format again
+        log_message_write("TEST", MSG_TYPE_INFO, format, "child", 2);
+        log_message_write("CHILD", MSG_TYPE_COMMAND, "child only %d", 3);
+        _exit(EXIT_SUCCESS);
+    }
+
+    int status;
+    waitpid(pid, &status, 0);
+    log_message_write("TEST", MSG_TYPE_INFO, format, "parent", 4);
+    flush_log();
+
+    if (!decoded("TEST", "INFORMATION", "process parent, value 1") ||
+        !decoded("TEST", "INFORMATION", "process child, value 2") ||
+        !decoded("CHILD", "COMMAND", "child only 3") ||
+        !decoded("TEST", "INFORMATION", "process parent, value 4"))
+    {
+        printf("Test failed: Records of a forked child do not decode with its own formats.\n");
+        return 1;
+    }
+
+    printf("Test passed: Each process decodes with its own format table.\n");
+    return 0;
+}
+
+/**
+ * Logs records from its own thread until the logger was stopped, and counts them.
+ */
+void *write_records(void *argument)
+{
+    int *count = argument;
+
+    while (!atomic_load(&stopped))
+    {
+        log_message_write("WRITER", MSG_TYPE_INFO, "record %d", (*count)++);
+    }
+    return NULL;
+}
+
+int test_stop_while_logging()
+{
+    log_config_t small;
+    pthread_t threads[WRITERS];
+    int written[WRITERS] = {0};
+    int total = 0;
+
+    // Two slots keep the writers waiting for space when the logger stops
+    logger_parse("block,binary,1k", &small);
+
+    for (int stop = 0; stop < STOPS; stop++)
+    {
+        atomic_store(&stopped, false);
+        logger_start(&small);
+
+        for (int i = 0; i < WRITERS; i++)
+        {
+            pthread_create(&threads[i], NULL, write_records, &written[i]);
+        }
+
+        usleep(2000);
+        logger_stop();
+        atomic_store(&stopped, true);
+
+        for (int i = 0; i < WRITERS; i++)
+        {
+            pthread_join(threads[i], NULL);
+        }
+    }
+
+    for (int i = 0; i < WRITERS; i++)
+    {
+        total += written[i];
+    }
+
+    int count = decoded("WRITER", "INFORMATION", NULL);
+    if (count != total)
+    {
+        printf("Test failed: %d of %d records written while the logger stopped.\n", count, total);
+        return 1;
+    }
+
+    printf("Test passed: Stopping the logger waits for its writers and loses no record.\n");
+    return 0;
+}
+
+/**
+ * Appends a hand-made record with the given pid to the binary log.
+ */
+void append_record(uint32_t pid, log_record_kind kind, const char *first, const char *second, int value)
+{
+    char record[LOG_RECORD_SIZE];
+    size_t size = sizeof(log_record_header_t);
+
+    for (const char *string = first; string; string = string == first ? second : NULL)
+    {
+        uint16_t length = strlen(string);
+        memcpy(record + size, &length, sizeof(length));
+        memcpy(record + size + sizeof(length), string, length);
+        size += sizeof(length) + length;
+    }
+    if (kind == LOG_RECORD_MESSAGE)
+    {
+        memcpy(record + size, &value, sizeof(value));
+        size += sizeof(value);
+    }
+
+    log_record_header_t header = {.pid = pid, .node = -1, .size = size, .format = 5, .kind = kind, .type = MSG_TYPE_INFO};
+    memcpy(record, &header, sizeof(header));
+
+    FILE *log = fopen(LOG_BINARY_FILE, "ab");
+    fwrite(record, size, 1, log);
+    fclose(log);
+}
+
+int test_format_tables()
+{
+    // Two processes define different formats under the same identifier
+    append_record(1, LOG_RECORD_FORMAT, "ONE", "first table %d", 0);
+    append_record(2, LOG_RECORD_FORMAT, "TWO", "second table %d", 0);
+    append_record(1, LOG_RECORD_MESSAGE, NULL, NULL, 10);
+    append_record(2, LOG_RECORD_MESSAGE, NULL, NULL, 20);
+
+    if (!decoded("ONE", "INFORMATION", "first table 10") || !decoded("TWO", "INFORMATION", "second table 20"))
+    {
+        printf("Test failed: Format identifiers of different processes are mixed up.\n");
+        return 1;
+    }
+
+    printf("Test passed: Format identifiers are resolved per process.\n");
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    char directory[] = "/tmp/test-logger-XXXXXX";
+
+    // app-logdecode is built next to the test
+    if (!realpath(argv[0], decoder) || !strrchr(decoder, '/') || !mkdtemp(directory) || chdir(directory) == -1)
+    {
+        perror("Failed to set up the test");
+        return EXIT_FAILURE;
+    }
+    strcpy(strrchr(decoder, '/') + 1, "app-logdecode");
+
+    logger_parse("block,binary", &config);
+    logger_start(&config);
+
+    int failures = 0;
+    failures += test_conversions();
+    failures += test_truncation();
+    failures += test_processes();
+
+    logger_stop();
+    failures += test_stop_while_logging();
+    failures += test_format_tables();
+
+    unlink(LOG_BINARY_FILE);
+    rmdir(directory);
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
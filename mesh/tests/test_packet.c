@@ -0,0 +1,263 @@
+#include "stdafx.h"
+#include "packet.h"
+#include "transport.h"
+
+/**
+ * Encodes a packet and gathers its parts into one datagram, as a transport would.
+ */
+size_t encode(const packet_t *packet, char *datagram)
+{
+    packet_wire_t wire;
+    size_t size = packet_serialize(packet, &wire);
+
+    transport_gather(datagram, wire.iov, wire.count);
+    return size;
+}
+
+int test_round_trip()
+{
+    const char *names[] = {"none", "fast", "best", "fast:dict"};
+    const char *messages[] = {"", "Hello", "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa"};
+
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++)
+    {
+        compression_level level;
+        bool dictionary;
+        compression_parse(names[i], &level, &dictionary);
+        compression_configure(level, dictionary);
+
+        for (size_t j = 0; j < sizeof(messages) / sizeof(messages[0]); j++)
+        {
+            packet_t original = create_packet(45, 67, 10, 45, 67, messages[j]);
+            original.topology_epoch = 0x01020304;
+
+            char datagram[PACKET_DATAGRAM_SIZE];
+            size_t size = encode(&original, datagram);
+            packet_t parsed;
+
+            if (size > PACKET_HEADER_SIZE + strlen(messages[j]) ||
+                packet_parse(datagram, size, &parsed) != PACKET_PARSE_OK ||
+                memcmp(&original, &parsed, sizeof(packet_t)) != 0)
+            {
+                printf("Test failed: Round trip of message %zu with compression %s.\n", j, names[i]);
+                return 1;
+            }
+        }
+    }
+
+    compression_configure(COMPRESSION_FAST, false);
+    printf("Test passed: Packets survive the wire at every compression level.\n");
+    return 0;
+}
+
+int test_byte_order()
+{
+    packet_t packet = create_packet(0x0102, 0x0304, 10, 0x0506, 0x0708, "Hi");
+    packet.topology_epoch = 0x0A0B0C0D;
+
+    char datagram[PACKET_DATAGRAM_SIZE];
+    encode(&packet, datagram);
+
+    const unsigned char *header = (const unsigned char *)datagram;
+    if (header[0] != PACKET_VERSION || header[2] != 10 || header[5] != 0x01 || header[6] != 0x02 ||
+        header[7] != 0x03 || header[8] != 0x04 || header[11] != 0x0A || header[14] != 0x0D ||
+        header[19] != 0x05 || header[20] != 0x06 || header[21] != 0x07 || header[22] != 0x08 || header[25] != 2)
+    {
+        printf("Test failed: Header fields are not in network byte order.\n");
+        return 1;
+    }
+
+    printf("Test passed: Header fields are in network byte order.\n");
+    return 0;
+}
+
+int test_rejects_bad_datagrams()
+{
+    packet_t packet = create_packet(1, 2, 10, 1, 2, "Hello");
+    char datagram[PACKET_DATAGRAM_SIZE];
+    size_t size = encode(&packet, datagram);
+    packet_t parsed;
+
+    if (packet_parse(datagram, PACKET_HEADER_SIZE - 1, &parsed) != PACKET_PARSE_MALFORMED ||
+        packet_parse(datagram, size - 1, &parsed) == PACKET_PARSE_OK)
+    {
+        printf("Test failed: Truncated datagram accepted.\n");
+        return 1;
+    }
+
+    datagram[0]++;
+    if (packet_parse(datagram, size, &parsed) != PACKET_PARSE_VERSION)
+    {
+        printf("Test failed: Unknown version accepted.\n");
+        return 1;
+    }
+    datagram[0]--;
+
+    datagram[25] = MAX_MESSAGE_LENGTH;
+    if (packet_parse(datagram, size, &parsed) != PACKET_PARSE_MALFORMED)
+    {
+        printf("Test failed: Oversized message length accepted.\n");
+        return 1;
+    }
+
+    printf("Test passed: Truncated and invalid datagrams are rejected.\n");
+    return 0;
+}
+
+int test_trace()
+{
+    compression_configure(COMPRESSION_FAST, false);
+
+    packet_t packet = create_packet(3, 7, 10, 3, 7, "Traced message");
+    packet.mac_packet.flags |= PACKET_FLAG_TRACE;
+    packet.trace.sent_at = 0x0123456789ABCDEFull;
+
+    for (int i = 0; i < TRACE_MAX_HOPS + 2; i++)
+    {
+        packet_trace_hop(&packet, i, packet.trace.sent_at + 1000 * i);
+    }
+    packet.mac_packet.crc = packet_mac_crc(&packet);
+
+    char datagram[PACKET_DATAGRAM_SIZE];
+    size_t size = encode(&packet, datagram);
+    packet_t parsed;
+
+    if (packet.trace.count != TRACE_MAX_HOPS || packet_parse(datagram, size, &parsed) != PACKET_PARSE_OK ||
+        memcmp(&packet, &parsed, sizeof(packet_t)) != 0)
+    {
+        printf("Test failed: Trace does not survive the wire.\n");
+        return 1;
+    }
+
+    datagram[PACKET_HEADER_SIZE + 8] = TRACE_MAX_HOPS + 1;
+    if (packet_parse(datagram, size, &parsed) != PACKET_PARSE_MALFORMED)
+    {
+        printf("Test failed: Oversized trace accepted.\n");
+        return 1;
+    }
+
+    printf("Test passed: Traces survive the wire and are bounded.\n");
+    return 0;
+}
+
+int test_link_fields()
+{
+    packet_t packet = create_packet(3, 7, 10, 3, 7, "Reliable message");
+    packet.mac_packet.flags |= PACKET_FLAG_RELIABLE | PACKET_FLAG_TRACE;
+    packet.link.session = 0xBEEF;
+    packet.link.sequence = 0x01020304;
+    packet.link.base = 0x01020300;
+    packet.trace.sent_at = 42;
+    packet_trace_hop(&packet, 3, 50);
+    packet.mac_packet.crc = packet_mac_crc(&packet);
+
+    char datagram[PACKET_DATAGRAM_SIZE];
+    size_t size = encode(&packet, datagram);
+    packet_t parsed;
+
+    if (packet_parse(datagram, size, &parsed) != PACKET_PARSE_OK || memcmp(&packet, &parsed, sizeof(packet_t)) != 0 ||
+        (unsigned char)datagram[PACKET_HEADER_SIZE] != 0xBE || datagram[PACKET_HEADER_SIZE + 5] != 0x04)
+    {
+        printf("Test failed: Link fields do not survive the wire.\n");
+        return 1;
+    }
+
+    if (packet_parse(datagram, PACKET_HEADER_SIZE + PACKET_LINK_SIZE - 1, &parsed) != PACKET_PARSE_MALFORMED)
+    {
+        printf("Test failed: Truncated link fields accepted.\n");
+        return 1;
+    }
+
+    printf("Test passed: Link fields survive the wire before the trace.\n");
+    return 0;
+}
+
+int test_fragment_fields()
+{
+    char data[FRAGMENT_PAYLOAD_SIZE];
+    memset(data, 'f', sizeof(data));
+    packet_t packet = create_fragment(3, 7, 10, 0x0102, 5, 300, data, sizeof(data));
+
+    char datagram[PACKET_DATAGRAM_SIZE];
+    size_t size = encode(&packet, datagram);
+    packet_t parsed;
+
+    if (packet_parse(datagram, size, &parsed) != PACKET_PARSE_OK || memcmp(&packet, &parsed, sizeof(packet_t)) != 0 ||
+        parsed.mac_packet.app_packet.message_length != FRAGMENT_PAYLOAD_SIZE)
+    {
+        printf("Test failed: Fragment fields do not survive the wire.\n");
+        return 1;
+    }
+
+    packet_t moved = packet;
+    moved.mac_packet.app_packet.fragment_index = 6;
+    if (packet_app_crc(&moved.mac_packet.app_packet) == packet.mac_packet.app_packet.crc)
+    {
+        printf("Test failed: Fragment index not covered by the checksum.\n");
+        return 1;
+    }
+
+    if (packet_parse(datagram, PACKET_HEADER_SIZE + PACKET_FRAGMENT_SIZE - 1, &parsed) != PACKET_PARSE_MALFORMED)
+    {
+        printf("Test failed: Truncated fragment fields accepted.\n");
+        return 1;
+    }
+
+    printf("Test passed: Fragment fields survive the wire and are checksummed.\n");
+    return 0;
+}
+
+int test_mac_checksum()
+{
+    packet_t packet = create_packet(3, 7, 10, 3, 7, "Checksummed message");
+    packet.topology_epoch = 42;
+    packet.mac_packet.flags |= PACKET_FLAG_RELIABLE;
+    packet.link = (packet_link_t){.session = 1, .sequence = 2, .base = 2};
+    packet.mac_packet.crc = packet_mac_crc(&packet);
+
+    char datagram[PACKET_DATAGRAM_SIZE];
+    size_t size = encode(&packet, datagram);
+    packet_t parsed;
+
+    // Every field of the MAC header after the version, the topology epoch included, then the link fields
+    for (int i = 1; i < PACKET_HEADER_SIZE + PACKET_LINK_SIZE; i++)
+    {
+        if (i >= PACKET_APP_HEADER_OFFSET - 4 && i < PACKET_HEADER_SIZE)
+        {
+            continue;
+        }
+
+        datagram[i] ^= 0x80;
+        if (packet_parse(datagram, size, &parsed) == PACKET_PARSE_OK && packet_mac_crc(&parsed) == parsed.mac_packet.crc)
+        {
+            printf("Test failed: Byte %d of the datagram not covered by the checksum.\n", i);
+            return 1;
+        }
+        datagram[i] ^= 0x80;
+    }
+
+    packet.link.base = 1;
+    packet_stamp_link(datagram, &packet.link);
+    if (packet_parse(datagram, size, &parsed) != PACKET_PARSE_OK || packet_mac_crc(&parsed) != parsed.mac_packet.crc ||
+        parsed.link.base != 1)
+    {
+        printf("Test failed: Restamped link fields do not pass the checksum.\n");
+        return 1;
+    }
+
+    printf("Test passed: The MAC checksum covers the MAC header and the link fields.\n");
+    return 0;
+}
+
+int main()
+{
+    int failures = 0;
+    failures += test_round_trip();
+    failures += test_byte_order();
+    failures += test_rejects_bad_datagrams();
+    failures += test_trace();
+    failures += test_link_fields();
+    failures += test_fragment_fields();
+    failures += test_mac_checksum();
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
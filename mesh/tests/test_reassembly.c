@@ -0,0 +1,183 @@
+#include "stdafx.h"
+#include "reassembly.h"
+
+#define MS 1000000ull
+#define FRAGMENTS 3
+
+char data[FRAGMENTS][FRAGMENT_PAYLOAD_SIZE];
+
+/**
+ * Adds fragment index of a transfer from the given node to the table.
+ */
+reassembly_result add(reassembly_table_t *table, int origin, int transfer_id, int index, int count, uint64_t now)
+{
+    packet_t fragment = create_fragment(origin, 0, 10, transfer_id, index, count, data[index % FRAGMENTS],
+                                        FRAGMENT_PAYLOAD_SIZE);
+    reassembly_t *transfer;
+
+    return reassembly_add(table, &fragment, now, &transfer);
+}
+
+int test_out_of_order()
+{
+    reassembly_table_t table = {0};
+    reassembly_t *transfer = NULL;
+
+    reassembly_result last = add(&table, 1, 7, 2, FRAGMENTS, 0);
+    reassembly_result first = add(&table, 1, 7, 0, FRAGMENTS, 0);
+
+    packet_t middle = create_fragment(1, 0, 10, 7, 1, FRAGMENTS, data[1], FRAGMENT_PAYLOAD_SIZE);
+    reassembly_result complete = reassembly_add(&table, &middle, 0, &transfer);
+
+    uint32_t crc = checksum_crc32c(0, data, sizeof(data));
+
+    if (last != REASSEMBLY_PENDING || first != REASSEMBLY_PENDING || complete != REASSEMBLY_COMPLETE ||
+        transfer->size != sizeof(data) || transfer->crc != crc || transfer->first.mac_packet.app_packet.fragment_index != 0)
+    {
+        printf("Test failed: Fragments received out of order are not put back in order.\n");
+        return 1;
+    }
+
+    reassembly_finish(transfer);
+    reassembly_free(&table);
+    printf("Test passed: Fragments received out of order are put back in order.\n");
+    return 0;
+}
+
+int test_duplicates()
+{
+    reassembly_table_t table = {0};
+
+    add(&table, 1, 7, 0, FRAGMENTS, 0);
+    reassembly_result consumed = add(&table, 1, 7, 0, FRAGMENTS, 0);
+
+    add(&table, 1, 7, 2, FRAGMENTS, 0);
+    reassembly_result buffered = add(&table, 1, 7, 2, FRAGMENTS, 0);
+
+    reassembly_free(&table);
+
+    if (consumed != REASSEMBLY_DUPLICATE || buffered != REASSEMBLY_DUPLICATE)
+    {
+        printf("Test failed: Duplicate fragments accepted.\n");
+        return 1;
+    }
+
+    printf("Test passed: Duplicate fragments are reported, whether consumed or buffered.\n");
+    return 0;
+}
+
+int test_window()
+{
+    reassembly_table_t table = {0};
+    int count = REASSEMBLY_WINDOW + 1;
+
+    reassembly_result beyond = add(&table, 1, 7, REASSEMBLY_WINDOW, count, 0);
+    reassembly_result within = add(&table, 1, 7, REASSEMBLY_WINDOW - 1, count, 0);
+
+    reassembly_free(&table);
+
+    if (beyond != REASSEMBLY_DROPPED || within != REASSEMBLY_PENDING)
+    {
+        printf("Test failed: Fragment window of %d not enforced.\n", REASSEMBLY_WINDOW);
+        return 1;
+    }
+
+    printf("Test passed: Fragments REASSEMBLY_WINDOW or more ahead are dropped.\n");
+    return 0;
+}
+
+int test_invalid_fragments()
+{
+    reassembly_table_t table = {0};
+
+    add(&table, 1, 7, 0, FRAGMENTS, 0);
+    reassembly_result mismatched = add(&table, 1, 7, 1, FRAGMENTS + 1, 0);
+    reassembly_result outside = add(&table, 1, 8, FRAGMENTS, FRAGMENTS, 0);
+
+    reassembly_free(&table);
+
+    if (mismatched != REASSEMBLY_DROPPED || outside != REASSEMBLY_DROPPED)
+    {
+        printf("Test failed: Fragment with a mismatched count or an index past it accepted.\n");
+        return 1;
+    }
+
+    printf("Test passed: Fragments that do not match their transfer are dropped.\n");
+    return 0;
+}
+
+int test_slots()
+{
+    reassembly_table_t table = {0};
+    int pending = 0;
+
+    for (int i = 0; i < REASSEMBLY_TRANSFERS; i++)
+    {
+        pending += add(&table, 1, i, 0, FRAGMENTS, 0) == REASSEMBLY_PENDING;
+    }
+
+    reassembly_result full = add(&table, 2, 0, 0, FRAGMENTS, 0);
+    reassembly_result known = add(&table, 1, 0, 1, FRAGMENTS, 0);
+
+    reassembly_free(&table);
+
+    if (pending != REASSEMBLY_TRANSFERS || full != REASSEMBLY_DROPPED || known != REASSEMBLY_PENDING)
+    {
+        printf("Test failed: %d transfers started, a new one %s once all slots are taken.\n", pending,
+               full == REASSEMBLY_DROPPED ? "dropped" : "accepted");
+        return 1;
+    }
+
+    printf("Test passed: New transfers are dropped while all %d slots are taken.\n", REASSEMBLY_TRANSFERS);
+    return 0;
+}
+
+int test_expiry()
+{
+    reassembly_table_t table = {0};
+    uint64_t start = 1000 * MS;
+
+    int idle = reassembly_timeout(&table, start);
+
+    add(&table, 1, 0, 0, FRAGMENTS, start);
+    add(&table, 1, 1, 0, FRAGMENTS, start + 100 * MS);
+
+    int timeout = reassembly_timeout(&table, start);
+    int early = reassembly_expire(&table, start + (REASSEMBLY_TIMEOUT_MS - 1) * MS);
+    int first = reassembly_expire(&table, start + REASSEMBLY_TIMEOUT_MS * MS);
+    int next = reassembly_timeout(&table, start + REASSEMBLY_TIMEOUT_MS * MS);
+    int second = reassembly_expire(&table, start + (REASSEMBLY_TIMEOUT_MS + 100) * MS);
+    int done = reassembly_timeout(&table, start + (REASSEMBLY_TIMEOUT_MS + 100) * MS);
+
+    // The expired transfer starts over from its first fragment
+    reassembly_result restarted = add(&table, 1, 0, 1, FRAGMENTS, start + (REASSEMBLY_TIMEOUT_MS + 100) * MS);
+
+    reassembly_free(&table);
+
+    if (idle != -1 || timeout != REASSEMBLY_TIMEOUT_MS || early != 0 || first != 1 || next != 100 || second != 1 ||
+        done != -1 || restarted != REASSEMBLY_PENDING)
+    {
+        printf("Test failed: Transfers expire after %d, %d and %d ms.\n", timeout, next, done);
+        return 1;
+    }
+
+    printf("Test passed: Transfers expire REASSEMBLY_TIMEOUT_MS after their last fragment.\n");
+    return 0;
+}
+
+int main()
+{
+    for (int i = 0; i < FRAGMENTS; i++)
+    {
+        memset(data[i], 'a' + i, FRAGMENT_PAYLOAD_SIZE);
+    }
+
+    int failures = 0;
+    failures += test_out_of_order();
+    failures += test_duplicates();
+    failures += test_window();
+    failures += test_invalid_fragments();
+    failures += test_slots();
+    failures += test_expiry();
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
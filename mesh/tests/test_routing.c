@@ -0,0 +1,237 @@
+#include "stdafx.h"
+#include "graph.h"
+#include "routing.h"
+
+#define MATRIX_SIZE 10
+#define NUM_NODES (MATRIX_SIZE * MATRIX_SIZE)
+
+graph_t graph;
+int reference[NUM_NODES][NUM_NODES];
+
+/**
+ * Reference all-pairs shortest distances computed with Floyd-Warshall directly on the adjacency matrix.
+ */
+void compute_reference()
+{
+    for (int u = 0; u < NUM_NODES; u++)
+    {
+        for (int v = 0; v < NUM_NODES; v++)
+        {
+            reference[u][v] = get_edge_weight(&graph, u, v);
+        }
+    }
+
+    for (int k = 0; k < NUM_NODES; k++)
+    {
+        for (int u = 0; u < NUM_NODES; u++)
+        {
+            for (int v = 0; v < NUM_NODES; v++)
+            {
+                if (reference[u][k] != INF && reference[k][v] != INF && reference[u][k] + reference[k][v] < reference[u][v])
+                {
+                    reference[u][v] = reference[u][k] + reference[k][v];
+                }
+            }
+        }
+    }
+}
+
+int test_full_table_matches_reference()
+{
+    csr_graph_t csr;
+    route_table_t routes = {0};
+
+    initialize_graph(&graph, NUM_NODES);
+    add_edges(MATRIX_SIZE, &graph);
+    // Make the weights uneven so that hop count and path cost differ
+    add_edge(44, 45, 5, &graph);
+    add_edge(12, 23, 3, &graph);
+    csr_build(&csr, &graph);
+    compute_reference();
+
+    for (int source = 0; source < NUM_NODES; source++)
+    {
+        route_table_build(&routes, &csr, source);
+
+        for (int dest = 0; dest < NUM_NODES; dest++)
+        {
+            if (routes.distances[dest] != reference[source][dest])
+            {
+                printf("Test failed: distance from %d to %d is %d, expected %d.\n", source, dest, routes.distances[dest], reference[source][dest]);
+                csr_free(&csr);
+                return 1;
+            }
+            if (dest == source)
+            {
+                continue;
+            }
+
+            // The next hop must be a neighbor that lies on a shortest path to the destination
+            int next_hop = route_table_next_hop(&routes, dest);
+
+            int weight = get_edge_weight(&graph, source, next_hop);
+            if (weight == INF || weight + reference[next_hop][dest] != reference[source][dest])
+            {
+                printf("Test failed: next hop %d from %d to %d is not on a shortest path.\n", next_hop, source, dest);
+                csr_free(&csr);
+                return 1;
+            }
+        }
+    }
+
+    route_table_free(&routes);
+    csr_free(&csr);
+    free_graph(&graph);
+    printf("Test passed: Next-hop tables follow shortest paths.\n");
+    return 0;
+}
+
+/**
+ * Whether a neighbor of the table's source is in the set of equal-cost next hops to a destination.
+ */
+bool uses_next_hop(route_table_t *routes, int dest, int neighbor)
+{
+    for (int i = 0; i < routes->neighbor_count; i++)
+    {
+        if (routes->neighbors[i] == neighbor)
+        {
+            return (route_table_next_hop_set(routes, dest) >> i) & 1;
+        }
+    }
+    return false;
+}
+
+int test_equal_cost_next_hops()
+{
+    csr_graph_t csr;
+    route_table_t routes = {0};
+    int spread = 0;
+
+    initialize_graph(&graph, NUM_NODES);
+    add_edges(MATRIX_SIZE, &graph);
+    add_edge(44, 45, 5, &graph);
+    csr_build(&csr, &graph);
+    compute_reference();
+
+    for (int source = 0; source < NUM_NODES; source++)
+    {
+        route_table_build(&routes, &csr, source);
+
+        for (int dest = 0; dest < NUM_NODES; dest++)
+        {
+            if (dest == source)
+            {
+                continue;
+            }
+
+            // Every neighbor on a shortest path must be in the set, and no other
+            for (int neighbor = 0; neighbor < NUM_NODES; neighbor++)
+            {
+                int weight = neighbor == source ? INF : get_edge_weight(&graph, source, neighbor);
+                bool expected = weight != INF && weight + reference[neighbor][dest] == reference[source][dest];
+
+                if (uses_next_hop(&routes, dest, neighbor) != expected)
+                {
+                    printf("Test failed: neighbor %d of %d %s an equal-cost next hop to %d.\n", neighbor, source,
+                           expected ? "is missing as" : "is wrongly", dest);
+                    csr_free(&csr);
+                    return 1;
+                }
+            }
+
+            int first = route_table_next_hop_flow(&routes, dest, 0);
+            for (uint32_t flow = 0; flow < 64; flow++)
+            {
+                int next_hop = route_table_next_hop_flow(&routes, dest, flow);
+                if (!uses_next_hop(&routes, dest, next_hop))
+                {
+                    printf("Test failed: flow %u from %d to %d sent to %d, off the shortest paths.\n", flow, source, dest, next_hop);
+                    csr_free(&csr);
+                    return 1;
+                }
+                spread += next_hop != first;
+            }
+        }
+    }
+
+    route_table_free(&routes);
+    csr_free(&csr);
+    free_graph(&graph);
+
+    if (spread == 0)
+    {
+        printf("Test failed: flows never take different equal-cost paths.\n");
+        return 1;
+    }
+
+    printf("Test passed: Flows spread over every equal-cost next hop.\n");
+    return 0;
+}
+
+int test_incremental_repair_matches_rebuild()
+{
+    int removed[] = {11, 45, 0, 54, 99, 12, 21, 22};
+    csr_graph_t csr;
+    csr_graph_t rebuilt_csr;
+    route_table_t repaired = {0};
+    route_table_t rebuilt = {0};
+
+    for (int source = 0; source < NUM_NODES; source++)
+    {
+        initialize_graph(&graph, NUM_NODES);
+        add_edges(MATRIX_SIZE, &graph);
+        csr_build(&csr, &graph);
+        route_table_build(&repaired, &csr, source);
+
+        for (size_t i = 0; i < sizeof(removed) / sizeof(removed[0]); i++)
+        {
+            remove_node(removed[i], &graph);
+            csr_remove_node(&csr, removed[i]);
+            route_table_remove_node(&repaired, &csr, removed[i]);
+
+            csr_build(&rebuilt_csr, &graph);
+            route_table_build(&rebuilt, &rebuilt_csr, source);
+
+            for (int dest = 0; dest < NUM_NODES; dest++)
+            {
+                if (repaired.distances[dest] != rebuilt.distances[dest] ||
+                    (route_table_next_hop(&repaired, dest) == -1) != (route_table_next_hop(&rebuilt, dest) == -1))
+                {
+                    printf("Test failed: repaired route from %d to %d differs after removing %d.\n", source, dest, removed[i]);
+                    csr_free(&csr);
+                    csr_free(&rebuilt_csr);
+                    return 1;
+                }
+
+                for (int neighbor = 0; neighbor < NUM_NODES; neighbor++)
+                {
+                    if (uses_next_hop(&repaired, dest, neighbor) != uses_next_hop(&rebuilt, dest, neighbor))
+                    {
+                        printf("Test failed: repaired next hops from %d to %d differ after removing %d.\n", source, dest, removed[i]);
+                        csr_free(&csr);
+                        csr_free(&rebuilt_csr);
+                        return 1;
+                    }
+                }
+            }
+            csr_free(&rebuilt_csr);
+        }
+
+        csr_free(&csr);
+        free_graph(&graph);
+    }
+
+    route_table_free(&repaired);
+    route_table_free(&rebuilt);
+    printf("Test passed: Incremental repair matches a full rebuild.\n");
+    return 0;
+}
+
+int main()
+{
+    int failures = 0;
+    failures += test_full_table_matches_reference();
+    failures += test_equal_cost_next_hops();
+    failures += test_incremental_repair_matches_rebuild();
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
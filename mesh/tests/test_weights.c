@@ -0,0 +1,100 @@
+#include "stdafx.h"
+#include "weights.h"
+#include "routing.h"
+
+#define MS 1000000ull
+
+graph_t graph;
+weights_t weights;
+
+/**
+ * Reports the cost of one link and returns the number of edges whose weight changed.
+ */
+int report_cost(int node_id, int neighbor, int cost, uint64_t now, topology_edge_t *changes)
+{
+    link_report_t report = {.node_id = node_id, .count = 1, .links = {{.neighbor = neighbor, .cost = cost}}};
+    return weights_update(&weights, &report, now, changes);
+}
+
+int test_hysteresis()
+{
+    topology_edge_t changes[LINK_REPORT_MAX_LINKS];
+    uint64_t now = 1000 * MS;
+
+    initialize_graph(&graph, 9);
+    add_edges(3, &graph);
+    weights_init(&weights, &graph);
+
+    int just_below = report_cost(0, 1, LINK_COST_HOP + WEIGHT_HYSTERESIS - 1, now, changes);
+    int raised = report_cost(0, 1, LINK_COST_HOP + WEIGHT_HYSTERESIS, now, changes);
+
+    if (just_below != 0 || raised != 1 || changes[0].u != 0 || changes[0].v != 1 || changes[0].weight != 2)
+    {
+        printf("Test failed: Weight not raised once the cost passed the next hop by the hysteresis.\n");
+        return 1;
+    }
+
+    int held = report_cost(0, 1, 0, now + (WEIGHT_HOLD_MS - 1) * MS, changes);
+    now += WEIGHT_HOLD_MS * MS;
+    int kept = report_cost(0, 1, LINK_COST_HOP - WEIGHT_HYSTERESIS, now, changes);
+    int lowered = report_cost(0, 1, LINK_COST_HOP - WEIGHT_HYSTERESIS - 1, now, changes);
+
+    if (held != 0 || kept != 0 || lowered != 1 || changes[0].weight != 1)
+    {
+        printf("Test failed: Weight flapped within the hold time or the hysteresis band.\n");
+        return 1;
+    }
+
+    now += WEIGHT_HOLD_MS * MS;
+    int capped = report_cost(4, 0, 100 * LINK_COST_HOP, now, changes);
+    int unknown = report_cost(0, 8, 100 * LINK_COST_HOP, now, changes);
+
+    if (capped != 1 || changes[0].weight != 1 + WEIGHT_MAX_PENALTY || unknown != 0)
+    {
+        printf("Test failed: Penalty not capped, or a report for a missing edge accepted.\n");
+        return 1;
+    }
+
+    weights_free(&weights);
+    free_graph(&graph);
+    printf("Test passed: Edge weights follow link costs with hysteresis.\n");
+    return 0;
+}
+
+int test_routes_avoid_penalized_edges()
+{
+    csr_graph_t csr;
+    route_table_t routes = {0};
+
+    initialize_graph(&graph, 9);
+    add_edges(3, &graph);
+    csr_build(&csr, &graph);
+
+    // From corner 0 to corner 2, the paths through 1 and through the center 4 are equally short
+    route_table_build(&routes, &csr, 0);
+    int before = __builtin_popcountll(route_table_next_hop_set(&routes, 2));
+
+    csr_set_weight(&csr, 0, 1, 1 + WEIGHT_MAX_PENALTY);
+    route_table_build(&routes, &csr, 0);
+
+    if (before != 2 || route_table_next_hop(&routes, 2) != 4 || __builtin_popcountll(route_table_next_hop_set(&routes, 2)) != 1 ||
+        route_table_next_hop(&routes, 1) == 1)
+    {
+        printf("Test failed: Routes from 0 still use the penalized edge to 1.\n");
+        return 1;
+    }
+
+    route_table_free(&routes);
+    csr_free(&csr);
+    free_graph(&graph);
+    printf("Test passed: Routes move away from penalized edges.\n");
+    return 0;
+}
+
+int main()
+{
+    int failures = 0;
+    failures += test_hysteresis();
+    failures += test_routes_avoid_penalized_edges();
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
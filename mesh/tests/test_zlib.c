@@ -59,8 +59,47 @@ void test_compression_decompression()
     }
 }
 
+int test_levels_and_dictionary()
+{
+    const char *names[] = {"none", "fast", "best", "none:dict", "fast:dict", "best:dict"};
+    packet_t original_packet = create_packet(45, 67, 10, 45, 67, "Hello");
+
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++)
+    {
+        compression_level level;
+        bool dictionary;
+        compression_parse(names[i], &level, &dictionary);
+        compression_configure(level, dictionary);
+
+        // Compress twice, so that the second packet goes through a reset context
+        for (int round = 0; round < 2; round++)
+        {
+            char compressed_data[2 * sizeof(packet_t)];
+            size_t compressed_size = sizeof(compressed_data);
+            char decompressed_data[sizeof(packet_t)];
+            size_t decompressed_size = sizeof(decompressed_data);
+
+            if (compress_data((char *)&original_packet, sizeof(packet_t), compressed_data, &compressed_size) != Z_OK ||
+                decompress_data(compressed_data, compressed_size, decompressed_data, &decompressed_size) != Z_OK ||
+                decompressed_size != sizeof(packet_t) || memcmp(&original_packet, decompressed_data, sizeof(packet_t)) != 0)
+            {
+                printf("Test failed: Round trip with compression %s.\n", names[i]);
+                return 1;
+            }
+
+            if (round == 1)
+            {
+                printf("Compression %s: %zu -> %zu bytes\n", names[i], sizeof(packet_t), compressed_size);
+            }
+        }
+    }
+
+    printf("Test passed: Every compression level round-trips, with and without the dictionary.\n");
+    return 0;
+}
+
 int main()
 {
     test_compression_decompression();
-    return 0;
+    return test_levels_and_dictionary() ? EXIT_FAILURE : EXIT_SUCCESS;
 }